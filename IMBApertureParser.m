@@ -57,6 +57,7 @@
 #import "IMBApertureHeaderViewController.h"
 #import "IMBParserController.h"
 #import "IMBNode.h"
+#import "IMBMetadataCache.h"
 #import "IMBObject.h"
 #import "IMBIconCache.h"
 #import "NSWorkspace+iMedia.h"
@@ -879,7 +880,7 @@
 	
 	if (![inObject isKindOfClass:[IMBNodeObject class]])
 	{
-		[metadata addEntriesFromDictionary:[NSImage imb_metadataFromImageAtPath:inObject.path checkSpotlightComments:NO]];
+		[metadata addEntriesFromDictionary:[[IMBMetadataCache sharedCache] imageMetadataForFileAtPath:inObject.path]];
 	}
     
 	NSString* description = [self metadataDescriptionForMetadata:metadata];
@@ -55,6 +55,7 @@
 #import "NSFileManager+iMedia.h"
 #import "IMBNode.h"
 #import "IMBNodeObject.h"
+#import "IMBOperationQueue.h"
 #import "IMBiPhotoEventObjectViewController.h"
 #import "IMBFaceObjectViewController.h"
 #import "IMBImageViewController.h"
@@ -732,6 +733,8 @@ NSString* const kIMBiPhotoNodeObjectTypeFace  = @"faces";
 	
 	for (NSDictionary* faceDict in sortedFaces)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSString* subNodeName = [faceDict objectForKey:@"name"];
 		
 		if ([self shouldUseAlbumType:subNodeType] && 
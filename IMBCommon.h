@@ -152,7 +152,17 @@ typedef NSUInteger IMBGroupType;
 										// (I'm guessing it was a pre-GM Snow Leopard version number)
 #endif
 
+#ifndef NSAppKitVersionNumber10_7
+#define NSAppKitVersionNumber10_7 1138
+#endif
+
+#ifndef NSAppKitVersionNumber10_12
+#define NSAppKitVersionNumber10_12 1504
+#endif
+
 #define IMBRunningOnSnowLeopardOrNewer()	(NSAppKitVersionNumber >= NSAppKitVersionNumber10_6)
+#define IMBRunningOnLionOrNewer()			(NSAppKitVersionNumber >= NSAppKitVersionNumber10_7)
+#define IMBRunningOnSierraOrNewer()			(NSAppKitVersionNumber >= NSAppKitVersionNumber10_12)
 
 #define IMB_COMPILING_WITH_LION_OR_NEWER_SDK  defined(MAC_OS_X_VERSION_10_7)
 #define IMB_COMPILING_WITH_SNOW_LEOPARD_OR_NEWER_SDK  defined(MAC_OS_X_VERSION_10_6)
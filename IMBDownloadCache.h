@@ -0,0 +1,112 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBSQLiteCache.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// IMBDownloadCache keeps a copy of every file downloaded by IMBRemoteObjectsPromise, so that dragging or opening the 
+// same remote object again only costs a conditional request instead of a full download. Entries are keyed by the URL, 
+// and the cached file is named after a digest of the URL and the validators (ETag, Last-Modified) of the response it 
+// came from. Only responses with validators are stored. Cached files are handed out as clones where the file system 
+// supports it (so that they take no extra space), and copied otherwise...
+
+@interface IMBDownloadCache : IMBSQLiteCache
+{
+	long long _totalSize;
+}
+
++ (IMBDownloadCache*) sharedCache;
+
+// Limits for the background compaction. Files that have not been used for the given time interval are purged,
+// and if the cache is bigger than allowed, the least recently used files are purged...
+
++ (void) setMaxCacheSize:(long long)inBytes;
++ (long long) maxCacheSize;
+
++ (void) setMaxEntryAge:(NSTimeInterval)inAge;
++ (NSTimeInterval) maxEntryAge;
+
+// Returns the validators of the cached file for the given URL, so that the caller can send a conditional request.
+// Returns NO if there is no cached file for this URL. Either out parameter may be NULL...
+
+- (BOOL) getETag:(NSString**)outETag lastModified:(NSString**)outLastModified forURL:(NSURL*)inURL;
+
+// Places a cached copy of the file for the given URL at the destination path (which must not exist yet). Only call 
+// this once the server has confirmed that the cached file is still current. Returns NO if there is no cached file 
+// for this URL...
+
+- (BOOL) copyCachedFileForURL:(NSURL*)inURL toPath:(NSString*)inPath;
+
+// Adds the file that was just downloaded from the given URL to the cache. The response supplies the validators. 
+// Responses without validators or that forbid storing are ignored. This copies the file, so it should not be 
+// called on the network thread...
+
+- (void) storeFileAtPath:(NSString*)inPath forURL:(NSURL*)inURL response:(NSURLResponse*)inResponse;
+
+// Same as above, but only the copy of the file is made right away (which is instant on file systems that can clone).
+// The cache index is updated later on a background queue. The caller may modify the file as soon as this returns...
+
+- (void) storeFileAtPathInBackground:(NSString*)inPath forURL:(NSURL*)inURL response:(NSURLResponse*)inResponse;
+
+- (void) removeEntryForURL:(NSURL*)inURL;
+- (void) removeAllEntries;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
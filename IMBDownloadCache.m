@@ -0,0 +1,643 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBDownloadCache.h"
+#import "IMBCommon.h"
+#import "NSFileManager+iMedia.h"
+#import "FMDatabase.h"
+#import <CommonCrypto/CommonDigest.h>
+#import <copyfile.h>
+#import <sys/stat.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Bump this version whenever the layout of the table or the naming of the cached files changes...
+
+static const int kIMBDownloadCacheSchemaVersion = 1;
+
+static const NSUInteger kIMBDownloadCacheCompactionInterval = 32;
+
+// COPYFILE_CLONE is only declared by the 10.12 SDK, but older systems simply don't understand it. So declare it
+// ourselves and only pass it when running on 10.12 or newer...
+
+#ifndef COPYFILE_CLONE
+#define COPYFILE_CLONE (1<<24)
+#endif
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static IMBDownloadCache* sSharedCache = nil;
+static long long sMaxCacheSize = 512LL * 1024LL * 1024LL;
+static NSTimeInterval sMaxEntryAge = 30.0 * 24.0 * 60.0 * 60.0;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@interface IMBDownloadCache ()
+
+- (NSString*) _cachedFilePathForURL:(NSURL*)inURL eTag:(NSString**)outETag lastModified:(NSString**)outLastModified;
+- (void) _removeFiles:(NSArray*)inFilenames;
+- (void) _storeFileAtPath:(NSString*)inPath forURL:(NSURL*)inURL response:(NSURLResponse*)inResponse inBackground:(BOOL)inBackground;
+- (void) _addEntryForURL:(NSURL*)inURL filename:(NSString*)inFilename eTag:(NSString*)inETag lastModified:(NSString*)inModified size:(long long)inSize;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@implementation IMBDownloadCache
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
++ (void) setMaxCacheSize:(long long)inBytes
+{
+	sMaxCacheSize = inBytes;
+}
+
+
++ (long long) maxCacheSize
+{
+	return sMaxCacheSize;
+}
+
+
++ (void) setMaxEntryAge:(NSTimeInterval)inAge
+{
+	sMaxEntryAge = inAge;
+}
+
+
++ (NSTimeInterval) maxEntryAge
+{
+	return sMaxEntryAge;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
++ (IMBDownloadCache*) sharedCache
+{
+	@synchronized(self)
+	{
+		if (sSharedCache == nil)
+		{
+			sSharedCache = [[IMBDownloadCache alloc] init];
+		}
+	}
+	
+	return sSharedCache;
+}
+
+
+- (id) init
+{
+	return [super initWithName:@"Downloads"];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Database
+
+- (int) schemaVersion
+{
+	return kIMBDownloadCacheSchemaVersion;
+}
+
+
+// The cached files are named differently in another schema version, so throw them away as well...
+
+- (void) resetDatabase
+{
+	NSFileManager* fileManager = [NSFileManager imb_threadSafeManager];
+	
+	for (NSString* filename in [fileManager contentsOfDirectoryAtPath:_folderPath error:NULL])
+	{
+		if (![filename hasPrefix:@"Downloads.sqlite"])
+		{
+			[fileManager removeItemAtPath:[_folderPath stringByAppendingPathComponent:filename] error:NULL];
+		}
+	}
+	
+	[_database executeUpdate:@"DROP TABLE IF EXISTS downloads"];
+}
+
+
+// The total size is kept up to date from now on, so that the size limit can be checked on every store...
+
+- (BOOL) prepareDatabase
+{
+	BOOL ok = 
+		[_database executeUpdate:@"CREATE TABLE IF NOT EXISTS downloads (url TEXT PRIMARY KEY, file TEXT NOT NULL, etag TEXT, modified TEXT, size INTEGER NOT NULL, accessed REAL NOT NULL)"] &&
+		[_database executeUpdate:@"CREATE INDEX IF NOT EXISTS downloads_accessed ON downloads (accessed)"];
+	
+	if (!ok) return NO;
+	
+	FMResultSet* results = [_database executeQuery:@"SELECT IFNULL(SUM(size),0) FROM downloads"];
+	if ([results next]) _totalSize = [results longLongIntForColumnIndex:0];
+	[results close];
+	
+	return YES;
+}
+
+
+- (NSUInteger) compactionInterval
+{
+	return kIMBDownloadCacheCompactionInterval;
+}
+
+
+- (BOOL) needsCompaction
+{
+	return _totalSize > sMaxCacheSize || [super needsCompaction];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Cached files are named after a digest of the URL and the validators, so a changed file on the server never 
+// overwrites a cached file that is still being handed out...
+
+static NSString* _IMBCacheFilename(NSURL* inURL,NSString* inETag,NSString* inModified)
+{
+	NSString* key = [NSString stringWithFormat:@"%@\n%@\n%@",[inURL absoluteString],inETag?inETag:@"",inModified?inModified:@""];
+	NSData* data = [key dataUsingEncoding:NSUTF8StringEncoding];
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1([data bytes],(CC_LONG)[data length],digest);
+	
+	NSMutableString* filename = [NSMutableString stringWithCapacity:2*CC_SHA1_DIGEST_LENGTH+8];
+	for (int i=0; i<CC_SHA1_DIGEST_LENGTH; i++) [filename appendFormat:@"%02x",digest[i]];
+	
+	NSString* extension = [[inURL path] pathExtension];
+	if ([extension length] > 0) [filename appendFormat:@".%@",extension];
+	
+	return filename;
+}
+
+
+// Header names in allHeaderFields are not reliably capitalized, so look them up case insensitively...
+
+static NSString* _IMBHeaderValue(NSDictionary* inHeaders,NSString* inName)
+{
+	for (NSString* name in inHeaders)
+	{
+		if ([name caseInsensitiveCompare:inName] == NSOrderedSame)
+		{
+			return [inHeaders objectForKey:name];
+		}
+	}
+	
+	return nil;
+}
+
+
+// Copies a file, cloning it on file systems that support it (so that it is instant and shares the storage until 
+// either copy is modified). Hard links are not used, because the promise post-processes the downloaded files in 
+// place, which would alter the cached file as well...
+
+static BOOL _IMBCloneFile(NSString* inSrcPath,NSString* inDstPath)
+{
+	copyfile_flags_t flags = COPYFILE_DATA | COPYFILE_EXCL;
+	if (IMBRunningOnSierraOrNewer()) flags |= COPYFILE_CLONE;
+	
+	return copyfile([inSrcPath fileSystemRepresentation],[inDstPath fileSystemRepresentation],NULL,flags) == 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Accessors
+
+
+// Looks up the entry for the given URL and makes sure the cached file is still there and complete. If not, then 
+// the entry is forgotten...
+
+- (NSString*) _cachedFilePathForURL:(NSURL*)inURL eTag:(NSString**)outETag lastModified:(NSString**)outLastModified
+{
+	if (_database == nil || inURL == nil) return nil;
+	
+	NSString* urlString = [inURL absoluteString];
+	NSString* filename = nil;
+	NSString* etag = nil;
+	NSString* modified = nil;
+	long long size = 0;
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT file, etag, modified, size, accessed FROM downloads WHERE url = ?",urlString];
+			
+		if ([results next])
+		{
+			filename = [results stringForColumnIndex:0];
+			etag = [results stringForColumnIndex:1];
+			modified = [results stringForColumnIndex:2];
+			size = [results longLongIntForColumnIndex:3];
+			NSTimeInterval accessed = [results doubleForColumnIndex:4];
+			[results close];
+			
+			NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+			
+			if (now - accessed > [self accessGranularity])
+			{
+				[_database executeUpdate:@"UPDATE downloads SET accessed = ? WHERE url = ?",[NSNumber numberWithDouble:now],urlString];
+			}
+		}
+		else
+		{
+			[results close];
+		}
+	}
+	
+	if (filename == nil) return nil;
+	
+	NSString* cachedPath = [_folderPath stringByAppendingPathComponent:filename];
+	struct stat info;
+	
+	if (stat([cachedPath fileSystemRepresentation],&info) != 0 || (long long)info.st_size != size)
+	{
+		[self removeEntryForURL:inURL];
+		return nil;
+	}
+	
+	if (outETag) *outETag = etag;
+	if (outLastModified) *outLastModified = modified;
+	return cachedPath;
+}
+
+
+- (BOOL) getETag:(NSString**)outETag lastModified:(NSString**)outLastModified forURL:(NSURL*)inURL
+{
+	return [self _cachedFilePathForURL:inURL eTag:outETag lastModified:outLastModified] != nil;
+}
+
+
+- (BOOL) copyCachedFileForURL:(NSURL*)inURL toPath:(NSString*)inPath
+{
+	if (inPath == nil) return NO;
+	
+	NSString* cachedPath = [self _cachedFilePathForURL:inURL eTag:NULL lastModified:NULL];
+	if (cachedPath == nil) return NO;
+	
+	return _IMBCloneFile(cachedPath,inPath);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Index updates of background stores run on this serial queue, so that they never hold up the caller...
+
+static dispatch_queue_t _IMBDownloadCacheStoreQueue()
+{
+	static dispatch_queue_t sQueue = NULL;
+	static dispatch_once_t sOnceToken = 0;
+	
+	dispatch_once(&sOnceToken,^
+	{
+		sQueue = dispatch_queue_create("com.karelia.imedia.downloadcache",NULL);
+	});
+	
+	return sQueue;
+}
+
+
+- (void) storeFileAtPath:(NSString*)inPath forURL:(NSURL*)inURL response:(NSURLResponse*)inResponse
+{
+	[self _storeFileAtPath:inPath forURL:inURL response:inResponse inBackground:NO];
+}
+
+
+- (void) storeFileAtPathInBackground:(NSString*)inPath forURL:(NSURL*)inURL response:(NSURLResponse*)inResponse
+{
+	[self _storeFileAtPath:inPath forURL:inURL response:inResponse inBackground:YES];
+}
+
+
+// The file itself is always captured right away (by cloning it to a temporary name in the cache folder), so that 
+// the caller is free to modify it once we return. Moving the clone in place and updating the index can then happen
+// later on the store queue...
+
+- (void) _storeFileAtPath:(NSString*)inPath forURL:(NSURL*)inURL response:(NSURLResponse*)inResponse inBackground:(BOOL)inBackground
+{
+	if (_database == nil || inURL == nil || inPath == nil) return;
+	if (![inResponse isKindOfClass:[NSHTTPURLResponse class]]) return;
+
+	// Without validators a cached file could never be revalidated, so there is no point in storing it...
+	
+	NSHTTPURLResponse* response = (NSHTTPURLResponse*)inResponse;
+	NSDictionary* headers = [response allHeaderFields];
+	NSString* cacheControl = _IMBHeaderValue(headers,@"Cache-Control");
+	NSString* etag = _IMBHeaderValue(headers,@"ETag");
+	NSString* modified = _IMBHeaderValue(headers,@"Last-Modified");
+	
+	if ([response statusCode] != 200) return;
+	if (cacheControl && [cacheControl rangeOfString:@"no-store" options:NSCaseInsensitiveSearch].location != NSNotFound) return;
+	if (etag == nil && modified == nil) return;
+	
+	struct stat info;
+	if (stat([inPath fileSystemRepresentation],&info) != 0 || !S_ISREG(info.st_mode)) return;
+	long long size = (long long)info.st_size;
+	if (size <= 0 || size > sMaxCacheSize) return;
+	
+	// Copy to a temporary name first and then move it in place, so that a reader never sees a partial file...
+	
+	NSString* filename = _IMBCacheFilename(inURL,etag,modified);
+	NSString* cachedPath = [_folderPath stringByAppendingPathComponent:filename];
+	NSString* tmpPath = nil;
+	NSFileManager* fileManager = [NSFileManager imb_threadSafeManager];
+
+	if (![fileManager fileExistsAtPath:cachedPath])
+	{
+		NSString* tmpName = [NSString stringWithFormat:@"%@.%@.tmp",filename,[[NSProcessInfo processInfo] globallyUniqueString]];
+		tmpPath = [_folderPath stringByAppendingPathComponent:tmpName];
+		
+		if (!_IMBCloneFile(inPath,tmpPath))
+		{
+			[fileManager removeItemAtPath:tmpPath error:NULL];
+			return;
+		}
+	}
+	
+	void (^commit)(void) = ^
+	{
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		
+		if (tmpPath == nil || rename([tmpPath fileSystemRepresentation],[cachedPath fileSystemRepresentation]) == 0)
+		{
+			[self _addEntryForURL:inURL filename:filename eTag:etag lastModified:modified size:size];
+		}
+		else
+		{
+			[[NSFileManager imb_threadSafeManager] removeItemAtPath:tmpPath error:NULL];
+		}
+		
+		[pool drain];
+	};
+	
+	if (inBackground)
+	{
+		dispatch_async(_IMBDownloadCacheStoreQueue(),commit);
+	}
+	else
+	{
+		commit();
+	}
+}
+
+
+// Update the index. If the URL previously pointed to a different file, then that one is now obsolete...
+
+- (void) _addEntryForURL:(NSURL*)inURL filename:(NSString*)inFilename eTag:(NSString*)inETag lastModified:(NSString*)inModified size:(long long)inSize
+{
+	NSString* oldFilename = nil;
+
+	@synchronized(self)
+	{
+		NSString* urlString = [inURL absoluteString];
+		FMResultSet* results = [_database executeQuery:@"SELECT file, size FROM downloads WHERE url = ?",urlString];
+		
+		if ([results next])
+		{
+			oldFilename = [results stringForColumnIndex:0];
+			_totalSize -= [results longLongIntForColumnIndex:1];
+		}
+		
+		[results close];
+		
+		[_database executeUpdate:
+			@"INSERT OR REPLACE INTO downloads (url, file, etag, modified, size, accessed) VALUES (?,?,?,?,?,?)",
+			urlString,
+			inFilename,
+			inETag ? (id)inETag : (id)[NSNull null],
+			inModified ? (id)inModified : (id)[NSNull null],
+			[NSNumber numberWithLongLong:inSize],
+			[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]]];
+			
+		_totalSize += inSize;
+	}
+	
+	if (oldFilename && ![oldFilename isEqualToString:inFilename])
+	{
+		[self _removeFiles:[NSArray arrayWithObject:oldFilename]];
+	}
+	
+	[self didStoreEntry];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+- (void) removeEntryForURL:(NSURL*)inURL
+{
+	if (_database == nil || inURL == nil) return;
+	
+	NSString* urlString = [inURL absoluteString];
+	NSString* filename = nil;
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT file, size FROM downloads WHERE url = ?",urlString];
+		
+		if ([results next])
+		{
+			filename = [results stringForColumnIndex:0];
+			_totalSize -= [results longLongIntForColumnIndex:1];
+		}
+		
+		[results close];
+
+		[_database executeUpdate:@"DELETE FROM downloads WHERE url = ?",urlString];
+	}
+	
+	if (filename)
+	{
+		[self _removeFiles:[NSArray arrayWithObject:filename]];
+	}
+}
+
+
+- (void) removeAllEntries
+{
+	if (_database == nil) return;
+
+	NSMutableArray* filenames = [NSMutableArray array];
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT file FROM downloads"];
+		while ([results next]) [filenames addObject:[results stringForColumnIndex:0]];
+		[results close];
+
+		[_database executeUpdate:@"DELETE FROM downloads"];
+		_totalSize = 0;
+	}
+	
+	[self _removeFiles:filenames];
+}
+
+
+// Several URLs may share a file (e.g. after a redirect), so a file is only deleted once no entry refers to it...
+
+- (void) _removeFiles:(NSArray*)inFilenames
+{
+	NSFileManager* fileManager = [NSFileManager imb_threadSafeManager];
+	
+	for (NSString* filename in inFilenames)
+	{
+		BOOL isReferenced = NO;
+		
+		@synchronized(self)
+		{
+			FMResultSet* results = [_database executeQuery:@"SELECT 1 FROM downloads WHERE file = ? LIMIT 1",filename];
+			isReferenced = [results next];
+			[results close];
+		}
+		
+		if (!isReferenced)
+		{
+			[fileManager removeItemAtPath:[_folderPath stringByAppendingPathComponent:filename] error:NULL];
+		}
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Compaction
+
+
+// First purge files that have not been used for a long time, then evict the least recently used files until the 
+// cache fits into its size limit again...
+
+- (void) compactDatabase
+{
+	NSTimeInterval cutoff = [NSDate timeIntervalSinceReferenceDate] - sMaxEntryAge;
+	NSMutableArray* filenames = [NSMutableArray array];
+	long long totalSize = 0;
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT file FROM downloads WHERE accessed < ?",[NSNumber numberWithDouble:cutoff]];
+		while ([results next]) [filenames addObject:[results stringForColumnIndex:0]];
+		[results close];
+
+		[_database executeUpdate:@"DELETE FROM downloads WHERE accessed < ?",[NSNumber numberWithDouble:cutoff]];
+	}
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT IFNULL(SUM(size),0) FROM downloads"];
+		if ([results next]) totalSize = [results longLongIntForColumnIndex:0];
+		[results close];
+		
+		_totalSize = totalSize;
+	}
+	
+	if (totalSize > sMaxCacheSize)
+	{
+		NSMutableArray* urls = [NSMutableArray array];
+		
+		@synchronized(self)
+		{
+			FMResultSet* results = [_database executeQuery:@"SELECT url, file, size FROM downloads ORDER BY accessed ASC"];
+			
+			while (_totalSize > sMaxCacheSize && [results next])
+			{
+				[urls addObject:[results stringForColumnIndex:0]];
+				[filenames addObject:[results stringForColumnIndex:1]];
+				_totalSize -= [results longLongIntForColumnIndex:2];
+			}
+			
+			[results close];
+
+			for (NSString* url in urls)
+			{
+				[_database executeUpdate:@"DELETE FROM downloads WHERE url = ?",url];
+			}
+		}
+	}
+	
+	[self _removeFiles:filenames];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@end
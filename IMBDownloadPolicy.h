@@ -0,0 +1,148 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// The decisions that IMBURLDownloadOperation makes about its transfers: how many downloads may run per host (and
+// which waiting download gets the next free slot), when a dropped download is resumed, and how a large file is 
+// split into ranges that are fetched in parallel. The code is plain C without any dependency on Cocoa, so that it 
+// can be tested without a network or Xcode (see Tests/IMBDownloadPolicyTests.c). It is not thread safe; 
+// IMBURLDownloadOperation only calls it on its network thread...
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// A download that fails with a network error is resumed up to this many times, with delays that double each time...
+
+#define kIMBDownloadMaxResumeCount 3
+#define kIMBDownloadResumeDelay 2.0
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark TYPES
+
+// A byte range of a file that is fetched with its own connection...
+
+typedef struct
+{
+	int64_t offset;							// Offset of the first byte of the range in the file
+	int64_t length;							// Number of bytes in the range
+	int64_t done;							// Number of bytes that were received so far
+}
+IMBDownloadRange;
+
+// Counts the active downloads per host and keeps the downloads that are waiting for a slot (in FIFO order)...
+
+typedef struct IMBHostSlots IMBHostSlots;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark FUNCTIONS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the delay in seconds before the download is resumed for the (inResumeCount+1)th time, or a negative value
+// if it has been resumed too often already...
+
+double IMBDownloadResumeDelay(unsigned inResumeCount);
+
+// Splits a file of inLength bytes into at most inMaxCount ranges of at least inMinLength bytes each. Returns the 
+// number of ranges written to outRanges (which must have room for inMaxCount ranges). A file that is too short to 
+// be split results in a single range...
+
+unsigned IMBDownloadSplitRanges(int64_t inLength,unsigned inMaxCount,int64_t inMinLength,IMBDownloadRange* outRanges);
+
+// Formats the value of a Range header for the part of inRange that has not been received yet, e.g. "bytes=100-199".
+// Returns false if the range is complete or the buffer is too small...
+
+bool IMBDownloadFormatRangeHeader(const IMBDownloadRange* inRange,char* outBuffer,size_t inBufferSize);
+
+// Parses the value of a Content-Range header, e.g. "bytes 100-199/1000". outTotal is -1 if the server doesn't know 
+// the total length ("bytes 100-199/*")...
+
+bool IMBDownloadParseContentRange(const char* inHeader,int64_t* outFirst,int64_t* outLast,int64_t* outTotal);
+
+// Host slots. Host names are compared case insensitively. If no slot is free, IMBHostSlotsAcquire queues inWaiter
+// (unless it is NULL) and returns false. IMBHostSlotsRelease hands the slot over to the oldest waiter for the same 
+// host and returns it, so the caller should start that waiter without acquiring again. If memory runs out, slots
+// are granted rather than blocking a download forever...
+
+IMBHostSlots* IMBHostSlotsCreate(unsigned inMaxPerHost);
+void IMBHostSlotsDispose(IMBHostSlots* inSlots);
+bool IMBHostSlotsAcquire(IMBHostSlots* inSlots,const char* inHost,void* inWaiter);
+void* IMBHostSlotsRelease(IMBHostSlots* inSlots,const char* inHost);
+bool IMBHostSlotsRemoveWaiter(IMBHostSlots* inSlots,void* inWaiter);
+unsigned IMBHostSlotsActiveCount(const IMBHostSlots* inSlots,const char* inHost);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+//----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,358 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include "IMBDownloadPolicy.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark TYPES
+
+typedef struct
+{
+	char* host;
+	unsigned active;
+}
+IMBHostSlotEntry;
+
+typedef struct
+{
+	char* host;
+	void* waiter;
+}
+IMBHostSlotWaiter;
+
+struct IMBHostSlots
+{
+	unsigned maxPerHost;
+	IMBHostSlotEntry* entries;
+	unsigned entryCount;
+	unsigned entryCapacity;
+	IMBHostSlotWaiter* waiters;
+	unsigned waiterCount;
+	unsigned waiterCapacity;
+};
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Resuming
+
+
+double IMBDownloadResumeDelay(unsigned inResumeCount)
+{
+	if (inResumeCount >= kIMBDownloadMaxResumeCount) return -1.0;
+	return kIMBDownloadResumeDelay * (double)(1u << inResumeCount);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Ranges
+
+
+// The ranges have equal length, except for the last one, which also gets the remainder...
+
+unsigned IMBDownloadSplitRanges(int64_t inLength,unsigned inMaxCount,int64_t inMinLength,IMBDownloadRange* outRanges)
+{
+	if (inLength <= 0 || inMaxCount == 0) return 0;
+	
+	int64_t count = inMinLength > 0 ? inLength / inMinLength : (int64_t)inMaxCount;
+	if (count > (int64_t)inMaxCount) count = (int64_t)inMaxCount;
+	if (count < 1) count = 1;
+	
+	int64_t length = inLength / count;
+	
+	for (int64_t i=0; i<count; i++)
+	{
+		outRanges[i].offset = i * length;
+		outRanges[i].length = (i == count-1) ? inLength - i*length : length;
+		outRanges[i].done = 0;
+	}
+	
+	return (unsigned)count;
+}
+
+
+bool IMBDownloadFormatRangeHeader(const IMBDownloadRange* inRange,char* outBuffer,size_t inBufferSize)
+{
+	if (inRange->done >= inRange->length) return false;
+	
+	int64_t first = inRange->offset + inRange->done;
+	int64_t last = inRange->offset + inRange->length - 1;
+	int n = snprintf(outBuffer,inBufferSize,"bytes=%" PRId64 "-%" PRId64,first,last);
+	
+	return n > 0 && (size_t)n < inBufferSize;
+}
+
+
+// Parses a non-negative decimal number and advances the pointer past it...
+
+static bool _IMBParseNumber(const char** ioString,int64_t* outValue)
+{
+	const char* s = *ioString;
+	int64_t value = 0;
+	
+	if (*s < '0' || *s > '9') return false;
+	
+	while (*s >= '0' && *s <= '9')
+	{
+		if (value > (INT64_MAX - 9) / 10) return false;
+		value = value*10 + (*s - '0');
+		s++;
+	}
+	
+	*ioString = s;
+	*outValue = value;
+	return true;
+}
+
+
+bool IMBDownloadParseContentRange(const char* inHeader,int64_t* outFirst,int64_t* outLast,int64_t* outTotal)
+{
+	if (inHeader == NULL) return false;
+	
+	const char* s = inHeader;
+	while (*s == ' ') s++;
+	if (strncasecmp(s,"bytes",5) != 0) return false;
+	s += 5;
+	while (*s == ' ') s++;
+	
+	int64_t first,last,total = -1;
+	
+	if (!_IMBParseNumber(&s,&first) || *s++ != '-') return false;
+	if (!_IMBParseNumber(&s,&last) || *s++ != '/') return false;
+	
+	if (*s == '*') s++;
+	else if (!_IMBParseNumber(&s,&total)) return false;
+	
+	while (*s == ' ') s++;
+	if (*s != 0 || last < first || (total >= 0 && last >= total)) return false;
+	
+	*outFirst = first;
+	*outLast = last;
+	*outTotal = total;
+	return true;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Host Slots
+
+
+IMBHostSlots* IMBHostSlotsCreate(unsigned inMaxPerHost)
+{
+	IMBHostSlots* slots = (IMBHostSlots*) calloc(1,sizeof(IMBHostSlots));
+	if (slots) slots->maxPerHost = inMaxPerHost > 0 ? inMaxPerHost : 1;
+	return slots;
+}
+
+
+void IMBHostSlotsDispose(IMBHostSlots* inSlots)
+{
+	if (inSlots == NULL) return;
+	
+	for (unsigned i=0; i<inSlots->entryCount; i++) free(inSlots->entries[i].host);
+	for (unsigned i=0; i<inSlots->waiterCount; i++) free(inSlots->waiters[i].host);
+	free(inSlots->entries);
+	free(inSlots->waiters);
+	free(inSlots);
+}
+
+
+static IMBHostSlotEntry* _IMBFindEntry(const IMBHostSlots* inSlots,const char* inHost)
+{
+	for (unsigned i=0; i<inSlots->entryCount; i++)
+	{
+		if (strcasecmp(inSlots->entries[i].host,inHost) == 0) return &inSlots->entries[i];
+	}
+	
+	return NULL;
+}
+
+
+// Entries are removed once their host has no active downloads anymore, so the table stays as small as the number
+// of hosts that are currently being downloaded from...
+
+static void _IMBRemoveEntry(IMBHostSlots* inSlots,IMBHostSlotEntry* inEntry)
+{
+	free(inEntry->host);
+	*inEntry = inSlots->entries[--inSlots->entryCount];
+}
+
+
+static bool _IMBGrow(void** ioArray,unsigned* ioCapacity,unsigned inCount,size_t inElementSize)
+{
+	if (inCount < *ioCapacity) return true;
+	
+	unsigned capacity = *ioCapacity ? 2 * *ioCapacity : 8;
+	void* array = realloc(*ioArray,capacity * inElementSize);
+	if (array == NULL) return false;
+	
+	*ioArray = array;
+	*ioCapacity = capacity;
+	return true;
+}
+
+
+bool IMBHostSlotsAcquire(IMBHostSlots* inSlots,const char* inHost,void* inWaiter)
+{
+	if (inSlots == NULL || inHost == NULL) return true;
+	
+	IMBHostSlotEntry* entry = _IMBFindEntry(inSlots,inHost);
+	
+	if (entry == NULL)
+	{
+		char* host = strdup(inHost);
+		
+		if (host == NULL || !_IMBGrow((void**)&inSlots->entries,&inSlots->entryCapacity,inSlots->entryCount,sizeof(IMBHostSlotEntry)))
+		{
+			free(host);
+			return true;
+		}
+		
+		entry = &inSlots->entries[inSlots->entryCount++];
+		entry->host = host;
+		entry->active = 0;
+	}
+	
+	if (entry->active < inSlots->maxPerHost)
+	{
+		entry->active++;
+		return true;
+	}
+	
+	if (inWaiter == NULL) return false;
+	
+	char* host = strdup(inHost);
+	
+	if (host == NULL || !_IMBGrow((void**)&inSlots->waiters,&inSlots->waiterCapacity,inSlots->waiterCount,sizeof(IMBHostSlotWaiter)))
+	{
+		free(host);
+		entry->active++;
+		return true;
+	}
+	
+	inSlots->waiters[inSlots->waiterCount].host = host;
+	inSlots->waiters[inSlots->waiterCount].waiter = inWaiter;
+	inSlots->waiterCount++;
+	return false;
+}
+
+
+void* IMBHostSlotsRelease(IMBHostSlots* inSlots,const char* inHost)
+{
+	if (inSlots == NULL || inHost == NULL) return NULL;
+	
+	IMBHostSlotEntry* entry = _IMBFindEntry(inSlots,inHost);
+	if (entry == NULL || entry->active == 0) return NULL;
+	
+	for (unsigned i=0; i<inSlots->waiterCount; i++)
+	{
+		if (strcasecmp(inSlots->waiters[i].host,inHost) == 0)
+		{
+			void* waiter = inSlots->waiters[i].waiter;
+			free(inSlots->waiters[i].host);
+			memmove(&inSlots->waiters[i],&inSlots->waiters[i+1],(inSlots->waiterCount-i-1) * sizeof(IMBHostSlotWaiter));
+			inSlots->waiterCount--;
+			return waiter;
+		}
+	}
+	
+	if (--entry->active == 0) _IMBRemoveEntry(inSlots,entry);
+	return NULL;
+}
+
+
+bool IMBHostSlotsRemoveWaiter(IMBHostSlots* inSlots,void* inWaiter)
+{
+	if (inSlots == NULL) return false;
+	
+	for (unsigned i=0; i<inSlots->waiterCount; i++)
+	{
+		if (inSlots->waiters[i].waiter == inWaiter)
+		{
+			free(inSlots->waiters[i].host);
+			memmove(&inSlots->waiters[i],&inSlots->waiters[i+1],(inSlots->waiterCount-i-1) * sizeof(IMBHostSlotWaiter));
+			inSlots->waiterCount--;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+
+unsigned IMBHostSlotsActiveCount(const IMBHostSlots* inSlots,const char* inHost)
+{
+	if (inSlots == NULL || inHost == NULL) return 0;
+	IMBHostSlotEntry* entry = _IMBFindEntry(inSlots,inHost);
+	return entry ? entry->active : 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
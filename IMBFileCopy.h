@@ -0,0 +1,109 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Copies a byte range of one open file into another. IMBObjectsPromise uses it to copy large files in several chunks
+// concurrently. The code is plain C without any dependency on Cocoa, so that it can be tested without Xcode (see 
+// Tests/IMBFileCopyTests.c). Chunks of the same file can run on different threads at the same time: they share one
+// error variable, where the first error is recorded atomically and tells all other chunks to stop...
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark TYPES
+
+// Called after each piece of a chunk has been written, with the number of bytes in that piece. Return false to stop
+// the copy, which is then recorded as ECANCELED...
+
+typedef bool (*IMBFileCopyProgressFunc)(void* inContext,int64_t inLength);
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark FUNCTIONS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Copies inLength bytes at inOffset from the file descriptor inSrcFile to the same offset in inDstFile. Where the
+// kernel can copy (or reflink) between files itself (copy_file_range on Linux), that is used first, otherwise the 
+// data goes through a buffer of inBufferSize bytes. Returns the error of this chunk or 0. The first error of all 
+// chunks is also stored in ioError, and a chunk returns early with that error once ioError is set...
+
+int IMBFileCopyChunk(int inSrcFile,int inDstFile,int64_t inOffset,int64_t inLength,size_t inBufferSize,
+	volatile int32_t* ioError,IMBFileCopyProgressFunc inProgress,void* inContext);
+
+// Same as above, but always goes through a buffer with pread and pwrite. A short write is continued where it left
+// off, and a write that makes no progress at all is recorded as ENOSPC. Reaching the end of the source file before
+// inLength bytes were read is recorded as EIO...
+
+int IMBFileCopyChunkWithBuffer(int inSrcFile,int inDstFile,int64_t inOffset,int64_t inLength,size_t inBufferSize,
+	volatile int32_t* ioError,IMBFileCopyProgressFunc inProgress,void* inContext);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+//----------------------------------------------------------------------------------------------------------------------
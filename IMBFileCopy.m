@@ -0,0 +1,212 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "IMBFileCopy.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Errors
+
+
+// Records inError unless another chunk got there first, and returns the error that is now recorded...
+
+static int _IMBFileCopyRecordError(volatile int32_t* ioError,int inError)
+{
+	int32_t previous = __sync_val_compare_and_swap(ioError,0,(int32_t)inError);
+	return previous ? previous : inError;
+}
+
+
+// Reports progress and turns a request to stop into ECANCELED...
+
+static int _IMBFileCopyDidCopy(volatile int32_t* ioError,IMBFileCopyProgressFunc inProgress,void* inContext,int64_t inLength)
+{
+	if (inProgress && !inProgress(inContext,inLength))
+	{
+		return _IMBFileCopyRecordError(ioError,ECANCELED);
+	}
+	
+	return 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Copying
+
+
+// Writes all of inLength bytes, continuing after short writes. A write that makes no progress without reporting an
+// error means that the disk is full...
+
+static int _IMBFileCopyWriteFully(int inFile,const char* inBuffer,size_t inLength,off_t inOffset)
+{
+	while (inLength > 0)
+	{
+		ssize_t n = pwrite(inFile,inBuffer,inLength,inOffset);
+		
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			return errno ? errno : EIO;
+		}
+		
+		if (n == 0) return ENOSPC;
+		
+		inBuffer += n;
+		inLength -= (size_t)n;
+		inOffset += n;
+	}
+	
+	return 0;
+}
+
+
+int IMBFileCopyChunkWithBuffer(int inSrcFile,int inDstFile,int64_t inOffset,int64_t inLength,size_t inBufferSize,
+	volatile int32_t* ioError,IMBFileCopyProgressFunc inProgress,void* inContext)
+{
+	if (inBufferSize == 0) return _IMBFileCopyRecordError(ioError,EINVAL);
+	
+	char* buffer = (char*) malloc(inBufferSize);
+	if (buffer == NULL) return _IMBFileCopyRecordError(ioError,ENOMEM);
+	
+	off_t offset = (off_t)inOffset;
+	off_t end = (off_t)(inOffset + inLength);
+	int error = 0;
+	
+	while (offset < end && error == 0)
+	{
+		if ((error = *ioError) != 0) break;
+		
+		size_t length = (size_t)(end - offset) < inBufferSize ? (size_t)(end - offset) : inBufferSize;
+		ssize_t n = pread(inSrcFile,buffer,length,offset);
+		
+		if (n < 0 && errno == EINTR) continue;
+		
+		if (n < 0) error = _IMBFileCopyRecordError(ioError,errno ? errno : EIO);
+		else if (n == 0) error = _IMBFileCopyRecordError(ioError,EIO);
+		else if ((error = _IMBFileCopyWriteFully(inDstFile,buffer,(size_t)n,offset)) != 0) error = _IMBFileCopyRecordError(ioError,error);
+		else
+		{
+			offset += n;
+			error = _IMBFileCopyDidCopy(ioError,inProgress,inContext,n);
+		}
+	}
+	
+	free(buffer);
+	return error;
+}
+
+
+// On Linux the kernel copies directly between the files, which avoids the buffer and lets file systems like btrfs
+// or XFS share the blocks instead of copying them. If it isn't supported for these files, then nothing has been 
+// copied yet and we fall back to the buffer. Failing later on is a real error. Partial copies simply continue...
+
+int IMBFileCopyChunk(int inSrcFile,int inDstFile,int64_t inOffset,int64_t inLength,size_t inBufferSize,
+	volatile int32_t* ioError,IMBFileCopyProgressFunc inProgress,void* inContext)
+{
+	#if defined(__linux__)
+	
+	loff_t srcOffset = (loff_t)inOffset;
+	loff_t dstOffset = (loff_t)inOffset;
+	loff_t end = (loff_t)(inOffset + inLength);
+	bool copiedAny = false;
+	
+	while (srcOffset < end)
+	{
+		int error = *ioError;
+		if (error != 0) return error;
+		
+		size_t length = (size_t)(end - srcOffset) < inBufferSize ? (size_t)(end - srcOffset) : inBufferSize;
+		ssize_t n = copy_file_range(inSrcFile,&srcOffset,inDstFile,&dstOffset,length,0);
+		
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			
+			if (!copiedAny && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF))
+			{
+				break;
+			}
+			
+			return _IMBFileCopyRecordError(ioError,errno ? errno : EIO);
+		}
+		
+		if (n == 0) return _IMBFileCopyRecordError(ioError,EIO);
+		
+		copiedAny = true;
+		if ((error = _IMBFileCopyDidCopy(ioError,inProgress,inContext,n)) != 0) return error;
+	}
+	
+	if (copiedAny) return 0;
+	
+	#endif
+	
+	return IMBFileCopyChunkWithBuffer(inSrcFile,inDstFile,inOffset,inLength,inBufferSize,ioError,inProgress,inContext);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
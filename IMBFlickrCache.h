@@ -0,0 +1,105 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBSQLiteCache.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// IMBFlickrCache keeps the responses of Flickr API calls and the thumbnails of Flickr photos, so that browsing the 
+// same queries again (even in a later session or while offline) is served locally. Responses are keyed by the method 
+// and arguments of the call and become stale after a while. Stale responses are still handed out, but callers are 
+// expected to revalidate them in the background...
+
+@interface IMBFlickrCache : IMBSQLiteCache
+
++ (IMBFlickrCache*) sharedCache;
+
+// Time after which a cached response is considered stale...
+
++ (void) setResponseLifetime:(NSTimeInterval)inLifetime;
++ (NSTimeInterval) responseLifetime;
+
+// Limits for the background compaction. Entries that have not been used for the given time interval are purged,
+// and if the cache is still bigger than allowed, the least recently used entries are purged...
+
++ (void) setMaxCacheSize:(long long)inBytes;
++ (long long) maxCacheSize;
+
++ (void) setMaxEntryAge:(NSTimeInterval)inAge;
++ (NSTimeInterval) maxEntryAge;
+
+// Returns the key for a Flickr API call. The order of the arguments doesn't matter...
+
++ (NSString*) keyForMethod:(NSString*)inMethod arguments:(NSDictionary*)inArguments;
+
+// Cached API responses. Returns nil if there is no cached response for this key. Otherwise outIsStale tells 
+// whether the response has outlived the response lifetime...
+
+- (NSDictionary*) responseForKey:(NSString*)inKey isStale:(BOOL*)outIsStale;
+- (void) storeResponse:(NSDictionary*)inResponse forKey:(NSString*)inKey;
+
+// Cached thumbnail data. Returns nil if the thumbnail for this URL isn't cached...
+
+- (NSData*) thumbnailDataForURL:(NSURL*)inURL;
+- (void) storeThumbnailData:(NSData*)inData forURL:(NSURL*)inURL;
+
+- (void) removeAllEntries;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
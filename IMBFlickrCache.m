@@ -0,0 +1,426 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBFlickrCache.h"
+#import "IMBCommon.h"
+#import "FMDatabase.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Bump this version whenever the layout of the tables or the encoding of the responses changes...
+
+static const int kIMBFlickrCacheSchemaVersion = 1;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static IMBFlickrCache* sSharedCache = nil;
+static NSTimeInterval sResponseLifetime = 60.0 * 60.0;
+static long long sMaxCacheSize = 64LL * 1024LL * 1024LL;
+static NSTimeInterval sMaxEntryAge = 14.0 * 24.0 * 60.0 * 60.0;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@implementation IMBFlickrCache
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
++ (void) setResponseLifetime:(NSTimeInterval)inLifetime
+{
+	sResponseLifetime = inLifetime;
+}
+
+
++ (NSTimeInterval) responseLifetime
+{
+	return sResponseLifetime;
+}
+
+
++ (void) setMaxCacheSize:(long long)inBytes
+{
+	sMaxCacheSize = inBytes;
+}
+
+
++ (long long) maxCacheSize
+{
+	return sMaxCacheSize;
+}
+
+
++ (void) setMaxEntryAge:(NSTimeInterval)inAge
+{
+	sMaxEntryAge = inAge;
+}
+
+
++ (NSTimeInterval) maxEntryAge
+{
+	return sMaxEntryAge;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
++ (IMBFlickrCache*) sharedCache
+{
+	@synchronized(self)
+	{
+		if (sSharedCache == nil)
+		{
+			sSharedCache = [[IMBFlickrCache alloc] init];
+		}
+	}
+	
+	return sSharedCache;
+}
+
+
+- (id) init
+{
+	return [super initWithName:@"Flickr"];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Database
+
+- (int) schemaVersion
+{
+	return kIMBFlickrCacheSchemaVersion;
+}
+
+
+- (void) resetDatabase
+{
+	[_database executeUpdate:@"DROP TABLE IF EXISTS responses"];
+	[_database executeUpdate:@"DROP TABLE IF EXISTS thumbnails"];
+}
+
+
+- (BOOL) prepareDatabase
+{
+	return
+		[_database executeUpdate:@"CREATE TABLE IF NOT EXISTS responses (key TEXT PRIMARY KEY, response BLOB NOT NULL, stored REAL NOT NULL, size INTEGER NOT NULL, accessed REAL NOT NULL)"] &&
+		[_database executeUpdate:@"CREATE TABLE IF NOT EXISTS thumbnails (url TEXT PRIMARY KEY, data BLOB NOT NULL, size INTEGER NOT NULL, accessed REAL NOT NULL)"] &&
+		[_database executeUpdate:@"CREATE INDEX IF NOT EXISTS responses_accessed ON responses (accessed)"] &&
+		[_database executeUpdate:@"CREATE INDEX IF NOT EXISTS thumbnails_accessed ON thumbnails (accessed)"];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// The arguments are sorted by name, so that equal calls always map to the same key...
+
++ (NSString*) keyForMethod:(NSString*)inMethod arguments:(NSDictionary*)inArguments
+{
+	NSMutableString* key = [NSMutableString stringWithString:inMethod ? inMethod : @""];
+	NSArray* names = [[inArguments allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	
+	for (NSString* name in names)
+	{
+		[key appendFormat:@"&%@=%@",name,[inArguments objectForKey:name]];
+	}
+	
+	return key;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Responses
+
+
+- (NSDictionary*) responseForKey:(NSString*)inKey isStale:(BOOL*)outIsStale
+{
+	if (_database == nil || inKey == nil) return nil;
+	
+	NSData* data = nil;
+	NSTimeInterval stored = 0.0;
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT response, stored, accessed FROM responses WHERE key = ?",inKey];
+		
+		if ([results next])
+		{
+			data = [results dataForColumnIndex:0];
+			stored = [results doubleForColumnIndex:1];
+			NSTimeInterval accessed = [results doubleForColumnIndex:2];
+			[results close];
+			
+			if (now - accessed > [self accessGranularity])
+			{
+				[_database executeUpdate:@"UPDATE responses SET accessed = ? WHERE key = ?",[NSNumber numberWithDouble:now],inKey];
+			}
+		}
+		else
+		{
+			[results close];
+		}
+	}
+	
+	if (data == nil) return nil;
+	
+	// A response that can't be decoded any more is useless, so simply forget about it...
+	
+	NSDictionary* response = nil;
+	
+	@try
+	{
+		response = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+	}
+	@catch (NSException* inException)
+	{
+		response = nil;
+	}
+	
+	if (![response isKindOfClass:[NSDictionary class]])
+	{
+		@synchronized(self)
+		{
+			[_database executeUpdate:@"DELETE FROM responses WHERE key = ?",inKey];
+		}
+		
+		return nil;
+	}
+	
+	if (outIsStale) *outIsStale = (now - stored > sResponseLifetime);
+	return response;
+}
+
+
+- (void) storeResponse:(NSDictionary*)inResponse forKey:(NSString*)inKey
+{
+	if (_database == nil || inResponse == nil || inKey == nil) return;
+	
+	NSData* data = [NSKeyedArchiver archivedDataWithRootObject:inResponse];
+	if (data == nil) return;
+	
+	NSNumber* now = [NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]];
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:
+			@"INSERT OR REPLACE INTO responses (key, response, stored, size, accessed) VALUES (?,?,?,?,?)",
+			inKey,
+			data,
+			now,
+			[NSNumber numberWithUnsignedInteger:[data length]],
+			now];
+	}
+	
+	[self didStoreEntry];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Thumbnails
+
+
+- (NSData*) thumbnailDataForURL:(NSURL*)inURL
+{
+	if (_database == nil || inURL == nil) return nil;
+	
+	NSString* urlString = [inURL absoluteString];
+	NSData* data = nil;
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT data, accessed FROM thumbnails WHERE url = ?",urlString];
+		
+		if ([results next])
+		{
+			data = [results dataForColumnIndex:0];
+			NSTimeInterval accessed = [results doubleForColumnIndex:1];
+			[results close];
+			
+			NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+			
+			if (now - accessed > [self accessGranularity])
+			{
+				[_database executeUpdate:@"UPDATE thumbnails SET accessed = ? WHERE url = ?",[NSNumber numberWithDouble:now],urlString];
+			}
+		}
+		else
+		{
+			[results close];
+		}
+	}
+	
+	return data;
+}
+
+
+- (void) storeThumbnailData:(NSData*)inData forURL:(NSURL*)inURL
+{
+	if (_database == nil || inURL == nil || [inData length] == 0) return;
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:
+			@"INSERT OR REPLACE INTO thumbnails (url, data, size, accessed) VALUES (?,?,?,?)",
+			[inURL absoluteString],
+			inData,
+			[NSNumber numberWithUnsignedInteger:[inData length]],
+			[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]]];
+	}
+	
+	[self didStoreEntry];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+- (void) removeAllEntries
+{
+	if (_database == nil) return;
+
+	@synchronized(self)
+	{
+		[_database executeUpdate:@"DELETE FROM responses"];
+		[_database executeUpdate:@"DELETE FROM thumbnails"];
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Compaction
+
+
+// First purge entries that have not been used for a long time, then evict the least recently used responses and
+// thumbnails until the cache fits into its size limit again...
+
+- (void) compactDatabase
+{
+	NSNumber* cutoff = [NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate] - sMaxEntryAge];
+	long long totalSize = 0;
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:@"DELETE FROM responses WHERE accessed < ?",cutoff];
+		[_database executeUpdate:@"DELETE FROM thumbnails WHERE accessed < ?",cutoff];
+
+		FMResultSet* results = [_database executeQuery:@"SELECT (SELECT IFNULL(SUM(size),0) FROM responses) + (SELECT IFNULL(SUM(size),0) FROM thumbnails)"];
+		if ([results next]) totalSize = [results longLongIntForColumnIndex:0];
+		[results close];
+	}
+	
+	if (totalSize > sMaxCacheSize)
+	{
+		NSMutableArray* responseKeys = [NSMutableArray array];
+		NSMutableArray* thumbnailURLs = [NSMutableArray array];
+		
+		@synchronized(self)
+		{
+			FMResultSet* results = [_database executeQuery:
+				@"SELECT 0, key, size, accessed FROM responses UNION ALL SELECT 1, url, size, accessed FROM thumbnails ORDER BY 4 ASC"];
+			
+			while (totalSize > sMaxCacheSize && [results next])
+			{
+				NSMutableArray* keys = [results intForColumnIndex:0] == 0 ? responseKeys : thumbnailURLs;
+				[keys addObject:[results stringForColumnIndex:1]];
+				totalSize -= [results longLongIntForColumnIndex:2];
+			}
+			
+			[results close];
+
+			for (NSString* key in responseKeys)
+			{
+				[_database executeUpdate:@"DELETE FROM responses WHERE key = ?",key];
+			}
+			
+			for (NSString* url in thumbnailURLs)
+			{
+				[_database executeUpdate:@"DELETE FROM thumbnails WHERE url = ?",url];
+			}
+		}
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@end
+
@@ -155,6 +155,8 @@ typedef enum {
 #pragma mark Utilities
 
 - (NSDictionary*) argumentsForFlickrCall;
++ (CGFloat) thumbnailSizeForPixelSize: (CGFloat) inPixelSize;
++ (NSURL*) thumbnailURLForPixelSize: (CGFloat) inPixelSize fromPhotoDict: (NSDictionary*) photoDict context: (OFFlickrAPIContext*) context;
 + (NSString *)base58EncodedValue:(long long)num;
 + (NSString *)descriptionOfLicense:(NSInteger)aLicenseNumber;
 + (NSString*) identifierWithQueryParams: (NSDictionary*) inQueryParams;
@@ -291,6 +291,46 @@ NSString* const IMBFlickrNodeProperty_UUID = @"uuid";
 }
 
 
+// Flickr sizes (longest edge in pixels) that may be used as thumbnails in the object views. The square size
+// is left out on purpose, since it is cropped and wouldn't match the aspect ratio of the other thumbnails...
+
+static const CGFloat sFlickrThumbnailSizes[] = { 100.0, 240.0, 500.0 };
+
+
++ (CGFloat) thumbnailSizeForPixelSize: (CGFloat) inPixelSize {
+	NSUInteger count = sizeof(sFlickrThumbnailSizes) / sizeof(CGFloat);
+	
+	for (NSUInteger i=0; i<count; i++) {
+		if (sFlickrThumbnailSizes[i] >= inPixelSize) return sFlickrThumbnailSizes[i];
+	}
+	
+	return sFlickrThumbnailSizes[count-1];
+}
+
+
+// Returns the URL of the smallest Flickr size that still covers the requested pixel size. The URLs that came 
+// with the 'extras' of the response are preferred, otherwise the URL is built from the photo dictionary...
+
++ (NSURL*) thumbnailURLForPixelSize: (CGFloat) inPixelSize fromPhotoDict: (NSDictionary*) photoDict context: (OFFlickrAPIContext*) context {
+	CGFloat size = [self thumbnailSizeForPixelSize:inPixelSize];
+	NSString* urlString = nil;
+	NSString* flickrSize = nil;
+	
+	if (size <= 100.0) {
+		flickrSize = OFFlickrThumbnailSize;
+	} else if (size <= 240.0) {
+		urlString = [photoDict objectForKey:@"url_s"];
+		flickrSize = OFFlickrSmallSize;
+	} else {
+		urlString = [photoDict objectForKey:@"url_m"];
+		flickrSize = OFFlickrMediumSize;		// Note: medium is nil, which is fine here
+	}
+	
+	if (urlString) return [NSURL URLWithString:urlString];
+	return [context photoSourceURLFromDictionary:photoDict size:flickrSize];
+}
+
+
 - (NSArray*) extractPhotosFromFlickrResponse: (NSDictionary*) response context: (OFFlickrAPIContext*) context {
 	IMBFlickrParser* parser = (IMBFlickrParser*) self.parser;
 	NSArray* photos = [response valueForKeyPath:@"photos.photo"];
@@ -361,7 +401,7 @@ NSString* const IMBFlickrNodeProperty_UUID = @"uuid";
 						 
 		obj.parser = self.parser;
 		
-		NSURL* thumbnailURL = [context photoSourceURLFromDictionary:photoDict size:OFFlickrThumbnailSize];
+		NSURL* thumbnailURL = [IMBFlickrNode thumbnailURLForPixelSize:parser.thumbnailPixelSize fromPhotoDict:photoDict context:context];
 		obj.imageLocation = thumbnailURL;
 		obj.imageRepresentationType = IKImageBrowserCGImageRepresentationType;
 		obj.imageRepresentation = nil;	// Build lazily when needed
@@ -87,11 +87,14 @@
 	IMBFlickrSizeSpecifier _desiredSize;
 	NSMutableArray* _customQueries;
 	NSMutableDictionary* _flickrRequests;
+	NSMutableDictionary* _flickrCacheKeys;
+	NSMutableSet* _revalidatingNodeIdentifiers;
 	id _delegate;
 	NSString* _flickrAPIKey;
 	OFFlickrAPIContext* _flickrContext;
 	NSString* _flickrSharedSecret;
 	IMBLoadMoreObject* _loadMoreButton;
+	CGFloat _thumbnailPixelSize;
 }
 
 #pragma mark Actions
@@ -128,6 +131,9 @@
 ///	A button object holding the 'load more' button.
 @property (readonly) IMBLoadMoreObject* loadMoreButton;
 
+///	The Flickr thumbnail size (in pixels) matching the current icon size of the object view.
+@property (readonly) CGFloat thumbnailPixelSize;
+
 
 #pragma mark Query Persistence
 
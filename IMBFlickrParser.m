@@ -57,6 +57,7 @@
 
 //	iMedia
 #import "IMBConfig.h"
+#import "IMBFlickrCache.h"
 #import "IMBFlickrNode.h"
 #import "IMBFlickrObject.h"
 #import "IMBFlickrParser.h"
@@ -77,14 +78,20 @@
 
 //#define VERBOSE
 
+//	Estimated cell size (in points) of the object view at the smallest and largest icon size...
+static const CGFloat kIMBFlickrMinCellSize = 40.0;
+static const CGFloat kIMBFlickrMaxCellSize = 440.0;
+
 //----------------------------------------------------------------------------------------------------------------------
 
 @interface IMBFlickrParser ()
 //	Flickr Request Handling:
 - (void) cancelAllPendingFlickrRequests;
+- (NSDictionary*) cachedResponseForFlickrNode: (IMBFlickrNode*) node isStale: (BOOL*) outIsStale;
 - (BOOL) hasFlickrRequestForNode: (IMBFlickrNode*) node;
 - (void) startLoadRequestForFlickrNode: (IMBFlickrNode*) node;
 - (void) startLoadMoreRequestForFlickrNode: (IMBFlickrNode*) node;
+- (void) startRequestForFlickrNode: (IMBFlickrNode*) node revalidating: (BOOL) isRevalidating;
 //	Query Persistence:
 - (NSArray*) instantiateCustomQueriesWithRoot: (IMBFlickrNode*) root;
 - (NSString*) metadataDescriptionForMetadata:(NSDictionary*)inMetadata;
@@ -103,6 +110,28 @@
 }
 
 
+// Until the object view reports its cell size, the thumbnail size is derived from the icon size that the object
+// view saved in the preferences (the zoom value of the icon view, between 0 and 1). The cell size is only estimated,
+// so the estimate errs on the large side: thumbnails that are too small would stay blurry until the user zooms...
+
+- (id) initWithMediaType: (NSString*) inMediaType {
+	if (self = [super initWithMediaType:inMediaType]) {
+		NSNumber* iconSize = [IMBConfig prefsValueForKey:@"globalIconSize"];
+		CGFloat zoom = iconSize ? [iconSize doubleValue] : 0.5;
+		CGFloat cellSize = kIMBFlickrMinCellSize + zoom * (kIMBFlickrMaxCellSize - kIMBFlickrMinCellSize);
+		CGFloat scale = 1.0;
+		NSScreen* screen = [NSScreen mainScreen];
+		if ([screen respondsToSelector:@selector(backingScaleFactor)]) {
+			scale = [screen backingScaleFactor];
+		}
+		
+		_thumbnailPixelSize = [IMBFlickrNode thumbnailSizeForPixelSize:cellSize * scale];
+	}
+	
+	return self;
+}
+
+
 - (void) dealloc {
 	_delegate = nil;
 	
@@ -113,6 +142,8 @@
 	IMBRelease (_flickrContext);
 	IMBRelease (_flickrSharedSecret);
 	IMBRelease (_flickrRequests);	
+	IMBRelease (_flickrCacheKeys);
+	IMBRelease (_revalidatingNodeIdentifiers);
 	IMBRelease (_loadMoreButton);
 	[super dealloc];
 }
@@ -249,6 +280,19 @@
 	IMBLibraryController* libController = [IMBLibraryController sharedLibraryControllerWithMediaType:self.mediaType];
 	IMBFlickrNode* node = (IMBFlickrNode*) [libController nodeWithIdentifier:nodeIdentifier];
 	
+	//	if the node is already showing a cached response, this was a background revalidation...
+	BOOL wasRevalidating = [_revalidatingNodeIdentifiers containsObject:nodeIdentifier];
+	[_revalidatingNodeIdentifiers removeObject:nodeIdentifier];
+	
+	//	remember the response for the next time the same call is made...
+	IMBFlickrCache* cache = [IMBFlickrCache sharedCache];
+	NSString* cacheKey = [[[_flickrCacheKeys objectForKey:nodeIdentifier] retain] autorelease];
+	NSDictionary* cachedResponse = wasRevalidating ? [cache responseForKey:cacheKey isStale:NULL] : nil;
+	if (cacheKey && inResponseDictionary) {
+		[cache storeResponse:inResponseDictionary forKey:cacheKey];
+	}
+	[_flickrCacheKeys removeObjectForKey:nodeIdentifier];
+	
 	//	if the node does not exist any more, there is not much to do...
 	if (!node) return;
 		
@@ -256,6 +300,15 @@
 		NSLog (@"Flickr request completed for node '%@'.", nodeIdentifier);
 	#endif
 	
+	//	a changed first page replaces the contents of the node. But once the user loaded more pages we don't pull 
+	//	the rug out from under them: a revalidated response for node.page > 0 is only stored in the cache above, 
+	//	it is not shown, and the node keeps the cached page it already displays until the next time...
+	if (wasRevalidating) {
+		if (inResponseDictionary == nil || node.page > 0 || [inResponseDictionary isEqual:cachedResponse]) return;
+		node.subNodes = nil;
+		node.objects = nil;
+	}
+	
 	//	save Flickr response in our iMB node for later population of the browser...
 	[node setFlickrResponse:(inResponseDictionary) ? inResponseDictionary : [NSDictionary dictionary]];
 	
@@ -267,6 +320,15 @@
 - (void) flickrAPIRequest: (OFFlickrAPIRequest*) inRequest 
 		 didFailWithError: (NSError*) inError {
 	
+	NSString* nodeIdentifier = inRequest.sessionInfo;
+	[_flickrCacheKeys removeObjectForKey:nodeIdentifier];
+	
+	//	a failed revalidation (e.g. while offline) is harmless, the node keeps showing the cached response...
+	if ([_revalidatingNodeIdentifiers containsObject:nodeIdentifier]) {
+		[_revalidatingNodeIdentifiers removeObject:nodeIdentifier];
+		return;
+	}
+	
 	NSLog (@"flickrAPIRequest:didFailWithError: %@", inError);	
 	//	TODO: Error Handling
 }
@@ -325,13 +387,54 @@
 
 - (void) startLoadMoreRequestForFlickrNode: (IMBFlickrNode*) node {
 	node.page = node.page + 1;
-	[self performSelectorOnMainThread:@selector(startLoadRequestForFlickrNode_onMainThread:) withObject:node waitUntilDone:NO];	
+	
+	//	serve the next page from the cache if we have it. Only go to Flickr if it's missing or stale. A stale page 
+	//	that we already show is only revalidated, which stores the fresh response without reloading the node a
+	//	second time. We decide this here, as the cache entry may be gone by the time the request starts...
+	BOOL isStale = YES;
+	NSDictionary* cachedResponse = [self cachedResponseForFlickrNode:node isStale:&isStale];
+	if (cachedResponse) {
+		IMBLibraryController* libController = [IMBLibraryController sharedLibraryControllerWithMediaType:self.mediaType];
+		[node setFlickrResponse:cachedResponse];
+		[libController reloadNode:node];
+		
+		if (isStale) {
+			[self performSelectorOnMainThread:@selector(startRevalidationRequestForFlickrNode_onMainThread:) withObject:node waitUntilDone:NO];	
+		}
+	} else {
+		[self performSelectorOnMainThread:@selector(startLoadRequestForFlickrNode_onMainThread:) withObject:node waitUntilDone:NO];	
+	}
+}
+
+
+- (NSDictionary*) cachedResponseForFlickrNode: (IMBFlickrNode*) node isStale: (BOOL*) outIsStale {
+	NSString* method = [self.class flickrMethodForMethodCode:node.method];
+	NSString* cacheKey = [IMBFlickrCache keyForMethod:method arguments:[node argumentsForFlickrCall]];
+	return [[IMBFlickrCache sharedCache] responseForKey:cacheKey isStale:outIsStale];
 }
 
 
 - (void) startLoadRequestForFlickrNode_onMainThread: (IMBFlickrNode*) node {
 	if (!node) return;
 	
+	//	if there is a cached response for the same call, then the node is already showing it and this request 
+	//	just revalidates it...
+	NSString* method = [self.class flickrMethodForMethodCode:node.method];
+	NSString* cacheKey = [IMBFlickrCache keyForMethod:method arguments:[node argumentsForFlickrCall]];
+	BOOL isRevalidating = [[IMBFlickrCache sharedCache] responseForKey:cacheKey isStale:NULL] != nil;
+	[self startRequestForFlickrNode:node revalidating:isRevalidating];
+}
+
+
+- (void) startRevalidationRequestForFlickrNode_onMainThread: (IMBFlickrNode*) node {
+	if (!node) return;
+	[self startRequestForFlickrNode:node revalidating:YES];
+}
+
+
+- (void) startRequestForFlickrNode: (IMBFlickrNode*) node revalidating: (BOOL) isRevalidating {
+	if (!node) return;
+	
 	OFFlickrAPIRequest* request = [self flickrRequestWithNode:node];
 	if (![request isRunning]) {			
 		[request setDelegate:self];	
@@ -346,6 +449,18 @@
 		//	compose and start Flickr request...
 		NSString* method = [self.class flickrMethodForMethodCode:node.method];
 		NSDictionary* arguments = [node argumentsForFlickrCall];
+		NSString* cacheKey = [IMBFlickrCache keyForMethod:method arguments:arguments];
+		
+		if (_flickrCacheKeys == nil) _flickrCacheKeys = [[NSMutableDictionary alloc] init];
+		if (_revalidatingNodeIdentifiers == nil) _revalidatingNodeIdentifiers = [[NSMutableSet alloc] init];
+		
+		[_flickrCacheKeys setObject:cacheKey forKey:node.identifier];
+		if (isRevalidating) {
+			[_revalidatingNodeIdentifiers addObject:node.identifier];
+		} else {
+			[_revalidatingNodeIdentifiers removeObject:node.identifier];
+		}
+		
 		[request callAPIMethodWithGET:method arguments:arguments];
 		
 #ifdef VERBOSE
@@ -395,6 +510,37 @@
 }
 
 
+// Thumbnails are requested at the smallest Flickr size that covers the cells of the object view. When the user 
+// zooms past the current size, the objects that were already loaded get the larger thumbnail URL. The images 
+// themselves are only fetched again once the view asks for them. Zooming out keeps the larger thumbnails...
+
+- (void) didChangeIconSize: (NSSize) inSize objectView: (NSView*) inView {
+	CGFloat scale = 1.0;
+	NSWindow* window = [inView window];
+	if ([window respondsToSelector:@selector(backingScaleFactor)]) {
+		scale = [window backingScaleFactor];
+	}
+	
+	CGFloat pixelSize = [IMBFlickrNode thumbnailSizeForPixelSize:MAX(inSize.width,inSize.height) * scale];
+	BOOL needsUpgrade = pixelSize > _thumbnailPixelSize;
+	_thumbnailPixelSize = pixelSize;
+	
+	if (!needsUpgrade || _flickrContext == nil) return;
+	
+	for (IMBFlickrNode* node in self.flickrRootNode.subNodes) {
+		for (IMBObject* object in node.objects) {
+			if (![object isKindOfClass:[IMBFlickrObject class]]) continue;
+			
+			NSURL* thumbnailURL = [IMBFlickrNode thumbnailURLForPixelSize:pixelSize fromPhotoDict:object.preliminaryMetadata context:_flickrContext];
+			if (thumbnailURL && ![thumbnailURL isEqual:object.imageLocation]) {
+				object.imageLocation = thumbnailURL;
+				object.imageRepresentation = nil;	// Loaded lazily when needed
+			}
+		}
+	}
+}
+
+
 - (IMBNode*) nodeWithOldNode: (const IMBNode*) inOldNode 
 					 options: (IMBOptions) inOptions 
 					   error: (NSError**) outError {
@@ -458,9 +604,20 @@
 		if ([inFlickrNode hasFlickrResponse]) {
 			[inFlickrNode processResponseForContext:_flickrContext];
 			[inFlickrNode clearFlickrResponse];
-		} else {			
+		} else {
+			//	show a cached response right away. A stale one is revalidated in the background...
+			BOOL isStale = YES;
+			NSDictionary* cachedResponse = [self cachedResponseForFlickrNode:inFlickrNode isStale:&isStale];
+			if (cachedResponse) {
+				[inFlickrNode setFlickrResponse:cachedResponse];
+				[inFlickrNode processResponseForContext:_flickrContext];
+				[inFlickrNode clearFlickrResponse];
+			}
+			
 			//	the network access needs to be started on the main thread...
-			[self startLoadRequestForFlickrNode:inFlickrNode];
+			if (cachedResponse == nil || isStale) {
+				[self startLoadRequestForFlickrNode:inFlickrNode];
+			}
 		}
 	}
 		
@@ -596,6 +753,55 @@
 }
 
 
+/// Thumbnails are served from the Flickr cache where possible. Otherwise they are
+///	downloaded here (we are on a background thread) and added to the cache.
+- (id) loadThumbnailForObject: (IMBObject*) inObject {
+	NSURL* url = inObject.imageLocation;
+	if (![url isKindOfClass:[NSURL class]] || [url isFileURL]) {
+		return [super loadThumbnailForObject:inObject];
+	}
+	
+	IMBFlickrCache* cache = [IMBFlickrCache sharedCache];
+	NSData* data = [cache thumbnailDataForURL:url];
+	BOOL isCached = (data != nil);
+	
+	if (!isCached) {
+		NSURLRequest* request = [NSURLRequest requestWithURL:url cachePolicy:NSURLRequestUseProtocolCachePolicy timeoutInterval:60.0];
+		NSURLResponse* response = nil;
+		data = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:NULL];
+		
+		if ([response isKindOfClass:[NSHTTPURLResponse class]] && [(NSHTTPURLResponse*)response statusCode] != 200) {
+			data = nil;
+		}
+	}
+	
+	CGImageRef imageRepresentation = NULL;
+	if (data) {
+		CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data, NULL);
+		if (source) {
+			imageRepresentation = CGImageSourceCreateImageAtIndex(source, 0, NULL);
+			CFRelease(source);
+		}
+		[NSMakeCollectable(imageRepresentation) autorelease];
+	}
+	
+	//	only cache what turned out to be a valid image...
+	if (imageRepresentation && !isCached) {
+		[cache storeThumbnailData:data forURL:url];
+	}
+	
+	//	return the result to the main thread...
+	if (imageRepresentation) {
+		[inObject performSelectorOnMainThread:@selector(setImageRepresentation:) 
+								   withObject:(id)imageRepresentation 
+								waitUntilDone:NO 
+										modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+	}
+	
+	return (id) imageRepresentation;
+}
+
+
 /// Convert metadata into human readable string.
 - (void) loadMetadataForObject:(IMBObject*)inObject
 {
@@ -710,6 +916,7 @@
 @synthesize flickrAPIKey = _flickrAPIKey;
 @synthesize flickrSharedSecret = _flickrSharedSecret;
 @synthesize desiredSize = _desiredSize;
+@synthesize thumbnailPixelSize = _thumbnailPixelSize;
 
 
 - (IMBLoadMoreObject*) loadMoreButton {
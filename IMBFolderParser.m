@@ -57,6 +57,8 @@
 #import "IMBNode.h"
 #import "IMBObject.h"
 #import "IMBNodeObject.h"
+#import "IMBMetadataCache.h"
+#import "IMBOperationQueue.h"
 #import "NSFileManager+iMedia.h"
 #import "NSWorkspace+iMedia.h"
 #import "NSString+iMedia.h"
@@ -227,6 +229,7 @@
         {
             IMBDrain(pool);
             pool = [[NSAutoreleasePool alloc] init];
+            if ([IMBOperationQueue isCurrentOperationCancelled]) break;
         }
         
         {
@@ -259,6 +262,8 @@
                 IMBObject* object = [self objectForPath:path name:betterName index:index++];
                 [objects addObject:object];
                 inNode.displayedObjectCount++;
+                
+                [self populateNode:inNode didAddObjects:objects];
             }
         }
     }
@@ -274,6 +279,8 @@
             pool = [[NSAutoreleasePool alloc] init];
         }
         
+        if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+        
         NSString* name = [fm displayNameAtPath:folder];
         BOOL isPackage = [ws isFilePackageAtPath:folder];
         
@@ -352,6 +359,115 @@
 }
 
 
+// If only a few files in the folder have changed, then there is no need to rescan the whole folder. Instead we 
+// add objects for new files, remove objects for deleted files, and replace objects for modified files (with a 
+// bumped imageVersion so that only their thumbnails are regenerated). Changes to subfolders affect the subnodes,
+// so in this case we return NO and let the controller repopulate the node...
+
+- (BOOL) updateNode:(IMBNode*)inNode forChangedFilesAtPaths:(NSArray*)inPaths error:(NSError**)outError
+{
+	if (outError) *outError = nil;
+	if (!inNode.isPopulated) return NO;
+	
+	NSFileManager* fm = [NSFileManager imb_threadSafeManager];
+	NSMutableArray* objects = [NSMutableArray arrayWithArray:inNode.objects];
+	BOOL didAddObjects = NO;
+	
+	for (NSString* path in inPaths)
+	{
+		BOOL isDir = NO;
+		BOOL exists = [fm fileExistsAtPath:path isDirectory:&isDir];
+		
+		if (exists && isDir) return NO;
+		
+		for (IMBNode* subnode in inNode.subNodes)
+		{
+			if ([subnode.mediaSource isEqualToString:path]) return NO;
+		}
+		
+		BOOL qualifies = exists && 
+			![[path lastPathComponent] hasPrefix:@"."] && 
+			[NSString imb_doesFileAtPath:path conformToUTI:_fileUTI];
+		
+		NSUInteger index = [objects indexOfObjectPassingTest:^BOOL(id inObject,NSUInteger inIndex,BOOL* outStop)
+		{
+			return ![inObject isKindOfClass:[IMBNodeObject class]] && [[inObject path] isEqualToString:path];
+		}];
+		
+		IMBObject* oldObject = index != NSNotFound ? [objects objectAtIndex:index] : nil;
+		IMBObject* newObject = nil;
+		
+		if (qualifies)
+		{
+			NSURL* fileURL = [NSURL fileURLWithPath:path];
+			NSString* betterName;
+			if (![fileURL getResourceValue:&betterName forKey:NSURLLocalizedNameKey error:NULL]) betterName = [fileURL lastPathComponent];
+			betterName = [betterName stringByReplacingOccurrencesOfString:@"_" withString:@" "];
+			
+			newObject = [self objectForPath:path name:betterName index:0];
+		}
+		
+		if (oldObject && newObject)
+		{
+			newObject.imageVersion = oldObject.imageVersion + 1;
+			[objects replaceObjectAtIndex:index withObject:newObject];
+		}
+		else if (oldObject)
+		{
+			[objects removeObjectAtIndex:index];
+		}
+		else if (newObject)
+		{
+			[objects addObject:newObject];
+			didAddObjects = YES;
+		}
+	}
+	
+	// Files are sorted by name and come before the folders, just like in populateNode:options:error:...
+	
+	NSMutableArray* files = [NSMutableArray arrayWithCapacity:objects.count];
+	NSMutableArray* folders = [NSMutableArray array];
+	
+	for (IMBObject* object in objects)
+	{
+		if ([object isKindOfClass:[IMBNodeObject class]]) [folders addObject:object];
+		else [files addObject:object];
+	}
+	
+	if (didAddObjects)
+	{
+		[files sortUsingComparator:^NSComparisonResult(id inObject1,id inObject2)
+		{
+			return [[[inObject1 path] lastPathComponent] localizedStandardCompare:[[inObject2 path] lastPathComponent]];
+		}];
+	}
+	
+	[files addObjectsFromArray:folders];
+	
+	// The objects are still shared with the node that is currently displayed on the main thread, so they must 
+	// not be modified here. Objects that need a new index are replaced with a copy instead...
+	
+	NSUInteger n = files.count;
+	
+	for (NSUInteger index=0; index<n; index++)
+	{
+		IMBObject* object = [files objectAtIndex:index];
+		
+		if (object.index != index)
+		{
+			IMBObject* copy = [[object copy] autorelease];
+			copy.index = index;
+			[files replaceObjectAtIndex:index withObject:copy];
+		}
+	}
+	
+	inNode.objects = files;
+	inNode.displayedObjectCount = files.count - folders.count;
+	
+	return YES;
+}
+
+
 //----------------------------------------------------------------------------------------------------------------------
 
 
@@ -395,14 +511,26 @@
 
 
 // Loaded lazily when actually needed for display. This method may be called on a background thread, 
-// so setters should only be called to the main thread...
+// so setters should only be called to the main thread. Metadata and description are kept in the persistent 
+// IMBMetadataCache, so that they do not have to be recomputed the next time the folder is opened...
 
 - (void) loadMetadataForObject:(IMBObject*)inObject
 {
 	if (![inObject isKindOfClass:[IMBNodeObject class]])
 	{
-		NSDictionary* metadata = [self metadataForFileAtPath:inObject.path];
-		NSString* description = [self metadataDescriptionForMetadata:metadata];
+		NSString* path = inObject.path;
+		NSString* domain = NSStringFromClass([self class]);
+		NSDictionary* metadata = nil;
+		NSString* description = nil;
+		
+		IMBMetadataCache* cache = [IMBMetadataCache sharedCache];
+		
+		if (![cache getMetadata:&metadata metadataDescription:&description forFileAtPath:path domain:domain])
+		{
+			metadata = [self metadataForFileAtPath:path];
+			description = [self metadataDescriptionForMetadata:metadata];
+			[cache setMetadata:metadata metadataDescription:description forFileAtPath:path domain:domain];
+		}
 		
 		if ([NSThread isMainThread])
 		{
@@ -66,6 +66,9 @@
 @interface IMBImageCaptureParser : IMBParser
 {
 	NSMutableDictionary *_loadingDevices;
+	NSMutableDictionary *_deviceKeys;			// ICA object -> key of its device (for the thumbnail cache)
+	NSMutableDictionary *_thumbnailQueues;		// device key -> objects waiting for a thumbnail (main thread only)
+	NSCountedSet *_pendingThumbnails;			// device key -> number of thumbnail requests in flight (main thread only)
 }
 @property (nonatomic, retain) NSMutableDictionary *loadingDevices;
 
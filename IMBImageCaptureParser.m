@@ -62,33 +62,58 @@
 #import "IMBConfig.h"
 #import "IMBLibraryController.h"
 #import "IMBNodeObject.h"
+#import "IMBButtonObject.h"
 #import "IMBObjectsPromise.h"
 #import "IMBOperationQueue.h"
 #import "NSFileManager+iMedia.h"
 #import "NSImage+iMedia.h"
 #import <Carbon/Carbon.h>
 #import <Quartz/Quartz.h>
+#import <libkern/OSAtomic.h>
+#import <sys/stat.h>
 #import "NSWorkspace+iMedia.h"
 
+//----------------------------------------------------------------------------------------------------------------------
+// Constants:
+
+// Number of thumbnail requests that are sent to one device at the same time. The remaining requests wait in a
+// per device queue, where thumbnails for visible objects jump ahead of prefetched ones...
+
+static const NSUInteger kIMBMaxPendingThumbnailsPerDevice = 4;
+
+// Devices only handle one transfer at a time, so there is one download operation per device and promise, and the
+// operations of later promises for the same device wait for the previous one (see _queueDownloadOperation:)...
+
+static NSMutableDictionary* sLastDownloadOperations = nil;
+
+// Limits for the thumbnail cache on disk. Thumbnails that have not been used for the given time are removed, and if
+// the cache is still too big, the least recently used ones go as well. The cache is trimmed in the background with 
+// the first thumbnail that is stored, and then again after every kIMBThumbnailCacheTrimInterval thumbnails...
+
+static const long long kIMBMaxThumbnailCacheSize = 64LL * 1024LL * 1024LL;
+static const NSTimeInterval kIMBMaxThumbnailCacheAge = 30.0 * 24.0 * 60.0 * 60.0;
+static const int32_t kIMBThumbnailCacheTrimInterval = 256;
+
 //----------------------------------------------------------------------------------------------------------------------
 // Internal classes:
 
-// Purpose: protocol to keep the user informed of download progress
+// Purpose: protocol to keep the user informed of download progress. Sent once per object, on the operation's thread
 @class IMBMTPDownloadOperation;
 @protocol IMBMTPDownloadOperationDelegate 
-- (void) operationDidDownloadFile:(IMBMTPDownloadOperation*)inOperation;
-- (void) operationDidFinish:(IMBMTPDownloadOperation*)inOperation;
-- (void) operation:(IMBMTPDownloadOperation*)inOperation didReceiveError:(NSError *) anError;
+- (void) operation:(IMBMTPDownloadOperation*)inOperation didDownloadObject:(IMBObject*)inObject toPath:(NSString*)inPath;
+- (void) operation:(IMBMTPDownloadOperation*)inOperation didFailToDownloadObject:(IMBObject*)inObject error:(NSError*)anError;
 @end
 
 // Purpose: Gets created from drag'n drop. Triggers copying of files to a local destination 
 @interface  IMBMTPObjectPromise : IMBRemoteObjectsPromise<IMBMTPDownloadOperationDelegate>
 { 
 	long long _bytesTotal;
-	long long _bytesDone;	
+	volatile int64_t _bytesDone;	
 }
 @property (assign,readonly) long long bytesTotal;
 @property (assign,readonly) long long bytesDone;
+- (void) _finishIfDone;
+- (void) _queueDownloadOperation:(IMBMTPDownloadOperation*)inOperation forDevice:(NSString*)inDeviceKey;
 @end
 
 // Purpose: Copy a bunch of files 
@@ -114,10 +139,16 @@
 
 @end
 
-// Purpose: proxy thumbnails that get lazily downloaded 
+// Purpose: proxy thumbnails that get lazily downloaded (or read from the thumbnail cache)
 @interface MTPVisualObject: IMBObject
 {
+	NSString *_deviceKey;
+	NSString *_thumbnailCachePath;
 }
+@property (copy) NSString *deviceKey;
+@property (copy) NSString *thumbnailCachePath;
+- (BOOL) _needsThumbnail;
+- (void) _getThumbnail;
 - (void) _gotThumbnailCallback: (ICACopyObjectThumbnailPB*)pbPtr;
 @end
 
@@ -127,15 +158,24 @@
 - (void) _installNotification;
 - (void) _uninstallNotification;
 - (BOOL) _isAppropriateICAType:(uint32_t) inType;
-- (BOOL) _addICATree:(NSArray *)subItems toNode:(IMBNode *)inNode;
-- (void) _addICAObject:(NSDictionary *) anItem toObjectArray:(NSMutableArray *) objectArray;
+- (BOOL) _addICATree:(NSArray *)subItems toNode:(IMBNode *)inNode deviceKey:(NSString *)inDeviceKey;
+- (void) _addICAObject:(NSDictionary *) anItem toObjectArray:(NSMutableArray *) objectArray deviceKey:(NSString *)inDeviceKey;
 - (void) _gotICANotification:(NSString *) aNotification withDictionary:(NSDictionary *) aDictionary;
 - (IMBNode *) _nodeForDevicelist;
 - (IMBNode *) _nodeForDevice:(NSDictionary *) anDevice;
 - (IMBNode *) _nodeForTempDevice:(NSDictionary *) anDevice;
 - (NSString *) _identifierForICAObject:(id) anObjectID;
-- (NSImage *) _getThumbnailSync:(id) anObject;
+- (NSImage *) _iconForICAObject:(id) anObject item:(NSDictionary *) anItem deviceKey:(NSString *) inDeviceKey nodeIdentifier:(NSString *) inIdentifier;
+- (void) _requestIcon:(NSDictionary *) inRequest;
+- (void) _gotIconCallback:(ICACopyObjectThumbnailPB*)pbPtr;
 - (void) _addICADeviceList:(NSArray *) devices toNode:(IMBNode *)inNode;
+- (NSString *) _deviceKeyForICAObject:(id) anObjectID;
+- (void) _setDeviceKey:(NSString *) inDeviceKey forICAObject:(id) anObjectID;
+- (void) _prefetchThumbnailsForObjects:(NSArray *) inObjects;
+- (void) _queueThumbnailsForObjects:(NSArray *) inObjects;
+- (void) _requestThumbnailForObject:(MTPVisualObject *) inObject;
+- (void) _startThumbnailRequestsForDevice:(NSString *) inDeviceKey;
+- (void) _didLoadThumbnailForObject:(MTPVisualObject *) inObject;
 @end
 
 // Hmm, is this an internal symbol?
@@ -146,6 +186,112 @@
 #define DEBUGLOG( fmt, ... ) {}
 #endif
 
+//----------------------------------------------------------------------------------------------------------------------
+// Thumbnail cache:
+
+// Thumbnails are cached on disk per device, so that reconnecting a camera shows its contents instantly. ICA object
+// IDs change with every connection, so the serial number of the device (or its name, if it has none) identifies
+// the device, and name and size identify an item on it...
+
+static NSString* _IMBDeviceKey(NSDictionary* inDevice)
+{
+	NSString *key = [inDevice valueForKey:@"sern"];
+	if( ![key isKindOfClass:[NSString class]] || ![key length] ) 
+		key = [inDevice valueForKey:@"ifil"];
+	if( ![key isKindOfClass:[NSString class]] || ![key length] ) 
+		return nil;
+	return key;
+}
+
+static NSString* _IMBThumbnailCachePath(NSString* inDeviceKey, NSDictionary* inItem)
+{
+	if( !inDeviceKey ) 
+		return nil;
+	
+	NSString *name = [NSString stringWithFormat:@"%@-%@.thumbnail",[inItem valueForKey:@"ifil"],[inItem valueForKey:@"isiz"]];
+	name = [[name componentsSeparatedByString:@"/"] componentsJoinedByString:@":"];
+	NSString *device = [[inDeviceKey componentsSeparatedByString:@"/"] componentsJoinedByString:@":"];
+	NSString *folder = [[NSFileManager imb_threadSafeManager] imb_sharedCachesFolder:@"ImageCapture"];
+	
+	return [[folder stringByAppendingPathComponent:device] stringByAppendingPathComponent:name];
+}
+
+static volatile int32_t sThumbnailStoreCount = 0;
+static volatile int32_t sIsTrimmingThumbnailCache = 0;
+
+// Removes old thumbnails from the cache, and then the least recently used ones until the cache fits into its size
+// limit. Reading a thumbnail updates its access time, so a thumbnail was last used when it was read or written...
+
+static void _IMBTrimThumbnailCache()
+{
+	if( !OSAtomicCompareAndSwap32Barrier(0,1,&sIsTrimmingThumbnailCache) ) 
+		return;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW,0),^{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSFileManager *fileManager = [NSFileManager imb_threadSafeManager];
+		NSString *folder = [fileManager imb_sharedCachesFolder:@"ImageCapture"];
+		NSMutableArray *entries = [NSMutableArray array];
+		time_t cutoff = time(NULL) - (time_t)kIMBMaxThumbnailCacheAge;
+		long long totalSize = 0;
+		
+		for( NSString *relativePath in [fileManager enumeratorAtPath:folder] )
+		{
+			NSString *path = [folder stringByAppendingPathComponent:relativePath];
+			struct stat info;
+			
+			if( stat([path fileSystemRepresentation],&info) != 0 || !S_ISREG(info.st_mode) ) 
+				continue;
+			
+			time_t used = MAX(info.st_atime,info.st_mtime);
+			
+			if( used < cutoff )
+			{
+				unlink([path fileSystemRepresentation]);
+				continue;
+			}
+			
+			totalSize += (long long)info.st_size;
+			[entries addObject:[NSArray arrayWithObjects:[NSNumber numberWithDouble:(double)used],path,[NSNumber numberWithLongLong:(long long)info.st_size],nil]];
+		}
+		
+		if( totalSize > kIMBMaxThumbnailCacheSize )
+		{
+			[entries sortUsingComparator:^NSComparisonResult(id inEntry1, id inEntry2) {
+				return [[inEntry1 objectAtIndex:0] compare:[inEntry2 objectAtIndex:0]];
+			}];
+			
+			for( NSArray *entry in entries )
+			{
+				if( totalSize <= kIMBMaxThumbnailCacheSize ) 
+					break;
+				
+				unlink([[entry objectAtIndex:1] fileSystemRepresentation]);
+				totalSize -= [[entry objectAtIndex:2] longLongValue];
+			}
+		}
+		
+		OSAtomicCompareAndSwap32Barrier(1,0,&sIsTrimmingThumbnailCache);
+		[pool drain];
+	});
+}
+
+// Writes a thumbnail to the cache in the background...
+
+static void _IMBStoreThumbnail(NSData* inData, NSString* inPath)
+{
+	if( !inData || !inPath ) 
+		return;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW,0),^{
+		[[NSFileManager imb_threadSafeManager] createDirectoryAtPath:[inPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+		[inData writeToFile:inPath atomically:YES];
+	});
+	
+	if( OSAtomicIncrement32Barrier(&sThumbnailStoreCount) % kIMBThumbnailCacheTrimInterval == 1 ) 
+		_IMBTrimThumbnailCache();
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 
 @implementation IMBImageCaptureParser
@@ -172,6 +318,9 @@
 		if( err == noErr )
 		{
 			self.loadingDevices = [NSMutableDictionary dictionary];
+			_deviceKeys = [[NSMutableDictionary alloc] init];
+			_thumbnailQueues = [[NSMutableDictionary alloc] init];
+			_pendingThumbnails = [[NSCountedSet alloc] init];
 			self.mediaSource = [[NSNumber numberWithInt:deviceListPB.object] stringValue];
 			
 			[self _installNotification];
@@ -186,6 +335,9 @@
 	
 	self.loadingDevices = nil;
 	self.mediaSource = nil;
+	IMBRelease(_deviceKeys);
+	IMBRelease(_thumbnailQueues);
+	IMBRelease(_pendingThumbnails);
 	[super dealloc];
 }
 
@@ -245,9 +397,18 @@
 			// DEBUGLOG( @"%@", propertiesDict );
 			NSArray *devices = [propertiesDict valueForKey:(NSString *)kICADevicesArrayKey];
 			if( devices ) 
+			{
 				[self _addICADeviceList:devices toNode:inNode];
+			}
 			else 
-				[self _addICATree:[(NSDictionary *)propertiesDict valueForKey:@"tree"] toNode:inNode];
+			{
+				// Subfolders know their device from when the tree was built. Otherwise this is the device itself...
+				NSString *deviceKey = [self _deviceKeyForICAObject:inNode.mediaSource];
+				if( !deviceKey ) 
+					deviceKey = _IMBDeviceKey(propertiesDict);
+				
+				[self _addICATree:[(NSDictionary *)propertiesDict valueForKey:@"tree"] toNode:inNode deviceKey:deviceKey];
+			}
 			
 			CFRelease( propertiesDict );
 		}	
@@ -294,6 +455,7 @@
 	for( NSDictionary *anDevice in devices )
 	{
 		[deviceIdentifiers addObject:[anDevice valueForKey:@"icao"]];
+		[self _setDeviceKey:_IMBDeviceKey(anDevice) forICAObject:[anDevice valueForKey:@"icao"]];
 		
 		IMBNode* deviceNode = [self _nodeForDevice:anDevice];
 		[subnodes addObject:deviceNode];
@@ -315,7 +477,7 @@
 // recursive creation of subtree nodes 
 // R: object had children
 
-- (BOOL) _addICATree:(NSArray *)subItems toNode:(IMBNode *)inNode
+- (BOOL) _addICATree:(NSArray *)subItems toNode:(IMBNode *)inNode deviceKey:(NSString *)inDeviceKey
 {
 	DEBUGLOG( @"%s\n inNode %@",__PRETTY_FUNCTION__, inNode );
 
@@ -340,14 +502,16 @@
 				subnode.parser = self;
 				subnode.attributes = anItem;	
 				
-				// retrieve the thumbnail. Fallback is the generic folder icon 
+				[self _setDeviceKey:inDeviceKey forICAObject:imageCaptureID];
+				
+				// retrieve the thumbnail (asynchronously, unless it is cached). Fallback is the generic folder icon 
 				if( [anItem valueForKey:@"thuP"] )
-					subnode.icon = [self _getThumbnailSync:imageCaptureID];
+					subnode.icon = [self _iconForICAObject:imageCaptureID item:anItem deviceKey:inDeviceKey nodeIdentifier:subnode.identifier];
 				if( !subnode.icon ) 
 					subnode.icon = [NSImage imb_sharedGenericFolderIcon];
 					// subnode.icon = [[NSWorkspace imb_threadSafeWorkspace] iconForFileType:@"'fldr'"];
 				
-				BOOL hasSubnodes = [self _addICATree:[anItem valueForKey:@"tree"] toNode:subnode];
+				BOOL hasSubnodes = [self _addICATree:[anItem valueForKey:@"tree"] toNode:subnode deviceKey:inDeviceKey];
 				subnode.leaf = !hasSubnodes;
 				subnode.wantsRecursiveObjects = YES;
 				
@@ -368,7 +532,7 @@
 				NSMutableArray *tmpObjects = [NSMutableArray array];
 				
 				for( NSDictionary *tmpObject in subObjects )
-					[self _addICAObject:tmpObject toObjectArray:tmpObjects];
+					[self _addICAObject:tmpObject toObjectArray:tmpObjects deviceKey:inDeviceKey];
 				
 				// TODO: test if really only one object remained
 				// TODO: test if an problem occurs with later handled removal notificatons
@@ -378,17 +542,22 @@
 		}
 		else 
 		{
-			[self _addICAObject:anItem toObjectArray:objects];			
+			[self _addICAObject:anItem toObjectArray:objects deviceKey:inDeviceKey];			
 		}
 		
 	}
 	inNode.subNodes = subnodes;
 	inNode.objects = objects;
+	
+	// Queue the thumbnails of all objects, so that they are there by the time the user scrolls to them...
+	if( [objects count] )
+		[self _prefetchThumbnailsForObjects:objects];
+	
 	return [subnodes count] > 0;
 	
 }
 
-- (void) _addICAObject:(NSDictionary *) anItem toObjectArray:(NSMutableArray *) objectArray
+- (void) _addICAObject:(NSDictionary *) anItem toObjectArray:(NSMutableArray *) objectArray deviceKey:(NSString *)inDeviceKey
 {	
 	uint32_t type = [[anItem valueForKey:@"file"] intValue];
 	NSUInteger index = 0;
@@ -401,6 +570,8 @@
 		object.metadata = anItem;
 		object.parser = self;
 		object.index = index+1;
+		object.deviceKey = inDeviceKey;
+		object.thumbnailCachePath = _IMBThumbnailCachePath(inDeviceKey,anItem);
 		
 		[objectArray addObject:object];
 		
@@ -467,7 +638,7 @@
 	if( !name || ![name length] )
 		name = [anDevice valueForKey:@"ifil"];
 	subnode.name = name;
-	subnode.icon = [self _getThumbnailSync:subnode.mediaSource]; 
+	subnode.icon = [self _iconForICAObject:subnode.mediaSource item:anDevice deviceKey:_IMBDeviceKey(anDevice) nodeIdentifier:subnode.identifier]; 
 	subnode.parser = self;
 	subnode.leaf = NO;
 	subnode.wantsRecursiveObjects = YES;
@@ -538,28 +709,205 @@
 	return isOurType;
 }
 
-- (NSImage *) _getThumbnailSync:(id) anObject
+// Folder and device icons come from the thumbnail cache. If they are not cached yet, then they are requested 
+// asynchronously (on the main thread, where ICA delivers the callbacks) and the node gets its icon later...
+
+- (NSImage *) _iconForICAObject:(id) anObject item:(NSDictionary *) anItem deviceKey:(NSString *) inDeviceKey nodeIdentifier:(NSString *) inIdentifier
 {
-	NSImage *image = NULL;
-	NSData *data = NULL;
-    ICACopyObjectThumbnailPB    pb = { 0  };
-    
-    pb.header.refcon   = 0L; 
+	NSString *path = _IMBThumbnailCachePath(inDeviceKey,anItem);
+	NSData *data = path ? [NSData dataWithContentsOfFile:path] : nil;
+	
+	if( data )
+	{
+		NSImage *image = [[NSImage alloc] initWithData:data];
+		[image setScalesWhenResized:YES];
+		[image setSize:NSMakeSize(16.0,16.0)];
+		return [image autorelease];
+	}
+	
+	NSMutableDictionary *request = [NSMutableDictionary dictionaryWithObject:anObject forKey:@"object"];
+	if( path ) [request setObject:path forKey:@"path"];
+	if( inIdentifier ) [request setObject:inIdentifier forKey:@"identifier"];
+	
+	[self performSelectorOnMainThread:@selector(_requestIcon:) withObject:request waitUntilDone:NO];
+	return nil;
+}
+
+static void ICAIconCallback (ICAHeader* pbHeader)
+{
+	ICACopyObjectThumbnailPB *pb = (ICACopyObjectThumbnailPB *) pbHeader;
+	NSDictionary *request = (NSDictionary *) pbHeader->refcon;
+	IMBImageCaptureParser *parser = [request objectForKey:@"parser"];
+	[parser _gotIconCallback:pb];
+	[request release];
+}
+
+- (void) _requestIcon:(NSDictionary *) inRequest
+{
+	NSMutableDictionary *request = [inRequest mutableCopy];	// released in ICAIconCallback
+	[request setObject:self forKey:@"parser"];
+	
+    ICACopyObjectThumbnailPB pb = { 0 };
+    pb.header.refcon   = (unsigned long) request;
     pb.thumbnailFormat = kICAThumbnailFormatTIFF; // gives transparency
-    pb.object          = [anObject intValue];
-	pb.thumbnailData   = (CFDataRef*) &data;
+    pb.object          = [[request objectForKey:@"object"] intValue];
     
-    /*err =*/ ICACopyObjectThumbnail( &pb, NULL );
-	if (noErr == pb.header.err)
+    if( ICACopyObjectThumbnail(&pb, ICAIconCallback) != noErr )
+		[request release];
+}
+
+- (void) _gotIconCallback:(ICACopyObjectThumbnailPB*)pbPtr
+{
+	NSDictionary *request = (NSDictionary *) pbPtr->header.refcon;
+	
+    if (noErr == pbPtr->header.err)
     {
-        // got the thumbnail data, now create an image...
-		image = [[NSImage alloc] initWithData:data];
+        NSData *data = (NSData*)*(pbPtr->thumbnailData);
+		_IMBStoreThumbnail(data,[request objectForKey:@"path"]);
+		
+		NSImage *image = [[NSImage alloc] initWithData:data];
 		[image setScalesWhenResized:YES];
 		[image setSize:NSMakeSize(16.0,16.0)];
 		[data release];
-		DEBUGLOG( @"%s -> %@", __PRETTY_FUNCTION__, self );
+		
+		// Give the icon to the node, if it is still in the library...
+		
+		NSString *identifier = [request objectForKey:@"identifier"];
+		IMBLibraryController *libController = [IMBLibraryController sharedLibraryControllerWithMediaType:[self mediaType]];
+		IMBNode *node = identifier ? [libController nodeWithIdentifier:identifier] : nil;
+		node.icon = image;
+		[image release];
     }
-	return [image autorelease];
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+- (NSString *) _deviceKeyForICAObject:(id) anObjectID
+{
+	@synchronized( _deviceKeys )
+	{
+		return [[[_deviceKeys objectForKey:[anObjectID description]] retain] autorelease];
+	}
+	return nil;
+}
+
+- (void) _setDeviceKey:(NSString *) inDeviceKey forICAObject:(id) anObjectID
+{
+	if( !inDeviceKey || !anObjectID ) 
+		return;
+	
+	@synchronized( _deviceKeys )
+	{
+		[_deviceKeys setObject:inDeviceKey forKey:[anObjectID description]];
+	}
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma mark Thumbnail Queues:
+
+// Objects whose thumbnails are not in the cache yet are looked up in the background (as a large folder means 
+// thousands of stat calls), and then handed to the main thread...
+
+- (void) _prefetchThumbnailsForObjects:(NSArray *) inObjects
+{
+	NSArray *objects = [[inObjects copy] autorelease];
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW,0),^{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSMutableArray *uncachedObjects = [NSMutableArray array];
+		
+		for( MTPVisualObject *object in objects )
+		{
+			struct stat info;
+			
+			if( ![object isKindOfClass:[MTPVisualObject class]] ) 
+				continue;
+			if( object.thumbnailCachePath && stat([object.thumbnailCachePath fileSystemRepresentation],&info) == 0 ) 
+				continue;
+			
+			[uncachedObjects addObject:object];
+		}
+		
+		if( [uncachedObjects count] )
+			[self performSelectorOnMainThread:@selector(_queueThumbnailsForObjects:) withObject:uncachedObjects waitUntilDone:NO];
+		
+		[pool drain];
+	});
+}
+
+// Objects that need a thumbnail are appended to the queue of their device. The queues are only ever touched on the
+// main thread, which is also where ICA delivers the thumbnail callbacks...
+
+- (void) _queueThumbnailsForObjects:(NSArray *) inObjects
+{
+	NSMutableSet *deviceKeys = [NSMutableSet set];
+	
+	for( MTPVisualObject *object in inObjects )
+	{
+		if( ![object _needsThumbnail] ) 
+			continue;
+		
+		NSString *key = object.deviceKey ? object.deviceKey : @"";
+		NSMutableArray *queue = [_thumbnailQueues objectForKey:key];
+		if( !queue )
+		{
+			queue = [NSMutableArray array];
+			[_thumbnailQueues setObject:queue forKey:key];
+		}
+		
+		[queue addObject:object];
+		[deviceKeys addObject:key];
+	}
+	
+	for( NSString *key in deviceKeys )
+		[self _startThumbnailRequestsForDevice:key];
+}
+
+// A thumbnail that is needed for display right now jumps to the front of the queue...
+
+- (void) _requestThumbnailForObject:(MTPVisualObject *) inObject
+{
+	NSString *key = inObject.deviceKey ? inObject.deviceKey : @"";
+	NSMutableArray *queue = [_thumbnailQueues objectForKey:key];
+	if( !queue )
+	{
+		queue = [NSMutableArray array];
+		[_thumbnailQueues setObject:queue forKey:key];
+	}
+	
+	[queue insertObject:inObject atIndex:0];
+	[self _startThumbnailRequestsForDevice:key];
+}
+
+- (void) _startThumbnailRequestsForDevice:(NSString *) inDeviceKey
+{
+	NSMutableArray *queue = [_thumbnailQueues objectForKey:inDeviceKey];
+	
+	while( [_pendingThumbnails countForObject:inDeviceKey] < kIMBMaxPendingThumbnailsPerDevice && [queue count] )
+	{
+		MTPVisualObject *object = [[queue objectAtIndex:0] retain];
+		[queue removeObjectAtIndex:0];
+		
+		// Objects may be queued more than once, or may have been loaded in the meantime...
+		if( [object _needsThumbnail] )
+		{
+			[_pendingThumbnails addObject:inDeviceKey];
+			[object _getThumbnail];
+		}
+		
+		[object release];
+	}
+	
+	if( queue && ![queue count] ) 
+		[_thumbnailQueues removeObjectForKey:inDeviceKey];
+}
+
+- (void) _didLoadThumbnailForObject:(MTPVisualObject *) inObject
+{
+	NSString *key = inObject.deviceKey ? inObject.deviceKey : @"";
+	[_pendingThumbnails removeObject:key];
+	[self _startThumbnailRequestsForDevice:key];
 }
 
 #pragma mark Image Capture Notification Handling:
@@ -705,6 +1053,8 @@ static void ICANotificationCallback(CFStringRef notificationType, CFDictionaryRe
 #pragma mark -
 
 @implementation MTPVisualObject
+@synthesize deviceKey = _deviceKey;
+@synthesize thumbnailCachePath = _thumbnailCachePath;
 
 // ---------------------------------------------------------------------------------------------------------------------
 static void ICAThumbnailCallback (ICAHeader* pbHeader)
@@ -712,7 +1062,10 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
     // we use the refcon to get back to the ICAHandler
     MTPVisualObject * handler = (MTPVisualObject *)pbHeader->refcon;
     if (handler)
+	{
         [handler _gotThumbnailCallback: (ICACopyObjectThumbnailPB*) pbHeader];
+		[handler release];	// retained in _getThumbnail
+	}
 }
 
 - (id) init
@@ -726,6 +1079,13 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 	return self;
 }
 
+- (void) dealloc
+{
+	IMBRelease(_deviceKey);
+	IMBRelease(_thumbnailCachePath);
+	[super dealloc];
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 - (void) _gotThumbnailCallback: (ICACopyObjectThumbnailPB*)pbPtr
 {
@@ -735,12 +1095,21 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
         // got the thumbnail data, now create an image...
         NSData * data  = (NSData*)*(pbPtr->thumbnailData);		
  		self.imageRepresentation = data;
+		_IMBStoreThumbnail(data,self.thumbnailCachePath);
 		[data release];
 		
 		self.imageVersion = self.imageVersion + 1;
 		
 		DEBUGLOG( @"Received Thumbnail %@", self );
     }
+	
+	if( [self.parser isKindOfClass:[IMBImageCaptureParser class]] )
+		[(IMBImageCaptureParser *)self.parser _didLoadThumbnailForObject:self];
+}
+
+- (BOOL) _needsThumbnail
+{
+	return !_imageRepresentation && !self.isLoadingThumbnail;
 }
 
 - (void) _getThumbnail
@@ -748,11 +1117,18 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 	self.isLoadingThumbnail = YES;
     ICACopyObjectThumbnailPB    pb = { 0 };
     
-    pb.header.refcon   = (unsigned long) self;
+    pb.header.refcon   = (unsigned long) [self retain];	// released in ICAThumbnailCallback
     pb.thumbnailFormat = kICAThumbnailFormatJPEG;
     pb.object          = (ICAObject)[self.location integerValue];
     
-    ICACopyObjectThumbnail(&pb, ICAThumbnailCallback );
+    if( ICACopyObjectThumbnail(&pb, ICAThumbnailCallback ) != noErr )
+	{
+		// The callback will not be called, so clean up here (deferred, as we are called from the request queue)...
+		self.isLoadingThumbnail = NO;
+		if( [self.parser isKindOfClass:[IMBImageCaptureParser class]] )
+			[self.parser performSelector:@selector(_didLoadThumbnailForObject:) withObject:self afterDelay:0.0];
+		[self release];
+	}
 	
 	DEBUGLOG( @"Loading Thumbnail %@", self );
 }
@@ -760,8 +1136,15 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 // ---------------------------------------------------------------------------------------------------------------------
 - (NSImage *) imageRepresentation
 {
-	if ( !_imageRepresentation && !self.isLoadingThumbnail  ) {
-		[self _getThumbnail];
+	if ( [self _needsThumbnail] ) {
+		// A reconnected device has its thumbnails in the cache. Otherwise let the parser schedule the request...
+		NSData *data = self.thumbnailCachePath ? [NSData dataWithContentsOfFile:self.thumbnailCachePath] : nil;
+		if( data )
+			self.imageRepresentation = data;
+		else if( [self.parser isKindOfClass:[IMBImageCaptureParser class]] )
+			[(IMBImageCaptureParser *)self.parser _requestThumbnailForObject:self];
+		else
+			[self _getThumbnail];
 	}
 	return _imageRepresentation;
 }
@@ -814,6 +1197,11 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 	if( !CFURLGetFSRef ( (CFURLRef)[NSURL fileURLWithPath:self.downloadFolderPath], &downloadFolder ) ) 
 	{
 		NSLog( @"IMBMTPDownloadOperation: Can not download without dastination folder" );
+		
+		for( IMBObject *anObject in self.objectsToLoad )
+			[self.delegate operation:self didFailToDownloadObject:anObject error:[NSError errorWithDomain:NSOSStatusErrorDomain code:fnfErr userInfo:nil]];
+		
+		[pool drain];
 		return;
 	}
 	
@@ -839,33 +1227,31 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 		err = ICADownloadFile(&pb, nil);
 		if( !err ) 
 		{
+			NSString *path = nil;
 			NSURL *fileURL = NSMakeCollectable(CFURLCreateFromFSRef( kCFAllocatorDefault, &fileFSRef ));
 			if( fileURL )
 			{
-				[self.receivedFilePaths addObject:[fileURL path]];
+				path = [fileURL path];
+				@synchronized( self.receivedFilePaths ) 
+				{
+					[self.receivedFilePaths addObject:path];
+				}
 				[fileURL release];
 			}
 			
 			self.receivedBytes += [[anObject.metadata valueForKey:@"isiz"] longLongValue];
+			[self.delegate operation:self didDownloadObject:anObject toPath:path];
 			
-			if( [(id)self.delegate respondsToSelector:@selector( operationDidDownloadFile: )] )
-				[self.delegate operationDidDownloadFile:self];
-			
-			DEBUGLOG( @"Did download file %x to %@", pb.object, [self.receivedFilePaths lastObject] );
+			DEBUGLOG( @"Did download file %x to %@", pb.object, path );
 		}
 		
 		if( err )
 		{
 			DEBUGLOG( @"Failed to download file %x: Error %i", pb.object, err );
-
-			if( [(id)self.delegate respondsToSelector:@selector( operation:didReceiveError: )])
-				[self.delegate operation:self didReceiveError:[NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:nil]];
+			[self.delegate operation:self didFailToDownloadObject:anObject error:[NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:nil]];
 		}
 	}
 	
-	if( [(id)self.delegate respondsToSelector:@selector( operationDidFinish: )] )
-		[self.delegate operationDidFinish:self];
-	
 	[pool drain];
 }
 
@@ -885,12 +1271,37 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 
 @implementation IMBMTPObjectPromise
 @synthesize bytesTotal = _bytesTotal;
-@synthesize bytesDone = _bytesDone;
+
+- (long long) bytesDone
+{
+	return _bytesDone;
+}
 
 - (void) loadObjects:(NSArray*)inObjects
 {	
-	// Retain self until all download operations have finished. We are going to release self in the   
-	// didFinish: and didReceiveError: delegate messages...
+	// Only real device objects are downloaded, so these are the ones that we are waiting for...
+	
+	NSMutableArray* objects = [NSMutableArray arrayWithCapacity:[inObjects count]];
+	
+	for (IMBObject* object in inObjects)
+	{
+		if (![object isKindOfClass:[IMBNodeObject class]] && ![object isKindOfClass:[IMBButtonObject class]])
+		{
+			[objects addObject:object];
+		}
+	}
+	
+	_objectCountTotal = (int32_t)[objects count];
+	_bytesDone = 0;
+	
+	if (_objectCountTotal == 0)
+	{
+		_didRelease = 1;	// Nothing retained, so there is nothing for cancel: to release
+		[self performSelector:@selector(_didFinish)];
+		return;
+	}
+	
+	// Retain self until all objects have been downloaded. We are going to release self in _finishIfDone or cancel:...
 	
 	[self retain];
 	
@@ -898,32 +1309,99 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 	
 	[self prepareProgress];
 	
-	// Create ONE download operations...
-
-	IMBMTPDownloadOperation* op = [[[IMBMTPDownloadOperation alloc] initWithArrayOfObjects:inObjects delegate:self] autorelease];
-	op.downloadFolderPath = self.destinationDirectoryPath;
-	[self.downloadOperations addObject:op]; 
+	// Create one download operation per device, which fetches the files in order...
+	
+	NSMutableDictionary* batches = [NSMutableDictionary dictionary];
+	NSMutableArray* deviceKeys = [NSMutableArray array];
+	_totalBytes = 0;
 	
-	// Get combined file sizes so that the progress bar can be configured...
+	for (IMBObject* object in objects)
+	{
+		NSString* deviceKey = [object isKindOfClass:[MTPVisualObject class]] ? [(MTPVisualObject*)object deviceKey] : nil;
+		if (deviceKey == nil) deviceKey = @"";
+		
+		NSMutableArray* batch = [batches objectForKey:deviceKey];
+		
+		if (batch == nil)
+		{
+			batch = [NSMutableArray array];
+			[batches setObject:batch forKey:deviceKey];
+			[deviceKeys addObject:deviceKey];
+		}
+		
+		[batch addObject:object];
+	}
 	
-	_totalBytes = [op totalBytes];
+	for (NSString* deviceKey in deviceKeys)
+	{
+		IMBMTPDownloadOperation* op = [[[IMBMTPDownloadOperation alloc] initWithArrayOfObjects:[batches objectForKey:deviceKey] delegate:self] autorelease];
+		op.downloadFolderPath = self.destinationDirectoryPath;
+		[self.downloadOperations addObject:op]; 
+		
+		// Get combined file sizes so that the progress bar can be configured...
+		
+		_totalBytes += [op totalBytes];
+	}
 	
 	// Start downloading...
-	[[IMBOperationQueue sharedQueue] addOperation:op];
+	
+	for (NSUInteger i=0; i<[deviceKeys count]; i++)
+	{
+		[self _queueDownloadOperation:[self.downloadOperations objectAtIndex:i] forDevice:[deviceKeys objectAtIndex:i]];
+	}
+}
+
+
+// Operations for the same device run one after the other, even if they belong to different promises...
+
+- (void) _queueDownloadOperation:(IMBMTPDownloadOperation*)inOperation forDevice:(NSString*)inDeviceKey
+{
+	@synchronized([IMBMTPObjectPromise class])
+	{
+		if (sLastDownloadOperations == nil)
+		{
+			sLastDownloadOperations = [[NSMutableDictionary alloc] init];
+		}
+		
+		IMBMTPDownloadOperation* previous = [sLastDownloadOperations objectForKey:inDeviceKey];
+		
+		if (previous && ![previous isFinished])
+		{
+			[inOperation addDependency:previous];
+		}
+		
+		[sLastDownloadOperations setObject:inOperation forKey:inDeviceKey];
+	}
+	
+	[[IMBOperationQueue sharedQueue] addOperation:inOperation];
 }
 
 
 //----------------------------------------------------------------------------------------------------------------------
 
 
+// Either cancel: or the last download releases the promise, whoever gets to set _didRelease first. If all files 
+// have already arrived, then they belong to the delegate and there is nothing left to cancel. Otherwise the files
+// that we already have are deleted. Files that arrive while we are cancelling are deleted by the delegate methods, 
+// which see _wasCanceled (it is set before we take the lock on each operation's list of files)...
+
 - (IBAction) cancel:(id)inSender
 {
-	NSArray *receivedFiles = nil;
+	if( !OSAtomicCompareAndSwap32Barrier(0,1,&_didRelease) )
+		return;
+		
+	NSMutableArray *receivedFiles = [NSMutableArray array];
+	_wasCanceled = YES;
+	OSMemoryBarrier();
+	
 	// Cancel outstanding operations...
 	for (IMBMTPDownloadOperation* op in self.downloadOperations)
 	{
 		[op cancel];
-		receivedFiles = op.receivedFilePaths; // We have only one operation ;-)
+		@synchronized( op.receivedFilePaths )
+		{
+			[receivedFiles addObjectsFromArray:op.receivedFilePaths];
+		}
 	}
 
 	// Trash any files that we already have...
@@ -947,47 +1425,57 @@ static void ICAThumbnailCallback (ICAHeader* pbHeader)
 
 //----------------------------------------------------------------------------------------------------------------------
 
-// We received some data, so display the current progress... 
-- (void) operationDidDownloadFile:(IMBMTPDownloadOperation*)inOperation
-{
-	double fraction = (double)inOperation.receivedBytes / (double)_totalBytes;
-	[self displayProgress:fraction];
-}
- 
-
-// A download has finished. Store the path to the downloaded file. Once all downloads are complete, we can hide 
-// the progress UI, Notify the delegate and release self...
+// A file has been downloaded. Store the path to the downloaded file and display the current progress. The 
+// operations call this from their own threads, hence the lock around the promise's file URLs...
 
-- (void) operationDidFinish:(IMBMTPDownloadOperation*)inOperation
+- (void) operation:(IMBMTPDownloadOperation*)inOperation didDownloadObject:(IMBObject*)inObject toPath:(NSString*)inPath
 {
-	// [self.localFiles addObject:inOperation.localPath];
-	_objectCountLoaded++;
+	if ([self isCancelled])
+	{
+		if (inPath) [[NSFileManager imb_threadSafeManager] removeItemAtPath:inPath error:NULL];
+		return;
+	}
 	
-	if (_objectCountLoaded >= _objectCountTotal)
+	@synchronized(self)
 	{
-		NSLog(@"%s",__FUNCTION__);
-		[self performSelectorOnMainThread:@selector(_didFinish) 
-							   withObject:nil 
-							waitUntilDone:YES 
-									modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
-		
-		[self release];
-	}	  
+		[self setFileURL:(inPath ? [NSURL fileURLWithPath:inPath] : nil) error:nil forObject:inObject];
+	}
+	
+	long long bytesDone = OSAtomicAdd64Barrier([[inObject.metadata valueForKey:@"isiz"] longLongValue],&_bytesDone);
+	
+	if (_totalBytes > 0)
+	{
+		[self displayProgress:(double)bytesDone / (double)_totalBytes];
+	}
+	
+	[self _finishIfDone];
 }
 
 
 // If an error has occured in one of the downloads, then store the error instead of the file path, but everything 
 // else is the same as in the previous method...
 
-- (void) operation:(IMBMTPDownloadOperation*)inOperation didReceiveError:(NSError *) anError
+- (void) operation:(IMBMTPDownloadOperation*)inOperation didFailToDownloadObject:(IMBObject*)inObject error:(NSError *) anError
 {
-	// [self.localFiles addObject:anError];
-	self.error = anError;
-	_objectCountLoaded++;
+	if ([self isCancelled]) return;
 	
-	if (_objectCountLoaded >= _objectCountTotal)
+	@synchronized(self)
+	{
+		[self setFileURL:nil error:anError forObject:inObject];
+	}
+	
+	self.error = anError;
+	[self _finishIfDone];
+}
+
+
+// Once all objects are downloaded, we can hide the progress UI, notify the delegate and release self, unless the 
+// promise was cancelled in the meantime...
+
+- (void) _finishIfDone
+{
+	if ([self didLoadObject] && OSAtomicCompareAndSwap32Barrier(0,1,&_didRelease))
 	{
-		NSLog(@"%s",__FUNCTION__);
 		[self performSelectorOnMainThread:@selector(_didFinish) 
 							   withObject:nil 
 							waitUntilDone:YES 
@@ -0,0 +1,159 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// IMBImageHeaderReader extracts the few image properties that iMedia displays (pixel size, bit depth, color model, 
+// orientation and EXIF DateTimeOriginal) by parsing only the headers of an image file: JPEG APP1/SOF segments, TIFF
+// IFDs (which also covers TIFF based RAW formats like CR2, NEF, ARW, DNG, ORF, PEF or RW2), PNG IHDR/eXIf chunks and
+// ISO-BMFF boxes of HEIF/AVIF files. Typical files are handled with a few KB of reads (never more than 64 KB) and no
+// memory is allocated, which makes this a lot cheaper than opening a CGImageSource. The code is plain C without any 
+// dependency on Cocoa, so that it can be used from any thread. Tests/IMBImageHeaderReaderTests.c exercises it...
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+typedef enum
+{
+	kIMBImageColorModelUnknown = 0,
+	kIMBImageColorModelRGB,
+	kIMBImageColorModelGray,
+	kIMBImageColorModelCMYK,
+	kIMBImageColorModelLab
+}
+IMBImageColorModel;
+
+typedef enum
+{
+	kIMBImageFormatUnknown = 0,
+	kIMBImageFormatJPEG,
+	kIMBImageFormatTIFF,
+	kIMBImageFormatPNG,
+	kIMBImageFormatHEIF
+}
+IMBImageFormat;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark TYPES
+
+typedef struct
+{
+	IMBImageFormat format;
+	uint32_t width;							// Pixel size of the (primary) image, 0 if unknown
+	uint32_t height;
+	uint32_t depth;							// Bits per sample, 0 if unknown
+	IMBImageColorModel colorModel;
+	uint32_t orientation;					// EXIF orientation (1-8), 0 if unknown
+	char dateTimeOriginal[20];				// EXIF format "YYYY:MM:DD HH:MM:SS", empty string if unknown
+}
+IMBImageHeaderInfo;
+
+// Location of a JPEG preview that is embedded in an image file (EXIF thumbnail or RAW preview)...
+
+typedef struct
+{
+	uint64_t offset;						// File offset of the JPEG stream
+	uint32_t length;						// Length of the JPEG stream in bytes
+	uint32_t width;							// Pixel size of the preview (not oriented)
+	uint32_t height;
+}
+IMBImagePreviewInfo;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark FUNCTIONS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Both functions return true if at least the pixel size of the image could be determined. Whatever else was found 
+// is filled into outInfo in any case...
+
+bool IMBImageHeaderReadFile(const char* inPath,IMBImageHeaderInfo* outInfo);
+bool IMBImageHeaderReadFileDescriptor(int inFileDescriptor,IMBImageHeaderInfo* outInfo);
+
+// Returns the embedded JPEG preview with the smallest size whose longer side is at least inMinPixelSize. Looks at
+// the EXIF thumbnail of JPEG files as well as the preview IFDs of TIFF based RAW files. The EXIF orientation of the
+// main image is returned in outOrientation (0 if unknown), since previews usually carry no orientation of their
+// own. Returns false if there is no preview that is large enough. Note that standard EXIF thumbnails are only 160
+// pixels wide, so a minimum size above that restricts the search to RAW previews in practice...
+
+bool IMBImageHeaderFindPreview(const char* inPath,uint32_t inMinPixelSize,IMBImagePreviewInfo* outPreview,uint32_t* outOrientation);
+bool IMBImageHeaderFindPreviewInFileDescriptor(int inFileDescriptor,uint32_t inMinPixelSize,IMBImagePreviewInfo* outPreview,uint32_t* outOrientation);
+
+// Returns the name of the color model as used by kCGImagePropertyColorModel, or NULL if unknown...
+
+const char* IMBImageHeaderColorModelName(IMBImageColorModel inColorModel);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
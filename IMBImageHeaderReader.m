@@ -0,0 +1,1344 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include "IMBImageHeaderReader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Number of bytes that may be read from a single file. This covers the headers of typical JPEG, PNG and TIFF files.
+// Structures whose size is stated in the file (IFDs, HEIF boxes) may raise the budget when they need to, but never
+// beyond the hard limit, which guarantees bounded work for corrupt or hostile files...
+
+#define kIMBHeaderReadBudget (4 * 1024)
+#define kIMBHeaderReadLimit (64 * 1024)
+
+// Limits for walking data structures...
+
+#define kIMBMaxJPEGSegments 64
+#define kIMBMaxIFDEntries 256
+#define kIMBMaxIFDs 8
+#define kIMBMaxSubIFDs 4
+#define kIMBMaxPNGChunks 32
+#define kIMBMaxBoxes 64
+#define kIMBMaxItemProperties 1024
+#define kIMBMaxItemAssociations 32
+#define kIMBMaxBoxPayload 8192
+#define kIMBMaxPreviewCandidates 8
+
+// TIFF tags...
+
+#define kTIFFTagNewSubfileType 0x00FE
+#define kTIFFTagImageWidth 0x0100
+#define kTIFFTagImageLength 0x0101
+#define kTIFFTagBitsPerSample 0x0102
+#define kTIFFTagCompression 0x0103
+#define kTIFFTagPhotometric 0x0106
+#define kTIFFTagStripOffsets 0x0111
+#define kTIFFTagOrientation 0x0112
+#define kTIFFTagStripByteCounts 0x0117
+#define kTIFFTagSubIFDs 0x014A
+#define kTIFFTagJPEGInterchangeFormat 0x0201
+#define kTIFFTagJPEGInterchangeFormatLength 0x0202
+#define kTIFFTagExifIFD 0x8769
+#define kTIFFTagDateTimeOriginal 0x9003
+#define kTIFFTagPixelXDimension 0xA002
+#define kTIFFTagPixelYDimension 0xA003
+
+// TIFF field types...
+
+#define kTIFFTypeByte 1
+#define kTIFFTypeASCII 2
+#define kTIFFTypeShort 3
+#define kTIFFTypeLong 4
+#define kTIFFTypeIFD 13
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark TYPES
+
+// All file access goes through this reader, which enforces the read budget...
+
+typedef struct
+{
+	int fd;
+	uint64_t fileSize;
+	uint32_t bytesRead;
+	uint32_t budget;
+}
+IMBHeaderReader;
+
+// A TIFF structure embedded somewhere in the file (standalone, in a JPEG APP1 segment, a PNG eXIf chunk or a 
+// HEIF Exif item). All offsets inside the structure are relative to base...
+
+typedef struct
+{
+	IMBHeaderReader* reader;
+	uint64_t base;
+	uint64_t length;
+	bool bigEndian;
+}
+IMBTIFFContext;
+
+// The subset of an IFD that we care about...
+
+typedef struct
+{
+	uint32_t newSubfileType;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bitsPerSample;
+	uint32_t photometric;
+	uint32_t compression;
+	uint32_t orientation;
+	uint32_t stripCount;
+	uint32_t stripOffset;
+	uint32_t stripByteCount;
+	uint32_t jpegOffset;
+	uint32_t jpegLength;
+	uint32_t exifOffset;
+	uint32_t subIFDOffsets[kIMBMaxSubIFDs];
+	uint32_t subIFDCount;
+	uint32_t nextIFDOffset;
+	uint32_t pixelXDimension;
+	uint32_t pixelYDimension;
+	char dateTimeOriginal[20];
+}
+IMBTIFFDirectory;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Reading
+
+static bool _IMBRead(IMBHeaderReader* inReader,uint64_t inOffset,void* outBuffer,uint32_t inLength)
+{
+	if (inLength == 0) return true;
+	if (inOffset > inReader->fileSize || inLength > inReader->fileSize - inOffset) return false;
+	if (inLength > inReader->budget - inReader->bytesRead) return false;
+	
+	inReader->bytesRead += inLength;
+	
+	uint8_t* buffer = (uint8_t*)outBuffer;
+	uint32_t done = 0;
+	
+	while (done < inLength)
+	{
+		ssize_t n = pread(inReader->fd,buffer+done,inLength-done,(off_t)(inOffset+done));
+		
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		done += (uint32_t)n;
+	}
+	
+	return true;
+}
+
+
+// Makes sure that the next inLength bytes can be read, if the hard limit allows it...
+
+static void _IMBGrowBudget(IMBHeaderReader* inReader,uint32_t inLength)
+{
+	uint32_t needed = inReader->bytesRead + inLength;
+	if (needed < inReader->bytesRead) return;
+	
+	if (needed > inReader->budget)
+	{
+		inReader->budget = needed < kIMBHeaderReadLimit ? needed : kIMBHeaderReadLimit;
+	}
+}
+
+
+static inline uint16_t _IMBBigU16(const uint8_t* p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+static inline uint32_t _IMBBigU32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+static inline uint64_t _IMBBigU64(const uint8_t* p)
+{
+	return ((uint64_t)_IMBBigU32(p) << 32) | (uint64_t)_IMBBigU32(p+4);
+}
+
+
+// Reads an unsigned integer of 0, 4 or 8 bytes (as used by the iloc box)...
+
+static inline uint64_t _IMBBigUN(const uint8_t* p,uint32_t inSize)
+{
+	if (inSize == 4) return _IMBBigU32(p);
+	if (inSize == 8) return _IMBBigU64(p);
+	return 0;
+}
+
+
+static inline uint16_t _IMBTIFFU16(const IMBTIFFContext* inContext,const uint8_t* p)
+{
+	return inContext->bigEndian ? _IMBBigU16(p) : (uint16_t)(p[0] | (p[1] << 8));
+}
+
+
+static inline uint32_t _IMBTIFFU32(const IMBTIFFContext* inContext,const uint8_t* p)
+{
+	return inContext->bigEndian ? _IMBBigU32(p) : ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+
+static bool _IMBTIFFRead(IMBTIFFContext* inContext,uint32_t inOffset,void* outBuffer,uint32_t inLength)
+{
+	if (inOffset > inContext->length || inLength > inContext->length - inOffset) return false;
+	return _IMBRead(inContext->reader,inContext->base + inOffset,outBuffer,inLength);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark TIFF
+
+
+// Returns the first value of a numeric IFD entry. Values that do not fit into the entry itself are read from 
+// their offset...
+
+static uint32_t _IMBTIFFEntryValue(IMBTIFFContext* inContext,const uint8_t* inEntry)
+{
+	uint16_t type = _IMBTIFFU16(inContext,inEntry+2);
+	uint32_t count = _IMBTIFFU32(inContext,inEntry+4);
+	const uint8_t* value = inEntry+8;
+	uint8_t buffer[4];
+	uint32_t size = 0;
+	
+	if (type == kTIFFTypeByte) size = 1;
+	else if (type == kTIFFTypeShort) size = 2;
+	else if (type == kTIFFTypeLong || type == kTIFFTypeIFD) size = 4;
+	else return 0;
+	
+	if (count > 4 / size)
+	{
+		if (!_IMBTIFFRead(inContext,_IMBTIFFU32(inContext,value),buffer,size)) return 0;
+		value = buffer;
+	}
+	
+	if (type == kTIFFTypeShort) return _IMBTIFFU16(inContext,value);
+	if (type == kTIFFTypeLong || type == kTIFFTypeIFD) return _IMBTIFFU32(inContext,value);
+	if (type == kTIFFTypeByte) return value[0];
+	return 0;
+}
+
+
+static void _IMBTIFFEntryString(IMBTIFFContext* inContext,const uint8_t* inEntry,char* outString,uint32_t inSize)
+{
+	uint16_t type = _IMBTIFFU16(inContext,inEntry+2);
+	uint32_t count = _IMBTIFFU32(inContext,inEntry+4);
+	
+	outString[0] = 0;
+	if (type != kTIFFTypeASCII || count == 0) return;
+	if (count > inSize) count = inSize;
+	
+	if (count <= 4)
+	{
+		memcpy(outString,inEntry+8,count);
+	}
+	else if (!_IMBTIFFRead(inContext,_IMBTIFFU32(inContext,inEntry+8),outString,count))
+	{
+		outString[0] = 0;
+		return;
+	}
+	
+	outString[count < inSize ? count : inSize-1] = 0;
+}
+
+
+// Reads a whole IFD with a single read and extracts the tags we are interested in...
+
+static bool _IMBTIFFReadDirectory(IMBTIFFContext* inContext,uint32_t inOffset,IMBTIFFDirectory* outDirectory)
+{
+	uint8_t buffer[2 + kIMBMaxIFDEntries*12 + 4];
+	
+	memset(outDirectory,0,sizeof(IMBTIFFDirectory));
+	if (inOffset == 0 || !_IMBTIFFRead(inContext,inOffset,buffer,2)) return false;
+	
+	uint32_t count = _IMBTIFFU16(inContext,buffer);
+	if (count == 0) return false;
+	if (count > kIMBMaxIFDEntries) count = kIMBMaxIFDEntries;
+	
+	// The next IFD offset may be missing in truncated files, so read it separately...
+	
+	_IMBGrowBudget(inContext->reader,count*12+4);
+	if (!_IMBTIFFRead(inContext,inOffset+2,buffer+2,count*12)) return false;
+	if (_IMBTIFFRead(inContext,inOffset+2+count*12,buffer+2+count*12,4))
+	{
+		outDirectory->nextIFDOffset = _IMBTIFFU32(inContext,buffer+2+count*12);
+	}
+	
+	for (uint32_t i=0; i<count; i++)
+	{
+		const uint8_t* entry = buffer + 2 + i*12;
+		uint16_t tag = _IMBTIFFU16(inContext,entry);
+		
+		switch (tag)
+		{
+			case kTIFFTagNewSubfileType:	outDirectory->newSubfileType = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagImageWidth:		outDirectory->width = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagImageLength:		outDirectory->height = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagBitsPerSample:		outDirectory->bitsPerSample = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagPhotometric:		outDirectory->photometric = _IMBTIFFEntryValue(inContext,entry) + 1; break;	// 0 is a valid value
+			case kTIFFTagCompression:		outDirectory->compression = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagStripByteCounts:	outDirectory->stripByteCount = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagJPEGInterchangeFormat:			outDirectory->jpegOffset = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagJPEGInterchangeFormatLength:	outDirectory->jpegLength = _IMBTIFFEntryValue(inContext,entry); break;
+			
+			case kTIFFTagStripOffsets:
+				outDirectory->stripCount = _IMBTIFFU32(inContext,entry+4);
+				outDirectory->stripOffset = _IMBTIFFEntryValue(inContext,entry);
+				break;
+			case kTIFFTagOrientation:		outDirectory->orientation = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagExifIFD:			outDirectory->exifOffset = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagPixelXDimension:	outDirectory->pixelXDimension = _IMBTIFFEntryValue(inContext,entry); break;
+			case kTIFFTagPixelYDimension:	outDirectory->pixelYDimension = _IMBTIFFEntryValue(inContext,entry); break;
+			
+			case kTIFFTagDateTimeOriginal:
+				_IMBTIFFEntryString(inContext,entry,outDirectory->dateTimeOriginal,sizeof(outDirectory->dateTimeOriginal));
+				break;
+				
+			case kTIFFTagSubIFDs:
+			{
+				uint16_t type = _IMBTIFFU16(inContext,entry+2);
+				uint32_t n = _IMBTIFFU32(inContext,entry+4);
+				if (n > kIMBMaxSubIFDs) n = kIMBMaxSubIFDs;
+				
+				if (n == 1)
+				{
+					outDirectory->subIFDOffsets[0] = _IMBTIFFEntryValue(inContext,entry);
+					outDirectory->subIFDCount = 1;
+				}
+				else if (n > 1 && (type == kTIFFTypeLong || type == kTIFFTypeIFD))
+				{
+					uint8_t offsets[kIMBMaxSubIFDs*4];
+					
+					if (_IMBTIFFRead(inContext,_IMBTIFFU32(inContext,entry+8),offsets,n*4))
+					{
+						for (uint32_t j=0; j<n; j++) outDirectory->subIFDOffsets[j] = _IMBTIFFU32(inContext,offsets+j*4);
+						outDirectory->subIFDCount = n;
+					}
+				}
+				break;
+			}
+				
+			default:
+				break;
+		}
+	}
+	
+	return true;
+}
+
+
+static IMBImageColorModel _IMBColorModelForPhotometric(uint32_t inPhotometric)
+{
+	switch (inPhotometric)
+	{
+		case 0:
+		case 1:		return kIMBImageColorModelGray;
+		case 2:
+		case 3:
+		case 6:
+		case 32803:	// CFA
+		case 34892:	// LinearRaw
+					return kIMBImageColorModelRGB;
+		case 5:		return kIMBImageColorModelCMYK;
+		case 8:
+		case 9:
+		case 10:	return kIMBImageColorModelLab;
+		default:	return kIMBImageColorModelUnknown;
+	}
+}
+
+
+// Remember the largest full resolution image in the file. RAW files usually contain several IFDs with reduced 
+// resolution previews (NewSubfileType bit 0 set) in addition to the actual sensor data...
+
+static void _IMBTIFFConsiderDirectory(const IMBTIFFDirectory* inDirectory,IMBImageHeaderInfo* ioInfo)
+{
+	if ((inDirectory->newSubfileType & 1) != 0) return;
+	if (inDirectory->width == 0 || inDirectory->height == 0) return;
+	
+	uint64_t area = (uint64_t)inDirectory->width * (uint64_t)inDirectory->height;
+	uint64_t bestArea = (uint64_t)ioInfo->width * (uint64_t)ioInfo->height;
+	
+	if (area > bestArea)
+	{
+		ioInfo->width = inDirectory->width;
+		ioInfo->height = inDirectory->height;
+		ioInfo->depth = inDirectory->bitsPerSample;
+		
+		if (inDirectory->photometric)
+		{
+			ioInfo->colorModel = _IMBColorModelForPhotometric(inDirectory->photometric - 1);
+		}
+	}
+}
+
+
+// Reads the TIFF header, determines the byte order and returns the offset of IFD0...
+
+static bool _IMBTIFFOpen(IMBTIFFContext* ioContext,uint32_t* outFirstIFDOffset)
+{
+	uint8_t header[8];
+	
+	if (!_IMBTIFFRead(ioContext,0,header,8)) return false;
+	
+	if (header[0] == 'M' && header[1] == 'M') ioContext->bigEndian = true;
+	else if (header[0] == 'I' && header[1] == 'I') ioContext->bigEndian = false;
+	else return false;
+	
+	// Accept regular TIFF (42) as well as the variants used by Panasonic (0x55) and Olympus (0x4F52, 0x5352)...
+	
+	uint16_t magic = _IMBTIFFU16(ioContext,header+2);
+	if (magic != 42 && magic != 0x55 && magic != 0x4F52 && magic != 0x5352) return false;
+	
+	*outFirstIFDOffset = _IMBTIFFU32(ioContext,header+4);
+	return true;
+}
+
+
+// Parses a TIFF structure. If inWantsImageSize is false (EXIF in JPEG, PNG or HEIF), only orientation and date
+// are extracted, since IFD0 only describes the embedded thumbnail in that case...
+
+static bool _IMBParseTIFF(IMBHeaderReader* inReader,uint64_t inBase,uint64_t inLength,bool inWantsImageSize,IMBImageHeaderInfo* ioInfo)
+{
+	IMBTIFFContext context = { inReader, inBase, inLength, false };
+	IMBTIFFDirectory directory;
+	uint32_t offset = 0;
+	uint32_t exifOffset = 0;
+	
+	if (!_IMBTIFFOpen(&context,&offset)) return false;
+	
+	for (uint32_t i=0; i<kIMBMaxIFDs && offset != 0; i++)
+	{
+		if (!_IMBTIFFReadDirectory(&context,offset,&directory)) break;
+		
+		if (i == 0)
+		{
+			exifOffset = directory.exifOffset;
+			if (directory.orientation) ioInfo->orientation = directory.orientation;
+		}
+		
+		if (!inWantsImageSize) break;
+		
+		// A full resolution IFD0 is the image itself (plain TIFF or CR2). Further IFDs are just additional pages.
+		// Otherwise (DNG, NEF, ARW) IFD0 is a thumbnail and the actual image is found in a SubIFD...
+		
+		_IMBTIFFConsiderDirectory(&directory,ioInfo);
+		if (i == 0 && ioInfo->width != 0) break;
+		
+		uint32_t subIFDCount = directory.subIFDCount;
+		uint32_t subIFDOffsets[kIMBMaxSubIFDs];
+		memcpy(subIFDOffsets,directory.subIFDOffsets,sizeof(subIFDOffsets));
+		uint32_t nextOffset = directory.nextIFDOffset;
+		
+		for (uint32_t j=0; j<subIFDCount; j++)
+		{
+			IMBTIFFDirectory subDirectory;
+			
+			if (_IMBTIFFReadDirectory(&context,subIFDOffsets[j],&subDirectory))
+			{
+				_IMBTIFFConsiderDirectory(&subDirectory,ioInfo);
+			}
+		}
+		
+		if (nextOffset == offset) break;
+		offset = nextOffset;
+	}
+	
+	if (exifOffset && _IMBTIFFReadDirectory(&context,exifOffset,&directory))
+	{
+		if (directory.dateTimeOriginal[0])
+		{
+			memcpy(ioInfo->dateTimeOriginal,directory.dateTimeOriginal,sizeof(ioInfo->dateTimeOriginal));
+		}
+		
+		if (inWantsImageSize && ioInfo->width == 0 && directory.pixelXDimension && directory.pixelYDimension)
+		{
+			ioInfo->width = directory.pixelXDimension;
+			ioInfo->height = directory.pixelYDimension;
+		}
+	}
+	
+	return true;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark JPEG
+
+
+// Walks the marker segments up to the start of scan. APP1 provides the EXIF data, SOFn the image size. Optionally
+// returns the location of the EXIF TIFF structure and the type of the frame marker...
+
+static bool _IMBParseJPEG(IMBHeaderReader* inReader,uint64_t inOffset,IMBImageHeaderInfo* ioInfo,uint64_t* outExifBase,uint64_t* outExifLength,uint8_t* outFrameType)
+{
+	uint64_t offset = inOffset + 2;
+	bool foundExif = false;
+	uint8_t soi[2];
+	
+	if (!_IMBRead(inReader,inOffset,soi,2) || soi[0] != 0xFF || soi[1] != 0xD8) return false;
+	
+	for (uint32_t i=0; i<kIMBMaxJPEGSegments; i++)
+	{
+		uint8_t marker[4];
+		if (!_IMBRead(inReader,offset,marker,4)) break;
+		if (marker[0] != 0xFF) break;
+		
+		// Skip fill bytes...
+		
+		if (marker[1] == 0xFF)
+		{
+			offset++;
+			continue;
+		}
+		
+		uint8_t type = marker[1];
+		uint16_t length = _IMBBigU16(marker+2);
+		
+		if (type == 0xD9 || type == 0xDA) break;							// EOI or SOS
+		if (type == 0x01 || (type >= 0xD0 && type <= 0xD7))				// Standalone markers
+		{
+			offset += 2;
+			continue;
+		}
+		if (length < 2) break;
+		
+		if (type == 0xE1 && !foundExif && length >= 16)
+		{
+			uint8_t signature[6];
+			
+			if (_IMBRead(inReader,offset+4,signature,6) && memcmp(signature,"Exif\0\0",6) == 0)
+			{
+				foundExif = _IMBParseTIFF(inReader,offset+10,length-8,false,ioInfo);
+				
+				if (foundExif)
+				{
+					if (outExifBase) *outExifBase = offset+10;
+					if (outExifLength) *outExifLength = length-8;
+				}
+			}
+		}
+		else if (type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC)
+		{
+			uint8_t frame[6];
+			
+			if (_IMBRead(inReader,offset+4,frame,6))
+			{
+				if (outFrameType) *outFrameType = type;
+				ioInfo->depth = frame[0];
+				ioInfo->height = _IMBBigU16(frame+1);
+				ioInfo->width = _IMBBigU16(frame+3);
+				
+				switch (frame[5])
+				{
+					case 1:		ioInfo->colorModel = kIMBImageColorModelGray; break;
+					case 3:		ioInfo->colorModel = kIMBImageColorModelRGB; break;
+					case 4:		ioInfo->colorModel = kIMBImageColorModelCMYK; break;
+					default:	break;
+				}
+			}
+			
+			// The frame header comes after the APP segments, so there is nothing left to find...
+			
+			break;
+		}
+		
+		offset += 2 + length;
+	}
+	
+	return ioInfo->width != 0 && ioInfo->height != 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark PNG
+
+
+static bool _IMBParsePNG(IMBHeaderReader* inReader,IMBImageHeaderInfo* ioInfo)
+{
+	uint64_t offset = 8;
+	
+	for (uint32_t i=0; i<kIMBMaxPNGChunks; i++)
+	{
+		uint8_t chunk[8+13];
+		if (!_IMBRead(inReader,offset,chunk,8)) break;
+		
+		uint32_t length = _IMBBigU32(chunk);
+		const uint8_t* type = chunk+4;
+		
+		if (memcmp(type,"IHDR",4) == 0)
+		{
+			if (length < 13 || !_IMBRead(inReader,offset+8,chunk+8,13)) return false;
+			
+			ioInfo->width = _IMBBigU32(chunk+8);
+			ioInfo->height = _IMBBigU32(chunk+12);
+			ioInfo->depth = chunk[16];
+			
+			uint8_t colorType = chunk[17];
+			ioInfo->colorModel = (colorType == 0 || colorType == 4) ? kIMBImageColorModelGray : kIMBImageColorModelRGB;
+		}
+		else if (memcmp(type,"eXIf",4) == 0)
+		{
+			_IMBParseTIFF(inReader,offset+8,length,false,ioInfo);
+		}
+		else if (memcmp(type,"IDAT",4) == 0 || memcmp(type,"IEND",4) == 0)
+		{
+			break;
+		}
+		
+		offset += 12 + (uint64_t)length;
+	}
+	
+	return ioInfo->width != 0 && ioInfo->height != 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark HEIF
+
+
+// Reads a box header at the given offset. Returns false if there is no valid box within the given range...
+
+static bool _IMBReadBoxHeader(IMBHeaderReader* inReader,uint64_t inOffset,uint64_t inEnd,char outType[4],uint64_t* outPayloadOffset,uint64_t* outBoxEnd)
+{
+	uint8_t header[16];
+	
+	if (inOffset + 8 > inEnd || !_IMBRead(inReader,inOffset,header,8)) return false;
+	
+	uint64_t size = _IMBBigU32(header);
+	uint64_t headerSize = 8;
+	memcpy(outType,header+4,4);
+	
+	if (size == 1)
+	{
+		if (inOffset + 16 > inEnd || !_IMBRead(inReader,inOffset+8,header+8,8)) return false;
+		size = _IMBBigU64(header+8);
+		headerSize = 16;
+	}
+	else if (size == 0)
+	{
+		size = inEnd - inOffset;
+	}
+	
+	if (size < headerSize || size > inEnd - inOffset) return false;
+	
+	*outPayloadOffset = inOffset + headerSize;
+	*outBoxEnd = inOffset + size;
+	return true;
+}
+
+
+// Reads the payload of a box into a buffer. Payloads that are larger than the buffer are truncated, which is fine
+// for our purposes as the parsers below never read beyond the returned length...
+
+static uint32_t _IMBReadBoxPayload(IMBHeaderReader* inReader,uint64_t inOffset,uint64_t inEnd,uint8_t* outBuffer,uint32_t inBufferSize)
+{
+	uint64_t length = inEnd - inOffset;
+	if (length > inBufferSize) length = inBufferSize;
+	_IMBGrowBudget(inReader,(uint32_t)length);
+	if (!_IMBRead(inReader,inOffset,outBuffer,(uint32_t)length)) return 0;
+	return (uint32_t)length;
+}
+
+
+typedef struct
+{
+	uint32_t primaryItemID;
+	uint32_t exifItemID;
+	uint64_t exifOffset;
+	uint64_t exifLength;
+	uint16_t associations[kIMBMaxItemAssociations];	// 1-based (15 bit) property indexes for the primary item
+	uint32_t associationCount;
+	uint32_t width;									// Properties of the primary item, 0 if unknown
+	uint32_t height;
+	uint32_t depth;
+	uint32_t orientation;
+	uint32_t largestWidth;
+	uint32_t largestHeight;
+}
+IMBHEIFState;
+
+
+static bool _IMBIsPrimaryItemProperty(const IMBHEIFState* inState,uint32_t inIndex)
+{
+	for (uint32_t i=0; i<inState->associationCount; i++)
+	{
+		if (inState->associations[i] == inIndex) return true;
+	}
+	
+	return false;
+}
+
+
+// Item property container: apply the ispe (size), pixi (bit depth) and irot (rotation) properties that are 
+// associated with the primary item. Must be called after _IMBParseIPMA. All ispe properties are looked at, so
+// that we can fall back to the largest image size in the file...
+
+static void _IMBParseIPCO(IMBHeaderReader* inReader,uint64_t inOffset,uint64_t inEnd,IMBHEIFState* ioState)
+{
+	uint64_t offset = inOffset;
+	
+	for (uint32_t i=0; i<kIMBMaxItemProperties; i++)
+	{
+		char type[4];
+		uint64_t payload,end;
+		_IMBGrowBudget(inReader,8);
+		if (!_IMBReadBoxHeader(inReader,offset,inEnd,type,&payload,&end)) break;
+		
+		bool isPrimary = _IMBIsPrimaryItemProperty(ioState,i+1);
+		uint8_t buffer[16];
+		
+		if (memcmp(type,"ispe",4) == 0 && _IMBReadBoxPayload(inReader,payload,end,buffer,12) == 12)
+		{
+			uint32_t width = _IMBBigU32(buffer+4);
+			uint32_t height = _IMBBigU32(buffer+8);
+			
+			if (isPrimary)
+			{
+				ioState->width = width;
+				ioState->height = height;
+			}
+			
+			if ((uint64_t)width * height > (uint64_t)ioState->largestWidth * ioState->largestHeight)
+			{
+				ioState->largestWidth = width;
+				ioState->largestHeight = height;
+			}
+		}
+		else if (isPrimary && memcmp(type,"pixi",4) == 0 && _IMBReadBoxPayload(inReader,payload,end,buffer,6) >= 6)
+		{
+			if (buffer[4]) ioState->depth = buffer[5];
+		}
+		else if (isPrimary && memcmp(type,"irot",4) == 0 && _IMBReadBoxPayload(inReader,payload,end,buffer,1) == 1)
+		{
+			static const uint32_t kOrientations[4] = { 1,8,3,6 };	// counter-clockwise rotation to EXIF orientation
+			ioState->orientation = kOrientations[buffer[0] & 3];
+		}
+		
+		offset = end;
+	}
+}
+
+
+// Item property associations: find the property indexes of the primary item...
+
+static void _IMBParseIPMA(IMBHeaderReader* inReader,uint64_t inOffset,uint64_t inEnd,IMBHEIFState* ioState)
+{
+	uint8_t buffer[kIMBMaxBoxPayload];
+	uint32_t length = _IMBReadBoxPayload(inReader,inOffset,inEnd,buffer,sizeof(buffer));
+	if (length < 8) return;
+	
+	uint8_t version = buffer[0];
+	bool largeIndexes = (buffer[3] & 1) != 0;
+	uint32_t entryCount = _IMBBigU32(buffer+4);
+	uint32_t pos = 8;
+	
+	for (uint32_t i=0; i<entryCount; i++)
+	{
+		uint32_t itemID;
+		
+		if (version < 1)
+		{
+			if (pos + 3 > length) return;
+			itemID = _IMBBigU16(buffer+pos);
+			pos += 2;
+		}
+		else
+		{
+			if (pos + 5 > length) return;
+			itemID = _IMBBigU32(buffer+pos);
+			pos += 4;
+		}
+		
+		uint8_t count = buffer[pos++];
+		uint32_t size = largeIndexes ? 2 : 1;
+		if (pos + count*size > length) return;
+		
+		if (itemID == ioState->primaryItemID)
+		{
+			for (uint32_t j=0; j<count && ioState->associationCount<kIMBMaxItemAssociations; j++)
+			{
+				uint16_t index = largeIndexes ? (_IMBBigU16(buffer+pos+j*2) & 0x7FFF) : (buffer[pos+j] & 0x7F);
+				if (index > 0) ioState->associations[ioState->associationCount++] = index;
+			}
+			return;
+		}
+		
+		pos += count*size;
+	}
+}
+
+
+// Item info: find the item id of the Exif metadata item...
+
+static void _IMBParseIINF(IMBHeaderReader* inReader,uint64_t inOffset,uint64_t inEnd,IMBHEIFState* ioState)
+{
+	uint8_t header[8];
+	if (_IMBReadBoxPayload(inReader,inOffset,inEnd,header,6) < 6) return;
+	
+	uint64_t offset = inOffset + (header[0] == 0 ? 6 : 8);
+	
+	for (uint32_t i=0; i<kIMBMaxBoxes; i++)
+	{
+		char type[4];
+		uint64_t payload,end;
+		if (!_IMBReadBoxHeader(inReader,offset,inEnd,type,&payload,&end)) break;
+		
+		if (memcmp(type,"infe",4) == 0)
+		{
+			uint8_t buffer[16];
+			uint32_t length = _IMBReadBoxPayload(inReader,payload,end,buffer,sizeof(buffer));
+			
+			if (length >= 12 && buffer[0] == 2 && memcmp(buffer+8,"Exif",4) == 0)
+			{
+				ioState->exifItemID = _IMBBigU16(buffer+4);
+				return;
+			}
+			else if (length >= 14 && buffer[0] == 3 && memcmp(buffer+10,"Exif",4) == 0)
+			{
+				ioState->exifItemID = _IMBBigU32(buffer+4);
+				return;
+			}
+		}
+		
+		offset = end;
+	}
+}
+
+
+// Item locations: find the file offset of the Exif item. Only items stored in the file itself (construction
+// method 0) are supported...
+
+static void _IMBParseILOC(IMBHeaderReader* inReader,uint64_t inOffset,uint64_t inEnd,IMBHEIFState* ioState)
+{
+	uint8_t buffer[kIMBMaxBoxPayload];
+	uint32_t length = _IMBReadBoxPayload(inReader,inOffset,inEnd,buffer,sizeof(buffer));
+	if (length < 8 || ioState->exifItemID == 0) return;
+	
+	uint8_t version = buffer[0];
+	uint32_t offsetSize = buffer[4] >> 4;
+	uint32_t lengthSize = buffer[4] & 0x0F;
+	uint32_t baseOffsetSize = buffer[5] >> 4;
+	uint32_t indexSize = (version == 1 || version == 2) ? (buffer[5] & 0x0F) : 0;
+	uint32_t pos = 6;
+	uint32_t itemCount;
+	
+	if (version < 2)
+	{
+		itemCount = _IMBBigU16(buffer+pos);
+		pos += 2;
+	}
+	else
+	{
+		itemCount = _IMBBigU32(buffer+pos);
+		pos += 4;
+	}
+	
+	for (uint32_t i=0; i<itemCount; i++)
+	{
+		uint32_t itemID;
+		uint32_t constructionMethod = 0;
+		
+		if (version < 2)
+		{
+			if (pos + 2 > length) return;
+			itemID = _IMBBigU16(buffer+pos);
+			pos += 2;
+		}
+		else
+		{
+			if (pos + 4 > length) return;
+			itemID = _IMBBigU32(buffer+pos);
+			pos += 4;
+		}
+		
+		if (version == 1 || version == 2)
+		{
+			if (pos + 2 > length) return;
+			constructionMethod = _IMBBigU16(buffer+pos) & 0x0F;
+			pos += 2;
+		}
+		
+		if (pos + 2 + baseOffsetSize + 2 > length) return;
+		pos += 2;	// data reference index
+		uint64_t baseOffset = _IMBBigUN(buffer+pos,baseOffsetSize);
+		pos += baseOffsetSize;
+		uint32_t extentCount = _IMBBigU16(buffer+pos);
+		pos += 2;
+		
+		uint32_t extentSize = indexSize + offsetSize + lengthSize;
+		if (pos + extentCount*extentSize > length) return;
+		
+		if (itemID == ioState->exifItemID && extentCount > 0 && constructionMethod == 0)
+		{
+			const uint8_t* extent = buffer + pos + indexSize;
+			ioState->exifOffset = baseOffset + _IMBBigUN(extent,offsetSize);
+			ioState->exifLength = _IMBBigUN(extent+offsetSize,lengthSize);
+			return;
+		}
+		
+		pos += extentCount*extentSize;
+	}
+}
+
+
+static bool _IMBParseHEIF(IMBHeaderReader* inReader,IMBImageHeaderInfo* ioInfo)
+{
+	IMBHEIFState state;
+	memset(&state,0,sizeof(state));
+	
+	uint64_t offset = 0;
+	uint64_t metaOffset = 0;
+	uint64_t metaEnd = 0;
+	
+	// Find the meta box at top level...
+	
+	for (uint32_t i=0; i<kIMBMaxBoxes && metaEnd == 0; i++)
+	{
+		char type[4];
+		uint64_t payload,end;
+		if (!_IMBReadBoxHeader(inReader,offset,inReader->fileSize,type,&payload,&end)) break;
+		
+		if (memcmp(type,"meta",4) == 0)
+		{
+			metaOffset = payload + 4;	// full box
+			metaEnd = end;
+		}
+		
+		offset = end;
+	}
+	
+	if (metaEnd == 0) return false;
+	
+	// Item info must be known before item locations are parsed, so do two passes over the children of meta...
+	
+	uint64_t ilocOffset = 0,ilocEnd = 0;
+	offset = metaOffset;
+	
+	for (uint32_t i=0; i<kIMBMaxBoxes; i++)
+	{
+		char type[4];
+		uint64_t payload,end;
+		if (!_IMBReadBoxHeader(inReader,offset,metaEnd,type,&payload,&end)) break;
+		
+		if (memcmp(type,"pitm",4) == 0)
+		{
+			uint8_t buffer[8];
+			uint32_t length = _IMBReadBoxPayload(inReader,payload,end,buffer,8);
+			if (length >= 6) state.primaryItemID = (buffer[0] == 0) ? _IMBBigU16(buffer+4) : (length >= 8 ? _IMBBigU32(buffer+4) : 0);
+		}
+		else if (memcmp(type,"iinf",4) == 0)
+		{
+			_IMBParseIINF(inReader,payload,end,&state);
+		}
+		else if (memcmp(type,"iloc",4) == 0)
+		{
+			ilocOffset = payload;
+			ilocEnd = end;
+		}
+		else if (memcmp(type,"iprp",4) == 0)
+		{
+			uint64_t childOffset = payload;
+			uint64_t ipcoOffset = 0,ipcoEnd = 0;
+			uint64_t ipmaOffset = 0,ipmaEnd = 0;
+			
+			for (uint32_t j=0; j<kIMBMaxBoxes; j++)
+			{
+				char childType[4];
+				uint64_t childPayload,childEnd;
+				if (!_IMBReadBoxHeader(inReader,childOffset,end,childType,&childPayload,&childEnd)) break;
+				
+				if (memcmp(childType,"ipco",4) == 0)
+				{
+					ipcoOffset = childPayload;
+					ipcoEnd = childEnd;
+				}
+				else if (memcmp(childType,"ipma",4) == 0)
+				{
+					ipmaOffset = childPayload;
+					ipmaEnd = childEnd;
+				}
+				
+				childOffset = childEnd;
+			}
+			
+			// The associations tell us which properties are relevant, so they are needed first...
+			
+			if (ipmaEnd) _IMBParseIPMA(inReader,ipmaOffset,ipmaEnd,&state);
+			if (ipcoEnd) _IMBParseIPCO(inReader,ipcoOffset,ipcoEnd,&state);
+		}
+		
+		offset = end;
+	}
+	
+	if (ilocEnd) _IMBParseILOC(inReader,ilocOffset,ilocEnd,&state);
+	
+	// Apply the properties of the primary item. If we could not make sense of the associations, then fall back
+	// to the largest image size in the file...
+	
+	ioInfo->colorModel = kIMBImageColorModelRGB;
+	ioInfo->depth = state.depth ? state.depth : 8;
+	ioInfo->orientation = state.orientation;
+	ioInfo->width = state.width;
+	ioInfo->height = state.height;
+	
+	if (ioInfo->width == 0 || ioInfo->height == 0)
+	{
+		ioInfo->width = state.largestWidth;
+		ioInfo->height = state.largestHeight;
+	}
+	
+	// The Exif item starts with the offset of the TIFF header...
+	
+	if (state.exifOffset && state.exifLength > 4)
+	{
+		uint8_t buffer[4];
+		
+		if (_IMBRead(inReader,state.exifOffset,buffer,4))
+		{
+			uint64_t tiffOffset = _IMBBigU32(buffer);
+			
+			if (tiffOffset < state.exifLength - 4)
+			{
+				uint32_t orientation = ioInfo->orientation;
+				_IMBParseTIFF(inReader,state.exifOffset+4+tiffOffset,state.exifLength-4-tiffOffset,false,ioInfo);
+				if (orientation) ioInfo->orientation = orientation;	// irot takes precedence, EXIF orientation is informational in HEIF
+			}
+		}
+	}
+	
+	return ioInfo->width != 0 && ioInfo->height != 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Previews
+
+
+typedef struct
+{
+	uint32_t minPixelSize;
+	uint32_t candidateCount;
+	bool found;
+	IMBImagePreviewInfo best;
+}
+IMBPreviewSearch;
+
+
+// Checks whether there really is a JPEG stream at the given location that can be decoded by regular decoders 
+// (i.e. not lossless JPEG as used for RAW sensor data) and keeps it if it is the best match so far...
+
+static void _IMBConsiderPreview(IMBHeaderReader* inReader,uint64_t inOffset,uint32_t inLength,IMBPreviewSearch* ioSearch)
+{
+	IMBImageHeaderInfo info;
+	uint8_t frameType = 0;
+	
+	if (inOffset == 0 || inLength < 128) return;
+	if (inOffset > inReader->fileSize || inLength > inReader->fileSize - inOffset) return;
+	if (ioSearch->candidateCount++ >= kIMBMaxPreviewCandidates) return;
+	
+	memset(&info,0,sizeof(info));
+	if (!_IMBParseJPEG(inReader,inOffset,&info,NULL,NULL,&frameType)) return;
+	if (frameType > 0xC2) return;	// Only baseline, extended and progressive DCT
+	
+	uint32_t longSide = info.width > info.height ? info.width : info.height;
+	if (longSide < ioSearch->minPixelSize) return;
+	
+	uint64_t area = (uint64_t)info.width * info.height;
+	uint64_t bestArea = (uint64_t)ioSearch->best.width * ioSearch->best.height;
+	
+	if (!ioSearch->found || area < bestArea)
+	{
+		ioSearch->found = true;
+		ioSearch->best.offset = inOffset;
+		ioSearch->best.length = inLength;
+		ioSearch->best.width = info.width;
+		ioSearch->best.height = info.height;
+	}
+}
+
+
+static void _IMBConsiderDirectoryPreviews(IMBTIFFContext* inContext,const IMBTIFFDirectory* inDirectory,IMBPreviewSearch* ioSearch)
+{
+	// Old style JPEG thumbnail (EXIF IFD1, CR2 IFD1, NEF/ARW preview IFDs)...
+	
+	if (inDirectory->jpegOffset && inDirectory->jpegLength)
+	{
+		_IMBConsiderPreview(inContext->reader,inContext->base+inDirectory->jpegOffset,inDirectory->jpegLength,ioSearch);
+	}
+	
+	// JPEG compressed single strip image (CR2 IFD0, DNG preview SubIFDs). Skip sensor data...
+	
+	uint32_t photometric = inDirectory->photometric ? inDirectory->photometric-1 : 0;
+	
+	if ((inDirectory->compression == 6 || inDirectory->compression == 7) && 
+		inDirectory->stripCount == 1 && inDirectory->stripOffset && inDirectory->stripByteCount &&
+		photometric != 32803 && photometric != 34892)
+	{
+		_IMBConsiderPreview(inContext->reader,inContext->base+inDirectory->stripOffset,inDirectory->stripByteCount,ioSearch);
+	}
+}
+
+
+// Walks the IFD chain and the SubIFDs of a TIFF structure looking for JPEG previews...
+
+static void _IMBFindTIFFPreviews(IMBHeaderReader* inReader,uint64_t inBase,uint64_t inLength,IMBPreviewSearch* ioSearch,uint32_t* outOrientation)
+{
+	IMBTIFFContext context = { inReader, inBase, inLength, false };
+	IMBTIFFDirectory directory;
+	uint32_t offset = 0;
+	
+	if (!_IMBTIFFOpen(&context,&offset)) return;
+	
+	for (uint32_t i=0; i<kIMBMaxIFDs && offset != 0; i++)
+	{
+		if (!_IMBTIFFReadDirectory(&context,offset,&directory)) break;
+		if (i == 0 && outOrientation && directory.orientation) *outOrientation = directory.orientation;
+		
+		_IMBConsiderDirectoryPreviews(&context,&directory,ioSearch);
+		
+		uint32_t subIFDCount = directory.subIFDCount;
+		uint32_t subIFDOffsets[kIMBMaxSubIFDs];
+		memcpy(subIFDOffsets,directory.subIFDOffsets,sizeof(subIFDOffsets));
+		uint32_t nextOffset = directory.nextIFDOffset;
+		
+		for (uint32_t j=0; j<subIFDCount; j++)
+		{
+			IMBTIFFDirectory subDirectory;
+			
+			if (_IMBTIFFReadDirectory(&context,subIFDOffsets[j],&subDirectory))
+			{
+				_IMBConsiderDirectoryPreviews(&context,&subDirectory,ioSearch);
+			}
+		}
+		
+		if (nextOffset == offset) break;
+		offset = nextOffset;
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Public Functions
+
+
+bool IMBImageHeaderReadFileDescriptor(int inFileDescriptor,IMBImageHeaderInfo* outInfo)
+{
+	struct stat info;
+	uint8_t signature[12];
+	
+	if (outInfo == NULL) return false;
+	memset(outInfo,0,sizeof(IMBImageHeaderInfo));
+	
+	if (fstat(inFileDescriptor,&info) != 0 || !S_ISREG(info.st_mode)) return false;
+	
+	IMBHeaderReader reader = { inFileDescriptor, (uint64_t)info.st_size, 0, kIMBHeaderReadBudget };
+	if (!_IMBRead(&reader,0,signature,sizeof(signature))) return false;
+	
+	if (signature[0] == 0xFF && signature[1] == 0xD8 && signature[2] == 0xFF)
+	{
+		outInfo->format = kIMBImageFormatJPEG;
+		return _IMBParseJPEG(&reader,0,outInfo,NULL,NULL,NULL);
+	}
+	else if (memcmp(signature,"\x89PNG\r\n\x1A\n",8) == 0)
+	{
+		outInfo->format = kIMBImageFormatPNG;
+		return _IMBParsePNG(&reader,outInfo);
+	}
+	else if ((signature[0] == 'I' && signature[1] == 'I') || (signature[0] == 'M' && signature[1] == 'M'))
+	{
+		outInfo->format = kIMBImageFormatTIFF;
+		return _IMBParseTIFF(&reader,0,reader.fileSize,true,outInfo) && outInfo->width != 0 && outInfo->height != 0;
+	}
+	else if (memcmp(signature+4,"ftyp",4) == 0)
+	{
+		static const char* kBrands[] = { "heic","heix","hevc","heim","heis","mif1","msf1","avif",NULL };
+		
+		for (const char** brand=kBrands; *brand; brand++)
+		{
+			if (memcmp(signature+8,*brand,4) == 0)
+			{
+				outInfo->format = kIMBImageFormatHEIF;
+				return _IMBParseHEIF(&reader,outInfo);
+			}
+		}
+	}
+	
+	return false;
+}
+
+
+bool IMBImageHeaderReadFile(const char* inPath,IMBImageHeaderInfo* outInfo)
+{
+	if (inPath == NULL) return false;
+	
+	int fd = open(inPath,O_RDONLY);
+	if (fd < 0) return false;
+	
+	bool result = IMBImageHeaderReadFileDescriptor(fd,outInfo);
+	close(fd);
+	return result;
+}
+
+
+bool IMBImageHeaderFindPreviewInFileDescriptor(int inFileDescriptor,uint32_t inMinPixelSize,IMBImagePreviewInfo* outPreview,uint32_t* outOrientation)
+{
+	struct stat info;
+	uint8_t signature[4];
+	IMBPreviewSearch search;
+	
+	if (outPreview == NULL) return false;
+	if (outOrientation) *outOrientation = 0;
+	memset(&search,0,sizeof(search));
+	search.minPixelSize = inMinPixelSize;
+	
+	if (fstat(inFileDescriptor,&info) != 0 || !S_ISREG(info.st_mode)) return false;
+	
+	IMBHeaderReader reader = { inFileDescriptor, (uint64_t)info.st_size, 0, kIMBHeaderReadBudget };
+	if (!_IMBRead(&reader,0,signature,sizeof(signature))) return false;
+	
+	if (signature[0] == 0xFF && signature[1] == 0xD8 && signature[2] == 0xFF)
+	{
+		IMBImageHeaderInfo header;
+		uint64_t exifBase = 0;
+		uint64_t exifLength = 0;
+		memset(&header,0,sizeof(header));
+		
+		_IMBParseJPEG(&reader,0,&header,&exifBase,&exifLength,NULL);
+		if (exifBase) _IMBFindTIFFPreviews(&reader,exifBase,exifLength,&search,NULL);
+		if (outOrientation) *outOrientation = header.orientation;
+		
+		// Only use the thumbnail if it is substantially smaller than the image itself...
+		
+		if (search.found && (uint64_t)search.best.width * search.best.height * 4 > (uint64_t)header.width * header.height)
+		{
+			search.found = false;
+		}
+	}
+	else if ((signature[0] == 'I' && signature[1] == 'I') || (signature[0] == 'M' && signature[1] == 'M'))
+	{
+		_IMBFindTIFFPreviews(&reader,0,reader.fileSize,&search,outOrientation);
+	}
+	
+	if (search.found) *outPreview = search.best;
+	return search.found;
+}
+
+
+bool IMBImageHeaderFindPreview(const char* inPath,uint32_t inMinPixelSize,IMBImagePreviewInfo* outPreview,uint32_t* outOrientation)
+{
+	if (inPath == NULL) return false;
+	
+	int fd = open(inPath,O_RDONLY);
+	if (fd < 0) return false;
+	
+	bool result = IMBImageHeaderFindPreviewInFileDescriptor(fd,inMinPixelSize,outPreview,outOrientation);
+	close(fd);
+	return result;
+}
+
+
+const char* IMBImageHeaderColorModelName(IMBImageColorModel inColorModel)
+{
+	switch (inColorModel)
+	{
+		case kIMBImageColorModelRGB:	return "RGB";
+		case kIMBImageColorModelGray:	return "Gray";
+		case kIMBImageColorModelCMYK:	return "CMYK";
+		case kIMBImageColorModelLab:	return "Lab";
+		default:						return NULL;
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
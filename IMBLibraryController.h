@@ -109,8 +109,16 @@ extern NSString* kIMBNodesDidChangeNotification;
 	IMBKQueue* _watcherUKKQueue;
 	IMBFSEventsWatcher* _watcherFSEvents;
 	NSRecursiveLock* _watcherLock;
-	NSMutableArray* _watcherUKKQueuePaths;
-	NSMutableArray* _watcherFSEventsPaths;
+	NSMutableSet* _watcherUKKQueuePaths;
+	NSMutableSet* _watcherFSEventsPaths;
+	NSTimeInterval _watcherUKKQueueBurstStart;
+	NSTimeInterval _watcherUKKQueueLastCallback;
+	NSTimeInterval _watcherUKKQueueDelay;
+	NSTimeInterval _watcherFSEventsBurstStart;
+	NSTimeInterval _watcherFSEventsLastCallback;
+	NSTimeInterval _watcherFSEventsDelay;
+	NSMutableDictionary* _watchedPathsByVolume;
+	NSMutableDictionary* _pendingNodeUpdates;
 }
 
 // Create singleton instance of the controller. Don't forget to set the delegate early in the app lifetime...
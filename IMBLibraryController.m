@@ -85,6 +85,10 @@ NSString* kIMBNodesWillReloadNotification = @"IMBNodesWillReloadNotification";
 NSString* kIMBNodesWillChangeNotification = @"IMBNodesWillChangeNotification";
 NSString* kIMBNodesDidChangeNotification = @"IMBNodesDidChangeNotification";
 
+static const NSTimeInterval kIMBWatcherInitialDelay = 0.25;	// Delay after the first event of a burst
+static const NSTimeInterval kIMBWatcherMaxDelay = 4.0;		// Delay never grows beyond this while a burst continues
+static const NSTimeInterval kIMBWatcherBurstWindow = 1.0;	// Events this soon after a callback continue the burst
+
 
 //----------------------------------------------------------------------------------------------------------------------
 
@@ -128,6 +132,25 @@ static NSMutableDictionary* sLibraryControllers = nil;
 
 
 @interface IMBPopulateNodeOperation : IMBLibraryOperation
+{
+  @private
+	BOOL _canPublishPartialObjects;
+	NSArray* _publishedObjects;
+}
+
+- (void) publishPartialObjects:(NSArray*)inObjects ofNode:(IMBNode*)inNode;
+- (void) discardPublishedObjects;
+@end
+
+
+@interface IMBUpdateNodeOperation : IMBLibraryOperation
+{
+  @private
+	NSArray* _changedPaths;
+}
+
+@property (retain) NSArray* changedPaths;
+
 @end
 
 
@@ -139,16 +162,27 @@ static NSMutableDictionary* sLibraryControllers = nil;
 @interface IMBLibraryController ()
 - (void) _didCreateNode:(IMBNode*)inNode;
 - (void) _didPopulateNode:(IMBNode*)inNode;
+- (void) _didPopulatePartialObjects:(NSDictionary*)inInfo;
+- (void) _discardPartialObjects:(NSDictionary*)inInfo;
 - (void) _replaceNode:(IMBNode*)inOldNode withNode:(IMBNode*)inNewNode parentNodeIdentifier:(NSString*)inParentNodeIdentifier;
 - (void) _presentError:(NSError*)inError;
 - (void) _coalescedUKKQueueCallback;
 - (void) _coalescedFSEventsCallback;
 - (void) _reloadNodesWithWatchedPath:(NSString*)inPath;
 - (void) _reloadNodesWithWatchedPath:(NSString*)inPath nodes:(NSArray*)inNodes;
-- (void) _unmountNodes:(NSArray*)inNodes onVolume:(NSString*)inVolume;
+- (void) _updateNodesWithChangedPaths:(NSArray*)inPaths;
+- (void) _updateNode:(IMBNode*)inNode forChangedPaths:(NSArray*)inPaths;
+- (void) _didUpdateNodeWithIdentifier:(NSString*)inIdentifier;
+- (void) _debounceSelector:(SEL)inSelector burstStart:(NSTimeInterval*)ioBurstStart lastCallback:(const NSTimeInterval*)inLastCallback delay:(NSTimeInterval*)ioDelay;
+- (NSDictionary*) _nodesByWatchedPath;
+- (void) _addNodes:(NSArray*)inNodes toWatchedPaths:(NSMutableDictionary*)ioNodesByWatchedPath ancestorPaths:(NSSet*)inAncestorPaths;
++ (NSString*) _volumeForPath:(NSString*)inPath;
+- (void) _createNodeForParser:(IMBParser*)inParser;
 - (void) _registerNodeForFileSystemNotificationsIfNeeded:(IMBNode*)theNode;
 - (void) _unregisterNodeForFileSystemNotificationsIfNeeded:(IMBNode*)theNode;
 - (void) _unregisterAllFileSystemNotifications;
+- (void) _restoreFSEventsReplayEventId;
+- (void) _saveFSEventsResumeEventId;
 @end
 
 
@@ -175,6 +209,23 @@ static NSMutableDictionary* sLibraryControllers = nil;
 @synthesize parentNodeIdentifier = _parentNodeIdentifier;
 
 
+// Register as the current operation of this thread while running, so that parsers can check for cancellation...
+
+- (void) start
+{
+	[IMBOperationQueue setCurrentOperation:self];
+	
+	@try
+	{
+		[super start];
+	}
+	@finally
+	{
+		[IMBOperationQueue setCurrentOperation:nil];
+	}
+}
+
+
 // General purpose method to send back results to controller in the main thread...
 
 - (void) performSelectorOnMainThread:(SEL)inSelector withObject:(id)inObject
@@ -275,7 +326,8 @@ static NSMutableDictionary* sLibraryControllers = nil;
 // Tell the parser to popuplate the node in this background operation. When done, pass back the result to  
 // the libraryController in the main thread. If nodes are collapsed or deselected in the user interface, a 
 // appropriate notification is sent out. Listen to these notifications and cancel any queued operations
-// that are now obsolete...
+// that are now obsolete. Parsers check for cancellation while populating, so that running operations also 
+// stop early...
 	
 	
 @implementation IMBPopulateNodeOperation
@@ -289,8 +341,22 @@ static NSMutableDictionary* sLibraryControllers = nil;
         IMBParser *parser = [self parser];
         [parser willUseParser];
 		
+		// Partial objects are only shown for nodes that had no objects yet, otherwise they would replace 
+		// perfectly good objects with an incomplete list...
+		
+		_canPublishPartialObjects = self.replacementNode.objects == nil;
+		
         NSError* error = nil;
-        if ([parser populateNode:self.replacementNode options:self.options error:&error])
+        BOOL success = [parser populateNode:self.replacementNode options:self.options error:&error];
+		
+		// If we were cancelled while the parser was working, then the result is incomplete and nobody wants
+		// it anymore. The node was already reverted in the cancel method...
+		
+		if (self.isCancelled)
+		{
+			return;
+		}
+		else if (success)
 		{
 			[self performSelectorOnMainThread:@selector(_didPopulateNode:) withObject:self.replacementNode];
 			[self doReplacement];
@@ -299,9 +365,59 @@ static NSMutableDictionary* sLibraryControllers = nil;
 		{
 			[self performSelectorOnMainThread:@selector(_presentError:) withObject:error];
 			
-			// If we failed then the _oldNode is still good but needs to have its status updated 
+			// If we failed then the _oldNode is still good but needs to have its status updated. Just like 
+			// when cancelling, partial objects that are already displayed must go away again...
+			self.oldNode.loading = NO;
 			self.oldNode.badgeTypeNormal = kIMBBadgeTypeNone;
+			[self discardPublishedObjects];
+		}
+	}
+}
+
+
+// Called by the parser (via populateNode:didAddObjects:) in this background operation. Partial objects are only
+// passed on for the node we are populating, not for any other nodes the parser may populate along the way...
+
+- (void) publishPartialObjects:(NSArray*)inObjects ofNode:(IMBNode*)inNode
+{
+	@synchronized (self)
+	{
+		if (_canPublishPartialObjects && self.isCancelled == NO && inNode == self.replacementNode && inNode.identifier != nil)
+		{
+			[_publishedObjects release];
+			_publishedObjects = [inObjects retain];
+			
+			NSDictionary* info = [NSDictionary dictionaryWithObjectsAndKeys:
+				inNode.identifier,@"identifier",
+				inObjects,@"objects",
+				nil];
+				
+			[self performSelectorOnMainThread:@selector(_didPopulatePartialObjects:) withObject:info];
+		}
+	}
+}
+
+
+// Removes the partial objects from the displayed node again, if the node still shows the ones we published last. 
+// Called when the operation is cancelled or the parser failed, so that the node doesn't look populated...
+
+- (void) discardPublishedObjects
+{
+	@synchronized (self)
+	{
+		NSString* identifier = self.replacementNode.identifier;
+		
+		if (_publishedObjects != nil && identifier != nil)
+		{
+			NSDictionary* info = [NSDictionary dictionaryWithObjectsAndKeys:
+				identifier,@"identifier",
+				_publishedObjects,@"objects",
+				nil];
+				
+			[self performSelectorOnMainThread:@selector(_discardPartialObjects:) withObject:info];
 		}
+		
+		IMBRelease(_publishedObjects);
 	}
 }
 
@@ -315,6 +431,105 @@ static NSMutableDictionary* sLibraryControllers = nil;
 	
 	self.oldNode.loading = NO;
 	self.oldNode.badgeTypeNormal = kIMBBadgeTypeNone;
+	
+	// Also get rid of partial objects that are already displayed, so that the node doesn't look populated...
+	
+	[self discardPublishedObjects];
+}
+
+
+- (void) dealloc
+{
+	IMBRelease(_publishedObjects);
+	[super dealloc];
+}
+
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Ask the parser to update just the objects for some changed files in this background operation. If the parser 
+// cannot do that, then fall back to reloading the node on the main thread...
+	
+	
+@implementation IMBUpdateNodeOperation
+
+@synthesize changedPaths = _changedPaths;
+
+
+// The controller serializes updates per node, so it must hear about the end of every operation, even one that 
+// was cancelled before it got to run...
+
+- (void) start
+{
+	NSString* identifier = self.oldNode.identifier;
+	
+	@try
+	{
+		[super start];
+	}
+	@finally
+	{
+		[self performSelectorOnMainThread:@selector(_didUpdateNodeWithIdentifier:) withObject:identifier];
+	}
+}
+
+
+- (void) main
+{
+	if (self.isCancelled == NO)
+	{
+        IMBParser* parser = [self parser];
+		NSError* error = nil;
+		
+		if ([parser updateNode:self.replacementNode forChangedFilesAtPaths:self.changedPaths error:&error])
+		{
+			[self doReplacement];
+		}
+		else if (error)
+		{
+			[self performSelectorOnMainThread:@selector(_presentError:) withObject:error];
+		}
+		else
+		{
+			[self performSelectorOnMainThread:@selector(_reloadNodesWithWatchedPath:) withObject:self.oldNode.watchedPath];
+		}
+	}
+}
+
+
+// If the node was replaced (e.g. reloaded) while we were working on our copy, then our copy is outdated and must 
+// not replace the newer node. Reload it instead, which picks up our changes as well...
+
+- (void) doReplacement
+{
+	if ([NSThread isMainThread])
+	{
+		IMBNode* node = [self.libraryController nodeWithIdentifier:self.oldNode.identifier];
+		
+		if (node == self.oldNode)
+		{
+			[super doReplacement];
+		}
+		else if (node != nil)
+		{
+			[self.libraryController _reloadNodesWithWatchedPath:self.oldNode.watchedPath];
+		}
+	}
+	else
+	{
+		[super doReplacement];
+	}
+}
+
+
+- (void) dealloc
+{
+	IMBRelease(_changedPaths);
+	[super dealloc];
 }
 
 
@@ -386,10 +601,28 @@ static NSMutableDictionary* sLibraryControllers = nil;
 		self.watcherFSEvents = [[[IMBFSEventsWatcher alloc] init] autorelease];
 		self.watcherFSEvents.delegate = self;
 		
+		// File level events are only available on 10.7 and newer. On older systems we get events for the
+		// changed folders instead, which simply reload the affected nodes...
+		
+		#if IMB_COMPILING_WITH_LION_OR_NEWER_SDK
+		if (IMBRunningOnLionOrNewer())
+		{
+			[self.watcherFSEvents setFSEventStreamCreateFlags:kFSEventStreamCreateFlagUseCFTypes | kFSEventStreamCreateFlagFileEvents];
+		}
+		#endif
+		
+		[self _restoreFSEventsReplayEventId];
+		
 		_isReplacingNode = NO;
 		_watcherLock = [[NSRecursiveLock alloc] init];
-		_watcherUKKQueuePaths = [[NSMutableArray alloc] init];
-		_watcherFSEventsPaths = [[NSMutableArray alloc] init];
+		_watcherUKKQueuePaths = [[NSMutableSet alloc] init];
+		_watcherFSEventsPaths = [[NSMutableSet alloc] init];
+		_watcherUKKQueueBurstStart = 0.0;
+		_watcherUKKQueueLastCallback = 0.0;
+		_watcherFSEventsBurstStart = 0.0;
+		_watcherFSEventsLastCallback = 0.0;
+		_watchedPathsByVolume = [[NSMutableDictionary alloc] init];
+		_pendingNodeUpdates = [[NSMutableDictionary alloc] init];
 		
 		// When volume are unmounted we would like to be notified so that we can disable file watching for 
 		// those paths...
@@ -405,6 +638,14 @@ static NSMutableDictionary* sLibraryControllers = nil;
 			selector:@selector(_didMountVolume:)
 			name:NSWorkspaceDidMountNotification 
 			object:nil];
+			
+		// Remember how far we got with FSEvents, so that we can catch up on the next launch...
+		
+		[[NSNotificationCenter defaultCenter]
+			addObserver:self 
+			selector:@selector(_saveFSEventsResumeEventId)
+			name:NSApplicationWillTerminateNotification 
+			object:nil];
 	}
 	
 	return self;
@@ -414,6 +655,7 @@ static NSMutableDictionary* sLibraryControllers = nil;
 - (void) dealloc
 {
 	[[[NSWorkspace imb_threadSafeWorkspace] notificationCenter] removeObserver:self];
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
 
 	IMBRelease(_mediaType);
 	IMBRelease(_rootNodes);
@@ -422,6 +664,8 @@ static NSMutableDictionary* sLibraryControllers = nil;
 	IMBRelease(_watcherLock);
 	IMBRelease(_watcherUKKQueuePaths);
 	IMBRelease(_watcherFSEventsPaths);
+	IMBRelease(_watchedPathsByVolume);
+	IMBRelease(_pendingNodeUpdates);
 
 	[super dealloc];
 }
@@ -451,30 +695,38 @@ static NSMutableDictionary* sLibraryControllers = nil;
 	
 	for (IMBParser* parser in parsers)
 	{
-		BOOL shouldCreateNode = YES;
+		[self _createNodeForParser:parser];
+	}
+}
+
+
+// If the delegate allows it, create a background operation that loads the top level node for the given parser...
 
-		if (_delegate != nil && [_delegate respondsToSelector:@selector(libraryController:shouldCreateNodeWithParser:)])
+- (void) _createNodeForParser:(IMBParser*)inParser
+{
+	BOOL shouldCreateNode = YES;
+
+	if (_delegate != nil && [_delegate respondsToSelector:@selector(libraryController:shouldCreateNodeWithParser:)])
+	{
+		shouldCreateNode = [_delegate libraryController:self shouldCreateNodeWithParser:inParser];
+	}
+	
+	if (shouldCreateNode)
+	{
+		if (_delegate != nil && [_delegate respondsToSelector:@selector(libraryController:willCreateNodeWithParser:)])
 		{
-			shouldCreateNode = [_delegate libraryController:self shouldCreateNodeWithParser:parser];
+			[_delegate libraryController:self willCreateNodeWithParser:inParser];
 		}
-		
-		if (shouldCreateNode)
-		{
-			if (_delegate != nil && [_delegate respondsToSelector:@selector(libraryController:willCreateNodeWithParser:)])
-			{
-				[_delegate libraryController:self willCreateNodeWithParser:parser];
-			}
 
-			IMBCreateNodeOperation* operation = [[IMBCreateNodeOperation alloc] init];
-			operation.libraryController = self;
-			operation.parser = parser;
-			operation.options = self.options;
-			operation.oldNode = nil;
-			operation.parentNodeIdentifier = nil;
-			
-			[[IMBOperationQueue sharedQueue] addOperation:operation];
-			[operation release];
-		}
+		IMBCreateNodeOperation* operation = [[IMBCreateNodeOperation alloc] init];
+		operation.libraryController = self;
+		operation.parser = inParser;
+		operation.options = self.options;
+		operation.oldNode = nil;
+		operation.parentNodeIdentifier = nil;
+		
+		[[IMBOperationQueue sharedQueue] addOperation:operation];
+		[operation release];
 	}
 }
 
@@ -610,6 +862,11 @@ static NSMutableDictionary* sLibraryControllers = nil;
 // can be more accountable to making sure we properly deregister when reloading.
 //
 // Note: Are KQueue type watches even used anymore? Maybe we can eliminate that.
+//
+// Watched paths are also kept in a registry (volume mount point -> node identifier -> watched path and watcher
+// type), so that mounting and unmounting a volume only has to deal with the nodes on that volume instead of walking 
+// the whole tree. The registry deliberately doesn't hold on to the nodes themselves, as nodes that are dropped from 
+// the tree without being unregistered (e.g. along with their parent) would otherwise never be released...
 
 - (void) _registerNodeForFileSystemNotificationsIfNeeded:(IMBNode*)theNode
 {
@@ -620,6 +877,26 @@ static NSMutableDictionary* sLibraryControllers = nil;
 			[self.watcherUKKQueue addPath:watchedPath];
 		else if (theNode.watcherType == kIMBWatcherTypeFSEvent)
 			[self.watcherFSEvents addURL:[NSURL fileURLWithPath:watchedPath] error:NULL];
+		else
+			return;
+
+		if (theNode.identifier == nil) return;
+		
+		NSString* volume = [[self class] _volumeForPath:watchedPath];
+		NSMutableDictionary* entries = [_watchedPathsByVolume objectForKey:volume];
+		
+		if (entries == nil)
+		{
+			entries = [NSMutableDictionary dictionary];
+			[_watchedPathsByVolume setObject:entries forKey:volume];
+		}
+		
+		NSDictionary* entry = [NSDictionary dictionaryWithObjectsAndKeys:
+			watchedPath,@"watchedPath",
+			[NSNumber numberWithUnsignedInteger:theNode.watcherType],@"watcherType",
+			nil];
+			
+		[entries setObject:entry forKey:theNode.identifier];
 	}
 }
 
@@ -632,6 +909,26 @@ static NSMutableDictionary* sLibraryControllers = nil;
 			[self.watcherUKKQueue removePath:watchedPath];
 		else if (theNode.watcherType == kIMBWatcherTypeFSEvent)
 			[self.watcherFSEvents removePath:watchedPath];
+		else
+			return;
+
+		// Only remove the registry entry if it still refers to this path. A new node with the same identifier 
+		// may already have taken its place. The volume is looked up in the registry rather than determined 
+		// again, because the volume may be going away right now...
+		
+		for (NSString* volume in [_watchedPathsByVolume allKeys])
+		{
+			NSMutableDictionary* entries = [_watchedPathsByVolume objectForKey:volume];
+			NSDictionary* entry = theNode.identifier ? [entries objectForKey:theNode.identifier] : nil;
+			
+			if ([[entry objectForKey:@"watchedPath"] isEqualToString:watchedPath] && 
+				[[entry objectForKey:@"watcherType"] unsignedIntegerValue] == theNode.watcherType)
+			{
+				[entries removeObjectForKey:theNode.identifier];
+				if (entries.count == 0) [_watchedPathsByVolume removeObjectForKey:volume];
+				break;
+			}
+		}
 	}
 }
 
@@ -639,6 +936,32 @@ static NSMutableDictionary* sLibraryControllers = nil;
 {
 	[self.watcherUKKQueue removeAllPaths];
 	[self.watcherFSEvents removeAllPaths];
+	[_watchedPathsByVolume removeAllObjects];
+}
+
+
+// Returns the mount point of the volume that contains the specified path. This is called when a node is registered,
+// i.e. right after it has been populated from that volume, so asking the file system is safe here. Volumes can be 
+// mounted anywhere, not just in /Volumes, so that is only used as a fallback...
+
++ (NSString*) _volumeForPath:(NSString*)inPath
+{
+	NSString* path = [inPath stringByStandardizingPath];
+	NSURL* volumeURL = nil;
+	
+	if ([[NSURL fileURLWithPath:path] getResourceValue:&volumeURL forKey:NSURLVolumeURLKey error:NULL] && volumeURL != nil)
+	{
+		return [[volumeURL path] stringByStandardizingPath];
+	}
+	
+	NSArray* components = [path pathComponents];
+	
+	if (components.count >= 3 && [[components objectAtIndex:1] isEqualToString:@"Volumes"])
+	{
+		return [NSString pathWithComponents:[components subarrayWithRange:NSMakeRange(0,3)]];
+	}
+	
+	return @"/";
 }
 
 // This method is called on the main thread as a result of any IMBLibraryOperation. We are given both the old  
@@ -935,6 +1258,47 @@ static NSMutableDictionary* sLibraryControllers = nil;
 }
 
 
+// Called back in the main thread while an IMBPopulateNodeOperation is still running. Display the objects that are
+// already available. The node stays in loading state until the final node replaces it. Since the object array
+// controller is bound to bindableObjects, we need to send the KVO notifications for that key ourselves...
+
+- (void) _didPopulatePartialObjects:(NSDictionary*)inInfo
+{
+	IMBNode* node = [self nodeWithIdentifier:[inInfo objectForKey:@"identifier"]];
+	NSArray* objects = [inInfo objectForKey:@"objects"];
+	
+	// Don't check for the loading state here: if the operation was cancelled or failed in the meantime, then a 
+	// _discardPartialObjects: is already queued behind us and relies on finding the last published objects...
+	
+	if (node != nil && objects.count > node.objects.count)
+	{
+		[node willChangeValueForKey:@"bindableObjects"];
+		node.objects = objects;
+		[node didChangeValueForKey:@"bindableObjects"];
+	}
+}
+
+
+// Called back in the main thread when an IMBPopulateNodeOperation was cancelled or failed. The partial objects are 
+// only removed if the node still displays them, i.e. if no other operation has published or replaced anything...
+
+- (void) _discardPartialObjects:(NSDictionary*)inInfo
+{
+	IMBNode* node = [self nodeWithIdentifier:[inInfo objectForKey:@"identifier"]];
+	NSArray* objects = [inInfo objectForKey:@"objects"];
+	
+	if (node != nil && node.objects == objects)
+	{
+		[node willChangeValueForKey:@"bindableObjects"];
+		node.objects = nil;
+		[node didChangeValueForKey:@"bindableObjects"];
+		
+		node.loading = NO;
+		node.badgeTypeNormal = kIMBBadgeTypeNone;
+	}
+}
+
+
 //----------------------------------------------------------------------------------------------------------------------
 
 
@@ -944,115 +1308,373 @@ static NSMutableDictionary* sLibraryControllers = nil;
 // A file watcher has fired for one of the paths we have registered. Since file watchers (especially UKKQueue can 
 // fire multiple times for a single change) we need to coalesce the calls. Please note that the parameter inPath  
 // is a different NSString instance every single time, so we cannot pass it as a param to the coalesced message 
-// (canceling wouldn't work). Instead we'll put it in an array, which is iterated in _coalescedFileWatcherCallback...
+// (canceling wouldn't work). Instead we'll put it in a set, which is iterated in the coalesced callbacks...
 
 - (void) watcher:(id<IMBFileWatcher>)inWatcher receivedNotification:(NSString*)inNotificationName forPath:(NSString*)inPath
 {
 //	NSLog(@"%s path=%@",__FUNCTION__,inPath);
 	
-	if ([inNotificationName isEqualToString:IMBFileWatcherWriteNotification])
+	BOOL isWrite = [inNotificationName isEqualToString:IMBFileWatcherWriteNotification];
+	BOOL isFileEvent = [inNotificationName isEqualToString:IMBFileWatcherDeleteNotification] || 
+		[inNotificationName isEqualToString:IMBFileWatcherRenameNotification];
+		
+	if (isWrite || isFileEvent)
 	{
-		if (inWatcher == _watcherUKKQueue)
+		if (inWatcher == _watcherUKKQueue && isWrite)
 		{
 			[_watcherLock lock];
-			if ([_watcherUKKQueuePaths indexOfObject:inPath] == NSNotFound) [_watcherUKKQueuePaths addObject:inPath];
+			[_watcherUKKQueuePaths addObject:inPath];
 			[_watcherLock unlock];
 			
-			SEL method = @selector(_coalescedUKKQueueCallback);
-			[NSObject cancelPreviousPerformRequestsWithTarget:self selector:method object:nil];
-			[self performSelector:method withObject:nil afterDelay:1.0 inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+			[self _debounceSelector:@selector(_coalescedUKKQueueCallback) burstStart:&_watcherUKKQueueBurstStart lastCallback:&_watcherUKKQueueLastCallback delay:&_watcherUKKQueueDelay];
 		}
 		else if (inWatcher == _watcherFSEvents)
 		{
 			[_watcherLock lock];
-			if ([_watcherFSEventsPaths indexOfObject:inPath] == NSNotFound) [_watcherFSEventsPaths addObject:inPath];
+			[_watcherFSEventsPaths addObject:inPath];
 			[_watcherLock unlock];
 
-			SEL method = @selector(_coalescedFSEventsCallback);
-			[NSObject cancelPreviousPerformRequestsWithTarget:self selector:method object:nil];
-			[self performSelector:method withObject:nil afterDelay:1.0 inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+			[self _debounceSelector:@selector(_coalescedFSEventsCallback) burstStart:&_watcherFSEventsBurstStart lastCallback:&_watcherFSEventsLastCallback delay:&_watcherFSEventsDelay];
 		}
 	}
 }
 
 
-// Given an array of paths, filter out all paths that are subpaths of others in the array.
-// In other words only return the unique roots of a bunch of file system paths...
+// Schedules the coalesced callback for file watcher events. Events that arrive while the callback is scheduled are 
+// simply collected, and never postpone it. An event that arrives within kIMBWatcherBurstWindow after the callback 
+// has fired means that the burst continues (e.g. during an import of thousands of files), so the delay doubles,  
+// up to kIMBWatcherMaxDelay. That way we do not reload the same nodes over and over again. After a quiet period 
+// the next event is answered quickly again...
+
+- (void) _debounceSelector:(SEL)inSelector burstStart:(NSTimeInterval*)ioBurstStart lastCallback:(const NSTimeInterval*)inLastCallback delay:(NSTimeInterval*)ioDelay
+{
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	NSTimeInterval delay = 0.0;
+	
+	[_watcherLock lock];
+	
+	if (*ioBurstStart != 0.0)
+	{
+		[_watcherLock unlock];
+		return;
+	}
+	
+	if (*inLastCallback != 0.0 && now - *inLastCallback < kIMBWatcherBurstWindow)
+	{
+		*ioDelay = MIN(*ioDelay * 2.0,kIMBWatcherMaxDelay);
+	}
+	else
+	{
+		*ioDelay = kIMBWatcherInitialDelay;
+	}
+	
+	*ioBurstStart = now;
+	delay = *ioDelay;
+	
+	[_watcherLock unlock];
+	
+	[self performSelector:inSelector withObject:nil afterDelay:delay inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+}
+
+
+// Given an array of paths, filter out all paths that are subpaths of others in the array. In other words only 
+// return the unique roots of a bunch of file system paths. Appending a slash to each path and sorting them puts 
+// all descendants of a path right behind it, so that a single pass is enough - O(n log n) in total...
 
 + (NSArray*) _rootPathsForPaths:(NSArray*)inAllPaths
 {
+	NSMutableArray* paths = [NSMutableArray arrayWithCapacity:inAllPaths.count];
+	
+	for (NSString* path in inAllPaths)
+	{
+		path = [path stringByStandardizingPath];
+		if (![path hasSuffix:@"/"]) path = [path stringByAppendingString:@"/"];
+		[paths addObject:path];
+	}
+	
+	[paths sortUsingSelector:@selector(compare:)];
+	
 	NSMutableArray* rootPaths = [NSMutableArray array];
+	NSString* rootPath = nil;
 	
-	for (NSString* newPath in inAllPaths)
+	for (NSString* path in paths)
 	{
-		// First eliminate any existing rootPaths that are subpaths of a new path...
-		
-		NSInteger n = [rootPaths count];
+		if (rootPath == nil || ![path hasPrefix:rootPath])
+		{
+			rootPath = path;
+			[rootPaths addObject:[path stringByStandardizingPath]];
+		}
+	}
+	
+	return (NSArray*) rootPaths;
+}
+
+
+// Reload the nodes for the collected paths on the main thread...
+
+- (void) _coalescedUKKQueueCallback
+{
+	if (![NSThread isMainThread])
+	{
+		[self performSelectorOnMainThread:_cmd withObject:nil waitUntilDone:NO];
+		return;
+	}
+	
+	[_watcherLock lock];
+	NSArray* changedPaths = [_watcherUKKQueuePaths allObjects];
+	[_watcherUKKQueuePaths removeAllObjects];
+	_watcherUKKQueueBurstStart = 0.0;
+	_watcherUKKQueueLastCallback = [NSDate timeIntervalSinceReferenceDate];
+	[_watcherLock unlock];
+	
+	// Reloading a node also reloads the nodes for its subfolders, so only reload the topmost watched paths...
+	
+	NSMutableArray* watchedPaths = [NSMutableArray arrayWithCapacity:changedPaths.count];
+	NSDictionary* nodesByWatchedPath = [self _nodesByWatchedPath];
+	
+	for (NSString* path in changedPaths)
+	{
+		if ([nodesByWatchedPath objectForKey:[path stringByStandardizingPath]]) [watchedPaths addObject:path];
+	}
+	
+	for (NSString* path in [[self class] _rootPathsForPaths:watchedPaths])
+	{
+		[self _reloadNodesWithWatchedPath:path];
+	}
+}	
+
+
+- (void) _coalescedFSEventsCallback
+{
+	[_watcherLock lock];
+	NSArray* paths = [_watcherFSEventsPaths allObjects];
+	[_watcherFSEventsPaths removeAllObjects];
+	_watcherFSEventsBurstStart = 0.0;
+	_watcherFSEventsLastCallback = [NSDate timeIntervalSinceReferenceDate];
+	[_watcherLock unlock];
+	
+	if ([NSThread isMainThread]) [self _updateNodesWithChangedPaths:paths];
+	else [self performSelectorOnMainThread:@selector(_updateNodesWithChangedPaths:) withObject:paths waitUntilDone:NO];
+}	
+
+
+// FSEvents reports changes with file granularity. If a path is the watchedPath of a node, then the folder itself
+// has changed and the node is reloaded as before. Otherwise the path is a file inside the watched folder of a node.
+// These files are grouped by node and handed to the parser in an IMBUpdateNodeOperation, so that only the affected 
+// objects have to be updated instead of rescanning the whole folder...
+
+- (void) _updateNodesWithChangedPaths:(NSArray*)inPaths
+{
+	NSMutableDictionary* changedFilesByFolder = [NSMutableDictionary dictionary];
+	NSMutableArray* changedFolders = [NSMutableArray array];
+	NSDictionary* nodesByWatchedPath = [self _nodesByWatchedPath];
+	
+	for (NSString* path in inPaths)
+	{
+		path = [path stringByStandardizingPath];
 		
-		for (NSInteger i=n-1; i>=0; i--)
+		if ([nodesByWatchedPath objectForKey:path])
+		{
+			[changedFolders addObject:path];
+		}
+		else
 		{
-			NSString* rootPath = [rootPaths objectAtIndex:i];
+			NSString* folder = [path stringByDeletingLastPathComponent];
+			NSMutableArray* files = [changedFilesByFolder objectForKey:folder];
 			
-			if ([rootPath hasPrefix:newPath])
+			if (files == nil)
 			{
-				[rootPaths removeObjectAtIndex:i];
+				files = [NSMutableArray array];
+				[changedFilesByFolder setObject:files forKey:folder];
 			}
+			
+			if ([files indexOfObject:path] == NSNotFound) [files addObject:path];
 		}
+	}
+	
+	// Reloading a folder also takes care of everything inside it, so only reload the topmost folders and skip 
+	// the file changes within them...
+	
+	NSArray* reloadedFolders = [[self class] _rootPathsForPaths:changedFolders];
+	
+	for (NSString* folder in reloadedFolders)
+	{
+		[self _reloadNodesWithWatchedPath:folder];
+	}
+	
+	for (NSString* folder in changedFilesByFolder)
+	{
+		NSArray* files = [changedFilesByFolder objectForKey:folder];
+		BOOL isReloaded = NO;
 		
-		// Add a new path if it is not a subpath (or equal) of another existing path...
-		
-		BOOL shouldAdd = YES;
-
-		for (NSString* rootPath in rootPaths)
+		for (NSString* reloadedFolder in reloadedFolders)
 		{
-			if ([newPath hasPrefix:rootPath])
+			if ([folder isEqualToString:reloadedFolder] || [folder hasPrefix:[reloadedFolder stringByAppendingString:@"/"]])
 			{
-				shouldAdd = NO;
+				isReloaded = YES;
 				break;
 			}
 		}
 		
-		if (shouldAdd) [rootPaths addObject:newPath];
+		if (isReloaded) continue;
+		
+		for (IMBNode* node in [nodesByWatchedPath objectForKey:folder])
+		{
+			// Unpopulated nodes will pick up the changes when they get populated. Nodes that are currently 
+			// loading may miss them though, so reload those...
+			
+			if (node.isLoading)
+			{
+				[self reloadNode:node];
+			}
+			else if (node.isPopulated)
+			{
+				[self _updateNode:node forChangedPaths:files];
+			}
+		}
 	}
-	
-	return (NSArray*) rootPaths;
 }
 
 
-// Pass the message on to the main thread...
+// Updates of the same node are serialized. An IMBUpdateNodeOperation works on a copy of the node, so two of them
+// running at the same time would each only contain their own changes, and the last replacement would win. While 
+// an update is running, further changed paths for the node are collected and then handed to a new operation, which
+// works on a fresh copy of the updated node...
 
-- (void) _coalescedUKKQueueCallback
+- (void) _updateNode:(IMBNode*)inNode forChangedPaths:(NSArray*)inPaths
 {
-	BOOL isMainThread = [NSThread isMainThread];
+	NSString* identifier = inNode.identifier;
+	NSMutableSet* pendingPaths = [_pendingNodeUpdates objectForKey:identifier];
 	
-	[_watcherLock lock];
-	
-	for (NSString* path in _watcherUKKQueuePaths)
+	if (pendingPaths)
 	{
-		if (isMainThread) [self _reloadNodesWithWatchedPath:path];
-		else [self performSelectorOnMainThread:@selector(_reloadNodesWithWatchedPath:) withObject:path waitUntilDone:NO];
+		[pendingPaths addObjectsFromArray:inPaths];
+		return;
 	}
 	
-	[_watcherUKKQueuePaths removeAllObjects];
-	[_watcherLock unlock];
-}	
+	if (identifier) [_pendingNodeUpdates setObject:[NSMutableSet set] forKey:identifier];
+	
+	IMBUpdateNodeOperation* operation = [[IMBUpdateNodeOperation alloc] init];
+	operation.libraryController = self;
+	operation.parser = inNode.parser;
+	operation.options = self.options;
+	operation.oldNode = inNode;
+	operation.replacementNode = inNode;
+	operation.parentNodeIdentifier = inNode.parentNode.identifier;
+	operation.changedPaths = inPaths;
+	
+	[[IMBOperationQueue sharedQueue] addOperation:operation];
+	[operation release];
+}
 
 
-- (void) _coalescedFSEventsCallback
+// Called on the main thread after an IMBUpdateNodeOperation is done (and after its node was replaced). If more 
+// files changed in the meantime, then start the next update...
+
+- (void) _didUpdateNodeWithIdentifier:(NSString*)inIdentifier
 {
-	BOOL isMainThread = [NSThread isMainThread];
+	if (inIdentifier == nil) return;
 	
-	[_watcherLock lock];
+	NSSet* pendingPaths = [[[_pendingNodeUpdates objectForKey:inIdentifier] retain] autorelease];
+	[_pendingNodeUpdates removeObjectForKey:inIdentifier];
 	
-	for (NSString* path in _watcherFSEventsPaths)
+	if ([pendingPaths count] > 0)
+	{
+		IMBNode* node = [self nodeWithIdentifier:inIdentifier];
+		
+		if (node.isLoading)
+		{
+			[self reloadNode:node];
+		}
+		else if (node.isPopulated)
+		{
+			[self _updateNode:node forChangedPaths:[pendingPaths allObjects]];
+		}
+	}
+}
+
+
+// Returns the nodes (in the whole tree) that are watching a path, keyed by the standardized path. This walks the  
+// tree only once, so it should be built once per batch of changed paths and then used for all of them. A node
+// is left out if one of its ancestors already watches the same path, as reloading the ancestor covers it...
+
+- (NSDictionary*) _nodesByWatchedPath
+{
+	NSMutableDictionary* nodesByWatchedPath = [NSMutableDictionary dictionary];
+	[self _addNodes:self.rootNodes toWatchedPaths:nodesByWatchedPath ancestorPaths:[NSSet set]];
+	return nodesByWatchedPath;
+}
+
+
+- (void) _addNodes:(NSArray*)inNodes toWatchedPaths:(NSMutableDictionary*)ioNodesByWatchedPath ancestorPaths:(NSSet*)inAncestorPaths
+{
+	for (IMBNode* node in inNodes)
 	{
-		if (isMainThread) [self _reloadNodesWithWatchedPath:path];
-		else [self performSelectorOnMainThread:@selector(_reloadNodesWithWatchedPath:) withObject:path waitUntilDone:NO];
+		NSString* nodePath = [(NSString*)node.watchedPath stringByStandardizingPath];
+		NSSet* ancestorPaths = inAncestorPaths;
+		
+		if (nodePath != nil && ![inAncestorPaths containsObject:nodePath])
+		{
+			NSMutableArray* nodes = [ioNodesByWatchedPath objectForKey:nodePath];
+			
+			if (nodes == nil)
+			{
+				nodes = [NSMutableArray array];
+				[ioNodesByWatchedPath setObject:nodes forKey:nodePath];
+			}
+			
+			[nodes addObject:node];
+			ancestorPaths = [inAncestorPaths setByAddingObject:nodePath];
+		}
+		
+		[self _addNodes:node.subNodes toWatchedPaths:ioNodesByWatchedPath ancestorPaths:ancestorPaths];
 	}
+}
+
+
+// FSEvents can tell us about changes that happened while the app wasn't running. For this we need to store the 
+// event ID up to which we have seen everything (along with the UUID of the event database, as IDs are meaningless 
+// once it has been reset) and the paths we were watching. On the next launch these paths are then sent the changes 
+// since that event when they are watched again, so that the affected nodes get reloaded. Paths that we didn't watch
+// last time don't get any history...
+
+- (NSString*) _fsEventsPrefsKey
+{
+	return [NSString stringWithFormat:@"fsEventsResumeInfo_%@",self.mediaType];
+}
+
+
+- (void) _restoreFSEventsReplayEventId
+{
+	NSDictionary* info = [IMBConfig prefsValueForKey:[self _fsEventsPrefsKey]];
+	NSNumber* eventId = [info objectForKey:@"eventId"];
+	NSString* uuid = [info objectForKey:@"uuid"];
+	NSArray* paths = [info objectForKey:@"paths"];
 	
-	[_watcherFSEventsPaths removeAllObjects];
-	[_watcherLock unlock];
-}	
+	if (eventId != nil && uuid != nil && [paths count] > 0 && [uuid isEqualToString:[IMBFSEventsWatcher eventDatabaseUUID]])
+	{
+		[self.watcherFSEvents setReplayEventId:[eventId unsignedLongLongValue] forPaths:paths];
+	}
+}
+
+
+- (void) _saveFSEventsResumeEventId
+{
+	NSString* uuid = [IMBFSEventsWatcher eventDatabaseUUID];
+	FSEventStreamEventId eventId = [self.watcherFSEvents resumeEventId];
+	NSArray* paths = [self.watcherFSEvents resumePaths];
+	
+	if (uuid != nil && eventId != 0 && paths != nil)
+	{
+		NSDictionary* info = [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedLongLong:eventId],@"eventId",
+			uuid,@"uuid",
+			paths,@"paths",
+			nil];
+			
+		[IMBConfig setPrefsValue:info forKey:[self _fsEventsPrefsKey]];
+	}
+}
 
 
 // Now look for all nodes that are interested in that path and reload them...
@@ -1091,45 +1713,100 @@ static NSMutableDictionary* sLibraryControllers = nil;
 //----------------------------------------------------------------------------------------------------------------------
 
 
-// When unmounting a volume, we need to stop the file watcher, or unmounting will fail. In this case we have to walk
-// throughte node tree and check which nodes are affected. These nodes are removed from the tree. This will also
-// take care of removing the offending file watcher...
-
+// When unmounting a volume, we need to stop the file watcher, or unmounting will fail. The registry tells us which  
+// nodes are watching paths on this volume, so we do not have to walk the node tree. A volume matches if it is the 
+// registered mount point or contains it (e.g. a disk image mounted inside a folder on that volume). The matching 
+// nodes are removed from the tree, which also takes care of removing the offending file watchers. Paths of nodes 
+// that were already removed along with one of their ancestors are simply unwatched...
 
 - (void) _willUnmountVolume:(NSNotification*)inNotification 
 {
-	NSString* volume = [[inNotification userInfo] objectForKey:@"NSDevicePath"];
-	[self _unmountNodes: self.rootNodes onVolume:volume];
-}
-
-
-- (void) _unmountNodes:(NSArray*)inNodes onVolume:(NSString*)inVolume 
-{
-	for (IMBNode* node in inNodes)
+	NSString* volume = [[[inNotification userInfo] objectForKey:@"NSDevicePath"] stringByStandardizingPath];
+	if (volume == nil) return;
+	
+	NSString* volumePrefix = [volume hasSuffix:@"/"] ? volume : [volume stringByAppendingString:@"/"];
+	NSMutableArray* identifiers = [NSMutableArray array];
+	NSMutableDictionary* entries = [NSMutableDictionary dictionary];
+	
+	for (NSString* key in [_watchedPathsByVolume allKeys])
 	{
-		NSString* path = node.watchedPath;
-		IMBWatcherType type =  node.watcherType;
+		if ([key isEqualToString:volume] || [key hasPrefix:volumePrefix])
+		{
+			NSDictionary* entriesOnVolume = [_watchedPathsByVolume objectForKey:key];
+			[identifiers addObjectsFromArray:[entriesOnVolume allKeys]];
+			[entries addEntriesFromDictionary:entriesOnVolume];
+			[_watchedPathsByVolume removeObjectForKey:key];
+		}
+	}
+	
+	// Remove ancestors before their descendants (shorter watched paths first)...
+	
+	[identifiers sortUsingComparator:^NSComparisonResult(id inIdentifier1,id inIdentifier2)
+	{
+		NSUInteger length1 = [[[entries objectForKey:inIdentifier1] objectForKey:@"watchedPath"] length];
+		NSUInteger length2 = [[[entries objectForKey:inIdentifier2] objectForKey:@"watchedPath"] length];
+		if (length1 < length2) return NSOrderedAscending;
+		if (length1 > length2) return NSOrderedDescending;
+		return NSOrderedSame;
+	}];
+	
+	for (NSString* identifier in identifiers)
+	{
+		IMBNode* node = [self nodeWithIdentifier:identifier];
 		
-		if ((type == kIMBWatcherTypeKQueue || type == kIMBWatcherTypeFSEvent) && [path hasPrefix:inVolume])
+		if (node)
 		{
-			NSDictionary* info = [NSDictionary dictionaryWithObjectsAndKeys:node,@"oldNode",nil];
-			[self _replaceNode:info];
+			[self _replaceNode:node withNode:nil parentNodeIdentifier:node.parentNode.identifier];
 		}
 		else
 		{
-			[self _unmountNodes:node.subNodes onVolume:inVolume];
+			NSDictionary* entry = [entries objectForKey:identifier];
+			NSString* watchedPath = [entry objectForKey:@"watchedPath"];
+			IMBWatcherType watcherType = [[entry objectForKey:@"watcherType"] unsignedIntegerValue];
+			
+			if (watcherType == kIMBWatcherTypeKQueue)
+				[self.watcherUKKQueue removePath:watchedPath];
+			else if (watcherType == kIMBWatcherTypeFSEvent)
+				[self.watcherFSEvents removePath:watchedPath];
 		}
 	}
 }
 
 
-// When a new volume is mounted, we have to assume that it contains a folder or library that we are interested in.
-// Currently we are simply reloading everything, but in the future we could possibly be more intelligent about it 
-// and reload just those nodes that are required and keep everything else intact...
+// When a new volume is mounted, it may contain a folder or library that we are interested in. Only the parsers 
+// whose media source lives on the new volume are (re)loaded, everything else stays intact...
 
 - (void) _didMountVolume:(NSNotification*)inNotification 
 {
-	[self reload];
+	NSString* volume = [[[inNotification userInfo] objectForKey:@"NSDevicePath"] stringByStandardizingPath];
+	
+	if (volume == nil)
+	{
+		[self reload];
+		return;
+	}
+	
+	NSString* volumePrefix = [volume stringByAppendingString:@"/"];
+	NSArray* parsers = [[IMBParserController sharedParserController] parsersForMediaType:self.mediaType];
+
+	for (IMBParser* parser in parsers)
+	{
+		NSString* mediaSource = [parser.mediaSource stringByStandardizingPath];
+		
+		if ([mediaSource isEqualToString:volume] || [mediaSource hasPrefix:volumePrefix])
+		{
+			IMBNode* node = [self topLevelNodeForParser:parser];
+			
+			if (node)
+			{
+				[self reloadNode:node parser:parser];
+			}
+			else
+			{
+				[self _createNodeForParser:parser];
+			}
+		}
+	}
 }
 
 
@@ -54,6 +54,7 @@
 
 #import "IMBLightroom4VideoParser.h"
 #import "IMBParserController.h"
+#import "IMBMetadataCache.h"
 #import "IMBObject.h"
 #import "NSDictionary+iMedia.h"
 #import "NSURL+iMedia.h"
@@ -138,7 +139,7 @@
 	NSMutableDictionary* metadata = [NSMutableDictionary dictionaryWithDictionary:inObject.preliminaryMetadata];
 	
 	[metadata setObject:[inObject path] forKey:@"path"];
-	[metadata addEntriesFromDictionary:[NSURL imb_metadataFromVideoAtURL:videoURL]];
+	[metadata addEntriesFromDictionary:[[IMBMetadataCache sharedCache] videoMetadataForURL:videoURL]];
 	
 	NSString* description = [self metadataDescriptionForMetadata:metadata];
 	
@@ -66,13 +66,16 @@
 #import "IMBLightroom3VideoParser.h"
 #import "IMBLightroom4VideoParser.h"
 #import "IMBIconCache.h"
+#import "IMBMetadataCache.h"
 #import "IMBNode.h"
 #import "IMBNodeObject.h"
 #import "IMBObject.h"
 #import "IMBObjectsPromise.h"
+#import "IMBOperationQueue.h"
 #import "IMBOrderedDictionary.h"
 #import "IMBParserController.h"
 #import "IMBPyramidObjectPromise.h"
+#import "IMBVirtualObjectArray.h"
 #import "NSFileManager+iMedia.h"
 #import "NSImage+iMedia.h"
 #import "NSString+iMedia.h"
@@ -220,6 +223,281 @@ static NSArray* sSupportedUTIs = nil;
 //----------------------------------------------------------------------------------------------------------------------
 
 
+#pragma mark 
+
+// Large Lightroom folders and collections can contain hundreds of thousands of images. Instead of creating a full
+// IMBLightroomObject (with its metadata dictionary) for every row of the query, the rows are kept in columns: numbers 
+// in a plain C array, and strings as UTF-8 in a single buffer. Strings that repeat from row to row (the folder path 
+// and the orientation) are only stored once. The node's objects array is an IMBVirtualObjectArray, which asks the 
+// store for an object only when its index is actually accessed. The few IMBNodeObjects for subfolders or collections 
+// are kept as they are...
+
+typedef struct
+{
+	long idLocal;
+	float width;
+	float height;
+	uint32_t directory;			// Offsets into the string buffer plus 1, so that 0 means nil...
+	uint32_t filename;
+	uint32_t name;				// 0 if the name is the filename
+	uint32_t orientation;
+	uint32_t pyramidPath;
+}
+IMBLightroomObjectRow;
+
+
+@interface IMBLightroomObjectStore : NSObject <IMBVirtualObjectArrayDataSource>
+{
+	IMBLightroomParser* _parser;
+	IMBLightroomObjectRow* _rows;
+	NSUInteger _rowCount;
+	NSUInteger _rowCapacity;
+	NSMutableData* _strings;
+	NSMutableDictionary* _internedStrings;
+	NSArray* _nodeObjects;
+	BOOL _nodeObjectsFirst;
+}
+
+- (id) initWithParser:(IMBLightroomParser*)inParser;
+
+- (void) addRowWithIdLocal:(long)inIdLocal
+					  path:(NSString*)inPath
+				  filename:(NSString*)inFilename
+					  name:(NSString*)inName
+					 width:(double)inWidth
+					height:(double)inHeight
+			   orientation:(NSString*)inOrientation
+			   pyramidPath:(NSString*)inPyramidPath;
+
+// IMBNodeObjects that are listed before or after the images...
+
+- (void) setNodeObjects:(NSArray*)inNodeObjects first:(BOOL)inFirst;
+
+// Returns a virtual array with all objects added so far. As the store only grows, this can also be used for 
+// snapshots while the node is still being populated...
+
+- (NSArray*) objects;
+- (NSUInteger) count;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@implementation IMBLightroomObjectStore
+
+
+- (id) initWithParser:(IMBLightroomParser*)inParser
+{
+	if (self = [super init])
+	{
+		_parser = [inParser retain];
+		_rows = NULL;
+		_rowCount = 0;
+		_rowCapacity = 0;
+		_strings = [[NSMutableData alloc] init];
+		_internedStrings = [[NSMutableDictionary alloc] init];
+		_nodeObjects = nil;
+		_nodeObjectsFirst = NO;
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	free(_rows);
+	IMBRelease(_strings);
+	IMBRelease(_internedStrings);
+	IMBRelease(_nodeObjects);
+	IMBRelease(_parser);
+	[super dealloc];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Appends a string to the buffer (or finds the existing copy if inIntern is YES). Must be called with the lock held...
+
+- (uint32_t) _offsetForString:(NSString*)inString intern:(BOOL)inIntern
+{
+	if (inString == nil) return 0;
+	
+	if (inIntern)
+	{
+		NSNumber* offset = [_internedStrings objectForKey:inString];
+		if (offset) return [offset unsignedIntValue];
+	}
+	
+	const char* utf8 = [inString UTF8String];
+	uint32_t offset = (uint32_t)[_strings length] + 1;
+	[_strings appendBytes:utf8 length:strlen(utf8)+1];
+	
+	if (inIntern)
+	{
+		[_internedStrings setObject:[NSNumber numberWithUnsignedInt:offset] forKey:inString];
+	}
+	
+	return offset;
+}
+
+
+// Must be called with the lock held...
+
+- (NSString*) _stringAtOffset:(uint32_t)inOffset
+{
+	if (inOffset == 0) return nil;
+	const char* utf8 = (const char*)[_strings bytes] + inOffset - 1;
+	return [[[NSString alloc] initWithUTF8String:utf8] autorelease];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// The path is split into the folder path (which is the same for many rows) and the filename. In the unlikely case
+// that the path doesn't end with the filename, the whole path is stored as the folder and the name is kept...
+
+- (void) addRowWithIdLocal:(long)inIdLocal
+					  path:(NSString*)inPath
+				  filename:(NSString*)inFilename
+					  name:(NSString*)inName
+					 width:(double)inWidth
+					height:(double)inHeight
+			   orientation:(NSString*)inOrientation
+			   pyramidPath:(NSString*)inPyramidPath
+{
+	NSString* directory = inPath;
+	NSString* filename = @"";
+	
+	if (inFilename != nil && [inPath hasSuffix:inFilename])
+	{
+		directory = [inPath substringToIndex:[inPath length] - [inFilename length]];
+		filename = inFilename;
+	}
+	
+	@synchronized(self)
+	{
+		if (_rowCount == _rowCapacity)
+		{
+			_rowCapacity = MAX(2*_rowCapacity,256);
+			_rows = (IMBLightroomObjectRow*) realloc(_rows,_rowCapacity*sizeof(IMBLightroomObjectRow));
+		}
+		
+		IMBLightroomObjectRow* row = &_rows[_rowCount];
+		row->idLocal = inIdLocal;
+		row->width = (float)inWidth;
+		row->height = (float)inHeight;
+		row->directory = [self _offsetForString:directory intern:YES];
+		row->filename = [self _offsetForString:filename intern:NO];
+		row->name = [inName isEqualToString:filename] ? 0 : [self _offsetForString:inName intern:NO];
+		row->orientation = [self _offsetForString:inOrientation intern:YES];
+		row->pyramidPath = [self _offsetForString:inPyramidPath intern:NO];
+		_rowCount++;
+	}
+}
+
+
+- (void) setNodeObjects:(NSArray*)inNodeObjects first:(BOOL)inFirst
+{
+	@synchronized(self)
+	{
+		[_nodeObjects release];
+		_nodeObjects = [inNodeObjects copy];
+		_nodeObjectsFirst = inFirst;
+	}
+}
+
+
+- (NSUInteger) count
+{
+	@synchronized(self)
+	{
+		return _rowCount + [_nodeObjects count];
+	}
+}
+
+
+- (NSArray*) objects
+{
+	return [[[IMBVirtualObjectArray alloc] initWithCount:[self count] dataSource:self] autorelease];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Called lazily by IMBVirtualObjectArray, possibly on any thread. The metadata is the same that was created for 
+// each row before the store existed...
+
+- (IMBObject*) objectForRecord:(id)inRecord index:(NSUInteger)inIndex
+{
+	NSUInteger rowIndex = inIndex;
+	NSString* directory = nil;
+	NSString* filename = nil;
+	NSString* name = nil;
+	NSString* orientation = nil;
+	NSString* pyramidPath = nil;
+	IMBLightroomObjectRow row;
+	
+	@synchronized(self)
+	{
+		NSUInteger nodeObjectCount = [_nodeObjects count];
+		
+		if (_nodeObjectsFirst)
+		{
+			if (inIndex < nodeObjectCount) return [[[_nodeObjects objectAtIndex:inIndex] retain] autorelease];
+			rowIndex = inIndex - nodeObjectCount;
+		}
+		else if (inIndex >= _rowCount)
+		{
+			return [[[_nodeObjects objectAtIndex:inIndex - _rowCount] retain] autorelease];
+		}
+		
+		row = _rows[rowIndex];
+		directory = [self _stringAtOffset:row.directory];
+		filename = [self _stringAtOffset:row.filename];
+		name = row.name ? [self _stringAtOffset:row.name] : filename;
+		orientation = [self _stringAtOffset:row.orientation];
+		pyramidPath = [self _stringAtOffset:row.pyramidPath];
+	}
+
+	NSString* path = [directory stringByAppendingString:filename];
+	NSNumber* idLocal = [NSNumber numberWithLong:row.idLocal];
+	NSMutableDictionary* metadata = [NSMutableDictionary dictionary];
+	
+	[metadata setObject:path forKey:@"MasterPath"];
+	[metadata setObject:idLocal forKey:@"idLocal"];
+	[metadata setObject:path forKey:@"path"];
+	[metadata setObject:[NSNumber numberWithDouble:row.height] forKey:@"height"];
+	[metadata setObject:[NSNumber numberWithDouble:row.width] forKey:@"width"];
+	
+	if (orientation) {
+		[metadata setObject:orientation forKey:@"orientation"];
+	}
+	
+	if (name) {
+		[metadata setObject:name forKey:@"name"];
+	}
+	
+	return [_parser objectWithPath:path
+						   idLocal:idLocal
+							  name:name
+					   pyramidPath:pyramidPath
+						  metadata:metadata
+							 index:rowIndex];
+}
+
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
 #pragma mark 
 
 @implementation IMBLightroomParser
@@ -486,6 +764,33 @@ static NSArray* sSupportedUTIs = nil;
 }
 
 
+// Each thread uses its own database connections and all shared state is accessed under @synchronized, so sibling
+// nodes can be populated concurrently...
+
+- (BOOL) supportsConcurrentPopulation
+{
+	return YES;
+}
+
+
+// The connections are kept per thread (see database below). Close the ones for a worker thread that is done with 
+// us, so that they don't pile up as the thread pool hands out different threads over time...
+
+- (void) didStopUsingParserOnCurrentThread
+{
+	NSValue* key = [NSValue valueWithPointer:[NSThread currentThread]];
+	
+	@synchronized (self)
+	{
+		[[_databases objectForKey:key] close];
+		[_databases removeObjectForKey:key];
+		
+		[[_thumbnailDatabases objectForKey:key] close];
+		[_thumbnailDatabases removeObjectForKey:key];
+	}
+}
+
+
 //----------------------------------------------------------------------------------------------------------------------
 
 
@@ -525,7 +830,7 @@ static NSArray* sSupportedUTIs = nil;
 		FMResultSet* results = [database executeQuery:query];
 		NSInteger index = 0;
 		
-		while ([results next]) {
+		while (![IMBOperationQueue isCurrentOperationCancelled] && [results next]) {
 			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 			NSNumber* id_local = [NSNumber numberWithLong:[results longForColumn:@"id_local"]];
 			NSString* path = [results stringForColumn:@"absolutePath"];
@@ -616,7 +921,7 @@ static NSArray* sSupportedUTIs = nil;
 		FMResultSet* results = [database executeQuery:query, parentRootFolder, pathFromRootAccept, pathFromRootReject];
 		NSInteger index = 0;
 		
-		while ([results next]) {
+		while (![IMBOperationQueue isCurrentOperationCancelled] && [results next]) {
 			NSNumber* id_local = [NSNumber numberWithLong:[results longForColumn:@"id_local"]];
 			NSString* pathFromRoot = [results stringForColumn:@"pathFromRoot"];
 			
@@ -707,7 +1012,7 @@ static NSArray* sSupportedUTIs = nil;
 		
 		NSInteger index = 0;
 		
-		while ([results next]) {
+		while (![IMBOperationQueue isCurrentOperationCancelled] && [results next]) {
 			// Get properties for next collection. Also substitute missing names...
 			
 			NSNumber* idLocal = [NSNumber numberWithLong:[results longForColumn:@"id_local"]]; 
@@ -805,25 +1110,26 @@ static NSArray* sSupportedUTIs = nil;
 		inNode.displayedObjectCount = 0;
 	}
 	
-	// Query the database for image files for the specified node. Add an IMBObject for each one we find...
+	// Query the database for image files for the specified node. Add a row to the store for each one we find.
+	// The objects are created lazily by the store...
 	
 	FMDatabase *database = self.database;
 	
 	if (database != nil) {
-		NSMutableArray* objects = [NSMutableArray array];
+		IMBLightroomObjectStore* store = [[[IMBLightroomObjectStore alloc] initWithParser:self] autorelease];
 		NSString* query = [self folderObjectsQuery];
 		
 		NSDictionary* attributes = inNode.attributes;
 		NSString* folderPath = [self absolutePathFromAttributes:attributes];
 		NSNumber* folderId = [self idLocalFromAttributes:attributes];
 		FMResultSet* results = [database executeQuery:query, folderId, folderId];
-		NSUInteger index = 0;
 		
-		while ([results next]) {
+		while (![IMBOperationQueue isCurrentOperationCancelled] && [results next]) {
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 			NSString* filename = [results stringForColumn:@"idx_filename"];
 			NSNumber* idLocal = [NSNumber numberWithLong:[results longForColumn:@"id_local"]];
-			NSNumber* fileHeight = [NSNumber numberWithDouble:[results doubleForColumn:@"fileHeight"]];
-			NSNumber* fileWidth = [NSNumber numberWithDouble:[results doubleForColumn:@"fileWidth"]];
+			double fileHeight = [results doubleForColumn:@"fileHeight"];
+			double fileWidth = [results doubleForColumn:@"fileWidth"];
 			NSString* orientation = [results stringForColumn:@"orientation"];
 			NSString* caption = [results stringForColumn:@"caption"];
 			NSString* pyramidPath = ([results hasColumnWithName:@"pyramidPath"] ? [results stringForColumn:@"pyramidPath"] : nil);
@@ -835,35 +1141,35 @@ static NSArray* sSupportedUTIs = nil;
 			}
 			
 			if ([self canOpenImageFileAtPath:path]) {
-				NSMutableDictionary* metadata = [NSMutableDictionary dictionary];
+				[store addRowWithIdLocal:[idLocal longValue]
+									path:path
+								filename:filename
+									name:name
+								   width:fileWidth
+								  height:fileHeight
+							 orientation:orientation
+							 pyramidPath:pyramidPath];
 				
-				[metadata setObject:path forKey:@"MasterPath"];
-				[metadata setObject:idLocal forKey:@"idLocal"];
-				[metadata setObject:path forKey:@"path"];
-				[metadata setObject:fileHeight forKey:@"height"];
-				[metadata setObject:fileWidth forKey:@"width"];
-				[metadata setObject:orientation forKey:@"orientation"];
+				inNode.displayedObjectCount++;
 				
-				if (name) {
-					[metadata setObject:name forKey:@"name"];
-				}
+				// Only create a snapshot when populateNode:didAddObjects: may publish it (whenever the count doubles)...
 				
-				IMBObject* object = [self objectWithPath:path
-												 idLocal:idLocal
-													name:name
-											 pyramidPath:pyramidPath
-												metadata:metadata
-												   index:index++];
+				NSUInteger count = [store count];
 				
-				[objects addObject:object];
-				inNode.displayedObjectCount++;
+				if ((count & (count-1)) == 0) {
+					[self populateNode:inNode didAddObjects:[store objects]];
+				}
 			}
+			
+			[pool drain];
 		}
 		
 		[results close];
 		
-		[objects addObjectsFromArray:inNode.objects];
-		inNode.objects = objects;
+		// The subfolders (which were added by populateSubnodesForFolderNode:) are listed after the images...
+		
+		[store setNodeObjects:inNode.objects first:NO];
+		inNode.objects = [store objects];
 	}
 }
 
@@ -879,26 +1185,30 @@ static NSArray* sSupportedUTIs = nil;
 	// Add object array, even if nothing is found in database, so that we do not cause endless loop...
 	
 	if (inNode.objects == nil) {
-		inNode.objects = [NSMutableArray array];
+		inNode.objects = [NSArray array];
 		inNode.displayedObjectCount = 0;
 	}
 	
-	// Query the database for image files for the specified node. Add an IMBObject for each one we find...
+	// Query the database for image files for the specified node. Add a row to the store for each one we find.
+	// The subcollections (which were added by populateSubnodesForCollectionNode:) are listed before the images...
 	
 	FMDatabase *database = self.database;
 	
 	if (database != nil) {
+		IMBLightroomObjectStore* store = [[[IMBLightroomObjectStore alloc] initWithParser:self] autorelease];
+		[store setNodeObjects:inNode.objects first:YES];
+		
 		NSString* query = [self collectionObjectsQuery];
 		NSNumber* collectionId = [self idLocalFromAttributes:inNode.attributes];
 		FMResultSet* results = [database executeQuery:query, collectionId];
-		NSUInteger index = 0;
 		
-		while ([results next]) {
+		while (![IMBOperationQueue isCurrentOperationCancelled] && [results next]) {
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 			NSString* absolutePath = [results stringForColumn:@"absolutePath"];
 			NSString* filename = [results stringForColumn:@"idx_filename"];
 			NSNumber* idLocal = [NSNumber numberWithLong:[results longForColumn:@"id_local"]];
-			NSNumber* fileHeight = [NSNumber numberWithDouble:[results doubleForColumn:@"fileHeight"]];
-			NSNumber* fileWidth = [NSNumber numberWithDouble:[results doubleForColumn:@"fileWidth"]];
+			double fileHeight = [results doubleForColumn:@"fileHeight"];
+			double fileWidth = [results doubleForColumn:@"fileWidth"];
 			NSString* orientation = [results stringForColumn:@"orientation"];
 			NSString* caption = [results stringForColumn:@"caption"];
 			NSString* pyramidPath = ([results hasColumnWithName:@"pyramidPath"] ? [results stringForColumn:@"pyramidPath"] : nil);
@@ -910,31 +1220,30 @@ static NSArray* sSupportedUTIs = nil;
 			}
 			
 			if ([self canOpenImageFileAtPath:path]) {
-				NSMutableDictionary* metadata = [NSMutableDictionary dictionary];
+				[store addRowWithIdLocal:[idLocal longValue]
+									path:path
+								filename:filename
+									name:name
+								   width:fileWidth
+								  height:fileHeight
+							 orientation:orientation
+							 pyramidPath:pyramidPath];
 				
-				[metadata setObject:path forKey:@"MasterPath"];
-				[metadata setObject:idLocal forKey:@"idLocal"];
-				[metadata setObject:path forKey:@"path"];
-				[metadata setObject:fileHeight forKey:@"height"];
-				[metadata setObject:fileWidth forKey:@"width"];
-				[metadata setObject:orientation forKey:@"orientation"];
+				inNode.displayedObjectCount++;
 				
-				if (name) {
-					[metadata setObject:name forKey:@"name"];
-				}
+				NSUInteger count = [store count];
 				
-				IMBObject* object = [self objectWithPath:path
-												 idLocal:idLocal
-													name:name
-											 pyramidPath:pyramidPath
-												metadata:metadata
-												   index:index++];
-				[(NSMutableArray*)inNode.objects addObject:object];
-				inNode.displayedObjectCount++;
+				if ((count & (count-1)) == 0) {
+					[self populateNode:inNode didAddObjects:[store objects]];
+				}
 			}
+			
+			[pool drain];
 		}
 		
 		[results close];
+		
+		inNode.objects = [store objects];
 	}
 }
 
@@ -1015,89 +1324,6 @@ static NSArray* sSupportedUTIs = nil;
 	}	
 }
 
-- (CGImageRef)imageRotated:(CGImageRef)imgRef forOrientation:(NSInteger)orientationProperty
-{
-	CGFloat w = CGImageGetWidth(imgRef);
-	CGFloat h = CGImageGetHeight(imgRef);
-	
-	CGAffineTransform transform = {0};
-	
-	switch (orientationProperty) {
-		case 1:
-			// 1 = 0th row is at the top, and 0th column is on the left.
-			// Orientation Normal
-			transform = CGAffineTransformMake(1.0, 0.0, 0.0, 1.0, 0.0, 0.0);
-			break;
-			
-		case 2:
-			// 2 = 0th row is at the top, and 0th column is on the right.
-			// Flip Horizontal
-			transform = CGAffineTransformMake(-1.0, 0.0, 0.0, 1.0, w, 0.0);
-			break;
-			
-		case 3:
-			// 3 = 0th row is at the bottom, and 0th column is on the right.
-			// Rotate 180 degrees
-			transform = CGAffineTransformMake(-1.0, 0.0, 0.0, -1.0, w, h);
-			break;
-			
-		case 4:
-			// 4 = 0th row is at the bottom, and 0th column is on the left.
-			// Flip Vertical
-			transform = CGAffineTransformMake(1.0, 0.0, 0, -1.0, 0.0, h);
-			break;
-			
-		case 5:
-			// 5 = 0th row is on the left, and 0th column is the top.
-			// Rotate -90 degrees and Flip Vertical
-			transform = CGAffineTransformMake(0.0, -1.0, -1.0, 0.0, h, w);
-			break;
-			
-		case 6:
-			// 6 = 0th row is on the right, and 0th column is the top.
-			// Rotate 90 degrees
-			transform = CGAffineTransformMake(0.0, -1.0, 1.0, 0.0, 0.0, w);
-			break;
-			
-		case 7:
-			// 7 = 0th row is on the right, and 0th column is the bottom.
-			// Rotate 90 degrees and Flip Vertical
-			transform = CGAffineTransformMake(0.0, 1.0, 1.0, 0.0, 0.0, 0.0);
-			break;
-			
-		case 8:
-			// 8 = 0th row is on the left, and 0th column is the bottom.
-			// Rotate -90 degrees
-			transform = CGAffineTransformMake(0.0, 1.0,-1.0, 0.0, h, 0.0);
-			break;
-	}
-	
-	CGImageRef rotatedImage = NULL;
-	CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
-	CGContextRef context = CGBitmapContextCreate(NULL,
-												 (orientationProperty < 5) ? w : h,
-												 (orientationProperty < 5) ? h : w,
-												 8,
-												 0,
-												 colorSpace,
-												 kCGImageAlphaPremultipliedFirst);
-	CGColorSpaceRelease(colorSpace);
-												 
-	if (context)
-	{											 
-		CGContextSetAllowsAntialiasing(context, FALSE);
-		CGContextSetInterpolationQuality(context, kCGInterpolationNone);
-		CGContextConcatCTM(context, transform);
-		CGContextDrawImage(context, CGRectMake(0, 0, w, h), imgRef);
-		rotatedImage = CGBitmapContextCreateImage(context);
-		CFRelease(context);
-		
-		[NSMakeCollectable(rotatedImage) autorelease];
-	}
-	
-	return rotatedImage;
-}
-
 - (NSString*)pyramidPathForImage:(NSNumber*)idLocal
 {
 	FMDatabase *database = [self thumbnailDatabase];
@@ -1257,7 +1483,7 @@ static NSArray* sSupportedUTIs = nil;
 	{
 		IMBLightroomObject* object = (IMBLightroomObject*)inObject;
 		NSMutableDictionary* metadata = [NSMutableDictionary dictionaryWithDictionary:object.preliminaryMetadata];
-		[metadata addEntriesFromDictionary:[NSImage imb_metadataFromImageAtPath:object.path checkSpotlightComments:NO]];
+		[metadata addEntriesFromDictionary:[[IMBMetadataCache sharedCache] imageMetadataForFileAtPath:object.path]];
 		NSString* description = [self metadataDescriptionForMetadata:metadata];
 		
 		if ([NSThread isMainThread])
@@ -0,0 +1,103 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBSQLiteCache.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// IMBMetadataCache stores the metadata dictionaries and metadataDescription strings that parsers compute for files. 
+// Entries are keyed by a domain (usually the parser class name) and the file path, and are only valid while the 
+// modification date, status change date and size of the file still match. That way re-opening a large folder can show sizes, durations 
+// and dates instantly instead of opening every file again...
+
+@interface IMBMetadataCache : IMBSQLiteCache
+
++ (IMBMetadataCache*) sharedCache;
+
+// Limits for the background compaction. Entries that have not been used for the given time interval are purged,
+// and if the store still contains more entries than allowed, the least recently used ones are purged...
+
++ (void) setMaxEntryCount:(NSUInteger)inCount;
++ (NSUInteger) maxEntryCount;
+
++ (void) setMaxEntryAge:(NSTimeInterval)inAge;
++ (NSTimeInterval) maxEntryAge;
+
+// Returns YES if a valid entry exists for the file at the given path. Either out parameter may be NULL...
+
+- (BOOL) getMetadata:(NSDictionary**)outMetadata metadataDescription:(NSString**)outDescription forFileAtPath:(NSString*)inPath domain:(NSString*)inDomain;
+
+// Stores the metadata (and optional description) for the file at the given path. The modification date, status 
+// change date and size of the file are recorded at this time...
+
+- (void) setMetadata:(NSDictionary*)inMetadata metadataDescription:(NSString*)inDescription forFileAtPath:(NSString*)inPath domain:(NSString*)inDomain;
+
+// Cached versions of the file based metadata readers. These are shared by all parsers that read the same kind of 
+// file (e.g. the iPhoto, Aperture and Lightroom parsers all look at the image files of their libraries), so the 
+// entries live in common domains rather than per parser domains...
+
+- (NSDictionary*) imageMetadataForFileAtPath:(NSString*)inPath;
+- (NSDictionary*) videoMetadataForURL:(NSURL*)inURL;
+- (NSDictionary*) audioMetadataForURL:(NSURL*)inURL;
+
+- (void) removeEntryForFileAtPath:(NSString*)inPath domain:(NSString*)inDomain;
+- (void) removeAllEntries;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
@@ -0,0 +1,486 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBMetadataCache.h"
+#import "IMBCommon.h"
+#import "FMDatabase.h"
+#import "NSImage+iMedia.h"
+#import "NSURL+iMedia.h"
+#import <sys/stat.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Bump this version whenever the layout of the table or the format of the stored metadata changes...
+
+static const int kIMBMetadataCacheSchemaVersion = 2;
+
+static const NSUInteger kIMBMetadataCacheCompactionInterval = 512;
+static const NSTimeInterval kIMBMetadataCacheAccessGranularity = 24.0 * 60.0 * 60.0;
+
+// Domains for the metadata that is read directly from files and shared by all parsers...
+
+static NSString* const kIMBMetadataCacheImageDomain = @"ImageFile";
+static NSString* const kIMBMetadataCacheVideoDomain = @"VideoFile";
+static NSString* const kIMBMetadataCacheAudioDomain = @"AudioFile";
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static IMBMetadataCache* sSharedCache = nil;
+static NSUInteger sMaxEntryCount = 100000;
+static NSTimeInterval sMaxEntryAge = 60.0 * 24.0 * 60.0 * 60.0;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@implementation IMBMetadataCache
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
++ (void) setMaxEntryCount:(NSUInteger)inCount
+{
+	sMaxEntryCount = inCount;
+}
+
+
++ (NSUInteger) maxEntryCount
+{
+	return sMaxEntryCount;
+}
+
+
++ (void) setMaxEntryAge:(NSTimeInterval)inAge
+{
+	sMaxEntryAge = inAge;
+}
+
+
++ (NSTimeInterval) maxEntryAge
+{
+	return sMaxEntryAge;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
++ (IMBMetadataCache*) sharedCache
+{
+	@synchronized(self)
+	{
+		if (sSharedCache == nil)
+		{
+			sSharedCache = [[IMBMetadataCache alloc] init];
+		}
+	}
+	
+	return sSharedCache;
+}
+
+
+- (id) init
+{
+	return [super initWithName:@"Metadata"];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Database
+
+- (int) schemaVersion
+{
+	return kIMBMetadataCacheSchemaVersion;
+}
+
+
+- (void) resetDatabase
+{
+	[_database executeUpdate:@"DROP TABLE IF EXISTS metadata"];
+	[_database executeUpdate:@"DROP TABLE IF EXISTS info"];
+	[_database executeUpdate:@"PRAGMA auto_vacuum = INCREMENTAL"];
+	[_database executeUpdate:@"VACUUM"];
+}
+
+
+// Descriptions are localized, so a change of the UI language invalidates all of them...
+
+- (BOOL) prepareDatabase
+{
+	BOOL ok = 
+		[_database executeUpdate:@"CREATE TABLE IF NOT EXISTS metadata (domain TEXT NOT NULL, path TEXT NOT NULL, mtime REAL NOT NULL, ctime REAL NOT NULL, size INTEGER NOT NULL, metadata BLOB, description TEXT, accessed REAL NOT NULL, PRIMARY KEY (domain, path))"] &&
+		[_database executeUpdate:@"CREATE INDEX IF NOT EXISTS metadata_accessed ON metadata (accessed)"] &&
+		[_database executeUpdate:@"CREATE TABLE IF NOT EXISTS info (key TEXT PRIMARY KEY, value TEXT)"];
+	
+	if (!ok) return NO;
+	
+	NSString* language = [[IMBBundle() preferredLocalizations] objectAtIndex:0];
+	NSString* storedLanguage = nil;
+	
+	FMResultSet* results = [_database executeQuery:@"SELECT value FROM info WHERE key = 'language'"];
+	if ([results next]) storedLanguage = [results stringForColumnIndex:0];
+	[results close];
+	
+	if (language != nil && ![language isEqualToString:storedLanguage])
+	{
+		[_database executeUpdate:@"DELETE FROM metadata"];
+		[_database executeUpdate:@"INSERT OR REPLACE INTO info (key,value) VALUES ('language',?)",language];
+	}
+	
+	return YES;
+}
+
+
+- (NSTimeInterval) accessGranularity
+{
+	return kIMBMetadataCacheAccessGranularity;
+}
+
+
+- (NSUInteger) compactionInterval
+{
+	return kIMBMetadataCacheCompactionInterval;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Returns the modification date, status change date and size of a file. A plain stat is used as this is called 
+// very often. The status change date is part of the key because some metadata (e.g. the Finder comment, which is 
+// stored in an extended attribute) can change without touching the modification date or size of the file...
+
+static BOOL _IMBStatFile(NSString* inPath,double* outModificationTime,double* outStatusChangeTime,long long* outSize)
+{
+	struct stat info;
+	
+	if (inPath == nil) return NO;
+	if (stat([inPath fileSystemRepresentation],&info) != 0) return NO;
+	if (!S_ISREG(info.st_mode)) return NO;
+	
+	*outModificationTime = (double)info.st_mtimespec.tv_sec + (double)info.st_mtimespec.tv_nsec * 1.0e-9;
+	*outStatusChangeTime = (double)info.st_ctimespec.tv_sec + (double)info.st_ctimespec.tv_nsec * 1.0e-9;
+	*outSize = (long long)info.st_size;
+	return YES;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Accessors
+
+
+- (BOOL) getMetadata:(NSDictionary**)outMetadata metadataDescription:(NSString**)outDescription forFileAtPath:(NSString*)inPath domain:(NSString*)inDomain
+{
+	double mtime = 0.0;
+	double ctime = 0.0;
+	long long size = 0;
+	
+	if (_database == nil || inDomain == nil) return NO;
+	if (!_IMBStatFile(inPath,&mtime,&ctime,&size)) return NO;
+	
+	NSData* data = nil;
+	NSString* description = nil;
+	BOOL found = NO;
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:
+			@"SELECT metadata, description, accessed FROM metadata WHERE domain = ? AND path = ? AND mtime = ? AND ctime = ? AND size = ?",
+			inDomain,
+			inPath,
+			[NSNumber numberWithDouble:mtime],
+			[NSNumber numberWithDouble:ctime],
+			[NSNumber numberWithLongLong:size]];
+			
+		if ([results next])
+		{
+			found = YES;
+			data = [results dataForColumnIndex:0];
+			description = [results stringForColumnIndex:1];
+			NSTimeInterval accessed = [results doubleForColumnIndex:2];
+			[results close];
+			
+			NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+			
+			if (now - accessed > [self accessGranularity])
+			{
+				[_database executeUpdate:@"UPDATE metadata SET accessed = ? WHERE domain = ? AND path = ?",
+					[NSNumber numberWithDouble:now],
+					inDomain,
+					inPath];
+			}
+		}
+		else
+		{
+			[results close];
+		}
+	}
+	
+	if (!found) return NO;
+	
+	NSDictionary* metadata = nil;
+	
+	if (data)
+	{
+		@try
+		{
+			metadata = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+		}
+		@catch (NSException* inException)
+		{
+			NSLog(@"%s Discarding corrupt metadata cache entry for %@: %@",__FUNCTION__,inPath,inException);
+			[self removeEntryForFileAtPath:inPath domain:inDomain];
+			return NO;
+		}
+		
+		if (![metadata isKindOfClass:[NSDictionary class]]) return NO;
+	}
+	
+	if (outMetadata) *outMetadata = metadata;
+	if (outDescription) *outDescription = description;
+	return YES;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+- (void) setMetadata:(NSDictionary*)inMetadata metadataDescription:(NSString*)inDescription forFileAtPath:(NSString*)inPath domain:(NSString*)inDomain
+{
+	double mtime = 0.0;
+	double ctime = 0.0;
+	long long size = 0;
+	
+	if (_database == nil || inDomain == nil) return;
+	if (!_IMBStatFile(inPath,&mtime,&ctime,&size)) return;
+	
+	NSData* data = nil;
+	
+	if (inMetadata)
+	{
+		@try
+		{
+			data = [NSKeyedArchiver archivedDataWithRootObject:inMetadata];
+		}
+		@catch (NSException* inException)
+		{
+			// Metadata containing objects that cannot be archived is simply not cached...
+			return;
+		}
+	}
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:
+			@"INSERT OR REPLACE INTO metadata (domain, path, mtime, ctime, size, metadata, description, accessed) VALUES (?,?,?,?,?,?,?,?)",
+			inDomain,
+			inPath,
+			[NSNumber numberWithDouble:mtime],
+			[NSNumber numberWithDouble:ctime],
+			[NSNumber numberWithLongLong:size],
+			data ? (id)data : (id)[NSNull null],
+			inDescription ? (id)inDescription : (id)[NSNull null],
+			[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]]];
+	}
+	
+	[self didStoreEntry];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Shared File Metadata
+
+
+- (NSDictionary*) imageMetadataForFileAtPath:(NSString*)inPath
+{
+	NSDictionary* metadata = nil;
+	
+	if (![self getMetadata:&metadata metadataDescription:NULL forFileAtPath:inPath domain:kIMBMetadataCacheImageDomain])
+	{
+		metadata = [NSImage imb_metadataFromImageAtPath:inPath checkSpotlightComments:NO];
+		[self setMetadata:metadata metadataDescription:nil forFileAtPath:inPath domain:kIMBMetadataCacheImageDomain];
+	}
+	
+	return metadata;
+}
+
+
+// Only file URLs can be cached, as entries are validated against the modification date and size of the file...
+
+- (NSDictionary*) videoMetadataForURL:(NSURL*)inURL
+{
+	NSDictionary* metadata = nil;
+	NSString* path = [inURL isFileURL] ? [inURL path] : nil;
+	
+	if (![self getMetadata:&metadata metadataDescription:NULL forFileAtPath:path domain:kIMBMetadataCacheVideoDomain])
+	{
+		metadata = [NSURL imb_metadataFromVideoAtURL:inURL];
+		[self setMetadata:metadata metadataDescription:nil forFileAtPath:path domain:kIMBMetadataCacheVideoDomain];
+	}
+	
+	return metadata;
+}
+
+
+- (NSDictionary*) audioMetadataForURL:(NSURL*)inURL
+{
+	NSDictionary* metadata = nil;
+	NSString* path = [inURL isFileURL] ? [inURL path] : nil;
+	
+	if (![self getMetadata:&metadata metadataDescription:NULL forFileAtPath:path domain:kIMBMetadataCacheAudioDomain])
+	{
+		metadata = [NSURL imb_metadataFromAudioAtURL:inURL];
+		[self setMetadata:metadata metadataDescription:nil forFileAtPath:path domain:kIMBMetadataCacheAudioDomain];
+	}
+	
+	return metadata;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+- (void) removeEntryForFileAtPath:(NSString*)inPath domain:(NSString*)inDomain
+{
+	if (_database == nil || inPath == nil || inDomain == nil) return;
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:@"DELETE FROM metadata WHERE domain = ? AND path = ?",inDomain,inPath];
+	}
+}
+
+
+- (void) removeAllEntries
+{
+	if (_database == nil) return;
+
+	@synchronized(self)
+	{
+		[_database executeUpdate:@"DELETE FROM metadata"];
+		[_database executeUpdate:@"PRAGMA incremental_vacuum"];
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Compaction
+
+
+// First purge entries that have not been used for a long time, then trim the least recently used entries if the
+// store is still too big. Finally give the freed pages back to the file system. Each step takes the lock separately,
+// so that lookups from other threads are only blocked briefly...
+
+- (void) compactDatabase
+{
+	NSTimeInterval cutoff = [NSDate timeIntervalSinceReferenceDate] - sMaxEntryAge;
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:@"DELETE FROM metadata WHERE accessed < ?",[NSNumber numberWithDouble:cutoff]];
+	}
+	
+	NSUInteger count = 0;
+	
+	@synchronized(self)
+	{
+		FMResultSet* results = [_database executeQuery:@"SELECT COUNT(*) FROM metadata"];
+		if ([results next]) count = (NSUInteger)[results longLongIntForColumnIndex:0];
+		[results close];
+	}
+	
+	if (count > sMaxEntryCount)
+	{
+		@synchronized(self)
+		{
+			[_database executeUpdate:
+				@"DELETE FROM metadata WHERE rowid IN (SELECT rowid FROM metadata ORDER BY accessed ASC LIMIT ?)",
+				[NSNumber numberWithLongLong:(long long)(count - sMaxEntryCount)]];
+		}
+	}
+	
+	@synchronized(self)
+	{
+		[_database executeUpdate:@"PRAGMA incremental_vacuum"];
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@end
@@ -56,6 +56,7 @@
 #import "IMBObject.h"
 #import "IMBParser.h"
 #import "IMBLibraryController.h"
+#import "IMBVirtualObjectArray.h"
 #import "NSString+iMedia.h"
 
 
@@ -179,9 +180,14 @@
 	
 	copy.shouldDisplayObjectView = self.shouldDisplayObjectView;
 	
-	// Create a shallow copy of objects array...
+	// Create a shallow copy of objects array. Virtual object arrays are immutable and can simply be shared, 
+	// which avoids creating all of their objects...
 	
-	if (self.objects)
+	if ([self.objects isKindOfClass:[IMBVirtualObjectArray class]])
+	{
+		copy.objects = self.objects;
+	}
+	else if (self.objects)
     {
         copy.objects = [NSMutableArray arrayWithArray:self.objects];
     }
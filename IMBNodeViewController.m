@@ -62,6 +62,7 @@
 #import "IMBNode.h"
 #import "IMBNodeCell.h"
 #import "IMBFlickrNode.h"
+#import "IMBVirtualObjectArray.h"
 #import "NSView+iMedia.h"
 #import "NSFileManager+iMedia.h"
 
@@ -602,6 +603,16 @@ static NSString* kIMBSelectNodeWithIdentifierNotification = @"IMBSelectNodeWithI
 		
 		[self.libraryController stopPopulatingNodeWithIdentifier:self.selectedNodeIdentifier];
 
+		// Objects of very large nodes are created on demand. Once the old node's objects are no longer displayed,
+		// release them again (at the end of this event, when the object views have switched to the new node)...
+		
+		NSArray* oldObjects = [self.libraryController nodeWithIdentifier:self.selectedNodeIdentifier].objects;
+		
+		if ([oldObjects isKindOfClass:[IMBVirtualObjectArray class]])
+		{
+			[oldObjects performSelector:@selector(recycleAllObjects) withObject:nil afterDelay:0.0];
+		}
+
 		if (newNode)
 		{
 			[self.libraryController populateNode:newNode];
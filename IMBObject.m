@@ -90,6 +90,7 @@ NSString* kIMBQuickLookImageProperty = @"quickLookImage";
 @property (copy) NSString *parserMediaSource;
 
 - (CGImageRef) _renderQuickLookImage;
+- (NSString*) _storedMetadataDescription;
 @end
 
 
@@ -117,7 +118,71 @@ NSString* kIMBQuickLookImageProperty = @"quickLookImage";
 @synthesize imageVersion = _imageVersion;
 @synthesize isLoadingThumbnail = _isLoadingThumbnail;
 
-@synthesize metadataDescription = _metadataDescription;
+
+// Parsers that provide the metadataDescription lazily get asked for it on first access. Usually this only happens 
+// for visible rows. The parser is called outside of the lock, so that formatting doesn't block other threads that
+// access this object. If two threads race here, the first result is kept...
+
+- (NSString*) metadataDescription
+{
+	NSString* description = nil;
+	NSDictionary* metadata = nil;
+	IMBParser* parser = nil;
+	
+	@synchronized(self)
+	{
+		description = [[_metadataDescription retain] autorelease];
+		
+		if (description == nil)
+		{
+			metadata = [[_metadata retain] autorelease];
+			parser = [[_parser retain] autorelease];
+		}
+	}
+	
+	if (description == nil && metadata != nil && 
+		[parser providesMetadataDescriptionLazily] &&
+		[parser respondsToSelector:@selector(metadataDescriptionForMetadata:)])
+	{
+		description = [parser performSelector:@selector(metadataDescriptionForMetadata:) withObject:metadata];
+		
+		@synchronized(self)
+		{
+			if (_metadataDescription == nil && _metadata == metadata)
+			{
+				_metadataDescription = [description copy];
+			}
+		}
+	}
+	
+	return description;
+}
+
+
+// Returns the description without formatting it lazily. Used when copying or archiving objects, so that doing so 
+// doesn't format descriptions that nobody is going to look at...
+
+- (NSString*) _storedMetadataDescription
+{
+	@synchronized(self)
+	{
+		return [[_metadataDescription retain] autorelease];
+	}
+}
+
+
+- (void) setMetadataDescription:(NSString*)inMetadataDescription
+{
+	@synchronized(self)
+	{
+		if (inMetadataDescription != _metadataDescription)
+		{
+			[_metadataDescription release];
+			_metadataDescription = [inMetadataDescription retain];
+		}
+	}
+}
+
 
 @synthesize parser = _parser;
 - (void)setParser:(IMBParser *)parser
@@ -212,7 +277,7 @@ NSString* kIMBQuickLookImageProperty = @"quickLookImage";
 	[inCoder encodeObject:self.parserMediaType forKey:@"parserMediaType"];
 	[inCoder encodeObject:self.preliminaryMetadata forKey:@"preliminaryMetadata"];
 	[inCoder encodeObject:self.metadata forKey:@"metadata"];
-	[inCoder encodeObject:self.metadataDescription forKey:@"metadataDescription"];
+	[inCoder encodeObject:[self _storedMetadataDescription] forKey:@"metadataDescription"];
 	[inCoder encodeInteger:self.index forKey:@"index"];
 	[inCoder encodeBool:self.shouldDrawAdornments forKey:@"shouldDrawAdornments"];
 	[inCoder encodeBool:self.shouldDisableTitle forKey:@"shouldDisableTitle"];
@@ -227,7 +292,7 @@ NSString* kIMBQuickLookImageProperty = @"quickLookImage";
 	copy.name = self.name;
 	copy.preliminaryMetadata = self.preliminaryMetadata;
 	copy.metadata = self.metadata;
-	copy.metadataDescription = self.metadataDescription;
+	copy.metadataDescription = [self _storedMetadataDescription];
 	copy.parser = self.parser;
     copy.parserClassName = self.parserClassName;
 	copy.parserMediaType = self.parserMediaType;
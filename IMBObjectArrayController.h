@@ -53,6 +53,7 @@
 #pragma mark CLASSES
 
 @class IMBObject;
+@class IMBVirtualObjectArray;
 @protocol IMBObjectArrayControllerDelegate;
 
 #pragma mark 
@@ -64,6 +65,7 @@
 	NSString* _searchString;
 	id <IMBObjectArrayControllerDelegate> _delegate;
 	id _newObject;
+	IMBVirtualObjectArray* _virtualArrangedObjects;
 }
 
 @property (nonatomic, assign) IBOutlet id <IMBObjectArrayControllerDelegate> delegate;
@@ -75,6 +77,12 @@
 - (IBAction) search:(id)inSender;
 - (IBAction) resetSearch:(id)inSender;
 
+// If the content is an IMBVirtualObjectArray and there is nothing to search, filter, or sort, then the content is 
+// arranged as is, so that its objects don't all have to be created. In this case this returns the content (which has 
+// the same indexes as arrangedObjects), otherwise nil...
+
+@property (readonly) IMBVirtualObjectArray* virtualArrangedObjects;
+
 @end
 
 
@@ -91,6 +99,11 @@
 
 - (id) proxyForObject:(id)inObject;
 
+// Returns NO if objectArrayController:filterObject: currently lets all objects pass. If not implemented, the
+// delegate is assumed to filter...
+
+- (BOOL) objectArrayControllerFiltersObjects:(IMBObjectArrayController*)inController;
+
 @end
 
 
@@ -53,6 +53,7 @@
 #pragma mark HEADERS
 
 #import "IMBObjectArrayController.h"
+#import "IMBVirtualObjectArray.h"
 #import "IMBObject.h"
 #import "IMBParser.h"
 #import "IMBCommon.h"
@@ -76,6 +77,7 @@ const NSString* kSearchStringContext = @"searchString";
 @synthesize delegate = _delegate;
 @synthesize searchableProperties = _searchableProperties;
 @synthesize searchString = _searchString;
+@synthesize virtualArrangedObjects = _virtualArrangedObjects;
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -103,6 +105,7 @@ const NSString* kSearchStringContext = @"searchString";
 	[self removeObserver:self forKeyPath:@"searchString"];
 	IMBRelease(_searchableProperties);
 	IMBRelease(_searchString);
+	IMBRelease(_virtualArrangedObjects);
 	[super dealloc];
 }
 
@@ -164,6 +167,23 @@ const NSString* kSearchStringContext = @"searchString";
 {
 	BOOL hasProxyForObject = _delegate && [_delegate respondsToSelector:@selector(proxyForObject:)];
 
+	// Very large virtual arrays are displayed as is if there is nothing to do for us. Iterating over them would 
+	// create every single object, while the views only ever ask for the visible ones...
+	
+	IMBRelease(_virtualArrangedObjects);
+	
+	if ([inObjects isKindOfClass:[IMBVirtualObjectArray class]] && 
+		[self filterPredicate] == nil && 
+		[[self sortDescriptors] count] == 0 && 
+		[_searchString length] == 0 && 
+		_newObject == nil && 
+		!hasProxyForObject &&
+		(_delegate == nil || ([_delegate respondsToSelector:@selector(objectArrayControllerFiltersObjects:)] && ![_delegate objectArrayControllerFiltersObjects:self])))
+	{
+		_virtualArrangedObjects = (IMBVirtualObjectArray*)[inObjects retain];
+		return inObjects;
+	}
+
 	// If we have a filterPredicate, then the array is already filtered at this point. All we need 
 	// to do is replace the objects with proxies...
 	
@@ -79,6 +79,7 @@
 #import "IMBFlickrNode.h"
 #import "NSFileManager+iMedia.h"
 #import "IMBButtonObject.h"
+#import "IMBVirtualObjectArray.h"
 
 
 @interface NSWindow (Mac_OS_X_10_7)
@@ -133,6 +134,8 @@ NSString* const IMBObjectViewControllerSegmentedControlKey = @"SegmentedControl"
 - (void) _reloadListView;
 - (void) _reloadComboView;
 - (void) _updateTooltips;
+- (void) _updateVisibleRangeOfIconView;
+- (void) _setVisibleRangeOfVirtualObjects:(NSRange)inRange;
 
 - (BOOL) writesLocalFilesToPasteboard;
 - (void) _downloadDraggedObjectsToDestination:(NSURL*)inDestination;
@@ -970,6 +973,39 @@ NSString* const IMBObjectViewControllerSegmentedControlKey = @"SegmentedControl"
 - (void) iconViewVisibleItemsChanged:(NSNotification *)notification
 {
 	[self _updateTooltips];
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_updateVisibleRangeOfIconView) object:nil];
+	[self performSelector:@selector(_updateVisibleRangeOfIconView) withObject:nil afterDelay:0.1];
+}
+
+
+// Objects of very large nodes are created on demand (see IMBVirtualObjectArray). Tell the array which objects
+// are visible, so that it can get rid of the ones that were scrolled past...
+
+- (void) _updateVisibleRangeOfIconView
+{
+	if (self.viewType != kIMBObjectViewTypeIcon || !IMBRunningOnSnowLeopardOrNewer()) return;
+	
+	NSIndexSet* indexes = [ibIconView visibleItemIndexes];
+	NSRange range = NSMakeRange(0,0);
+	
+	if ([indexes count] > 0)
+	{
+		range = NSMakeRange([indexes firstIndex],[indexes lastIndex] - [indexes firstIndex] + 1);
+	}
+	
+	[self _setVisibleRangeOfVirtualObjects:range];
+}
+
+
+- (void) _setVisibleRangeOfVirtualObjects:(NSRange)inRange
+{
+	IMBVirtualObjectArray* objects = [ibObjectArrayController virtualArrangedObjects];
+	
+	if (objects != nil && inRange.length > 0)
+	{
+		[objects setVisibleRange:inRange];
+	}
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -2282,6 +2318,8 @@ NSString* const IMBObjectViewControllerSegmentedControlKey = @"SegmentedControl"
 	// Finally cache our old visible items set
 	[_observedVisibleItems release];
     _observedVisibleItems = newVisibleItemsSetRetained;
+	
+	[self _setVisibleRangeOfVirtualObjects:newVisibleRows];
 }
 
 
@@ -2349,6 +2387,14 @@ NSString* const IMBObjectViewControllerSegmentedControlKey = @"SegmentedControl"
 #pragma mark 
 #pragma mark IMBObjectArrayControllerDelegate
 
+// Lets IMBObjectArrayController skip asking us about every single object...
+
+- (BOOL) objectArrayControllerFiltersObjects:(IMBObjectArrayController*)inController
+{
+	return ibObjectFilter != kIMBObjectFilterAll;
+}
+
+
 - (BOOL) objectArrayController:(IMBObjectArrayController*)inController filterObject:(IMBObject*)inObject
 {
 	id <IMBObjectViewControllerDelegate> delegate = nil;
@@ -68,8 +68,11 @@ extern NSString* kIMBPasteboardTypeObjectsPromise;
 
 
 @class IMBObject;
+@class IMBObjectsPromise;
 @protocol IMBObjectsPromiseDelegate;
 
+typedef void (^IMBObjectsPromiseCompletionHandler)(IMBObjectsPromise* inPromise,NSError* inError);
+
 
 #pragma mark 
 
@@ -88,11 +91,13 @@ extern NSString* kIMBPasteboardTypeObjectsPromise;
 	NSString* _destinationDirectoryPath;
 	NSError* _error;
 	
-	int _objectCountTotal;
-	int _objectCountLoaded;
+	volatile int32_t _objectCountTotal;
+	volatile int32_t _objectCountLoaded;	// Only modify with -didLoadObject, as downloads finish on several threads
 	NSObject <IMBObjectsPromiseDelegate> *_delegate;
 	SEL _finishSelector;
 	BOOL _wasCanceled;
+	CFAbsoluteTime _lastProgressTime;
+	IMBObjectsPromiseCompletionHandler _completionHandler;
 }
 
 
@@ -114,6 +119,17 @@ extern NSString* kIMBPasteboardTypeObjectsPromise;
 // Special case until we have blocks support so you can run a custom method upon completion
 
 - (void) setDelegate:(NSObject <IMBObjectsPromiseDelegate> *)delegate completionSelector:(SEL)selector;
+
+// Starts the promise and returns right away. The handler is called exactly once on the main thread: with the error 
+// of a failed object (or nil) when the promise is fulfilled, with NSUserCancelledError when it was cancelled, or 
+// with ETIMEDOUT when it did not finish within the timeout (in which case it is cancelled). A timeout of 0 means 
+// no timeout. Call this on the main thread. The delegate is still informed as usual...
+
+- (void) startWithTimeout:(NSTimeInterval)inTimeout completionHandler:(IMBObjectsPromiseCompletionHandler)inHandler;
+
+// Blocks the caller by spinning a nested runloop until all objects are available. Prefer the completion handler 
+// above, as the nested runloop may dispatch unrelated events (e.g. during a drag)...
+
 - (void) waitUntilFinished;
 
 
@@ -152,6 +168,16 @@ extern NSString* kIMBPasteboardTypeObjectsPromise;
 #pragma mark Subclass Support
 - (void)setFileURL:(NSURL *)URL error:(NSError *)error forObject:(IMBObject *)object;
 
+// Atomically counts another loaded (or failed) object. Returns YES for exactly one caller: the one that loaded 
+// the last object, which is then responsible for finishing the promise...
+
+- (BOOL) didLoadObject;
+
+// Reports progress to the delegate on the main thread (throttled)...
+
+- (void) prepareProgress;
+- (void) displayProgress:(double)inFraction;
+
 
 @end
 
@@ -190,9 +216,15 @@ didFailLoadingWithError:(NSError *)error;
 #pragma mark
 
 // This subclass is used for local object files that can be returned immediately. In this case a promise isn't 
-// really necessary, but to make the architecture more consistent, this abstraction is used nonetheless... 
+// really necessary, but to make the architecture more consistent, this abstraction is used nonetheless. If the 
+// client sets a destinationDirectoryPath, then the files are materialized there in the background: as clones 
+// where the file system supports it, or else as a chunked parallel copy with progress reporting... 
 
 @interface IMBLocalObjectsPromise : IMBObjectsPromise
+{
+	long long _bytesToCopy;
+	volatile int64_t _bytesCopied;
+}
 
 @end
 
@@ -211,20 +243,26 @@ didFailLoadingWithError:(NSError *)error;
 	NSMutableArray* _getSizeOperations;
 	NSMutableArray* _downloadOperations;
 	long long _totalBytes;
+	volatile int64_t _bytesLoaded;	// Sum of all downloads, updated by deltas
 	int _downloadFileTotal;
-	int _downloadFileLoaded;	// different from _objectCountLoaded, _objectCountTotal; this is downloads only
-
+	volatile int32_t _downloadFileLoaded;	// different from _objectCountLoaded, _objectCountTotal; this is downloads only
+	int _downloadFileSized;		// number of downloads whose Content-Length is known
+	volatile int32_t _didRelease;	// Set (with compare and swap) by whoever balances the retain in loadObjects:
+	BOOL _prefetchesSizes;
 }
 
 @property (retain) NSMutableArray* getSizeOperations;
 @property (retain) NSMutableArray* downloadOperations;
 
+// Downloads start right away, and the total number of bytes is derived from the Content-Length of the responses 
+// as they arrive. Set this to YES to determine all sizes with HEAD requests before downloading instead (which 
+// costs an extra round trip, but gives exact progress from the start)...
+
+@property (assign) BOOL prefetchesSizes;
+
 - (void) loadObjects:(NSArray*)inObjects;
 - (IBAction) cancel:(id)inSender;
 
-- (void) prepareProgress;
-- (void) displayProgress:(double)inFraction;
-
 @end
 
 
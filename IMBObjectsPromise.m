@@ -64,7 +64,13 @@
 #import "IMBParserController.h"
 #import "IMBURLDownloadOperation.h"
 #import "IMBURLGetSizeOperation.h"
+#import "IMBDownloadCache.h"
+#import "IMBFileCopy.h"
 #import "NSFileManager+iMedia.h"
+#import <libkern/OSAtomic.h>
+#import <copyfile.h>
+#import <fcntl.h>
+#import <sys/stat.h>
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -74,6 +80,23 @@
 	
 NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.objects-promise";
 
+// Progress is published to the delegate at most 30 times per second...
+
+static const CFAbsoluteTime kIMBProgressInterval = 1.0 / 30.0;
+
+// Local files that cannot be cloned are copied in chunks of this size in parallel, each chunk in pieces of the 
+// buffer size, so that progress is reported smoothly...
+
+static const off_t kIMBCopyChunkSize = 8 * 1024 * 1024;
+static const size_t kIMBCopyBufferSize = 1024 * 1024;
+
+// COPYFILE_CLONE_FORCE is only declared by the 10.12 SDK, so declare it ourselves and check the running system
+// before passing it to copyfile...
+
+#ifndef COPYFILE_CLONE_FORCE
+#define COPYFILE_CLONE_FORCE (1<<25)
+#endif
+
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -89,6 +112,8 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 - (void) loadObjects:(NSArray*)inObjects;
 - (void) _loadObject:(IMBObject*)inObject;
 - (void) _didFinish;
+- (void) _didTimeOut;
+- (void) _callCompletionHandlerWithError:(NSError*)inError;
 
 - (IMBParser*) _parserForObject:(IMBObject *)object;
 
@@ -196,6 +221,7 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 {
 	[NSObject cancelPreviousPerformRequestsWithTarget:self];
 	
+	IMBRelease(_completionHandler);
 	IMBRelease(_objects);
 	IMBRelease(_URLsByObject);
 	IMBRelease(_destinationDirectoryPath);
@@ -299,6 +325,50 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 }
 
 
+// Tell delegate to prepare the progress UI (must be done in main thread)...
+
+- (void) prepareProgress
+{
+	[self displayProgress:0.0];
+}
+
+
+// Tell delegate to display the current progress (must be done in main thread). Intermediate values are throttled,
+// so that many small chunks of data do not flood the main thread. The initial and the final state are always sent, 
+// so that the progress UI never gets stuck just short of completion. A racing caller can at worst cause one extra
+// update, which is harmless...
+
+- (void) displayProgress:(double)inFraction
+{
+	if (inFraction > 0.0 && inFraction < 1.0)	// Always show the initial and final state
+	{
+		CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+		if (now - _lastProgressTime < kIMBProgressInterval) return;
+		_lastProgressTime = now;
+	}
+	
+	if (_delegate)
+	{
+		if ([_delegate respondsToSelector:@selector(objectsPromise:didProgress:)])
+		{
+			[self performSelectorOnMainThread:@selector(__displayProgress:) 
+				  withObject:[NSNumber numberWithDouble:inFraction] 
+				  waitUntilDone:NO 
+				  modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+		}
+	}
+}
+
+
+- (void) __displayProgress:(NSNumber*)inFraction
+{
+	[_delegate objectsPromise:self didProgress:[inFraction doubleValue]];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
 // Notify the delegate that loading is done...
 
 - (void) _didFinish
@@ -337,6 +407,14 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 			}	
 		}	
 	}
+	
+	// The completion handler is always called asynchronously, even if we are already on the main thread...
+	
+	[self 
+		performSelectorOnMainThread:@selector(_callCompletionHandlerWithError:) 
+		withObject:self.error 
+		waitUntilDone:NO 
+		modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
 }
 
 - (IMBParser *)_parserForObject:(IMBObject *)object;
@@ -388,6 +466,77 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
     }
 }
 
+// The timeout is scheduled in the common modes, so that it also fires during a drag or a modal session. The
+// delayed perform retains self until it is cancelled in _callCompletionHandlerWithError:...
+
+- (void) startWithTimeout:(NSTimeInterval)inTimeout completionHandler:(IMBObjectsPromiseCompletionHandler)inHandler
+{
+	IMBRelease(_completionHandler);
+	_completionHandler = [inHandler copy];
+	
+	if (inTimeout > 0.0)
+	{
+		[self performSelector:@selector(_didTimeOut) 
+			withObject:nil 
+			afterDelay:inTimeout 
+			inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+	}
+	
+	[self start];
+	
+	// If the promise had already been fulfilled before, then start did nothing, so call the handler ourselves...
+	
+	if (_objectCountLoaded >= _objectCountTotal)
+	{
+		[self performSelector:@selector(_callCompletionHandlerWithError:) 
+			withObject:self.error 
+			afterDelay:0.0 
+			inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+	}
+}
+
+
+// If the last object finished loading in the meantime, then the completion handler is already on its way. Cancelling
+// now would throw away the files of a promise that succeeded...
+
+- (void) _didTimeOut
+{
+	if (OSAtomicAdd32Barrier(0,&_objectCountLoaded) >= _objectCountTotal)
+	{
+		return;
+	}
+	
+	if (_completionHandler)
+	{
+		NSError* error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ETIMEDOUT userInfo:nil];
+		[self _callCompletionHandlerWithError:error];
+		[self cancel:nil];
+	}
+}
+
+
+// Calls the handler and then forgets it, so that it is called only once (all of this happens on the main thread)...
+
+- (void) _callCompletionHandlerWithError:(NSError*)inError
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_didTimeOut) object:nil];
+	
+	if (_completionHandler)
+	{
+		IMBObjectsPromiseCompletionHandler handler = _completionHandler;
+		_completionHandler = nil;
+		
+		if (_wasCanceled && inError == nil)
+		{
+			inError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+		}
+		
+		handler(self,inError);
+		[handler release];
+	}
+}
+
+
 // Spin a runloop (blocking the caller) until all objects are available...
 
 - (void) waitUntilFinished
@@ -424,6 +573,12 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 	NSLog(@"%s",__FUNCTION__);
 }
 
+- (BOOL) didLoadObject
+{
+	return OSAtomicIncrement32Barrier(&_objectCountLoaded) == _objectCountTotal;
+}
+
+
 - (void)setFileURL:(NSURL *)URL error:(NSError *)error forObject:(IMBObject *)object;
 {
     if (URL)
@@ -482,18 +637,225 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 	return self;
 }
 
+// Without a destination folder the original files are handed out directly, which is instantaneous. Otherwise 
+// the files need to be materialized in the destination folder, which is done in the background...
+
 - (void) loadObjects:(NSArray*)inObjects
 {
+	if (self.destinationDirectoryPath == nil)
+	{
+		[super loadObjects:inObjects];
+		[self _didFinish];
+	}
+	else
+	{
+		[self retain];	// Released in _materializeObjects:
+		
+		NSInvocationOperation* op = [[NSInvocationOperation alloc] initWithTarget:self selector:@selector(_materializeObjects:) object:inObjects];
+		[[IMBOperationQueue sharedQueue] addOperation:op];
+		[op release];
+	}
+}
+
+
+- (void) _materializeObjects:(NSArray*)inObjects
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	
+	// Add up the sizes first, so that we can report linear progress. Every file counted here is accounted for in
+	// _materializeFileAtURL:error:, whether it is copied, skipped, or fails...
+	
+	_bytesToCopy = 0;
+	_bytesCopied = 0;
+	
+	for (IMBObject* object in inObjects)
+	{
+		NSURL* url = [object URL];
+		struct stat info;
+		
+		if ([url isFileURL] && stat([[url path] fileSystemRepresentation],&info) == 0 && S_ISREG(info.st_mode))
+		{
+			_bytesToCopy += (long long)info.st_size;
+		}
+	}
+	
+	[self prepareProgress];
 	[super loadObjects:inObjects];
-	[self _didFinish];
+	[self displayProgress:1.0];
+	
+	[self performSelectorOnMainThread:@selector(_didFinish) 
+		withObject:nil 
+		waitUntilDone:YES 
+		modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+
+	[pool drain];
+	[self release];
+}
+
+
+- (void) _didCopyBytes:(long long)inLength
+{
+	long long bytesCopied = OSAtomicAdd64Barrier(inLength,&_bytesCopied);
+	
+	if (_bytesToCopy > 0)
+	{
+		[self displayProgress:MIN((double)bytesCopied / (double)_bytesToCopy,1.0)];
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Progress callback for IMBFileCopyChunk. It is called concurrently by all chunks of a file...
+
+typedef struct
+{
+	IMBObjectsPromise* promise;
+	volatile int64_t bytesCopied;
+}
+IMBCopyProgress;
+
+static bool _IMBDidCopyChunkBytes(void* inContext,int64_t inLength)
+{
+	IMBCopyProgress* progress = (IMBCopyProgress*)inContext;
+	OSAtomicAdd64Barrier(inLength,&progress->bytesCopied);
+	[progress->promise _didCopyBytes:inLength];
+	return ![progress->promise isCancelled];
+}
+
+
+// Copies a file in chunks that are copied in parallel (see IMBFileCopy). This keeps fast disks (and especially SSDs)
+// busy, where a single sequential copy is latency bound. Caching is turned off, as we are moving gigabytes that will
+// not be read again soon. The first error of any chunk is recorded in copyErrno, which also tells the other chunks 
+// to stop. If the copy fails, then the bytes that were not copied are still reported, so that the progress stays 
+// consistent...
+
+- (BOOL) _copyFileAtPath:(NSString*)inSrcPath toPath:(NSString*)inDstPath size:(long long)inSize error:(NSError**)outError
+{
+	__block volatile int32_t copyErrno = 0;
+	IMBCopyProgress progress = { self,0 };
+	IMBCopyProgress* progressRef = &progress;
+	int src = -1;
+	int dst = -1;
+	
+	if ((src = open([inSrcPath fileSystemRepresentation],O_RDONLY)) < 0)
+	{
+		copyErrno = errno;
+	}
+	else if ((dst = open([inDstPath fileSystemRepresentation],O_WRONLY|O_CREAT|O_EXCL,0644)) < 0)
+	{
+		copyErrno = errno;
+		close(src);
+		src = -1;
+	}
+	
+	if (copyErrno != 0)
+	{
+		[self _didCopyBytes:inSize];
+		if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:copyErrno userInfo:nil];
+		return NO;
+	}
+	
+	fcntl(src,F_NOCACHE,1);
+	fcntl(dst,F_NOCACHE,1);
+	
+	if (ftruncate(dst,(off_t)inSize) == 0)
+	{
+		size_t chunkCount = (size_t)((inSize + kIMBCopyChunkSize - 1) / kIMBCopyChunkSize);
+		
+		dispatch_apply(chunkCount,dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT,0),^(size_t inChunk)
+		{
+			off_t offset = (off_t)inChunk * kIMBCopyChunkSize;
+			off_t length = MIN(kIMBCopyChunkSize,(off_t)inSize - offset);
+			IMBFileCopyChunk(src,dst,offset,length,kIMBCopyBufferSize,&copyErrno,_IMBDidCopyChunkBytes,progressRef);
+		});
+	}
+	else
+	{
+		copyErrno = errno;
+	}
+	
+	if (copyErrno == 0 && [self isCancelled]) copyErrno = ECANCELED;
+	close(src);
+	close(dst);
+	
+	if (copyErrno != 0)
+	{
+		[self _didCopyBytes:inSize - progress.bytesCopied];
+		unlink([inDstPath fileSystemRepresentation]);
+		if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:copyErrno userInfo:nil];
+		return NO;
+	}
+	
+	// Finally carry over permissions, dates and extended attributes...
+	
+	copyfile([inSrcPath fileSystemRepresentation],[inDstPath fileSystemRepresentation],NULL,COPYFILE_STAT|COPYFILE_METADATA);
+	return YES;
 }
 
 
+// Returns the URL of a copy of the file in the destination folder. Cloning is tried first, as it is instantaneous
+// and shares storage until either file is modified. Hard links are deliberately not used: editing the copy in place 
+// would then silently alter the original, e.g. a master in the iPhoto library...
+
+- (NSURL*) _materializeFileAtURL:(NSURL*)inURL error:(NSError**)outError
+{
+	NSFileManager* fileManager = [NSFileManager imb_threadSafeManager];
+	NSString* srcPath = [inURL path];
+	NSString* folder = self.destinationDirectoryPath;
+	struct stat info;
+	
+	if (stat([srcPath fileSystemRepresentation],&info) != 0)
+	{
+		if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		return nil;
+	}
+	
+	if ([[srcPath stringByDeletingLastPathComponent] isEqualToString:folder])
+	{
+		[self _didCopyBytes:(long long)info.st_size];
+		return inURL;
+	}
+	
+	[fileManager createDirectoryAtPath:folder withIntermediateDirectories:YES attributes:nil error:NULL];
+	
+	NSString* name = [srcPath lastPathComponent];
+	NSString* dstPath = [folder stringByAppendingPathComponent:name];
+	
+	unsigned i = 1;
+	
+	while ([fileManager fileExistsAtPath:dstPath])
+	{
+		NSString* uniqueName = [NSString stringWithFormat:@"%@ %u",[name stringByDeletingPathExtension],i++];
+		if ([[name pathExtension] length] > 0) uniqueName = [uniqueName stringByAppendingPathExtension:[name pathExtension]];
+		dstPath = [folder stringByAppendingPathComponent:uniqueName];
+	}
+	
+	if (IMBRunningOnSierraOrNewer() && copyfile([srcPath fileSystemRepresentation],[dstPath fileSystemRepresentation],NULL,COPYFILE_CLONE_FORCE) == 0)
+	{
+		[self _didCopyBytes:(long long)info.st_size];
+		return [NSURL fileURLWithPath:dstPath];
+	}
+	
+	if ([self _copyFileAtPath:srcPath toPath:dstPath size:(long long)info.st_size error:outError])
+	{
+		return [NSURL fileURLWithPath:dstPath];
+	}
+	
+	return nil;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
 - (void) _loadObject:(IMBObject*)inObject
 {
 	// Get the path...
 	
 	NSURL* localURL = [inObject URL];
+	NSError* error = nil;
 	
 	// For file URLs, only add if the file at the path exists...
 	
@@ -508,13 +870,26 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 		}
 	}
 
+	// If the client wants the files in a specific folder, then materialize them there...
+	
+	if ([localURL isFileURL] && self.destinationDirectoryPath != nil)
+	{
+		localURL = [self _materializeFileAtURL:localURL error:&error];
+	}
+	
 	// If we have a valid URL, add it to our array. If we were not able to construct a suitable URL, 
 	// then issue an error instead...		
 	
 	if (localURL != nil)
 	{	
         [self setFileURL:localURL error:nil forObject:inObject];
-		_objectCountLoaded++;
+		[self didLoadObject];
+	}
+	else if (error != nil)
+	{
+        [self setFileURL:nil error:error forObject:inObject];
+		self.error = error;
+		[self didLoadObject];
 	}
 	else
 	{
@@ -529,7 +904,7 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 		NSError* error = [NSError errorWithDomain:kIMBErrorDomain code:fnfErr userInfo:info];
 
         [self setFileURL:nil error:error forObject:inObject];
-		_objectCountLoaded++;
+		[self didLoadObject];
 	}
 }
 
@@ -539,12 +914,44 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 //----------------------------------------------------------------------------------------------------------------------
 
 
+#pragma mark
+
+@interface IMBRemoteObjectsPromise ()
+
+- (void) _didFinishOperation:(IMBURLDownloadOperation*)inOperation;
+- (void) _didFailOperation:(IMBURLDownloadOperation*)inOperation;
+
+@end
+
+
+// Finished downloads are post-processed on this serial queue, so that the disk work does not hold up the network 
+// thread, and so that the completions of a promise never run concurrently. The IMBDownloadCache only takes a clone
+// of the file here and updates its index on a queue of its own...
+
+static dispatch_queue_t _IMBDownloadCompletionQueue()
+{
+	static dispatch_queue_t sQueue = NULL;
+	static dispatch_once_t sOnceToken = 0;
+	
+	dispatch_once(&sOnceToken,^
+	{
+		sQueue = dispatch_queue_create("com.karelia.imedia.downloads",NULL);
+	});
+	
+	return sQueue;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
 #pragma mark
 
 @implementation IMBRemoteObjectsPromise
 
 @synthesize downloadOperations = _downloadOperations;
 @synthesize getSizeOperations = _getSizeOperations;
+@synthesize prefetchesSizes = _prefetchesSizes;
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -557,8 +964,11 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 		self.getSizeOperations = [NSMutableArray array];
 		self.downloadOperations = [NSMutableArray array];
 		_totalBytes = 0;
+		_bytesLoaded = 0;
 		_downloadFileTotal = 0;
 		_downloadFileLoaded = 0;
+		_downloadFileSized = 0;
+		_prefetchesSizes = NO;
 	}
 	
 	return self;
@@ -572,8 +982,11 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 		self.getSizeOperations = [NSMutableArray array];
 		self.downloadOperations = [NSMutableArray array];
 		_totalBytes = 0;
+		_bytesLoaded = 0;
 		_downloadFileTotal = 0;
 		_downloadFileLoaded = 0;
+		_downloadFileSized = 0;
+		_prefetchesSizes = NO;
 	}
 	
 	return self;
@@ -591,53 +1004,39 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 //----------------------------------------------------------------------------------------------------------------------
 
 
-// Tell delegate to prepare the progress UI (must be done in main thread)...
-
-- (void) prepareProgress
-{
-	[self displayProgress:0.0];
-}
-
-
-// Tell delegate to display the current progress (must be done in main thread)...
-
-- (void) displayProgress:(double)inFraction
+- (void) startDownload;
 {
-	if (_delegate)
+	// Add the the total number of bytes to be downloaded (if we prefetched the sizes)...
+	
+	_totalBytes = 0;
+	_downloadFileSized = 0;
+	
+	for (IMBURLGetSizeOperation* getSizeOp in self.getSizeOperations)
 	{
-		if ([_delegate respondsToSelector:@selector(objectsPromise:didProgress:)])
+		if (getSizeOp.bytesTotal > 0)
 		{
-			[self performSelectorOnMainThread:@selector(__displayProgress:) 
-				  withObject:[NSNumber numberWithDouble:inFraction] 
-				  waitUntilDone:NO 
-				  modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+			_totalBytes += getSizeOp.bytesTotal;
+			_downloadFileSized++;
 		}
 	}
-}
-
-
-- (void) __displayProgress:(NSNumber*)inFraction
-{
-	[_delegate objectsPromise:self didProgress:[inFraction doubleValue]];
-}
-
-
-//----------------------------------------------------------------------------------------------------------------------
-
-- (void) startDownload;
-{
-	// Add the the total number of bytes to be downloaded...
-	_totalBytes = 0;
-	for (IMBURLGetSizeOperation* getSizeOp in self.getSizeOperations)
+	
+	if (_downloadFileSized < _downloadFileTotal)	// Incomplete, so derive it from the responses after all
+	{
+		_totalBytes = 0;
+		_downloadFileSized = 0;
+	}
+	else
 	{
-		_totalBytes += getSizeOp.bytesTotal;
+		_downloadFileSized = _downloadFileTotal + 1;	// Don't add the lengths from the responses again
 	}
 	
 	// Start downloading once we have the size of each and every single file to be downloaded...
 	
+	// Downloads go on the network queue, so that they do not hold up thumbnail loading and node population...
+	
 	for (IMBURLDownloadOperation* downloadOp in self.downloadOperations)
 	{
-		[[IMBOperationQueue sharedQueue] addOperation:downloadOp];
+		[[IMBURLDownloadOperation networkQueue] addOperation:downloadOp];
 	}
 	
 	// Switch progress from indeterminate to linear...
@@ -697,11 +1096,14 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 				downloadOp.delegateReference = object;				
 				downloadOp.downloadFolderPath = downloadFolderPath;
 				
-				// If we already have a local file, and the option key is not down, then use the local file...
+				// If we already have a local file, and the option key is not down, then use the local file. Otherwise
+				// download it, but let the server confirm a copy in the shared download cache if there is one, unless 
+				// the option key asks for a fresh download...
 				
-				unsigned eventModifierFlags = [[NSApp currentEvent] modifierFlags];				
-				if ([[NSFileManager imb_threadSafeManager] fileExistsAtPath:localPath]
-					&& 0 == (eventModifierFlags & NSAlternateKeyMask))
+				unsigned eventModifierFlags = [[NSApp currentEvent] modifierFlags];	
+				BOOL useCachedFiles = 0 == (eventModifierFlags & NSAlternateKeyMask);
+							
+				if (useCachedFiles && [[NSFileManager imb_threadSafeManager] fileExistsAtPath:localPath])
 				{
 					downloadOp.localPath = localPath;	// Indicate already-ready local path, meaning that no download needs to actually happen
 					[self didFinish:downloadOp];
@@ -712,6 +1114,7 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 				
 				else
 				{
+					downloadOp.usesDownloadCache = useCachedFiles;
 					_downloadFileTotal++;
 					[self.getSizeOperations addObject:getSizeOp];
 					[self.downloadOperations addObject:downloadOp];
@@ -726,13 +1129,11 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 		
 		const int kNumberOfFilesToCountFilesInsteadOfBytes = 8;
 		
-		if (1 == _downloadFileTotal)	// 1 file: Don't do a GetSize operation, just start downloading; get size when response is there
-		{
-			[self.getSizeOperations removeAllObjects];
-			[self startDownload];
-		}
-		else if (_downloadFileTotal >= kNumberOfFilesToCountFilesInsteadOfBytes)	// Lots of files. Progress in FILES, not bytes
+		if (!self.prefetchesSizes || 1 == _downloadFileTotal || _downloadFileTotal >= kNumberOfFilesToCountFilesInsteadOfBytes)	
 		{
+			// Just start downloading and get the sizes when the responses are there. Lots of files show progress 
+			// in FILES, not bytes...
+			
 			[self.getSizeOperations removeAllObjects];
 			[self startDownload];
 		}
@@ -746,7 +1147,7 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 			for (IMBURLGetSizeOperation* getSizeOp in self.getSizeOperations)
 			{
 				[startDownloadOp addDependency:getSizeOp];	// startDownloadOp is dependent on each getSize
-				[[IMBOperationQueue sharedQueue] addOperation:getSizeOp];
+				[[IMBURLDownloadOperation networkQueue] addOperation:getSizeOp];
 			}
 			
 			[[IMBOperationQueue sharedQueue] addOperation:startDownloadOp];
@@ -757,8 +1158,17 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 //----------------------------------------------------------------------------------------------------------------------
 
 
+// Only one of cancel: and the completion of the last download may balance the retain in loadObjects:. If all downloads
+// have finished already, then the promise is fulfilled and its files belong to the delegate, so there is nothing left
+// to cancel...
+
 - (IBAction) cancel:(id)inSender
 {
+	if (!OSAtomicCompareAndSwap32Barrier(0,1,&_didRelease))
+	{
+		return;
+	}
+	
 	_wasCanceled = YES;
 	
 	// Cancel outstanding operations...
@@ -799,29 +1209,40 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 
 //----------------------------------------------------------------------------------------------------------------------
 
+// A download has received its response. Add its Content-Length to the total number of bytes. Byte based progress
+// is only used for a few files, and only as long as every response has a Content-Length...
+
 - (void) didGetLength:(long long)inExpectedLength;
 {
-	if (0 == _totalBytes && 1 == _downloadFileTotal)	// If we didn't have a length before, set the expected length and start the progress
+	const int kNumberOfFilesToCountFilesInsteadOfBytes = 8;
+
+	if (_downloadFileSized >= 0 && _downloadFileSized < _downloadFileTotal && _downloadFileTotal < kNumberOfFilesToCountFilesInsteadOfBytes)
 	{
-		_totalBytes = inExpectedLength;
-		[self displayProgress:0.0];
+		if (inExpectedLength > 0)
+		{
+			_totalBytes += inExpectedLength;
+			_downloadFileSized++;
+		}
+		else
+		{
+			_totalBytes = 0;
+			_downloadFileSized = -1;	// Give up on byte based progress, count files instead
+		}
 	}
 }
 
-// We received some data, so display the current progress...
+// We received some data, so display the current progress. While not all responses have arrived yet, the total is  
+// extrapolated from the sizes we already know...
 
-- (void) didReceiveData:(IMBURLDownloadOperation*)inOperation
+- (void) didReceiveData:(IMBURLDownloadOperation*)inOperation ofLength:(long long)inLength
 {
-	if (_totalBytes > 0)
+	long long currentBytes = OSAtomicAdd64Barrier(inLength,&_bytesLoaded);
+	
+	if (_totalBytes > 0 && _downloadFileSized > 0)
 	{
-		// Get currrent count of bytes
-		long long currentBytes = 0;
-		for (IMBURLDownloadOperation* op in self.downloadOperations)
-		{
-			currentBytes += [op bytesDone];
-		}
-		
-		double fraction = (double)currentBytes / (double)_totalBytes;
+		int sized = MIN(_downloadFileSized,_downloadFileTotal);
+		double estimatedBytes = (double)_totalBytes * (double)_downloadFileTotal / (double)sized;
+		double fraction = MIN((double)currentBytes / estimatedBytes,1.0);
 		[self displayProgress:fraction];
 	}
 }
@@ -831,26 +1252,51 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 // the progress UI, Notify the delegate and release self...
 
 - (void) didFinish:(IMBURLDownloadOperation*)inOperation
+{
+	dispatch_async(_IMBDownloadCompletionQueue(),^
+	{
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[self _didFinishOperation:inOperation];
+		[pool drain];
+	});
+}
+
+
+- (void) _didFinishOperation:(IMBURLDownloadOperation*)inOperation
 {
 	IMBObject* object = (IMBObject*) inOperation.delegateReference;
+	
+	// Keep a copy of real downloads in the shared cache. The copy must be taken before the file gets post-processed,
+	// but that is only a clone on most file systems. Updating the cache index happens later on the cache's own queue, 
+	// so that it doesn't delay the delegate...
+	
+	if ([inOperation bytesDone] > 0 && ![inOperation isCachedCopy])
+	{
+		[[IMBDownloadCache sharedCache] storeFileAtPathInBackground:inOperation.localPath forURL:inOperation.remoteURL response:inOperation.response];
+	}
+	
 	[self setFileURL:[NSURL fileURLWithPath:inOperation.localPath] error:nil forObject:object];
-	_objectCountLoaded++;	// for check on all promises
 	
 	if ([inOperation bytesDone] > 0)	// Is this a real download?
 	{
-		_downloadFileLoaded++;
+		int32_t loaded = OSAtomicIncrement32Barrier(&_downloadFileLoaded);
 		if (0 == _totalBytes)	// Possibly display per-file progress
 		{
-			double fraction = (double)_downloadFileLoaded / (double)_downloadFileTotal;
+			double fraction = (double)loaded / (double)_downloadFileTotal;
 			[self displayProgress:fraction];
 		}
 	}
 	
-	if (_objectCountLoaded >= _objectCountTotal)		// Totally done?
+	// Don't block the completion queue until the main thread gets around to it. performSelectorOnMainThread: retains 
+	// us until _didFinish has run, so it is safe to release ourself right away...
+	
+	if ([self didLoadObject] && OSAtomicCompareAndSwap32Barrier(0,1,&_didRelease))		// Totally done and not cancelled?
 	{
+		[self displayProgress:1.0];
+		
 		[self performSelectorOnMainThread:@selector(_didFinish) 
 			withObject:nil 
-			waitUntilDone:YES 
+			waitUntilDone:NO 
 			modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
 
 		[self release];
@@ -862,19 +1308,31 @@ NSString* kIMBPasteboardTypeObjectsPromise = @"com.karelia.imedia.pasteboard.obj
 // else is the same as in the previous method...
 
 - (void) didReceiveError:(IMBURLDownloadOperation*)inOperation
+{
+	dispatch_async(_IMBDownloadCompletionQueue(),^
+	{
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[self _didFailOperation:inOperation];
+		[pool drain];
+	});
+}
+
+
+- (void) _didFailOperation:(IMBURLDownloadOperation*)inOperation
 {
 	IMBObject* object = (IMBObject*) inOperation.delegateReference;
 	[self setFileURL:nil error:inOperation.error forObject:object];
 	
 	self.error = inOperation.error;
-	_objectCountLoaded++;	// for check on all promises
-	_downloadFileLoaded++;	// for checking on actual downloads
+	OSAtomicIncrement32Barrier(&_downloadFileLoaded);	// for checking on actual downloads
 
-	if (_objectCountLoaded >= _objectCountTotal)
+	if ([self didLoadObject] && OSAtomicCompareAndSwap32Barrier(0,1,&_didRelease))	// for check on all promises
 	{
+		[self displayProgress:1.0];
+		
 		[self performSelectorOnMainThread:@selector(_didFinish) 
 			withObject:nil 
-			waitUntilDone:YES 
+			waitUntilDone:NO 
 			modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
 			
 		[self release];
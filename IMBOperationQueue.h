@@ -61,6 +61,14 @@
 - (void) suspend;
 - (void) resume;
 
+// Operations that support cooperative cancellation register themselves as the current operation of their thread
+// while they are running. Long running loops (e.g. in parsers) can then check whether their work is still needed 
+// and bail out early...
+
++ (void) setCurrentOperation:(NSOperation*)inOperation;
++ (NSOperation*) currentOperation;
++ (BOOL) isCurrentOperationCancelled;
+
 @end
 
 
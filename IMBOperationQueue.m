@@ -68,6 +68,8 @@
  
 const NSInteger kMaxConcurrentOperationCount = 4;
 
+static NSString* kIMBCurrentOperationKey = @"IMBCurrentOperation";
+
 
 //----------------------------------------------------------------------------------------------------------------------
 
@@ -134,4 +136,31 @@ static IMBOperationQueue* sSharedQueue = nil;
 //----------------------------------------------------------------------------------------------------------------------
 
 
+// The current operation is stored in the thread dictionary, so that it can be queried from deep inside the code
+// that the operation calls, without having to pass it along through every method...
+
++ (void) setCurrentOperation:(NSOperation*)inOperation
+{
+	NSMutableDictionary* threadDictionary = [[NSThread currentThread] threadDictionary];
+	
+	if (inOperation) [threadDictionary setObject:inOperation forKey:kIMBCurrentOperationKey];
+	else [threadDictionary removeObjectForKey:kIMBCurrentOperationKey];
+}
+
+
++ (NSOperation*) currentOperation
+{
+	return [[[NSThread currentThread] threadDictionary] objectForKey:kIMBCurrentOperationKey];
+}
+
+
++ (BOOL) isCurrentOperationCancelled
+{
+	return [[self currentOperation] isCancelled];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
 @end
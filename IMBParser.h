@@ -90,7 +90,8 @@
 
 // ATTENTION: inOldNode is readonly and is only passed in for reference, but must not be modified by the parser in 
 // a background operation. It is passed as an argument to the parser so that existing old nodes can be recreated
-// as faithfully as possible. Must return an autoreleased object...
+// as faithfully as possible. Must return an autoreleased object. Long running loops in populateNode:options:error:
+// should check [IMBOperationQueue isCurrentOperationCancelled] and bail out early, as the result is then discarded...
 
 - (IMBNode*) nodeWithOldNode:(const IMBNode*)inOldNode options:(IMBOptions)inOptions error:(NSError**)outError;
 - (BOOL) populateNode:(IMBNode*)inNode options:(IMBOptions)inOptions error:(NSError**)outError;
@@ -115,6 +116,11 @@
 
 - (void) didStopUsingParser;
 
+// Called on a worker thread of populateNewNode:likeOldNode:options: when it is done with a subtree. The thread goes 
+// back to a shared pool, so parsers that keep resources per thread (e.g. database connections) should release them...
+
+- (void) didStopUsingParserOnCurrentThread;
+
 // Called when a file watcher fires and it concerns a parser. Also gives a parser a chance to update any cached data...
 
 - (void) watchedPathDidChange:(NSString*)inWatchedPath;
@@ -165,6 +171,32 @@
 - (IMBNode*) nodeWithIdentifier:(NSString*)inIdentifier;
 - (void) populateNewNode:(IMBNode*)inNewNode likeOldNode:(const IMBNode*)inOldNode options:(IMBOptions)inOptions;
 
+// Called in a background operation with a private copy of a populated node, when only some files inside its 
+// watchedPath folder have changed (created, deleted, renamed, or modified). Parsers that can do so should add, 
+// remove, or replace the affected objects and return YES. The default implementation returns NO, in which case 
+// the node is repopulated completely...
+
+- (BOOL) updateNode:(IMBNode*)inNode forChangedFilesAtPaths:(NSArray*)inPaths error:(NSError**)outError;
+
+// Parsers that return YES do not set the metadataDescription of their objects when populating (as formatting it 
+// for thousands of objects would be wasteful), but implement metadataDescriptionForMetadata: instead. IMBObject  
+// then asks for the description on first access. The default implementation returns NO...
+
+- (BOOL) providesMetadataDescriptionLazily;
+
+// Return YES if populateNode:options:error: can safely run on several threads at the same time (for different 
+// nodes). populateNewNode:likeOldNode:options: then populates sibling subtrees concurrently. Parsers that share
+// mutable state or non thread safe resources between nodes must return NO, which is the default...
+
+- (BOOL) supportsConcurrentPopulation;
+
+// Parsers with potentially huge nodes should call this method in populateNode:options:error: every time they have 
+// added a (fully configured) object to the objects array. When the first screenful is ready and then every time the 
+// number of objects has doubled, a snapshot is handed to the user interface, so that it can start displaying 
+// objects before the node is completely populated...
+
+- (void) populateNode:(IMBNode*)inNode didAddObjects:(NSArray*)inObjects;
+
 // Controls whether object views should be installed for a given node...
 
 - (BOOL) shouldDisplayObjectViewForNode:(IMBNode*)inNode;	
@@ -177,6 +209,10 @@
 - (NSViewController*) customObjectViewControllerForNode:(IMBNode*)inNode;
 - (NSViewController*) customFooterViewControllerForNode:(IMBNode*)inNode;
 
+// Returns an autoreleased copy of a CGImage that is transformed according to an EXIF orientation (1-8)...
+
+- (CGImageRef) imageRotated:(CGImageRef)imgRef forOrientation:(NSInteger)orientationProperty;
+
 // Informs that some of the receiver's IMBObjects have been written to a pasteboard. Could use this to add some
 // extra parser-specific data to the pasteboard. Default implementation does nothing.
 - (void)didWriteObjects:(NSArray *)objects toPasteboard:(NSPasteboard *)pasteboard;
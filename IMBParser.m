@@ -61,6 +61,19 @@
 #import <Quartz/Quartz.h>
 #import <QTKit/QTKit.h>
 #import "NSURL+iMedia.h"
+#import "IMBImageHeaderReader.h"
+#import "IMBOperationQueue.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Number of objects that are handed to the user interface before a node is completely populated. Should be a power
+// of two, roughly a screenful of thumbnails...
+
+static const NSUInteger kIMBPartialObjectsFirstChunk = 64;
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -68,10 +81,18 @@
 
 #pragma mark
 
+// Operations that can display partial results implement this method (see IMBPopulateNodeOperation)...
+
+@interface NSObject (IMBPartialPopulation)
+- (void) publishPartialObjects:(NSArray*)inObjects ofNode:(IMBNode*)inNode;
+@end
+
+
 @interface IMBParser ()
 
 - (CGImageSourceRef) _imageSourceForURL:(NSURL*)inURL;
 - (CGImageRef) _imageForURL:(NSURL*)inURL;
+- (CGImageRef) _embeddedPreviewImageForURL:(NSURL*)inURL maxPixelSize:(CGFloat)inMaxPixelSize;
 
 @end
 
@@ -214,6 +235,12 @@
 }
 
 
+- (void) didStopUsingParserOnCurrentThread
+{
+
+}
+
+
 - (void) watchedPathDidChange:(NSString*)inWatchedPath
 {
 
@@ -442,7 +469,10 @@
 
 
 // This helper method makes sure that the new node tree is pre-populated as deep as the old one was. Obviously
-// this is a recursive method that descends into the tree as far as necessary to recreate the state...
+// this is a recursive method that descends into the tree as far as necessary to recreate the state. Sibling 
+// subtrees are independent of each other (each one only modifies its own private new node), so for parsers that
+// support it they are populated concurrently. dispatch_apply bounds the number of threads and only returns once 
+// all subtrees are done, so the caller still gets a completely populated tree...
 
 - (void) populateNewNode:(IMBNode*)inNewNode likeOldNode:(const IMBNode*)inOldNode options:(IMBOptions)inOptions
 {
@@ -452,16 +482,106 @@
 	{
         [self populateNode:inNewNode options:inOptions error:&error];
 		
+		// Collect the subtrees that actually need work...
+		
+		NSMutableArray* oldSubNodes = [NSMutableArray array];
+		NSMutableArray* newSubNodes = [NSMutableArray array];
+		
 		for (IMBNode* oldSubNode in [[inOldNode.subNodes copy] autorelease])
 		{
-			NSString* identifier = oldSubNode.identifier;
-			IMBNode* newSubNode = [inNewNode subNodeWithIdentifier:identifier];
-			[self populateNewNode:newSubNode likeOldNode:oldSubNode options:inOptions];
+			IMBNode* newSubNode = [inNewNode subNodeWithIdentifier:oldSubNode.identifier];
+			
+			if (oldSubNode.isPopulated && newSubNode != nil)
+			{
+				[oldSubNodes addObject:oldSubNode];
+				[newSubNodes addObject:newSubNode];
+			}
+		}
+		
+		NSUInteger count = oldSubNodes.count;
+		
+		if (count == 1 || ![self supportsConcurrentPopulation])
+		{
+			for (NSUInteger i=0; i<count; i++)
+			{
+				[self populateNewNode:[newSubNodes objectAtIndex:i] likeOldNode:[oldSubNodes objectAtIndex:i] options:inOptions];
+			}
+		}
+		else if (count > 1)
+		{
+			// The worker threads inherit the current operation, so that parsers can still check for cancellation...
+			
+			NSOperation* operation = [IMBOperationQueue currentOperation];
+			NSThread* callingThread = [NSThread currentThread];
+			
+			dispatch_apply(count,dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT,0),^(size_t i)
+			{
+				NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+				NSOperation* previousOperation = [[[IMBOperationQueue currentOperation] retain] autorelease];
+				[IMBOperationQueue setCurrentOperation:operation];
+				
+				if (![operation isCancelled])
+				{
+					[self populateNewNode:[newSubNodes objectAtIndex:i] likeOldNode:[oldSubNodes objectAtIndex:i] options:inOptions];
+				}
+				
+				// dispatch_apply also runs some iterations on the calling thread, whose resources are still needed
+				// by the caller. Resources of the worker threads would never be used again though...
+				
+				if ([NSThread currentThread] != callingThread)
+				{
+					[self didStopUsingParserOnCurrentThread];
+				}
+				
+				[IMBOperationQueue setCurrentOperation:previousOperation];
+				[pool drain];
+			});
 		}
 	}
 }
 
 
+// Partial objects are published when there are enough to fill a screen, and then whenever the count has doubled. 
+// That way the first objects appear quickly, while the total cost of the snapshots stays linear. Copying an 
+// immutable array (like an IMBVirtualObjectArray snapshot) is free and doesn't create its objects...
+
+- (void) populateNode:(IMBNode*)inNode didAddObjects:(NSArray*)inObjects
+{
+	NSUInteger count = inObjects.count;
+	
+	if (count >= kIMBPartialObjectsFirstChunk && (count & (count-1)) == 0)
+	{
+		id operation = [IMBOperationQueue currentOperation];
+		
+		if ([operation respondsToSelector:@selector(publishPartialObjects:ofNode:)])
+		{
+			[operation publishPartialObjects:[[inObjects copy] autorelease] ofNode:inNode];
+		}
+	}
+}
+
+
+// Incremental updates are not supported by default. Parsers that can do better should override this method...
+
+- (BOOL) updateNode:(IMBNode*)inNode forChangedFilesAtPaths:(NSArray*)inPaths error:(NSError**)outError
+{
+	if (outError) *outError = nil;
+	return NO;
+}
+
+
+- (BOOL) providesMetadataDescriptionLazily
+{
+	return NO;
+}
+
+
+- (BOOL) supportsConcurrentPopulation
+{
+	return NO;
+}
+
+
 //----------------------------------------------------------------------------------------------------------------------
 
 
@@ -527,7 +647,11 @@
 }
 
 	
-// Returns an autoreleased image for the given url...
+// Returns an autoreleased image for the given url. As a first stage we try to use a JPEG preview that is embedded
+// in the file, which is a lot cheaper than decoding the full image. Only if there is no preview that is large enough
+// do we fall back to decoding the full image. Since the preview must be at least kIMBMaxThumbnailSize, this stage
+// effectively targets the previews of RAW files (and the occasional camera that writes a large EXIF thumbnail). 
+// Standard 160x120 EXIF thumbnails are rejected on purpose, as they would look blurry when scaled up in the browser...
 
 - (CGImageRef) _imageForURL:(NSURL*)inURL
 {
@@ -535,6 +659,9 @@
 	
 	if (inURL)
 	{
+		image = [self _embeddedPreviewImageForURL:inURL maxPixelSize:kIMBMaxThumbnailSize];
+		if (image) return image;
+		
 		CGImageSourceRef source = [self _imageSourceForURL:inURL];
 
 		if (source)
@@ -555,6 +682,149 @@
 }	
 
 
+// Returns an autoreleased image that was decoded from the smallest embedded JPEG preview that is at least as large
+// as the requested size, or NULL if there is no such preview. Previews do not carry an orientation of their own, so
+// the orientation of the main image is applied...
+
+- (CGImageRef) _embeddedPreviewImageForURL:(NSURL*)inURL maxPixelSize:(CGFloat)inMaxPixelSize
+{
+	if (![inURL isFileURL]) return NULL;
+	
+	NSString* path = [inURL path];
+	IMBImagePreviewInfo preview;
+	uint32_t orientation = 0;
+	
+	if (!IMBImageHeaderFindPreview([path fileSystemRepresentation],(uint32_t)inMaxPixelSize,&preview,&orientation))
+	{
+		return NULL;
+	}
+	
+	NSData* data = nil;
+	NSFileHandle* file = [NSFileHandle fileHandleForReadingAtPath:path];
+	
+	@try
+	{
+		[file seekToFileOffset:preview.offset];
+		data = [file readDataOfLength:preview.length];
+	}
+	@catch (NSException* inException)
+	{
+		data = nil;
+	}
+	
+	[file closeFile];
+	if ([data length] != preview.length) return NULL;
+	
+	CGImageRef image = NULL;
+	CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data,NULL);
+	
+	if (source)
+	{
+		NSDictionary* options = [NSDictionary dictionaryWithObjectsAndKeys:
+		   (id)kCFBooleanTrue,(id)kCGImageSourceCreateThumbnailFromImageAlways,
+		   [NSNumber numberWithInteger:inMaxPixelSize],(id)kCGImageSourceThumbnailMaxPixelSize, 
+		   nil];
+		
+		image = CGImageSourceCreateThumbnailAtIndex(source,0,(CFDictionaryRef)options);
+		[NSMakeCollectable(image) autorelease];
+		CFRelease(source);
+	}
+	
+	if (image && orientation > 1 && orientation <= 8)
+	{
+		image = [self imageRotated:image forOrientation:orientation];
+	}
+	
+	return image;
+}
+
+
+// Returns an autoreleased copy of the image, transformed according to the EXIF orientation...
+
+- (CGImageRef)imageRotated:(CGImageRef)imgRef forOrientation:(NSInteger)orientationProperty
+{
+	CGFloat w = CGImageGetWidth(imgRef);
+	CGFloat h = CGImageGetHeight(imgRef);
+	
+	CGAffineTransform transform = {0};
+	
+	switch (orientationProperty) {
+		case 1:
+			// 1 = 0th row is at the top, and 0th column is on the left.
+			// Orientation Normal
+			transform = CGAffineTransformMake(1.0, 0.0, 0.0, 1.0, 0.0, 0.0);
+			break;
+			
+		case 2:
+			// 2 = 0th row is at the top, and 0th column is on the right.
+			// Flip Horizontal
+			transform = CGAffineTransformMake(-1.0, 0.0, 0.0, 1.0, w, 0.0);
+			break;
+			
+		case 3:
+			// 3 = 0th row is at the bottom, and 0th column is on the right.
+			// Rotate 180 degrees
+			transform = CGAffineTransformMake(-1.0, 0.0, 0.0, -1.0, w, h);
+			break;
+			
+		case 4:
+			// 4 = 0th row is at the bottom, and 0th column is on the left.
+			// Flip Vertical
+			transform = CGAffineTransformMake(1.0, 0.0, 0, -1.0, 0.0, h);
+			break;
+			
+		case 5:
+			// 5 = 0th row is on the left, and 0th column is the top.
+			// Rotate -90 degrees and Flip Vertical
+			transform = CGAffineTransformMake(0.0, -1.0, -1.0, 0.0, h, w);
+			break;
+			
+		case 6:
+			// 6 = 0th row is on the right, and 0th column is the top.
+			// Rotate 90 degrees
+			transform = CGAffineTransformMake(0.0, -1.0, 1.0, 0.0, 0.0, w);
+			break;
+			
+		case 7:
+			// 7 = 0th row is on the right, and 0th column is the bottom.
+			// Rotate 90 degrees and Flip Vertical
+			transform = CGAffineTransformMake(0.0, 1.0, 1.0, 0.0, 0.0, 0.0);
+			break;
+			
+		case 8:
+			// 8 = 0th row is on the left, and 0th column is the bottom.
+			// Rotate -90 degrees
+			transform = CGAffineTransformMake(0.0, 1.0,-1.0, 0.0, h, 0.0);
+			break;
+	}
+	
+	CGImageRef rotatedImage = NULL;
+	CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGContextRef context = CGBitmapContextCreate(NULL,
+												 (orientationProperty < 5) ? w : h,
+												 (orientationProperty < 5) ? h : w,
+												 8,
+												 0,
+												 colorSpace,
+												 kCGImageAlphaPremultipliedFirst);
+	CGColorSpaceRelease(colorSpace);
+												 
+	if (context)
+	{											 
+		CGContextSetAllowsAntialiasing(context, FALSE);
+		CGContextSetInterpolationQuality(context, kCGInterpolationNone);
+		CGContextConcatCTM(context, transform);
+		CGContextDrawImage(context, CGRectMake(0, 0, w, h), imgRef);
+		rotatedImage = CGBitmapContextCreateImage(context);
+		CFRelease(context);
+		
+		[NSMakeCollectable(rotatedImage) autorelease];
+	}
+	
+	return rotatedImage;
+}
+
+
 //----------------------------------------------------------------------------------------------------------------------
 
 
@@ -111,7 +111,7 @@
 	
 	if (imageURL != nil) {
 		[self setFileURL:imageURL error:nil forObject:inObject];
-		_objectCountLoaded++;
+		[self didLoadObject];
 	}
 	else {
 		[super _loadObject:inObject];
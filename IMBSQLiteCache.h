@@ -0,0 +1,124 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CLASSES
+
+@class FMDatabase;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// IMBSQLiteCache is the common base class of the persistent caches (IMBMetadataCache, IMBDownloadCache and 
+// IMBFlickrCache). Each cache is a small SQLite database in its own folder inside the shared caches folder. If the 
+// schema version stored in the database does not match, then its contents are discarded. After a number of writes 
+// the cache is compacted by a low priority operation on the shared IMBOperationQueue. Subclasses access the database 
+// inside @synchronized(self), so that all methods are thread safe...
+
+@interface IMBSQLiteCache : NSObject
+{
+	FMDatabase* _database;
+	NSString* _folderPath;
+	NSUInteger _writeCount;
+	BOOL _isCompacting;
+}
+
+// Opens (or creates) the database inName.sqlite in the folder inName inside the shared caches folder. If the 
+// database cannot be opened, then _database is nil and the cache simply stays empty...
+
+- (id) initWithName:(NSString*)inName;
+
+// Subclasses must call this after every write, so that compaction is triggered when needed...
+
+- (void) didStoreEntry;
+
+// Queues a compaction operation on the shared IMBOperationQueue. Only one compaction is queued at any time...
+
+- (void) compact;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Subclasses override these methods. Except for compactDatabase they are called with the lock held...
+
+@interface IMBSQLiteCache (Subclassing)
+
+// Bump the version whenever the layout of the tables changes...
+
+- (int) schemaVersion;
+
+// Discards the old contents after the schema version has changed, and creates the tables (if necessary)...
+
+- (void) resetDatabase;
+- (BOOL) prepareDatabase;
+
+// Access times are only refreshed if they are older than the granularity, so that reads do not turn into writes...
+
+- (NSTimeInterval) accessGranularity;
+
+// By default a compaction is triggered after every compactionInterval writes...
+
+- (NSUInteger) compactionInterval;
+- (BOOL) needsCompaction;
+
+// Purges old entries. Runs on a background thread, so it must take the lock itself...
+
+- (void) compactDatabase;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
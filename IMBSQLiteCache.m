@@ -0,0 +1,255 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBSQLiteCache.h"
+#import "IMBOperationQueue.h"
+#import "IMBCommon.h"
+#import "NSFileManager+iMedia.h"
+#import "FMDatabase.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@interface IMBSQLiteCache ()
+
+- (BOOL) _openDatabase:(NSString*)inPath;
+- (void) _compact;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@implementation IMBSQLiteCache
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+- (id) initWithName:(NSString*)inName
+{
+	if (self = [super init])
+	{
+		_folderPath = [[[NSFileManager imb_threadSafeManager] imb_sharedCachesFolder:inName] copy];
+		_writeCount = 0;
+		_isCompacting = NO;
+		
+		NSString* filename = [inName stringByAppendingPathExtension:@"sqlite"];
+		
+		if (![self _openDatabase:[_folderPath stringByAppendingPathComponent:filename]])
+		{
+			[_database close];
+			IMBRelease(_database);
+		}
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	[_database close];
+	IMBRelease(_database);
+	IMBRelease(_folderPath);
+	[super dealloc];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Database
+
+
+- (BOOL) _openDatabase:(NSString*)inPath
+{
+	_database = [[FMDatabase alloc] initWithPath:inPath];
+	[_database setLogsErrors:YES];
+	
+	if (![_database open])
+	{
+		NSLog(@"%s Could not open cache at %@",__FUNCTION__,inPath);
+		return NO;
+	}
+	
+	int version = 0;
+	int schemaVersion = [self schemaVersion];
+	
+	FMResultSet* results = [_database executeQuery:@"PRAGMA user_version"];
+	if ([results next]) version = [results intForColumnIndex:0];
+	[results close];
+
+	if (version != schemaVersion)
+	{
+		[self resetDatabase];
+		[_database executeUpdate:[NSString stringWithFormat:@"PRAGMA user_version = %d",schemaVersion]];
+	}
+	
+	[_database executeUpdate:@"PRAGMA synchronous = NORMAL"];
+	
+	return [self prepareDatabase];
+}
+
+
+- (int) schemaVersion
+{
+	return 1;
+}
+
+
+- (void) resetDatabase
+{
+
+}
+
+
+- (BOOL) prepareDatabase
+{
+	return YES;
+}
+
+
+- (NSTimeInterval) accessGranularity
+{
+	return 60.0 * 60.0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Compaction
+
+
+- (NSUInteger) compactionInterval
+{
+	return 64;
+}
+
+
+- (BOOL) needsCompaction
+{
+	return _writeCount % [self compactionInterval] == 0;
+}
+
+
+- (void) didStoreEntry
+{
+	BOOL shouldCompact = NO;
+	
+	@synchronized(self)
+	{
+		_writeCount++;
+		shouldCompact = [self needsCompaction];
+	}
+	
+	if (shouldCompact)
+	{
+		[self compact];
+	}
+}
+
+
+// Compaction runs as a low priority operation on the shared queue, so that it never competes with thumbnail 
+// loading...
+
+- (void) compact
+{
+	@synchronized(self)
+	{
+		if (_database == nil || _isCompacting) return;
+		_isCompacting = YES;
+	}
+	
+	NSInvocationOperation* op = [[NSInvocationOperation alloc] initWithTarget:self selector:@selector(_compact) object:nil];
+	[op setQueuePriority:NSOperationQueuePriorityVeryLow];
+	[[IMBOperationQueue sharedQueue] addOperation:op];
+	[op release];
+}
+
+
+- (void) _compact
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	
+	[self compactDatabase];
+	
+	@synchronized(self)
+	{
+		_isCompacting = NO;
+	}
+	
+	[pool drain];
+}
+
+
+- (void) compactDatabase
+{
+
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@end
@@ -52,7 +52,10 @@
 
 #pragma mark 
 
-// This helper class is being used by IMBRemoteObjectsPromise. Not for general use...
+// This helper class is being used by IMBRemoteObjectsPromise. Not for general use. It is a concurrent operation:
+// the transfer runs on a single shared network thread (together with all other transfers) and reports back via 
+// delegate callbacks on that thread, so no thread is blocked while waiting for the network. For this reason these 
+// operations should be added to the networkQueue, not to the IMBOperationQueue...
 
 @interface IMBURLDownloadOperation : NSOperation <NSURLDownloadDelegate>
 {
@@ -62,11 +65,24 @@
 	NSString* _downloadFolderPath;
 	NSString* _localPath;
 	NSURLDownload* _download;
+	NSURLResponse* _response;
 	NSError* _error;
 	
 	long long _bytesTotal;
 	long long _bytesDone;
+	NSUInteger _resumeCount;
+	BOOL _usesDownloadCache;
+	BOOL _isCachedCopy;
+	BOOL _holdsHostSlot;
+	BOOL _executing;
 	BOOL _finished;
+	
+	NSMutableData* _ranges;
+	NSMutableArray* _rangeConnections;
+	NSString* _rangeValidator;
+	int _rangeFileDescriptor;
+	NSUInteger _extraHostSlots;
+	BOOL _triedRanges;
 }
 
 @property (assign) id delegate;
@@ -75,14 +91,26 @@
 @property (retain) NSString* downloadFolderPath;
 @property (retain) NSString* localPath;
 @property (retain) NSURLDownload* download;
+@property (retain) NSURLResponse* response;		// The first response, for its validators
 @property (retain) NSError* error;
 
 @property (assign,readonly) long long bytesTotal;
 @property (assign,readonly) long long bytesDone;
+@property (assign) BOOL usesDownloadCache;			// Revalidate a file in the IMBDownloadCache instead of downloading it
+@property (assign,readonly) BOOL isCachedCopy;		// The server confirmed the cached file, which was copied to localPath
 @property (assign,getter=isFinished) BOOL finished;
 		
 - (id) initWithURL:(NSURL*)inURL delegate:(id)inDelegate;
 
+// The thread on whose runloop all network transfers are scheduled, and the queue for network operations. The 
+// queue is wider than IMBOperationQueue, since its operations do not occupy a thread while running. Downloads
+// from the same host are additionally limited (see kIMBMaxConnectionsPerHost), and a download that fails with
+// a network error is resumed where it left off, as long as the server supports it. Large files are fetched in
+// several ranges in parallel if the server supports range requests and there are free connections to the host...
+
++ (NSThread*) networkThread;
++ (NSOperationQueue*) networkQueue;
+
 @end
 
 
@@ -91,10 +119,10 @@
 
 @protocol IMBURLDownloadDelegate
 
-- (void) didReceiveData:(IMBURLDownloadOperation*)inOperation;
+- (void) didReceiveData:(IMBURLDownloadOperation*)inOperation ofLength:(long long)inLength;	// inLength may be negative when resuming
 - (void) didFinish:(IMBURLDownloadOperation*)inOperation;
 - (void) didReceiveError:(IMBURLDownloadOperation*)inOperation;
-- (void) didGetLength:(long long)inExpectedLength;
+- (void) didGetLength:(long long)inExpectedLength;	// Sent once per download, -1 if unknown
 
 @end
 
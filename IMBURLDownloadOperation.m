@@ -53,8 +53,46 @@
 #pragma mark HEADERS
 
 #import "IMBURLDownloadOperation.h"
+#import "IMBDownloadCache.h"
+#import "IMBDownloadPolicy.h"
 #import "NSFileManager+iMedia.h"
 #import "IMBCommon.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Number of concurrent transfers. Since transfers do not block threads, this can be wider than IMBOperationQueue...
+
+static const NSInteger kIMBMaxConcurrentNetworkOperationCount = 8;
+
+// Number of connections that may be open concurrently to a single host. Further downloads wait for a free slot...
+
+static const unsigned kIMBMaxConnectionsPerHost = 4;
+
+// Large files are fetched in up to this many ranges in parallel (each with its own connection), if the server
+// supports range requests and there are free connections to the host. Each range is at least this long...
+
+static const unsigned kIMBMaxParallelRanges = 4;
+static const long long kIMBMinRangeLength = 8 * 1024 * 1024;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static NSThread* sNetworkThread = nil;
+static NSOperationQueue* sNetworkQueue = nil;
+
+// Only accessed on the network thread, so it needs no locking. Waiting operations are retained while they wait...
+
+static IMBHostSlots* sHostSlots = NULL;
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -65,6 +103,21 @@
 @interface IMBURLDownloadOperation ()
 
 - (void) downloadDidFinish:(NSURLDownload*)inDownload;
+- (void) _startDownload;
+- (void) _cancelDownload;
+- (void) _resumeDownload:(NSData*)inResumeData;
+- (void) _copyCachedFile;
+- (void) _didCopyCachedFile:(NSString*)inPath;
+- (BOOL) _acquireHostSlot;
+- (void) _releaseHostSlot;
+- (void) _releaseSlotForHost;
+- (BOOL) _isResumableError:(NSError*)inError;
+- (void) _failWithError:(NSError*)inError;
+- (BOOL) _startRangesForResponse:(NSURLResponse*)inResponse;
+- (void) _startRange:(NSUInteger)inIndex;
+- (void) _stopRanges;
+- (void) _restartWithoutRanges;
+- (void) _rangeAtIndex:(NSUInteger)inIndex didFailWithError:(NSError*)inError;
 
 @end
 
@@ -82,10 +135,66 @@
 @synthesize downloadFolderPath = _downloadFolderPath;
 @synthesize localPath = _localPath;
 @synthesize download = _download;
+@synthesize response = _response;
 @synthesize error = _error;
 @synthesize bytesTotal = _bytesTotal;
 @synthesize bytesDone = _bytesDone;
-@synthesize finished = _finished;
+@synthesize usesDownloadCache = _usesDownloadCache;
+@synthesize isCachedCopy = _isCachedCopy;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// The network thread does nothing but run its runloop, on which all NSURLDownloads and NSURLConnections of our 
+// operations are scheduled. The port keeps the runloop alive while there are no transfers...
+
++ (void) _networkThreadMain:(id)inObject
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	NSRunLoop* runloop = [NSRunLoop currentRunLoop];
+	[runloop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+	
+	while (YES)
+	{
+		NSAutoreleasePool* innerPool = [[NSAutoreleasePool alloc] init];
+		[runloop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+		[innerPool drain];
+	}
+	
+	[pool drain];
+}
+
+
++ (NSThread*) networkThread
+{
+	@synchronized(self)
+	{
+		if (sNetworkThread == nil)
+		{
+			sNetworkThread = [[NSThread alloc] initWithTarget:self selector:@selector(_networkThreadMain:) object:nil];
+			[sNetworkThread setName:@"com.karelia.imedia.network"];
+			[sNetworkThread start];
+		}
+	}
+	
+	return sNetworkThread;
+}
+
+
++ (NSOperationQueue*) networkQueue
+{
+	@synchronized(self)
+	{
+		if (sNetworkQueue == nil)
+		{
+			sNetworkQueue = [[NSOperationQueue alloc] init];
+			sNetworkQueue.maxConcurrentOperationCount = kIMBMaxConcurrentNetworkOperationCount;
+		}
+	}
+	
+	return sNetworkQueue;
+}
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -97,6 +206,7 @@
 	{
 		self.remoteURL = inURL;
 		self.delegate = inDelegate;
+		_rangeFileDescriptor = -1;
 	}
 	
 	return self;
@@ -110,7 +220,13 @@
 	IMBRelease(_downloadFolderPath);
 	IMBRelease(_localPath);
 	IMBRelease(_download);
+	IMBRelease(_response);
 	IMBRelease(_error);
+	IMBRelease(_ranges);
+	IMBRelease(_rangeConnections);
+	IMBRelease(_rangeValidator);
+	
+	if (_rangeFileDescriptor >= 0) close(_rangeFileDescriptor);
 	
 	[super dealloc];
 } 
@@ -119,35 +235,104 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 
-// Create a NSURLDownload, start it and spin the runloop until we are done. Since we are in a background thread
-// we can block without problems...
+// We are a concurrent operation: start only schedules the download on the network thread and returns right away.
+// The operation is finished once the download has finished, failed, or was cancelled...
+
+- (BOOL) isConcurrent
+{
+	return YES;
+}
+
+
+- (BOOL) isExecuting
+{
+	return _executing;
+}
+
+
+- (BOOL) isFinished
+{
+	return _finished;
+}
+
+
+- (void) setFinished:(BOOL)inFinished
+{
+	[self willChangeValueForKey:@"isExecuting"];
+	[self willChangeValueForKey:@"isFinished"];
+	_finished = inFinished;
+	if (inFinished) _executing = NO;
+	[self didChangeValueForKey:@"isFinished"];
+	[self didChangeValueForKey:@"isExecuting"];
+}
+
+
+- (void) start
+{
+	if ([self isCancelled])
+	{
+		self.finished = YES;
+		return;
+	}
+	
+	[self willChangeValueForKey:@"isExecuting"];
+	_executing = YES;
+	[self didChangeValueForKey:@"isExecuting"];
+	
+	[self performSelector:@selector(_startDownload) onThread:[[self class] networkThread] withObject:nil waitUntilDone:NO];
+}
 
-- (void) main
+
+// Create a NSURLDownload on the network thread. Its delegate messages will arrive on this thread as well...
+
+- (void) _startDownload
 {
 	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-//	NSLog(@"%s Starting %@",__FUNCTION__,self);
 
-	if (!self.localPath)	// only do the actual download if we don't already have a local path.
+	if ([self isCancelled])
+	{
+		self.finished = YES;
+	}
+	else if (!self.localPath)	// only do the actual download if we don't already have a local path.
 	{
+		// If there are too many downloads from this host already, then wait until one of them is done...
+		
+		if (![self _acquireHostSlot])
+		{
+			[pool drain];
+			return;
+		}
+		
 		NSString* downloadFolderPath = self.downloadFolderPath;
 		NSString* filename = [[self.remoteURL path] lastPathComponent];
 		NSString* localFilePath = [downloadFolderPath stringByAppendingPathComponent:filename];
 		
 		NSURLRequestCachePolicy policy = NSURLRequestUseProtocolCachePolicy;
 		
-		NSURLRequest* request = [NSURLRequest requestWithURL:self.remoteURL cachePolicy:policy timeoutInterval:90.0];
+		NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL:self.remoteURL cachePolicy:policy timeoutInterval:90.0];
+		
+		// If the IMBDownloadCache has a copy of this file, then only ask the server whether it is still current...
+		
+		NSString* etag = nil;
+		NSString* modified = nil;
+		
+		if (_usesDownloadCache && [[IMBDownloadCache sharedCache] getETag:&etag lastModified:&modified forURL:self.remoteURL])
+		{
+			[request setCachePolicy:NSURLRequestReloadIgnoringLocalCacheData];
+			if (etag) [request setValue:etag forHTTPHeaderField:@"If-None-Match"];
+			if (modified) [request setValue:modified forHTTPHeaderField:@"If-Modified-Since"];
+		}
+		else
+		{
+			_usesDownloadCache = NO;
+		}
+		
 		NSURLDownload* download = [[NSURLDownload alloc] initWithRequest:request delegate:self];
 		[download setDestination:localFilePath allowOverwrite:NO];
-		[download setDeletesFileUponFailure:YES];
+		[download setDeletesFileUponFailure:NO];	// Keep partial file, so that we can resume the download
 		
 		self.download = download;
 		[download release];
-		
-		do 
-		{
-			CFRunLoopRunInMode(kCFRunLoopDefaultMode,1.0,false);
-		}
-		while (_finished == NO);
 	}
 	else
 	{
@@ -158,9 +343,27 @@
 }
 
 
+// Cancelling is forwarded to the network thread, so that we do not race with the delegate messages of the download...
+
 - (void) cancel
 {
+	[super cancel];
+	[self performSelector:@selector(_cancelDownload) onThread:[[self class] networkThread] withObject:nil waitUntilDone:NO];
+}
+
+
+- (void) _cancelDownload
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self];
+	
+	if (IMBHostSlotsRemoveWaiter(sHostSlots,self))
+	{
+		[self autorelease];
+	}
+	
 	[self.download cancel];
+	[self _stopRanges];
+	[self _releaseHostSlot];
 	
 	if (self.localPath)
 	{
@@ -170,7 +373,10 @@
 	
 	self.delegate = nil;
 	self.download = nil;
-	self.finished = YES;
+	
+	// Operations that have not been started yet are finished in start...
+	
+	if (_executing) self.finished = YES;
 }
 
 
@@ -181,7 +387,25 @@
 
 - (void)download:(NSURLDownload *)download didReceiveResponse:(NSURLResponse *)inResponse
 {
-	[_delegate didGetLength:[inResponse expectedContentLength]];
+	// The cached file is still current, so stop the download and use the cached file instead...
+	
+	if (_usesDownloadCache && [inResponse isKindOfClass:[NSHTTPURLResponse class]] && [(NSHTTPURLResponse*)inResponse statusCode] == 304)
+	{
+		[download cancel];
+		self.download = nil;
+		[self _releaseHostSlot];
+		[self _copyCachedFile];
+		return;
+	}
+	
+	if (_bytesTotal == 0)
+	{
+		self.response = inResponse;
+		_bytesTotal = [inResponse expectedContentLength];
+		[_delegate didGetLength:_bytesTotal];
+		
+		[self _startRangesForResponse:inResponse];
+	}
 }
 
 - (void) download:(NSURLDownload*)inDownload didCreateDestination:(NSString*)inPath
@@ -197,7 +421,7 @@
 {	
 //	NSLog(@"%s inLength=%d",__FUNCTION__,(int)inLength);
 	_bytesDone += (long long)inLength;
-	[_delegate didReceiveData:self];
+	[_delegate didReceiveData:self ofLength:(long long)inLength];
 }
 
 
@@ -205,6 +429,8 @@
 
 - (void) downloadDidFinish:(NSURLDownload*)inDownload
 {
+	[self _releaseHostSlot];
+	
 	self.error = nil;
 	self.finished = YES;
 	[_delegate didFinish:self];
@@ -213,8 +439,50 @@
 }
 
 
+// If the connection dropped, then try to resume the download where it left off. Otherwise give up, delete the 
+// partial file and report the error...
+
 - (void) download:(NSURLDownload*)inDownload didFailWithError:(NSError*)inError
 {
+	NSData* resumeData = [inDownload resumeData];
+	NSInteger code = [inError code];
+	
+	// If the server cannot be reached to revalidate the cached file, then the cached file is better than nothing...
+	
+	if (_usesDownloadCache && _bytesDone == 0 && [[inError domain] isEqualToString:NSURLErrorDomain] && 
+		(code == NSURLErrorNotConnectedToInternet || code == NSURLErrorCannotConnectToHost || code == NSURLErrorTimedOut))
+	{
+		self.download = nil;
+		[self _releaseHostSlot];
+		[self _copyCachedFile];
+		return;
+	}
+	
+	NSTimeInterval delay = IMBDownloadResumeDelay((unsigned)_resumeCount);
+	
+	if (resumeData != nil && delay >= 0.0 && [self _isResumableError:inError])
+	{
+		_resumeCount++;
+		[self performSelector:@selector(_resumeDownload:) withObject:resumeData afterDelay:delay];
+		return;
+	}
+	
+	[self _failWithError:inError];
+}
+
+
+// Gives up: deletes the partial file and reports the error...
+
+- (void) _failWithError:(NSError*)inError
+{
+	[self _stopRanges];
+	[self _releaseHostSlot];
+	
+	if (self.localPath)
+	{
+		[[NSFileManager imb_threadSafeManager] removeItemAtPath:self.localPath error:NULL];
+	}
+	
 	self.error = inError;
 	self.finished = YES;
 	[_delegate didReceiveError:self];
@@ -223,6 +491,476 @@
 }
 
 
+// NSURLDownload sends a range request for the missing part. If the file on the server has changed in the meantime, 
+// then the server sends the whole file again, which NSURLDownload handles by starting over...
+
+- (void) _resumeDownload:(NSData*)inResumeData
+{
+	if ([self isCancelled]) return;
+	
+	NSURLDownload* download = [[NSURLDownload alloc] initWithResumeData:inResumeData delegate:self path:self.localPath];
+	[download setDeletesFileUponFailure:NO];
+	self.download = download;
+	[download release];
+}
+
+
+// Copying the cached file may take a while on file systems that cannot clone, so this happens on a background queue
+// rather than on the network thread. The result is reported back on the network thread...
+
+- (void) _copyCachedFile
+{
+	NSString* filename = [[self.remoteURL path] lastPathComponent];
+	NSString* localFilePath = [self.downloadFolderPath stringByAppendingPathComponent:filename];
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT,0),^
+	{
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		
+		BOOL copied = ![self isCancelled] && [[IMBDownloadCache sharedCache] copyCachedFileForURL:self.remoteURL toPath:localFilePath];
+		[self performSelector:@selector(_didCopyCachedFile:) onThread:[[self class] networkThread] withObject:(copied ? localFilePath : nil) waitUntilDone:NO];
+		
+		[pool drain];
+	});
+}
+
+
+// If the cached file has vanished in the meantime, then download the file after all...
+
+- (void) _didCopyCachedFile:(NSString*)inPath
+{
+	if ([self isCancelled])
+	{
+		if (inPath) [[NSFileManager imb_threadSafeManager] removeItemAtPath:inPath error:NULL];
+		return;
+	}
+	
+	if (inPath == nil)
+	{
+		_usesDownloadCache = NO;
+		[self _startDownload];
+		return;
+	}
+	
+	long long size = (long long)[[[NSFileManager imb_threadSafeManager] attributesOfItemAtPath:inPath error:NULL] fileSize];
+	self.localPath = inPath;
+	_isCachedCopy = YES;
+	
+	if (_bytesTotal == 0)
+	{
+		_bytesTotal = size;
+		[_delegate didGetLength:_bytesTotal];
+	}
+	
+	_bytesDone = size;
+	[_delegate didReceiveData:self ofLength:size];
+	[self downloadDidFinish:nil];
+}
+
+
+- (void) download:(NSURLDownload*)inDownload willResumeWithResponse:(NSURLResponse*)inResponse fromByte:(long long)inStartingByte
+{
+	long long delta = inStartingByte - _bytesDone;
+	_bytesDone = inStartingByte;
+	if (delta != 0) [_delegate didReceiveData:self ofLength:delta];
+}
+
+
+- (BOOL) _isResumableError:(NSError*)inError
+{
+	if (![[inError domain] isEqualToString:NSURLErrorDomain]) return NO;
+	
+	NSInteger code = [inError code];
+	
+	return
+		code == NSURLErrorTimedOut ||
+		code == NSURLErrorNetworkConnectionLost ||
+		code == NSURLErrorNotConnectedToInternet ||
+		code == NSURLErrorCannotConnectToHost;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark
+#pragma mark Parallel Ranges
+
+
+// Header names in allHeaderFields are not reliably capitalized, so look them up case insensitively...
+
+static NSString* _IMBHeaderValue(NSURLResponse* inResponse,NSString* inName)
+{
+	NSDictionary* headers = [(NSHTTPURLResponse*)inResponse allHeaderFields];
+	
+	for (NSString* name in headers)
+	{
+		if ([name caseInsensitiveCompare:inName] == NSOrderedSame)
+		{
+			return [headers objectForKey:name];
+		}
+	}
+	
+	return nil;
+}
+
+
+// Called with the first response of the NSURLDownload. If the file is large and the server supports range requests,
+// then the download is replaced by several connections that fetch one range each and write it directly into the
+// destination file. Every range request carries an If-Range header with a strong validator, so that all ranges are
+// guaranteed to come from the same version of the file. Returns NO if the download continues as a single stream...
+
+- (BOOL) _startRangesForResponse:(NSURLResponse*)inResponse
+{
+	if (_triedRanges || ![inResponse isKindOfClass:[NSHTTPURLResponse class]]) return NO;
+	_triedRanges = YES;
+	
+	if ([(NSHTTPURLResponse*)inResponse statusCode] != 200 || _bytesTotal < 2*kIMBMinRangeLength) return NO;
+	
+	NSString* acceptRanges = _IMBHeaderValue(inResponse,@"Accept-Ranges");
+	NSString* validator = _IMBHeaderValue(inResponse,@"ETag");
+	if (validator == nil || [validator hasPrefix:@"W/"]) validator = _IMBHeaderValue(inResponse,@"Last-Modified");
+	
+	if (validator == nil || acceptRanges == nil || [acceptRanges rangeOfString:@"bytes"].location == NSNotFound) return NO;
+	
+	// Use as many ranges as there are free connections to the host (we already hold one of them)...
+	
+	const char* host = [[self.remoteURL host] UTF8String];
+	NSUInteger extraSlots = 0;
+	
+	while (extraSlots+1 < kIMBMaxParallelRanges && IMBHostSlotsAcquire(sHostSlots,host,NULL))
+	{
+		extraSlots++;
+	}
+	
+	NSMutableData* ranges = [NSMutableData dataWithLength:(extraSlots+1) * sizeof(IMBDownloadRange)];
+	unsigned count = IMBDownloadSplitRanges(_bytesTotal,(unsigned)(extraSlots+1),kIMBMinRangeLength,(IMBDownloadRange*)[ranges mutableBytes]);
+	
+	// Create the destination file ourselves, or reuse it if the NSURLDownload has already created it...
+	
+	NSString* path = self.localPath;
+	int fd = -1;
+	
+	if (count > 1)
+	{
+		if (path)
+		{
+			fd = open([path fileSystemRepresentation],O_WRONLY|O_TRUNC);
+		}
+		else
+		{
+			path = [self.downloadFolderPath stringByAppendingPathComponent:[[self.remoteURL path] lastPathComponent]];
+			fd = open([path fileSystemRepresentation],O_WRONLY|O_CREAT|O_EXCL,0644);
+		}
+	}
+	
+	if (fd < 0)
+	{
+		while (extraSlots > 0)
+		{
+			extraSlots--;
+			[self _releaseSlotForHost];
+		}
+		
+		return NO;
+	}
+	
+	// Return the slots that are not needed, because the file is too short for that many ranges...
+	
+	while (extraSlots+1 > count)
+	{
+		extraSlots--;
+		[self _releaseSlotForHost];
+	}
+	
+	[self.download cancel];
+	self.download = nil;
+	self.localPath = path;
+	
+	_rangeFileDescriptor = fd;
+	_extraHostSlots = extraSlots;
+	_ranges = [ranges retain];
+	_rangeValidator = [validator copy];
+	_rangeConnections = [[NSMutableArray alloc] init];
+	
+	for (NSUInteger i=0; i<count; i++)
+	{
+		[_rangeConnections addObject:[NSNull null]];
+	}
+	
+	for (NSUInteger i=0; i<count; i++)
+	{
+		[self _startRange:i];
+	}
+	
+	return YES;
+}
+
+
+// Requests the part of a range that hasn't been received yet. This is also used to resume a range...
+
+- (void) _startRange:(NSUInteger)inIndex
+{
+	if ([self isCancelled] || _rangeConnections == nil) return;
+	
+	IMBDownloadRange* range = (IMBDownloadRange*)[_ranges mutableBytes] + inIndex;
+	char header[64];
+	
+	if (!IMBDownloadFormatRangeHeader(range,header,sizeof(header))) return;
+	
+	NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL:self.remoteURL cachePolicy:NSURLRequestReloadIgnoringLocalCacheData timeoutInterval:90.0];
+	[request setValue:[NSString stringWithUTF8String:header] forHTTPHeaderField:@"Range"];
+	[request setValue:_rangeValidator forHTTPHeaderField:@"If-Range"];
+	
+	NSURLConnection* connection = [[NSURLConnection alloc] initWithRequest:request delegate:self];
+	[_rangeConnections replaceObjectAtIndex:inIndex withObject:connection];
+	[connection release];
+}
+
+
+- (void) _resumeRange:(NSNumber*)inIndex
+{
+	[self _startRange:[inIndex unsignedIntegerValue]];
+}
+
+
+// Cancels all range connections, closes the file and gives the extra connections back to the host...
+
+- (void) _stopRanges
+{
+	if (_rangeConnections == nil) return;
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self];
+	
+	for (id connection in _rangeConnections)
+	{
+		if (connection != [NSNull null]) [connection cancel];
+	}
+	
+	IMBRelease(_rangeConnections);
+	
+	if (_rangeFileDescriptor >= 0)
+	{
+		close(_rangeFileDescriptor);
+		_rangeFileDescriptor = -1;
+	}
+	
+	while (_extraHostSlots > 0)
+	{
+		_extraHostSlots--;
+		[self _releaseSlotForHost];
+	}
+}
+
+
+// The server didn't answer a range request as expected (e.g. because the file has changed in the meantime, so that
+// If-Range failed). Start over with a single download. We still hold our own host slot for that...
+
+- (void) _restartWithoutRanges
+{
+	long long bytesDone = _bytesDone;
+	
+	[self _stopRanges];
+	
+	if (self.localPath)
+	{
+		[[NSFileManager imb_threadSafeManager] removeItemAtPath:self.localPath error:NULL];
+		self.localPath = nil;
+	}
+	
+	_bytesDone = 0;
+	if (bytesDone != 0) [_delegate didReceiveData:self ofLength:-bytesDone];
+	
+	[self _startDownload];
+}
+
+
+- (IMBDownloadRange*) _rangeForConnection:(NSURLConnection*)inConnection index:(NSUInteger*)outIndex
+{
+	if (_rangeConnections == nil) return NULL;
+	
+	NSUInteger index = [_rangeConnections indexOfObjectIdenticalTo:inConnection];
+	if (index == NSNotFound) return NULL;
+	
+	if (outIndex) *outIndex = index;
+	return (IMBDownloadRange*)[_ranges mutableBytes] + index;
+}
+
+
+// A range must be answered with 206 and start exactly where we asked. Anything else means that the server ignored
+// the Range or If-Range header...
+
+- (void) connection:(NSURLConnection*)inConnection didReceiveResponse:(NSURLResponse*)inResponse
+{
+	IMBDownloadRange* range = [self _rangeForConnection:inConnection index:NULL];
+	if (range == NULL) return;
+	
+	int64_t first = 0, last = 0, total = 0;
+	
+	BOOL valid =
+		[inResponse isKindOfClass:[NSHTTPURLResponse class]] &&
+		[(NSHTTPURLResponse*)inResponse statusCode] == 206 &&
+		IMBDownloadParseContentRange([_IMBHeaderValue(inResponse,@"Content-Range") UTF8String],&first,&last,&total) &&
+		first == range->offset + range->done &&
+		(total < 0 || total == _bytesTotal);
+	
+	if (!valid)
+	{
+		[[inConnection retain] autorelease];
+		[self _restartWithoutRanges];
+	}
+}
+
+
+// Write the data at its place in the file. Anything the server sends beyond the end of the range is ignored...
+
+- (void) connection:(NSURLConnection*)inConnection didReceiveData:(NSData*)inData
+{
+	IMBDownloadRange* range = [self _rangeForConnection:inConnection index:NULL];
+	if (range == NULL) return;
+	
+	const char* bytes = (const char*)[inData bytes];
+	long long length = MIN((long long)[inData length],range->length - range->done);
+	long long written = 0;
+	
+	while (written < length)
+	{
+		ssize_t n = pwrite(_rangeFileDescriptor,bytes+written,(size_t)(length-written),range->offset+range->done+written);
+		
+		if (n < 0 && errno == EINTR) continue;
+		
+		if (n <= 0)
+		{
+			[[inConnection retain] autorelease];
+			[self _failWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:(n < 0 ? errno : EIO) userInfo:nil]];
+			return;
+		}
+		
+		written += n;
+	}
+	
+	range->done += length;
+	_bytesDone += length;
+	[_delegate didReceiveData:self ofLength:length];
+}
+
+
+// A finished range gives its connection back to the host. Once all ranges are complete, the download is done...
+
+- (void) connectionDidFinishLoading:(NSURLConnection*)inConnection
+{
+	NSUInteger index = 0;
+	IMBDownloadRange* range = [self _rangeForConnection:inConnection index:&index];
+	if (range == NULL) return;
+	
+	[[inConnection retain] autorelease];
+	[_rangeConnections replaceObjectAtIndex:index withObject:[NSNull null]];
+	
+	// The server closed the connection before the range was complete...
+	
+	if (range->done < range->length)
+	{
+		NSError* error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+		[self _rangeAtIndex:index didFailWithError:error];
+		return;
+	}
+	
+	if (_extraHostSlots > 0)
+	{
+		_extraHostSlots--;
+		[self _releaseSlotForHost];
+	}
+	
+	const IMBDownloadRange* ranges = (const IMBDownloadRange*)[_ranges bytes];
+	
+	for (NSUInteger i=0; i<[_rangeConnections count]; i++)
+	{
+		if (ranges[i].done < ranges[i].length) return;
+	}
+	
+	[self _stopRanges];
+	[self downloadDidFinish:nil];
+}
+
+
+- (void) connection:(NSURLConnection*)inConnection didFailWithError:(NSError*)inError
+{
+	NSUInteger index = 0;
+	IMBDownloadRange* range = [self _rangeForConnection:inConnection index:&index];
+	if (range == NULL) return;
+	
+	[[inConnection retain] autorelease];
+	[_rangeConnections replaceObjectAtIndex:index withObject:[NSNull null]];
+	[self _rangeAtIndex:index didFailWithError:inError];
+}
+
+
+// A dropped range is resumed on its own, just like a single download. The resume attempts are counted for the
+// whole download...
+
+- (void) _rangeAtIndex:(NSUInteger)inIndex didFailWithError:(NSError*)inError
+{
+	NSTimeInterval delay = IMBDownloadResumeDelay((unsigned)_resumeCount);
+	
+	if (delay >= 0.0 && [self _isResumableError:inError])
+	{
+		_resumeCount++;
+		[self performSelector:@selector(_resumeRange:) withObject:[NSNumber numberWithUnsignedInteger:inIndex] afterDelay:delay];
+	}
+	else
+	{
+		[self _failWithError:inError];
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Per host connection limits (see IMBDownloadPolicy). Operations that cannot get a slot wait in sHostSlots (without
+// blocking anything), and are started as soon as another download from the same host gives its slot back...
+
+- (BOOL) _acquireHostSlot
+{
+	if (_holdsHostSlot) return YES;
+	if (sHostSlots == NULL) sHostSlots = IMBHostSlotsCreate(kIMBMaxConnectionsPerHost);
+	
+	if (!IMBHostSlotsAcquire(sHostSlots,[[self.remoteURL host] UTF8String],self))
+	{
+		[self retain];	// Balanced when the operation gets its slot or is cancelled
+		return NO;
+	}
+	
+	_holdsHostSlot = YES;
+	return YES;
+}
+
+
+- (void) _releaseHostSlot
+{
+	if (!_holdsHostSlot) return;
+	
+	_holdsHostSlot = NO;
+	[self _releaseSlotForHost];
+}
+
+
+// Gives one connection to our host back. If another operation is waiting for it, the slot goes directly to that
+// operation, which is then started...
+
+- (void) _releaseSlotForHost
+{
+	IMBURLDownloadOperation* operation = (IMBURLDownloadOperation*) IMBHostSlotsRelease(sHostSlots,[[self.remoteURL host] UTF8String]);
+	
+	if (operation)
+	{
+		operation->_holdsHostSlot = YES;
+		[operation _startDownload];
+		[operation release];
+	}
+}
+
+
 //----------------------------------------------------------------------------------------------------------------------
 
 
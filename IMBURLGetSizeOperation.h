@@ -51,6 +51,9 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 
+// Concurrent operation that asks a server for the size of a file. Like IMBURLDownloadOperation, its connection runs 
+// on the shared network thread, and it should be added to [IMBURLDownloadOperation networkQueue]...
+
 @interface IMBURLGetSizeOperation : NSOperation
 {
 	id _delegate;
@@ -58,6 +61,7 @@
 	NSURLConnection* _connection;
 	
 	long long _bytesTotal;
+	BOOL _executing;
 	BOOL _finished;
 }
 
@@ -51,6 +51,7 @@
 #pragma mark HEADERS
 
 #import "IMBURLGetSizeOperation.h"
+#import "IMBURLDownloadOperation.h"
 #import "NSFileManager+iMedia.h"
 #import "IMBCommon.h"
 
@@ -63,6 +64,8 @@
 @interface IMBURLGetSizeOperation ()
 
 - (void) connectionDidFinishLoading:(NSURLConnection*)inConnection;
+- (void) _startConnection;
+- (void) _cancelConnection;
 
 @end
 
@@ -78,7 +81,6 @@
 @synthesize remoteURL = _remoteURL;
 @synthesize connection = _connection;
 @synthesize bytesTotal = _bytesTotal;
-@synthesize finished = _finished;
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -108,45 +110,96 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 
-// Create a NSURLDownload, start it and spin the runloop until we are done. Since we are in a background thread
-// we can block without problems...
+// We are a concurrent operation: start only schedules the HEAD request on the shared network thread and returns 
+// right away. The operation is finished once the request has completed, failed, or was cancelled...
 
-- (void) main
+- (BOOL) isConcurrent
+{
+	return YES;
+}
+
+
+- (BOOL) isExecuting
+{
+	return _executing;
+}
+
+
+- (BOOL) isFinished
+{
+	return _finished;
+}
+
+
+- (void) setFinished:(BOOL)inFinished
+{
+	[self willChangeValueForKey:@"isExecuting"];
+	[self willChangeValueForKey:@"isFinished"];
+	_finished = inFinished;
+	if (inFinished) _executing = NO;
+	[self didChangeValueForKey:@"isFinished"];
+	[self didChangeValueForKey:@"isExecuting"];
+}
+
+
+- (void) start
+{
+	if ([self isCancelled])
+	{
+		self.finished = YES;
+		return;
+	}
+	
+	[self willChangeValueForKey:@"isExecuting"];
+	_executing = YES;
+	[self didChangeValueForKey:@"isExecuting"];
+	
+	[self performSelector:@selector(_startConnection) onThread:[IMBURLDownloadOperation networkThread] withObject:nil waitUntilDone:NO];
+}
+
+
+- (void) _startConnection
 {
 	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-//	NSLog(@"%s Starting %@",__FUNCTION__,self);
 
-	if (0 == self.bytesTotal)	// only do the actual check if we don't already have a (local) size
+	if ([self isCancelled])
+	{
+		self.finished = YES;
+	}
+	else if (0 == self.bytesTotal)	// only do the actual check if we don't already have a (local) size
 	{
 		NSURLRequestCachePolicy policy = NSURLRequestUseProtocolCachePolicy;
 		NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL:self.remoteURL cachePolicy:policy timeoutInterval:15.0];
 		[request setHTTPMethod:@"HEAD"];
 		
 		self.connection = [NSURLConnection connectionWithRequest:request delegate:self];
-				
-		do 
-		{
-			CFRunLoopRunInMode(kCFRunLoopDefaultMode,1.0,false);
-		}
-		while (!_finished);
 	}
 	else
 	{
 		[self connectionDidFinishLoading:nil];	// notify owner that the download (which never started) is finished.
 	}
 	
-//	NSLog(@"%s Ending %@",__FUNCTION__,self);
 	[pool drain];
 }
 
 
 - (void) cancel
+{
+	[super cancel];
+	[self performSelector:@selector(_cancelConnection) onThread:[IMBURLDownloadOperation networkThread] withObject:nil waitUntilDone:NO];
+}
+
+
+- (void) _cancelConnection
 {
 	[self.connection cancel];
 	
 	self.delegate = nil;
 	self.connection = nil;
-	self.finished = YES;
+	
+	// Operations that have not been started yet are finished in start...
+	
+	if (_executing) self.finished = YES;
 }
 
 
@@ -161,13 +214,15 @@
 
 - (void) connectionDidFinishLoading:(NSURLConnection*)inConnection
 {
-	_finished = YES;
+	self.connection = nil;
+	self.finished = YES;
 }
 
 
 - (void) connection:(NSURLConnection*)inConnection didFailWithError:(NSError*)inError
 {
-	_finished = YES;
+	self.connection = nil;
+	self.finished = YES;
 }
 
 
@@ -0,0 +1,117 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CLASSES
+
+@class IMBObject;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark PROTOCOLS
+
+// The data source (usually the parser) knows how to turn a compact record into a full IMBObject. This method may 
+// be called on any thread and must return an autoreleased object. For arrays that were created with a count instead 
+// of records, inRecord is nil and the data source looks up the item by its index...
+
+@protocol IMBVirtualObjectArrayDataSource <NSObject>
+
+- (IMBObject*) objectForRecord:(id)inRecord index:(NSUInteger)inIndex;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// IMBVirtualObjectArray is an immutable NSArray that can be used as the objects array of very large nodes (e.g. an 
+// iTunes library with 100k tracks). Instead of holding a full IMBObject per item, it only holds one record per item 
+// (usually a pointer into data that the parser has already loaded, like a track dictionary), or nothing at all if the
+// data source keeps its own compact storage (like the Lightroom parser does). IMBObjects are created 
+// on demand when an index is accessed. The object view tells the array which range is currently visible, and objects
+// that are far enough outside of that range are released again, so that they are recreated the next time. KVO
+// observers that are registered for all objects (e.g. by NSArrayController for arrangedObjects.imageRepresentation) 
+// are only added to objects once they exist. Copying the array is cheap, as it is immutable. All methods are thread 
+// safe...
+
+@interface IMBVirtualObjectArray : NSArray
+{
+	NSArray* _records;
+	id <IMBVirtualObjectArrayDataSource> _dataSource;
+	IMBObject** _objects;
+	NSUInteger _count;
+	NSMutableIndexSet* _materializedIndexes;
+	NSMutableArray* _observations;
+	NSRange _visibleRange;
+}
+
+- (id) initWithRecords:(NSArray*)inRecords dataSource:(id <IMBVirtualObjectArrayDataSource>)inDataSource;
+
+// Use this if the data source keeps its own (e.g. columnar) storage and doesn't need any record objects at all...
+
+- (id) initWithCount:(NSUInteger)inCount dataSource:(id <IMBVirtualObjectArrayDataSource>)inDataSource;
+
+- (NSUInteger) materializedObjectCount;
+
+// Objects in the visible range (and a margin before and after it) are kept, all others are released. An empty 
+// range releases all objects, which is what recycleAllObjects does when the array is no longer displayed...
+
+- (void) setVisibleRange:(NSRange)inRange;
+- (NSRange) visibleRange;
+- (void) recycleAllObjects;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
@@ -0,0 +1,457 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#import "IMBVirtualObjectArray.h"
+#import "IMBObject.h"
+#import "IMBCommon.h"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark CONSTANTS
+
+// Minimum number of objects that are kept before and after the visible range, so that scrolling back a little
+// doesn't immediately recreate objects (and reload their thumbnails)...
+
+static const NSUInteger kIMBVirtualObjectArrayMinimumMargin = 64;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+// A KVO registration for a set of indexes. Just like KVO itself, we do not retain the observer...
+
+@interface IMBVirtualObjectArrayObservation : NSObject
+{
+  @public
+	NSObject* _observer;
+	NSIndexSet* _indexes;
+	NSString* _keyPath;
+	NSKeyValueObservingOptions _options;
+	void* _context;
+}
+@end
+
+@implementation IMBVirtualObjectArrayObservation
+
+- (void) dealloc
+{
+	IMBRelease(_indexes);
+	IMBRelease(_keyPath);
+	[super dealloc];
+}
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@interface IMBVirtualObjectArray ()
+- (void) _addObservationsToObject:(IMBObject*)inObject atIndex:(NSUInteger)inIndex;
+- (void) _removeObservationsFromObject:(IMBObject*)inObject atIndex:(NSUInteger)inIndex;
+- (void) _releaseObjectAtIndex:(NSUInteger)inIndex;
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+
+@implementation IMBVirtualObjectArray
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+- (id) initWithRecords:(NSArray*)inRecords dataSource:(id <IMBVirtualObjectArrayDataSource>)inDataSource
+{
+	if (self = [self initWithCount:[inRecords count] dataSource:inDataSource])
+	{
+		_records = [inRecords copy];
+	}
+	
+	return self;
+}
+
+
+- (id) initWithCount:(NSUInteger)inCount dataSource:(id <IMBVirtualObjectArrayDataSource>)inDataSource
+{
+	if (self = [super init])
+	{
+		_records = nil;
+		_dataSource = [inDataSource retain];
+		_count = inCount;
+		_objects = (IMBObject**) calloc(_count > 0 ? _count : 1,sizeof(IMBObject*));
+		_materializedIndexes = [[NSMutableIndexSet alloc] init];
+		_observations = [[NSMutableArray alloc] init];
+		_visibleRange = NSMakeRange(0,0);
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	NSUInteger i = [_materializedIndexes firstIndex];
+	
+	while (i != NSNotFound)
+	{
+		[self _removeObservationsFromObject:_objects[i] atIndex:i];
+		[_objects[i] release];
+		i = [_materializedIndexes indexGreaterThanIndex:i];
+	}
+	
+	free(_objects);
+	IMBRelease(_materializedIndexes);
+	IMBRelease(_observations);
+	IMBRelease(_records);
+	IMBRelease(_dataSource);
+	
+	[super dealloc];
+}
+
+
+// Since the array is immutable, a copy can simply share the same storage. This is important, because IMBNode  
+// copies its objects array every time a node is handed to a background operation...
+
+- (id) copyWithZone:(NSZone*)inZone
+{
+	return [self retain];
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark NSArray Primitives
+
+
+- (NSUInteger) count
+{
+	return _count;
+}
+
+
+// Objects are created lazily by the data source. Once created, the same instance is returned until it is recycled,
+// so that identity based lookups (e.g. indexOfObjectIdenticalTo:) keep working...
+
+- (id) objectAtIndex:(NSUInteger)inIndex
+{
+	if (inIndex >= _count)
+	{
+		[NSException raise:NSRangeException format:@"%s: index %lu beyond bounds (%lu)",__FUNCTION__,(unsigned long)inIndex,(unsigned long)_count];
+	}
+	
+	IMBObject* object = nil;
+	
+	@synchronized(self)
+	{
+		object = _objects[inIndex];
+		
+		if (object == nil)
+		{
+			id record = _records ? [_records objectAtIndex:inIndex] : nil;
+			object = [[_dataSource objectForRecord:record index:inIndex] retain];
+			_objects[inIndex] = object;
+			[_materializedIndexes addIndex:inIndex];
+			[self _addObservationsToObject:object atIndex:inIndex];
+		}
+		
+		[[object retain] autorelease];
+	}
+	
+	return object;
+}
+
+
+// Objects that were never created cannot be identical to (or equal to, as IMBObject uses identity) the object we  
+// are looking for, so only look at the existing ones instead of creating all of them...
+
+- (NSUInteger) indexOfObjectIdenticalTo:(id)inObject
+{
+	@synchronized(self)
+	{
+		NSUInteger i = [_materializedIndexes firstIndex];
+		
+		while (i != NSNotFound)
+		{
+			if (_objects[i] == inObject) return i;
+			i = [_materializedIndexes indexGreaterThanIndex:i];
+		}
+	}
+	
+	return NSNotFound;
+}
+
+
+- (NSUInteger) indexOfObject:(id)inObject
+{
+	@synchronized(self)
+	{
+		NSUInteger i = [_materializedIndexes firstIndex];
+		
+		while (i != NSNotFound)
+		{
+			if (_objects[i] == inObject || [_objects[i] isEqual:inObject]) return i;
+			i = [_materializedIndexes indexGreaterThanIndex:i];
+		}
+	}
+	
+	return NSNotFound;
+}
+
+
+- (BOOL) containsObject:(id)inObject
+{
+	return [self indexOfObject:inObject] != NSNotFound;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Observing
+
+
+// NSArray doesn't support observing its elements directly, so clients (like NSArrayController for a key path like
+// arrangedObjects.imageRepresentation) register with each object via these methods. Instead of creating all objects
+// just to observe them, we remember the registration and add it to objects as they are created...
+
+- (void) addObserver:(NSObject*)inObserver toObjectsAtIndexes:(NSIndexSet*)inIndexes forKeyPath:(NSString*)inKeyPath options:(NSKeyValueObservingOptions)inOptions context:(void*)inContext
+{
+	IMBVirtualObjectArrayObservation* observation = [[IMBVirtualObjectArrayObservation alloc] init];
+	observation->_observer = inObserver;
+	observation->_indexes = [inIndexes copy];
+	observation->_keyPath = [inKeyPath copy];
+	observation->_options = inOptions & ~NSKeyValueObservingOptionInitial;
+	observation->_context = inContext;
+	
+	@synchronized(self)
+	{
+		[_observations addObject:observation];
+		
+		NSUInteger i = [_materializedIndexes firstIndex];
+		
+		while (i != NSNotFound)
+		{
+			if ([inIndexes containsIndex:i])
+			{
+				[_objects[i] addObserver:inObserver forKeyPath:inKeyPath options:inOptions context:inContext];
+			}
+			
+			i = [_materializedIndexes indexGreaterThanIndex:i];
+		}
+	}
+	
+	[observation release];
+}
+
+
+- (void) removeObserver:(NSObject*)inObserver fromObjectsAtIndexes:(NSIndexSet*)inIndexes forKeyPath:(NSString*)inKeyPath context:(void*)inContext
+{
+	[self removeObserver:inObserver fromObjectsAtIndexes:inIndexes forKeyPath:inKeyPath];
+}
+
+
+- (void) removeObserver:(NSObject*)inObserver fromObjectsAtIndexes:(NSIndexSet*)inIndexes forKeyPath:(NSString*)inKeyPath
+{
+	@synchronized(self)
+	{
+		for (IMBVirtualObjectArrayObservation* observation in [[_observations copy] autorelease])
+		{
+			if (observation->_observer == inObserver && [observation->_keyPath isEqualToString:inKeyPath])
+			{
+				NSUInteger i = [_materializedIndexes firstIndex];
+				
+				while (i != NSNotFound)
+				{
+					if ([inIndexes containsIndex:i] && [observation->_indexes containsIndex:i])
+					{
+						[_objects[i] removeObserver:inObserver forKeyPath:inKeyPath];
+					}
+					
+					i = [_materializedIndexes indexGreaterThanIndex:i];
+				}
+				
+				NSMutableIndexSet* indexes = [[observation->_indexes mutableCopy] autorelease];
+				[indexes removeIndexes:inIndexes];
+				[observation->_indexes release];
+				observation->_indexes = [indexes copy];
+				
+				if ([indexes count] == 0) [_observations removeObjectIdenticalTo:observation];
+				break;
+			}
+		}
+	}
+}
+
+
+- (void) _addObservationsToObject:(IMBObject*)inObject atIndex:(NSUInteger)inIndex
+{
+	for (IMBVirtualObjectArrayObservation* observation in _observations)
+	{
+		if ([observation->_indexes containsIndex:inIndex])
+		{
+			[inObject addObserver:observation->_observer forKeyPath:observation->_keyPath options:observation->_options context:observation->_context];
+		}
+	}
+}
+
+
+- (void) _removeObservationsFromObject:(IMBObject*)inObject atIndex:(NSUInteger)inIndex
+{
+	for (IMBVirtualObjectArrayObservation* observation in _observations)
+	{
+		if ([observation->_indexes containsIndex:inIndex])
+		{
+			[inObject removeObserver:observation->_observer forKeyPath:observation->_keyPath];
+		}
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Recycling
+
+
+- (NSUInteger) materializedObjectCount
+{
+	@synchronized(self)
+	{
+		return [_materializedIndexes count];
+	}
+}
+
+
+- (NSRange) visibleRange
+{
+	@synchronized(self)
+	{
+		return _visibleRange;
+	}
+}
+
+
+// Called by the object view whenever it scrolls. Only the objects that were created so far are looked at, so this
+// is cheap even for huge arrays. Objects that are released here may still be used elsewhere for a while (e.g. by a
+// background operation), but nobody will get them from this array anymore...
+
+- (void) setVisibleRange:(NSRange)inRange
+{
+	@synchronized(self)
+	{
+		_visibleRange = inRange;
+		
+		NSRange keptRange = NSMakeRange(0,0);
+		
+		if (inRange.length > 0)
+		{
+			NSUInteger margin = MAX(inRange.length,kIMBVirtualObjectArrayMinimumMargin);
+			NSUInteger start = inRange.location > margin ? inRange.location - margin : 0;
+			NSUInteger end = MIN(NSMaxRange(inRange) + margin,_count);
+			if (end > start) keptRange = NSMakeRange(start,end-start);
+		}
+		
+		NSMutableIndexSet* recycledIndexes = [[_materializedIndexes mutableCopy] autorelease];
+		[recycledIndexes removeIndexesInRange:keptRange];
+		
+		NSUInteger i = [recycledIndexes firstIndex];
+		
+		while (i != NSNotFound)
+		{
+			[self _releaseObjectAtIndex:i];
+			i = [recycledIndexes indexGreaterThanIndex:i];
+		}
+	}
+}
+
+
+- (void) recycleAllObjects
+{
+	[self setVisibleRange:NSMakeRange(0,0)];
+}
+
+
+- (void) _releaseObjectAtIndex:(NSUInteger)inIndex
+{
+	IMBObject* object = _objects[inIndex];
+	
+	if (object != nil)
+	{
+		[self _removeObservationsFromObject:object atIndex:inIndex];
+		_objects[inIndex] = nil;
+		[_materializedIndexes removeIndex:inIndex];
+		[object release];
+	}
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@end
+
@@ -71,6 +71,8 @@
 	BOOL _shouldDisplayLibraryName;
 	int _fakeAlbumID;					// for iPhoto2 compatibility
 	NSDateFormatter* _dateFormatter;
+	NSDictionary* _keywordMap;
+	NSMutableDictionary* _internedKeywords;
 }
 
 @property (retain) NSString* appPath;
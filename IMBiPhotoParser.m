@@ -57,9 +57,11 @@
 #import "IMBConfig.h"
 #import "IMBParserController.h"
 #import "IMBNode.h"
+#import "IMBMetadataCache.h"
 #import "IMBObject.h"
 #import "IMBiPhotoEventNodeObject.h"
 #import "IMBIconCache.h"
+#import "IMBOperationQueue.h"
 #import "NSWorkspace+iMedia.h"
 #import "NSFileManager+iMedia.h"
 #import "NSImage+iMedia.h"
@@ -86,6 +88,7 @@
 - (void) populateEventsNode:(IMBNode*)inNode withEvents:(NSArray*)inEvents images:(NSDictionary*)inImages;
 - (void) populatePhotoStreamNode:(IMBNode*)inNode images:(NSDictionary*)inImages;
 - (void) populateAlbumNode:(IMBNode*)inNode images:(NSDictionary*)inImages;
+- (NSMutableDictionary*) preliminaryMetadataForImage:(NSDictionary*)inImageDict key:(NSString*)inKey;
 
 @end
 
@@ -199,6 +202,8 @@
 {
 	IMBRelease(_appPath);
 	IMBRelease(_dateFormatter);
+	IMBRelease(_keywordMap);
+	IMBRelease(_internedKeywords);
 	[super dealloc];
 }
 
@@ -457,28 +462,16 @@
 
 - (void) loadMetadataForObject:(IMBObject*)inObject
 {
+	// Please note that the keywords were already resolved into the preliminaryMetadata at populate time...
+	
 	NSMutableDictionary* metadata = [NSMutableDictionary dictionaryWithDictionary:inObject.preliminaryMetadata];
-	NSMutableArray *realKeywords = [NSMutableArray array];
-    
-	NSDictionary *keywordMap = [self.plist objectForKey:@"List of Keywords"];
-
-	//swap the keyword index to names
-	for (NSString *keywordKey in [metadata objectForKey:@"Keywords"])
-	{
-		NSString *actualKeyword = [keywordMap objectForKey:keywordKey];
-		if (actualKeyword)
-		{
-			[realKeywords addObject:actualKeyword];
-		}
-		[metadata setObject:realKeywords forKey:@"iMediaKeywords"];
-	}
 	
 	// Do not load (key) image specific metadata for node objects
 	// because it doesn't represent the nature of the object well enough.
 	
 	if (![inObject isKindOfClass:[IMBNodeObject class]])
 	{
-		[metadata addEntriesFromDictionary:[NSImage imb_metadataFromImageAtPath:inObject.path checkSpotlightComments:NO]];
+		[metadata addEntriesFromDictionary:[[IMBMetadataCache sharedCache] imageMetadataForFileAtPath:inObject.path]];
 	}
 	
 	NSString* description = [self metadataDescriptionForMetadata:metadata];
@@ -497,20 +490,85 @@
 }
 
 
+// Keywords are stored as IDs in the image dictionaries. We resolve them via the "List of Keywords" map, which is 
+// extracted once per library load (see setPlist:). Since many photos share the same set of keywords, the resolved 
+// arrays are interned, so that identical keyword lists share a single array instance...
+
 - (NSArray *)iMediaKeywordsFromIDs:(NSArray *)keywordIDs
 {
-	NSMutableArray *realKeywords = [NSMutableArray array];
-	NSDictionary *keywordMap = [self.plist objectForKey:@"List of Keywords"];
-	//swap the keyword index to names
-	for (NSString *keywordKey in keywordIDs)
+	NSArray* keywords = nil;
+	
+	if (keywordIDs.count == 0)
+	{
+		return [NSArray array];
+	}
+	
+	@synchronized(self)
 	{
-		NSString *actualKeyword = [keywordMap objectForKey:keywordKey];
-		if (actualKeyword)
+		if (_keywordMap == nil)
 		{
-			[realKeywords addObject:actualKeyword];
+			[self plist];	// Loads the library and with it the keyword map
 		}
+		
+		keywords = [_internedKeywords objectForKey:keywordIDs];
+		
+		if (keywords == nil)
+		{
+			NSMutableArray* realKeywords = [NSMutableArray arrayWithCapacity:keywordIDs.count];
+			
+			for (NSString* keywordKey in keywordIDs)
+			{
+				NSString* actualKeyword = [_keywordMap objectForKey:keywordKey];
+				if (actualKeyword) [realKeywords addObject:actualKeyword];
+			}
+			
+			keywords = [NSArray arrayWithArray:realKeywords];
+			if (_internedKeywords) [_internedKeywords setObject:keywords forKey:keywordIDs];
+		}
+		
+		[[keywords retain] autorelease];
 	}
-	return realKeywords;
+	
+	return keywords;
+}
+
+
+// Whenever the library is (re)loaded or purged, the keyword map and the interned keyword arrays are replaced 
+// accordingly. Please note that this is always called from within @synchronized(self)...
+
+- (void) setPlist:(NSDictionary*)inPlist
+{
+	[super setPlist:inPlist];
+	
+	IMBRelease(_keywordMap);
+	IMBRelease(_internedKeywords);
+	
+	if (inPlist)
+	{
+		_keywordMap = [inPlist objectForKey:@"List of Keywords"];
+		if (_keywordMap == nil) _keywordMap = [NSDictionary dictionary];
+		[_keywordMap retain];
+		
+		_internedKeywords = [[NSMutableDictionary alloc] init];
+	}
+}
+
+
+// Returns the preliminary metadata for an image with resolved keywords...
+
+- (NSMutableDictionary*) preliminaryMetadataForImage:(NSDictionary*)inImageDict key:(NSString*)inKey
+{
+	NSMutableDictionary* metadata = [[inImageDict mutableCopy] autorelease];
+	[metadata setObject:inKey forKey:@"iPhotoKey"];   // so pasteboard-writing code can retrieve it later
+	
+	NSArray* keywordIDs = [inImageDict objectForKey:@"Keywords"];
+	
+	if (keywordIDs.count > 0)
+	{
+		[metadata setObject:[self iMediaKeywordsFromIDs:keywordIDs] forKey:@"iMediaKeywords"];
+	}
+	
+	return metadata;
 }
 
 
@@ -752,6 +810,8 @@
 	
 	for (NSDictionary* albumDict in inAlbums)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 		
 		NSString* albumType = [albumDict objectForKey:@"Album Type"];
@@ -936,6 +996,8 @@
 	
 	for (NSDictionary* subNodeDict in inEvents)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 
 		NSString* subNodeName = [subNodeDict objectForKey:@"RollName"];
@@ -1063,6 +1125,8 @@
 	
 	for (NSString* key in imageKeys)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 		NSDictionary* imageDict = [inImages objectForKey:key];
 		
@@ -1082,10 +1146,7 @@
 			object.location = (id)path;
 			object.name = name;
             
-            NSMutableDictionary *metadata = [imageDict mutableCopy];
-            [metadata setObject:key forKey:@"iPhotoKey"];   // so pasteboard-writing code can retrieve it later
-			object.preliminaryMetadata = metadata;	// This metadata from the XML file is available immediately
-            [metadata release];
+			object.preliminaryMetadata = [self preliminaryMetadataForImage:imageDict key:key];	// This metadata from the XML file is available immediately
             
 			object.metadata = nil;					// Build lazily when needed (takes longer)
 			object.metadataDescription = nil;		// Build lazily when needed (takes longer)
@@ -1095,6 +1156,8 @@
 			object.imageLocation = [self imageLocationForObject:imageDict];
 			object.imageRepresentationType = [self requestedImageRepresentationType];
 			object.imageRepresentation = nil;
+			
+			[self populateNode:inNode didAddObjects:objects];
 		}
 		
 		[pool drain];
@@ -1116,6 +1179,8 @@
 	
 	for (NSString *imageKey in inImages)
 	{
+        if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+        
         imageDict = [inImages objectForKey:imageKey];
 		
         // Being a member of Photo Stream is determined by having a non-empty Photo Stream asset id.
@@ -1126,11 +1191,9 @@
             ![assetIds member:photoStreamAssetId] &&
             [self shouldUseObject:imageDict])
 		{
-            NSMutableDictionary *metadata = [imageDict mutableCopy];
-            [metadata setObject:imageKey forKey:@"iPhotoKey"];   // so pasteboard-writing code can retrieve it later
+            NSMutableDictionary *metadata = [self preliminaryMetadataForImage:imageDict key:imageKey];
             [assetIds addObject:photoStreamAssetId];
             [photoStreamObjectDictionaries addObject:metadata];
-            [metadata release];
         }
     }
     // After collecting all Photo Stream object dictionaries sort them by date
@@ -1171,6 +1234,8 @@
 	
 	for (NSDictionary *imageDict in sortedPhotoStreamObjectDictionaries)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 		
         NSString* path = [imageDict objectForKey:@"ImagePath"];
@@ -56,6 +56,7 @@
 #import "IMBParserController.h"
 #import "IMBMovieViewController.h"
 #import "IMBNode.h"
+#import "IMBMetadataCache.h"
 #import "IMBObject.h"
 #import "IMBObject.h"
 #import "NSDictionary+iMedia.h"
@@ -197,7 +198,7 @@
 	
 	if (![inObject isKindOfClass:[IMBNodeObject class]])
 	{
-		[metadata addEntriesFromDictionary:[NSURL imb_metadataFromVideoAtURL:videoURL]];
+		[metadata addEntriesFromDictionary:[[IMBMetadataCache sharedCache] videoMetadataForURL:videoURL]];
 	}
 	
 	NSString* description = [self metadataDescriptionForMetadata:metadata];
@@ -59,6 +59,8 @@
 #import "IMBNode.h"
 #import "IMBObject.h"
 #import "IMBIconCache.h"
+#import "IMBOperationQueue.h"
+#import "IMBVirtualObjectArray.h"
 #import "NSDictionary+iMedia.h"
 #import "NSString+iMedia.h"
 #import "NSWorkspace+iMedia.h"
@@ -73,7 +75,7 @@
 
 #pragma mark 
 
-@interface IMBiTunesParser ()
+@interface IMBiTunesParser () <IMBVirtualObjectArrayDataSource>
 
 - (NSString*) identifierWithPersistentID:(NSString*)inPersistentID;
 - (BOOL) shoudlUsePlaylist:(NSDictionary*)inPlaylistDict;
@@ -90,6 +92,138 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 
+#pragma mark 
+
+// Lightweight read-only view on a track dictionary from the iTunes XML plist. Rather than copying each track into
+// a new mutable dictionary, we share the original record and only answer the bindings compatible lowercase keys
+// (e.g. "artist" for "Artist") on the fly. The duration is converted from milliseconds to seconds on access...
+
+@interface IMBiTunesTrackMetadata : NSDictionary
+{
+	NSDictionary* _track;
+}
+
+- (id) initWithTrack:(NSDictionary*)inTrack;
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+@implementation IMBiTunesTrackMetadata
+
+static NSDictionary* sAliasedKeys = nil;
+
+
++ (void) initialize
+{
+	if (self == [IMBiTunesTrackMetadata class])
+	{
+		sAliasedKeys = [[NSDictionary alloc] initWithObjectsAndKeys:
+			@"Total Time",@"duration",
+			@"Artist",@"artist",
+			@"Album",@"album",
+			@"Genre",@"genre",
+			@"Comment",@"comment",
+			nil];
+	}
+}
+
+
+- (id) initWithTrack:(NSDictionary*)inTrack
+{
+	if ((self = [super init]) != nil)
+	{
+		_track = [inTrack retain];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	IMBRelease(_track);
+	[super dealloc];
+}
+
+
+// Returns the aliased keys whose original key is present in the track...
+
+- (NSArray*) _aliasesPresent
+{
+	NSMutableArray* aliases = [NSMutableArray arrayWithCapacity:sAliasedKeys.count];
+	
+	for (NSString* alias in sAliasedKeys)
+	{
+		if ([_track objectForKey:alias] == nil && [_track objectForKey:[sAliasedKeys objectForKey:alias]] != nil)
+		{
+			[aliases addObject:alias];
+		}
+	}
+	
+	return aliases;
+}
+
+
+- (NSUInteger) count
+{
+	return _track.count + [[self _aliasesPresent] count];
+}
+
+
+- (id) objectForKey:(id)inKey
+{
+	id object = [_track objectForKey:inKey];
+	
+	if (object == nil)
+	{
+		NSString* key = [sAliasedKeys objectForKey:inKey];
+		if (key) object = [_track objectForKey:key];
+		
+		if (object != nil && [inKey isEqualToString:@"duration"])
+		{
+			object = [NSNumber numberWithDouble:[object doubleValue] / 1000.0];
+		}
+	}
+	
+	return object;
+}
+
+
+- (NSEnumerator*) keyEnumerator
+{
+	return [[[_track allKeys] arrayByAddingObjectsFromArray:[self _aliasesPresent]] objectEnumerator];
+}
+
+
+// Archive and copy as a plain dictionary, so that the receiving side doesn't need to know about this class...
+
+- (Class) classForCoder
+{
+	return [NSDictionary class];
+}
+
+
+- (Class) classForKeyedArchiver
+{
+	return [NSDictionary class];
+}
+
+
+- (id) copyWithZone:(NSZone*)inZone
+{
+	return [self retain];
+}
+
+
+@end
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
 #pragma mark 
 
 @implementation IMBiTunesParser
@@ -565,6 +699,8 @@
 	
 	for (NSDictionary* playlistDict in inPlaylists)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 		
 		NSString* albumName = [playlistDict objectForKey:@"Name"];
@@ -617,24 +753,21 @@
 }
 
 
+// Playlists can contain tens of thousands of tracks. Instead of creating an IMBObject for each track right away,
+// we only collect the track dictionaries (which are part of the plist anyway) and hand them to an IMBVirtualObjectArray, 
+// which creates the IMBObjects on demand in objectForRecord:index:...
+
 - (void) populateNode:(IMBNode*)inNode playlists:(NSArray*)inPlaylists tracks:(NSDictionary*)inTracks
 {
-	// Select the correct imageRepresentationType for our mediaType...
+	// Look for the correct playlist in the iTunes XML plist. Once we find it, collect the tracks that we want
+	// to display...
 	
-	NSString* imageRepresentationType = [self requestedImageRepresentationType];
-		
-	// Create the objects array on demand  - even if turns out to be empty after exiting this method, because
-	// without creating an array we would cause an endless loop...
-	
-	NSMutableArray* objects = [[NSMutableArray alloc] initWithArray:inNode.objects];
-
-	Class objectClass = [self objectClass];
-    
-	// Look for the correct playlist in the iTunes XML plist. Once we find it, populate the node with IMBVisualObjects
-	// for each song in this playlist...
+	NSMutableArray* records = [NSMutableArray array];
 	
 	for (NSDictionary* playlistDict in inPlaylists)
 	{
+		if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+		
 		NSAutoreleasePool* pool1 = [[NSAutoreleasePool alloc] init];
 		NSString* playlistID = [playlistDict objectForKey:@"Playlist Persistent ID"];
 		NSString* playlistIdentifier = [self identifierWithPersistentID:playlistID];
@@ -642,77 +775,98 @@
 		if ([inNode.identifier isEqualToString:playlistIdentifier])
 		{
 			NSArray* trackKeys = [playlistDict objectForKey:@"Playlist Items"];
-			NSUInteger index = 0;
 
 			for (NSDictionary* trackID in trackKeys)
 			{
-				NSAutoreleasePool* pool2 = [[NSAutoreleasePool alloc] init];
+				if ([IMBOperationQueue isCurrentOperationCancelled]) break;
+				
 				NSString* key = [[trackID objectForKey:@"Track ID"] stringValue];
 				NSDictionary* trackDict = [inTracks objectForKey:key];
 			
 				if ([self shouldUseTrack:trackDict])
 				{
-					// Get name and path to file...
-					
-					NSString* name = [trackDict objectForKey:@"Name"];
-					NSString* location = [trackDict objectForKey:@"Location"];
-					NSURL* url = [NSURL URLWithString:location];
-					NSString* path = [url path];
-					BOOL isFileURL = [url isFileURL];
-					
-					// Create an object...
-					
-					IMBObject* object = [[objectClass alloc] init];
-					[objects addObject:object];
-					[object release];
-
-					// For local files path is preferred (as we gain automatic support for some context menu items).
-					// For remote files we'll use a URL (less context menu support)...
-					
-					if (isFileURL) object.location = (id)path;
-					else object.location = (id)url;
-					
-					object.name = name;
-					object.parser = self;
-					object.index = index++;
-					
-					object.imageLocation = path;
-					object.imageRepresentationType = imageRepresentationType; 
-					object.imageRepresentation = nil;	// will be loaded lazily when needed
-
-					// Add metadata and convert the duration property to seconds. Also note that the original
-					// key "Total Time" is not bindings compatible as it contains a space...
-					
-					NSMutableDictionary* metadata = [NSMutableDictionary dictionaryWithDictionary:trackDict];
-					object.metadata = metadata;
-					
-					double duration = [[trackDict objectForKey:@"Total Time"] doubleValue] / 1000.0;
-					[metadata setObject:[NSNumber numberWithDouble:duration] forKey:@"duration"]; 
-					
-					NSString* artist = [trackDict objectForKey:@"Artist"];
-					if (artist) [metadata setObject:artist forKey:@"artist"]; 
-					
-					NSString* album = [trackDict objectForKey:@"Album"];
-					if (album) [metadata setObject:album forKey:@"album"]; 
-					
-					NSString* genre = [trackDict objectForKey:@"Genre"];
-					if (genre) [metadata setObject:genre forKey:@"genre"]; 
-
-					NSString* comment = [trackDict objectForKey:@"Comment"];
-					if (comment) [metadata setObject:comment forKey:@"comment"]; 
-					
-					object.metadataDescription = [self metadataDescriptionForMetadata:metadata];
+					[records addObject:trackDict];
 				}
-				
-				[pool2 drain];
 			}
 		}
 		
 		[pool1 drain];
 	}
     
-    inNode.objects = objects;
-    [objects release];
+	// Create the objects array even if it turns out to be empty, because without an array we would cause an 
+	// endless loop. Existing objects are kept, in which case the objects can't be virtual...
+	
+	if ([inNode.objects count] == 0)
+	{
+		IMBVirtualObjectArray* objects = [[IMBVirtualObjectArray alloc] initWithRecords:records dataSource:self];
+		inNode.objects = objects;
+		[objects release];
+	}
+	else
+	{
+		NSMutableArray* objects = [NSMutableArray arrayWithArray:inNode.objects];
+		NSUInteger index = 0;
+		
+		for (NSDictionary* trackDict in records)
+		{
+			[objects addObject:[self objectForRecord:trackDict index:index++]];
+		}
+		
+		inNode.objects = objects;
+	}
+}
+
+
+// Creates the IMBObject for a track. This is called lazily by IMBVirtualObjectArray, possibly on any thread...
+
+- (IMBObject*) objectForRecord:(id)inRecord index:(NSUInteger)inIndex
+{
+	NSDictionary* trackDict = (NSDictionary*)inRecord;
+	
+	// Get name and path to file...
+	
+	NSString* name = [trackDict objectForKey:@"Name"];
+	NSString* location = [trackDict objectForKey:@"Location"];
+	NSURL* url = [NSURL URLWithString:location];
+	NSString* path = [url path];
+	BOOL isFileURL = [url isFileURL];
+	
+	// Create an object...
+	
+	IMBObject* object = [[[[self objectClass] alloc] init] autorelease];
+
+	// For local files path is preferred (as we gain automatic support for some context menu items).
+	// For remote files we'll use a URL (less context menu support)...
+	
+	if (isFileURL) object.location = (id)path;
+	else object.location = (id)url;
+	
+	object.name = name;
+	object.parser = self;
+	object.index = inIndex;
+	
+	object.imageLocation = path;
+	object.imageRepresentationType = [self requestedImageRepresentationType]; 
+	object.imageRepresentation = nil;	// will be loaded lazily when needed
+
+	// Add metadata as a view on the shared track record. The duration is converted to seconds and keys
+	// like "Total Time" are made bindings compatible by IMBiTunesTrackMetadata. Please note that the 
+	// metadataDescription is not created here, as IMBObject asks us for it lazily when needed...
+	
+	IMBiTunesTrackMetadata* metadata = [[IMBiTunesTrackMetadata alloc] initWithTrack:trackDict];
+	object.metadata = metadata;
+	[metadata release];
+	
+	return object;
+}
+
+
+// Playlists can contain tens of thousands of tracks, so descriptions are only formatted for the rows that are
+// actually displayed...
+
+- (BOOL) providesMetadataDescriptionLazily
+{
+	return YES;
 }
 
 
@@ -61,6 +61,7 @@
 - (NSString*)imb_uniqueTemporaryPathWithinDirectory:(NSString*)directoryPath;
 
 - (NSString*)imb_sharedTemporaryFolder:(NSString*)dirName;
+- (NSString*)imb_sharedCachesFolder:(NSString*)dirName;
 
 - (NSString*) imb_volumeNameAtPath:(NSString*)inPath;
 - (NSString*) imb_relativePathToVolumeAtPath:(NSString*)inPath;
@@ -168,6 +168,26 @@
     return directoryPath;
 }
 
+// Return (creating if necessary) a path to the iMedia folder inside the caches folder of the host app. Unlike the
+// temporary folder, its contents survive a relaunch, so it is suitable for persistent caches. If you pass in a 
+// subfolder name, that will be created and appended.
+
+- (NSString*)imb_sharedCachesFolder:(NSString*)dirName;
+{
+	NSString *cachesPath = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory,NSUserDomainMask,YES) lastObject];
+	NSString *bundleIdentifier = [[NSBundle mainBundle] bundleIdentifier];
+	if (cachesPath == nil) cachesPath = NSTemporaryDirectory();
+	if (bundleIdentifier == nil) bundleIdentifier = [[NSProcessInfo processInfo] processName];
+	
+	NSString *directoryPath = [[cachesPath stringByAppendingPathComponent:bundleIdentifier] stringByAppendingPathComponent:@"iMedia"];
+	if (dirName && ![dirName isEqualToString:@""])
+	{
+		directoryPath = [directoryPath stringByAppendingPathComponent:dirName];
+	}
+	[self createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:NULL];
+    return directoryPath;
+}
+
 - (NSString*)imb_uniqueTemporaryFile:(NSString*)name
 {
 	NSString *processName = [[NSProcessInfo processInfo] processName];
@@ -51,6 +51,7 @@
 #import "NSString+iMedia.h"
 #import "NSWorkspace+iMedia.h"
 #import "IMBNode.h"
+#import "IMBImageHeaderReader.h"
 
 @interface NSBundle (SDK_10_7)
 
@@ -106,7 +107,36 @@
 	return image;
 }
 
-// Return a dictionary with these properties: width (NSNumber), height (NSNumber), dateTimeLocalized (NSString)
+// Fills in the properties that IMBImageHeaderReader can extract by reading just the file headers. Returns NO if
+// the file format is not supported by the reader...
+
++ (BOOL) _imb_addHeaderMetadataFromImageAtPath:(NSString *)aPath toDictionary:(NSMutableDictionary *)md
+{
+	IMBImageHeaderInfo info;
+	
+	if (!IMBImageHeaderReadFile([aPath fileSystemRepresentation],&info))
+	{
+		return NO;
+	}
+	
+	[md setObject:[NSNumber numberWithUnsignedInt:info.width] forKey:@"width"];
+	[md setObject:[NSNumber numberWithUnsignedInt:info.height] forKey:@"height"];
+	if (info.depth) [md setObject:[NSNumber numberWithUnsignedInt:info.depth] forKey:@"depth"];
+	
+	const char* model = IMBImageHeaderColorModelName(info.colorModel);
+	if (model) [md setObject:[NSString stringWithUTF8String:model] forKey:@"model"];
+	
+	NSString* dateTime = info.dateTimeOriginal[0] ? [NSString stringWithUTF8String:info.dateTimeOriginal] : nil;
+	if (dateTime) [md setObject:dateTime forKey:@"dateTime"];
+	
+	return YES;
+}
+
+
+// Return a dictionary with these properties: width (NSNumber), height (NSNumber), dateTimeLocalized (NSString).
+// The cheap header reader is tried first. Only if it doesn't understand the file format do we fall back to 
+// opening a CGImageSource...
+
 + (NSDictionary *)imb_metadataFromImageAtPath:(NSString *)aPath checkSpotlightComments:(BOOL)aCheckSpotlight;
 {
 	NSDictionary *result = nil;
@@ -114,44 +144,53 @@
 	
 	if (url)
 	{
-		CGImageSourceRef source = CGImageSourceCreateWithURL((CFURLRef)url, NULL);
 		NSMutableDictionary *md = [NSMutableDictionary dictionary];
+		NSString *filetype = [[aPath pathExtension] uppercaseString];
 		
-		if (source)
+		if ([self _imb_addHeaderMetadataFromImageAtPath:aPath toDictionary:md])
 		{
-			CGImageSourceStatus status = CGImageSourceGetStatus(source);
+			if (filetype) [md setObject:filetype forKey:@"filetype"];
+			[md setObject:aPath forKey:@"path"];
+		}
+		else
+		{
+			CGImageSourceRef source = CGImageSourceCreateWithURL((CFURLRef)url, NULL);
 
-			if (status == kCGImageStatusComplete) {
-				CFDictionaryRef propsCF = CGImageSourceCopyPropertiesAtIndex(source,  0,  NULL );
-				if (propsCF)
-				{
-					NSDictionary *props = (NSDictionary *)propsCF;
-					NSNumber *width = (NSNumber*) [props objectForKey:(NSString *)kCGImagePropertyPixelWidth];
-					NSNumber *height= (NSNumber*) [props objectForKey:(NSString *)kCGImagePropertyPixelHeight];
-					NSNumber *depth = (NSNumber*) [props objectForKey:(NSString *)kCGImagePropertyDepth];
-					NSString *model = [props objectForKey:(NSString *)kCGImagePropertyColorModel];
-					NSString *filetype = [[aPath pathExtension] uppercaseString];
-					if (width) [md setObject:width forKey:@"width"];
-					if (height) [md setObject:height forKey:@"height"];
-					if (depth) [md setObject:depth forKey:@"depth"];
-					if (model) [md setObject:model forKey:@"model"];
-					if (filetype) [md setObject:filetype forKey:@"filetype"];
-					[md setObject:aPath forKey:@"path"];
-
-					NSDictionary *exif = [props objectForKey:(NSString *)kCGImagePropertyExifDictionary];
-					if ( nil != exif )
+			if (source)
+			{
+				CGImageSourceStatus status = CGImageSourceGetStatus(source);
+
+				if (status == kCGImageStatusComplete) {
+					CFDictionaryRef propsCF = CGImageSourceCopyPropertiesAtIndex(source,  0,  NULL );
+					if (propsCF)
 					{
-						NSString *dateTime = [exif objectForKey:(NSString *)kCGImagePropertyExifDateTimeOriginal];
-						// format from EXIF -- we could convert to a date and make more localized....
-						if (nil != dateTime)
+						NSDictionary *props = (NSDictionary *)propsCF;
+						NSNumber *width = (NSNumber*) [props objectForKey:(NSString *)kCGImagePropertyPixelWidth];
+						NSNumber *height= (NSNumber*) [props objectForKey:(NSString *)kCGImagePropertyPixelHeight];
+						NSNumber *depth = (NSNumber*) [props objectForKey:(NSString *)kCGImagePropertyDepth];
+						NSString *model = [props objectForKey:(NSString *)kCGImagePropertyColorModel];
+						if (width) [md setObject:width forKey:@"width"];
+						if (height) [md setObject:height forKey:@"height"];
+						if (depth) [md setObject:depth forKey:@"depth"];
+						if (model) [md setObject:model forKey:@"model"];
+						if (filetype) [md setObject:filetype forKey:@"filetype"];
+						[md setObject:aPath forKey:@"path"];
+
+						NSDictionary *exif = [props objectForKey:(NSString *)kCGImagePropertyExifDictionary];
+						if ( nil != exif )
 						{
-							[md setObject:dateTime forKey:@"dateTime"];
+							NSString *dateTime = [exif objectForKey:(NSString *)kCGImagePropertyExifDateTimeOriginal];
+							// format from EXIF -- we could convert to a date and make more localized....
+							if (nil != dateTime)
+							{
+								[md setObject:dateTime forKey:@"dateTime"];
+							}
 						}
+						CFRelease(propsCF);
 					}
-					CFRelease(propsCF);
 				}
+				CFRelease(source);
 			}
-			CFRelease(source);
 		}
 		
 		if (aCheckSpotlight)	// done from folder parsers, but not library-based items like iPhoto
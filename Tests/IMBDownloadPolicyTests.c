@@ -0,0 +1,268 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Tests for IMBDownloadPolicy, the plain C part of IMBURLDownloadOperation. They build and run without Xcode:
+//
+//     make -C Tests check
+//
+// The transfers themselves use NSURLDownload and NSURLConnection, which can't run here, so these tests cover the 
+// decisions the operation makes: host slots, resume delays and the ranges of parallel downloads...
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include "../IMBDownloadPolicy.h"
+#include <stdio.h>
+#include <string.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static int sFailures = 0;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#define IMBExpect(condition) \
+	do { if (!(condition)) { fprintf(stderr,"%s:%d: %s\n",__FILE__,__LINE__,#condition); sFailures++; } } while (0)
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// The delays double with each attempt, and a download is given up after kIMBDownloadMaxResumeCount attempts...
+
+static void _IMBTestResumeDelay(void)
+{
+	IMBExpect(IMBDownloadResumeDelay(0) == kIMBDownloadResumeDelay);
+	IMBExpect(IMBDownloadResumeDelay(1) == 2.0 * kIMBDownloadResumeDelay);
+	IMBExpect(IMBDownloadResumeDelay(kIMBDownloadMaxResumeCount-1) > 0.0);
+	IMBExpect(IMBDownloadResumeDelay(kIMBDownloadMaxResumeCount) < 0.0);
+	IMBExpect(IMBDownloadResumeDelay(1000) < 0.0);
+}
+
+
+// Ranges must cover the whole file without gaps or overlaps...
+
+static void _IMBTestSplitRanges(void)
+{
+	IMBDownloadRange ranges[4];
+	
+	IMBExpect(IMBDownloadSplitRanges(1003,4,100,ranges) == 4);
+	IMBExpect(ranges[0].offset == 0 && ranges[0].length == 250 && ranges[0].done == 0);
+	IMBExpect(ranges[1].offset == 250 && ranges[1].length == 250);
+	IMBExpect(ranges[3].offset == 750 && ranges[3].length == 253);
+	
+	IMBExpect(IMBDownloadSplitRanges(250,4,100,ranges) == 2);
+	IMBExpect(ranges[0].length + ranges[1].length == 250 && ranges[1].offset == ranges[0].length);
+	
+	IMBExpect(IMBDownloadSplitRanges(99,4,100,ranges) == 1);
+	IMBExpect(ranges[0].offset == 0 && ranges[0].length == 99);
+	
+	IMBExpect(IMBDownloadSplitRanges(0,4,100,ranges) == 0);
+	IMBExpect(IMBDownloadSplitRanges(1000,0,100,ranges) == 0);
+}
+
+
+// A resumed range only asks for the bytes that are still missing...
+
+static void _IMBTestRangeHeader(void)
+{
+	IMBDownloadRange range = { 1000,500,0 };
+	char header[64];
+	
+	IMBExpect(IMBDownloadFormatRangeHeader(&range,header,sizeof(header)));
+	IMBExpect(strcmp(header,"bytes=1000-1499") == 0);
+	
+	range.done = 123;
+	IMBExpect(IMBDownloadFormatRangeHeader(&range,header,sizeof(header)));
+	IMBExpect(strcmp(header,"bytes=1123-1499") == 0);
+	
+	range.done = 500;
+	IMBExpect(!IMBDownloadFormatRangeHeader(&range,header,sizeof(header)));
+	
+	range.done = 0;
+	IMBExpect(!IMBDownloadFormatRangeHeader(&range,header,8));
+}
+
+
+static void _IMBTestContentRange(void)
+{
+	int64_t first = 0,last = 0,total = 0;
+	
+	IMBExpect(IMBDownloadParseContentRange("bytes 100-199/1000",&first,&last,&total));
+	IMBExpect(first == 100 && last == 199 && total == 1000);
+	
+	IMBExpect(IMBDownloadParseContentRange("bytes 0-4294967296/8589934592",&first,&last,&total));
+	IMBExpect(last == 4294967296LL && total == 8589934592LL);
+	
+	IMBExpect(IMBDownloadParseContentRange("Bytes 5-9/*",&first,&last,&total));
+	IMBExpect(first == 5 && last == 9 && total == -1);
+	
+	IMBExpect(!IMBDownloadParseContentRange("bytes */1000",&first,&last,&total));
+	IMBExpect(!IMBDownloadParseContentRange("bytes 200-100/1000",&first,&last,&total));
+	IMBExpect(!IMBDownloadParseContentRange("bytes 100-1000/1000",&first,&last,&total));
+	IMBExpect(!IMBDownloadParseContentRange("bytes 100-199/1000x",&first,&last,&total));
+	IMBExpect(!IMBDownloadParseContentRange("items 1-2/3",&first,&last,&total));
+	IMBExpect(!IMBDownloadParseContentRange("bytes 99999999999999999999-1/2",&first,&last,&total));
+	IMBExpect(!IMBDownloadParseContentRange(NULL,&first,&last,&total));
+}
+
+
+// Slots are counted per host, waiters get freed slots in FIFO order (but only for their own host), and cancelled
+// waiters are skipped...
+
+static void _IMBTestHostSlots(void)
+{
+	IMBHostSlots* slots = IMBHostSlotsCreate(2);
+	int a,b,c,d;
+	
+	IMBExpect(IMBHostSlotsAcquire(slots,"example.com",&a));
+	IMBExpect(IMBHostSlotsAcquire(slots,"EXAMPLE.com",&b));
+	IMBExpect(IMBHostSlotsActiveCount(slots,"example.COM") == 2);
+	IMBExpect(!IMBHostSlotsAcquire(slots,"example.com",&c));
+	IMBExpect(!IMBHostSlotsAcquire(slots,"example.com",&d));
+	IMBExpect(!IMBHostSlotsAcquire(slots,"example.com",NULL));
+	IMBExpect(IMBHostSlotsAcquire(slots,"other.org",&a));
+	IMBExpect(IMBHostSlotsActiveCount(slots,"example.com") == 2);
+	
+	// A slot of another host doesn't wake up anybody...
+	
+	IMBExpect(IMBHostSlotsRelease(slots,"other.org") == NULL);
+	IMBExpect(IMBHostSlotsActiveCount(slots,"other.org") == 0);
+	
+	// The slot is handed over to the oldest waiter, so the count stays the same...
+	
+	IMBExpect(IMBHostSlotsRelease(slots,"example.com") == &c);
+	IMBExpect(IMBHostSlotsActiveCount(slots,"example.com") == 2);
+	
+	// A cancelled waiter is removed from the queue...
+	
+	IMBExpect(IMBHostSlotsRemoveWaiter(slots,&d));
+	IMBExpect(!IMBHostSlotsRemoveWaiter(slots,&d));
+	IMBExpect(IMBHostSlotsRelease(slots,"example.com") == NULL);
+	IMBExpect(IMBHostSlotsActiveCount(slots,"example.com") == 1);
+	IMBExpect(IMBHostSlotsRelease(slots,"example.com") == NULL);
+	IMBExpect(IMBHostSlotsActiveCount(slots,"example.com") == 0);
+	
+	// Releasing more often than acquiring must not underflow...
+	
+	IMBExpect(IMBHostSlotsRelease(slots,"example.com") == NULL);
+	IMBExpect(IMBHostSlotsAcquire(slots,"example.com",NULL));
+	IMBExpect(IMBHostSlotsActiveCount(slots,"example.com") == 1);
+	
+	// Downloads without a host are never limited...
+	
+	IMBExpect(IMBHostSlotsAcquire(slots,NULL,&a));
+	IMBExpect(IMBHostSlotsRelease(slots,NULL) == NULL);
+	
+	IMBHostSlotsDispose(slots);
+}
+
+
+// Many hosts and waiters, to exercise growing the tables...
+
+static void _IMBTestManyHosts(void)
+{
+	IMBHostSlots* slots = IMBHostSlotsCreate(1);
+	int waiters[100];
+	char host[32];
+	
+	for (int i=0; i<100; i++)
+	{
+		snprintf(host,sizeof(host),"host%d.example.com",i);
+		IMBExpect(IMBHostSlotsAcquire(slots,host,NULL));
+		IMBExpect(!IMBHostSlotsAcquire(slots,host,&waiters[i]));
+	}
+	
+	for (int i=99; i>=0; i--)
+	{
+		snprintf(host,sizeof(host),"host%d.example.com",i);
+		IMBExpect(IMBHostSlotsRelease(slots,host) == &waiters[i]);
+		IMBExpect(IMBHostSlotsRelease(slots,host) == NULL);
+		IMBExpect(IMBHostSlotsActiveCount(slots,host) == 0);
+	}
+	
+	IMBHostSlotsDispose(slots);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+int main(int argc,const char* argv[])
+{
+	(void)argc;
+	(void)argv;
+	
+	_IMBTestResumeDelay();
+	_IMBTestSplitRanges();
+	_IMBTestRangeHeader();
+	_IMBTestContentRange();
+	_IMBTestHostSlots();
+	_IMBTestManyHosts();
+	
+	if (sFailures) fprintf(stderr,"%d failure(s)\n",sFailures);
+	else printf("All IMBDownloadPolicy tests passed\n");
+	
+	return sFailures ? 1 : 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
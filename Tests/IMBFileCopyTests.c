@@ -0,0 +1,321 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Tests for IMBFileCopy, the plain C part of the chunked file copy in IMBObjectsPromise. They build and run without
+// Xcode:
+//
+//     make -C Tests check
+//
+// Every test runs against both the default copy (which may let the kernel copy) and the buffered copy...
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include "../IMBFileCopy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark TYPES
+
+typedef int (*IMBCopyFunc)(int,int,int64_t,int64_t,size_t,volatile int32_t*,IMBFileCopyProgressFunc,void*);
+
+typedef struct
+{
+	int64_t bytesCopied;
+	int64_t stopAfter;						// Stop once this many bytes were reported, or never if negative
+}
+IMBTestProgress;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static int sFailures = 0;
+
+static const int64_t kIMBTestFileSize = 3 * 65536 + 1234;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#define IMBExpect(condition) \
+	do { if (!(condition)) { fprintf(stderr,"%s:%d: %s\n",__FILE__,__LINE__,#condition); sFailures++; } } while (0)
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Helpers
+
+
+static bool _IMBTestDidCopy(void* inContext,int64_t inLength)
+{
+	IMBTestProgress* progress = (IMBTestProgress*)inContext;
+	progress->bytesCopied += inLength;
+	return progress->stopAfter < 0 || progress->bytesCopied < progress->stopAfter;
+}
+
+
+// Creates an empty temporary file, which is unlinked right away, as the tests only need the file descriptor...
+
+static int _IMBTestTempFile(void)
+{
+	const char* folder = getenv("TMPDIR");
+	char path[1024];
+	snprintf(path,sizeof(path),"%s/IMBFileCopyTests.XXXXXX",folder ? folder : "/tmp");
+	
+	int file = mkstemp(path);
+	if (file >= 0) unlink(path);
+	return file;
+}
+
+
+static unsigned char _IMBTestByte(int64_t inOffset)
+{
+	return (unsigned char)((inOffset * 31 + (inOffset >> 8)) & 0xFF);
+}
+
+
+static int _IMBTestSourceFile(void)
+{
+	int file = _IMBTestTempFile();
+	unsigned char buffer[4096];
+	
+	for (int64_t offset=0; file >= 0 && offset<kIMBTestFileSize; offset+=sizeof(buffer))
+	{
+		size_t length = kIMBTestFileSize - offset < (int64_t)sizeof(buffer) ? (size_t)(kIMBTestFileSize - offset) : sizeof(buffer);
+		for (size_t i=0; i<length; i++) buffer[i] = _IMBTestByte(offset + (int64_t)i);
+		if (pwrite(file,buffer,length,offset) != (ssize_t)length) return -1;
+	}
+	
+	return file;
+}
+
+
+static bool _IMBTestSameContents(int inFile,int64_t inOffset,int64_t inLength)
+{
+	unsigned char byte;
+	
+	for (int64_t offset=inOffset; offset<inOffset+inLength; offset++)
+	{
+		if (pread(inFile,&byte,1,offset) != 1 || byte != _IMBTestByte(offset)) return false;
+	}
+	
+	return true;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark 
+#pragma mark Tests
+
+
+// Chunks with odd sizes and a buffer that doesn't divide them must still reproduce the file exactly...
+
+static void _IMBTestCopy(IMBCopyFunc inCopy)
+{
+	int src = _IMBTestSourceFile();
+	int dst = _IMBTestTempFile();
+	IMBExpect(src >= 0 && dst >= 0);
+	IMBExpect(ftruncate(dst,kIMBTestFileSize) == 0);
+
+	volatile int32_t error = 0;
+	IMBTestProgress progress = { 0,-1 };
+	int64_t chunk = 70001;
+	
+	for (int64_t offset=0; offset<kIMBTestFileSize; offset+=chunk)
+	{
+		int64_t length = kIMBTestFileSize - offset < chunk ? kIMBTestFileSize - offset : chunk;
+		IMBExpect(inCopy(src,dst,offset,length,5000,&error,_IMBTestDidCopy,&progress) == 0);
+	}
+	
+	IMBExpect(error == 0);
+	IMBExpect(progress.bytesCopied == kIMBTestFileSize);
+	IMBExpect(_IMBTestSameContents(dst,0,kIMBTestFileSize));
+	
+	// Zero length is fine, a missing progress callback too...
+	
+	IMBExpect(inCopy(src,dst,0,0,5000,&error,NULL,NULL) == 0);
+	IMBExpect(inCopy(src,dst,0,1000,5000,&error,NULL,NULL) == 0);
+	IMBExpect(error == 0);
+	
+	close(src);
+	close(dst);
+}
+
+
+// Stopping from the progress callback is recorded as ECANCELED, and an error recorded by another chunk stops a 
+// chunk before it copies anything...
+
+static void _IMBTestStop(IMBCopyFunc inCopy)
+{
+	int src = _IMBTestSourceFile();
+	int dst = _IMBTestTempFile();
+	
+	volatile int32_t error = 0;
+	IMBTestProgress progress = { 0,1 };
+	IMBExpect(inCopy(src,dst,0,kIMBTestFileSize,4096,&error,_IMBTestDidCopy,&progress) == ECANCELED);
+	IMBExpect(error == ECANCELED);
+	IMBExpect(progress.bytesCopied > 0 && progress.bytesCopied < kIMBTestFileSize);
+	
+	error = EIO;
+	progress.bytesCopied = 0;
+	progress.stopAfter = -1;
+	IMBExpect(inCopy(src,dst,0,kIMBTestFileSize,4096,&error,_IMBTestDidCopy,&progress) == EIO);
+	IMBExpect(error == EIO);
+	IMBExpect(progress.bytesCopied == 0);
+	
+	close(src);
+	close(dst);
+}
+
+
+// A source that is shorter than expected is an error, not an endless loop. The first error wins...
+
+static void _IMBTestShortSource(IMBCopyFunc inCopy)
+{
+	int src = _IMBTestSourceFile();
+	int dst = _IMBTestTempFile();
+	
+	volatile int32_t error = 0;
+	IMBTestProgress progress = { 0,-1 };
+	IMBExpect(inCopy(src,dst,kIMBTestFileSize-100,1000,4096,&error,_IMBTestDidCopy,&progress) == EIO);
+	IMBExpect(error == EIO);
+	IMBExpect(progress.bytesCopied == 100);
+	IMBExpect(_IMBTestSameContents(dst,kIMBTestFileSize-100,100));
+	
+	IMBExpect(inCopy(-1,dst,0,1000,4096,&error,NULL,NULL) == EIO);
+	IMBExpect(error == EIO);
+	
+	close(src);
+	close(dst);
+}
+
+
+// A write that stops short (here because of the file size limit) must not be mistaken for success, nor record a 
+// stale errno. The limit leaves room for part of the first buffer...
+
+static void _IMBTestShortWrite(IMBCopyFunc inCopy)
+{
+	int src = _IMBTestSourceFile();
+	int dst = _IMBTestTempFile();
+	struct rlimit limit;
+	struct rlimit small;
+	
+	IMBExpect(getrlimit(RLIMIT_FSIZE,&limit) == 0);
+	small = limit;
+	small.rlim_cur = 1000;
+	signal(SIGXFSZ,SIG_IGN);
+	IMBExpect(setrlimit(RLIMIT_FSIZE,&small) == 0);
+	
+	volatile int32_t error = 0;
+	IMBTestProgress progress = { 0,-1 };
+	errno = 0;
+	int result = inCopy(src,dst,0,4096,4096,&error,_IMBTestDidCopy,&progress);
+	
+	IMBExpect(setrlimit(RLIMIT_FSIZE,&limit) == 0);
+	signal(SIGXFSZ,SIG_DFL);
+	
+	IMBExpect(result == EFBIG);
+	IMBExpect(error == EFBIG);
+	IMBExpect(_IMBTestSameContents(dst,0,1000));
+	
+	close(src);
+	close(dst);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+int main(int argc,const char* argv[])
+{
+	(void)argc;
+	(void)argv;
+	
+	IMBCopyFunc functions[] = { IMBFileCopyChunk,IMBFileCopyChunkWithBuffer };
+	
+	for (size_t i=0; i<sizeof(functions)/sizeof(functions[0]); i++)
+	{
+		_IMBTestCopy(functions[i]);
+		_IMBTestStop(functions[i]);
+		_IMBTestShortSource(functions[i]);
+		_IMBTestShortWrite(functions[i]);
+	}
+	
+	if (sFailures) fprintf(stderr,"%d failure(s)\n",sFailures);
+	else printf("All IMBFileCopy tests passed\n");
+	
+	return sFailures ? 1 : 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
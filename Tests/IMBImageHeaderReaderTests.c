@@ -0,0 +1,337 @@
+/*
+ iMedia Browser Framework <http://karelia.com/imedia/>
+ 
+ Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+ iMedia Browser is based on code originally developed by Jason Terhorst,
+ further developed for Sandvox by Greg Hulands, Dan Wood, and Terrence Talbot.
+ The new architecture for version 2.0 was developed by Peter Baumgartner.
+ Contributions have also been made by Matt Gough, Martin Wennerberg and others
+ as indicated in source files.
+ 
+ The iMedia Browser Framework is licensed under the following terms:
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in all or substantial portions of the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following
+ conditions:
+ 
+	Redistributions of source code must retain the original terms stated here,
+	including this list of conditions, the disclaimer noted below, and the
+	following copyright notice: Copyright (c) 2005-2012 by Karelia Software et al.
+ 
+	Redistributions in binary form must include, in an end-user-visible manner,
+	e.g., About window, Acknowledgments window, or similar, either a) the original
+	terms stated here, including this list of conditions, the disclaimer noted
+	below, and the aforementioned copyright notice, or b) the aforementioned
+	copyright notice and a link to karelia.com/imedia.
+ 
+	Neither the name of Karelia Software, nor Sandvox, nor the names of
+	contributors to iMedia Browser may be used to endorse or promote products
+	derived from the Software without prior and express written permission from
+	Karelia Software or individual contributors, as appropriate.
+ 
+ Disclaimer: THE SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER AND CONTRIBUTORS
+ "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE,
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ CONTRACT, TORT, OR OTHERWISE, ARISING FROM, OUT OF, OR IN CONNECTION WITH, THE
+ SOFTWARE OR THE USE OF, OR OTHER DEALINGS IN, THE SOFTWARE.
+*/
+
+
+// Author: Unknown
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Fixture tests for IMBImageHeaderReader. The reader is plain C, so these build and run without Xcode:
+//
+//     make -C Tests check
+//
+// The fixtures in Tests/Fixtures are tiny hand made files that only contain headers (no real pixel data)...
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark HEADERS
+
+#include "../IMBImageHeaderReader.h"
+#include <stdio.h>
+#include <string.h>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#pragma mark GLOBALS
+
+static int sFailures = 0;
+static const char* sFixturesPath = "Fixtures";
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+#define IMBExpect(condition) \
+	do { if (!(condition)) { fprintf(stderr,"%s:%d: %s\n",__FILE__,__LINE__,#condition); sFailures++; } } while (0)
+
+
+static bool _IMBReadFixture(const char* inName,IMBImageHeaderInfo* outInfo)
+{
+	char path[1024];
+	snprintf(path,sizeof(path),"%s/%s",sFixturesPath,inName);
+	return IMBImageHeaderReadFile(path,outInfo);
+}
+
+
+static bool _IMBFindFixturePreview(const char* inName,uint32_t inMinPixelSize,IMBImagePreviewInfo* outPreview,uint32_t* outOrientation)
+{
+	char path[1024];
+	snprintf(path,sizeof(path),"%s/%s",sFixturesPath,inName);
+	memset(outPreview,0,sizeof(IMBImagePreviewInfo));
+	return IMBImageHeaderFindPreview(path,inMinPixelSize,outPreview,outOrientation);
+}
+
+
+// Makes sure that a preview really points at the start of a JPEG stream...
+
+static bool _IMBIsJPEGAt(const char* inName,uint64_t inOffset)
+{
+	char path[1024];
+	unsigned char soi[2] = { 0,0 };
+	snprintf(path,sizeof(path),"%s/%s",sFixturesPath,inName);
+	
+	FILE* file = fopen(path,"rb");
+	if (file == NULL) return false;
+	bool ok = fseek(file,(long)inOffset,SEEK_SET) == 0 && fread(soi,1,2,file) == 2;
+	fclose(file);
+	
+	return ok && soi[0] == 0xFF && soi[1] == 0xD8;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+// Baseline JPEG with an EXIF segment: size and depth come from SOF0, orientation from IFD0 and the date from the
+// EXIF IFD...
+
+static void _IMBTestJPEG(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("exif.jpg",&info));
+	IMBExpect(info.format == kIMBImageFormatJPEG);
+	IMBExpect(info.width == 640 && info.height == 480);
+	IMBExpect(info.depth == 8);
+	IMBExpect(info.colorModel == kIMBImageColorModelRGB);
+	IMBExpect(info.orientation == 6);
+	IMBExpect(strcmp(info.dateTimeOriginal,"2011:07:14 09:30:05") == 0);
+}
+
+
+// 16 bit gray PNG with alpha...
+
+static void _IMBTestPNG(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("gray.png",&info));
+	IMBExpect(info.format == kIMBImageFormatPNG);
+	IMBExpect(info.width == 300 && info.height == 200);
+	IMBExpect(info.depth == 16);
+	IMBExpect(info.colorModel == kIMBImageColorModelGray);
+	IMBExpect(info.orientation == 0);
+}
+
+
+// Little endian RGB TIFF. BitsPerSample is a SHORT array that doesn't fit into the entry...
+
+static void _IMBTestTIFF(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("rgb16.tif",&info));
+	IMBExpect(info.format == kIMBImageFormatTIFF);
+	IMBExpect(info.width == 1024 && info.height == 768);
+	IMBExpect(info.depth == 16);
+	IMBExpect(info.colorModel == kIMBImageColorModelRGB);
+	IMBExpect(info.orientation == 3);
+}
+
+
+// Numeric values stored as LONG arrays must be read from their offset, not taken for the offset itself...
+
+static void _IMBTestTIFFLongArrays(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("long-arrays.tif",&info));
+	IMBExpect(info.width == 4000 && info.height == 3000);
+	IMBExpect(info.depth == 8);
+	IMBExpect(info.colorModel == kIMBImageColorModelGray);
+	IMBExpect(info.orientation == 8);
+}
+
+
+// Canon CR2: IFD0 is a full size JPEG, so its size is taken and the lossless sensor IFD is never looked at...
+
+static void _IMBTestCR2(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("canon.cr2",&info));
+	IMBExpect(info.format == kIMBImageFormatTIFF);
+	IMBExpect(info.width == 5184 && info.height == 3456);
+	IMBExpect(info.depth == 8);
+	IMBExpect(info.orientation == 6);
+	IMBExpect(strcmp(info.dateTimeOriginal,"2019:05:21 16:45:12") == 0);
+}
+
+
+// Big endian NEF: IFD0 is a reduced resolution thumbnail, the sensor data is the second of two SubIFDs...
+
+static void _IMBTestNEF(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("nikon.nef",&info));
+	IMBExpect(info.format == kIMBImageFormatTIFF);
+	IMBExpect(info.width == 6016 && info.height == 4016);
+	IMBExpect(info.depth == 14);
+	IMBExpect(info.colorModel == kIMBImageColorModelRGB);
+	IMBExpect(info.orientation == 1);
+	IMBExpect(strcmp(info.dateTimeOriginal,"2019:05:21 16:45:12") == 0);
+}
+
+
+// DNG with a single SubIFD whose offset is stored inline with field type IFD (13)...
+
+static void _IMBTestDNG(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("adobe.dng",&info));
+	IMBExpect(info.format == kIMBImageFormatTIFF);
+	IMBExpect(info.width == 4000 && info.height == 3000);
+	IMBExpect(info.depth == 16);
+	IMBExpect(info.colorModel == kIMBImageColorModelRGB);
+	IMBExpect(info.orientation == 8);
+	IMBExpect(strcmp(info.dateTimeOriginal,"2019:05:21 16:45:12") == 0);
+}
+
+
+// HEIF whose ipma uses 15 bit property indexes. The primary item's ispe, pixi and irot are properties 300-302,
+// while property 1 is a larger ispe of another item. irot takes precedence over the EXIF orientation...
+
+static void _IMBTestHEIF(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(_IMBReadFixture("large-indexes.heic",&info));
+	IMBExpect(info.format == kIMBImageFormatHEIF);
+	IMBExpect(info.width == 4032 && info.height == 3024);
+	IMBExpect(info.depth == 10);
+	IMBExpect(info.colorModel == kIMBImageColorModelRGB);
+	IMBExpect(info.orientation == 8);
+	IMBExpect(strcmp(info.dateTimeOriginal,"2019:05:21 16:45:12") == 0);
+}
+
+
+// The 160x120 EXIF thumbnail of a JPEG is returned if it is large enough, along with the orientation of the main
+// image. A minimum size above the thumbnail size must reject it...
+
+static void _IMBTestJPEGPreview(void)
+{
+	IMBImagePreviewInfo preview;
+	uint32_t orientation = 0;
+	
+	IMBExpect(_IMBFindFixturePreview("exif-thumbnail.jpg",128,&preview,&orientation));
+	IMBExpect(preview.width == 160 && preview.height == 120);
+	IMBExpect(_IMBIsJPEGAt("exif-thumbnail.jpg",preview.offset));
+	IMBExpect(orientation == 6);
+	
+	IMBExpect(!_IMBFindFixturePreview("exif-thumbnail.jpg",256,&preview,&orientation));
+	IMBExpect(orientation == 6);
+	
+	IMBExpect(!_IMBFindFixturePreview("exif.jpg",0,&preview,&orientation));
+}
+
+
+// CR2 has a full size JPEG in IFD0, a thumbnail in IFD1 and lossless JPEG sensor data in IFD3. The smallest preview
+// that is large enough wins, and the sensor data (which would be a smaller match for 3000 pixels) is never used...
+
+static void _IMBTestRAWPreview(void)
+{
+	IMBImagePreviewInfo preview;
+	uint32_t orientation = 0;
+	
+	IMBExpect(_IMBFindFixturePreview("canon.cr2",100,&preview,&orientation));
+	IMBExpect(preview.width == 160 && preview.height == 120);
+	IMBExpect(_IMBIsJPEGAt("canon.cr2",preview.offset));
+	IMBExpect(orientation == 6);
+	
+	IMBExpect(_IMBFindFixturePreview("canon.cr2",256,&preview,&orientation));
+	IMBExpect(preview.width == 5184 && preview.height == 3456);
+	IMBExpect(_IMBIsJPEGAt("canon.cr2",preview.offset));
+	
+	IMBExpect(_IMBFindFixturePreview("canon.cr2",3000,&preview,&orientation));
+	IMBExpect(preview.width == 5184 && preview.height == 3456);
+	
+	IMBExpect(!_IMBFindFixturePreview("canon.cr2",6000,&preview,&orientation));
+	
+	// NEF keeps its preview in a SubIFD...
+	
+	IMBExpect(_IMBFindFixturePreview("nikon.nef",256,&preview,&orientation));
+	IMBExpect(preview.width == 640 && preview.height == 424);
+	IMBExpect(_IMBIsJPEGAt("nikon.nef",preview.offset));
+	IMBExpect(orientation == 1);
+}
+
+
+// Files that are not images, or do not exist, must be rejected...
+
+static void _IMBTestRejects(void)
+{
+	IMBImageHeaderInfo info;
+	
+	IMBExpect(!_IMBReadFixture("missing.jpg",&info));
+	IMBExpect(!IMBImageHeaderReadFile(__FILE__,&info));
+	IMBExpect(info.format == kIMBImageFormatUnknown);
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+int main(int argc,const char* argv[])
+{
+	if (argc > 1) sFixturesPath = argv[1];
+	
+	_IMBTestJPEG();
+	_IMBTestPNG();
+	_IMBTestTIFF();
+	_IMBTestTIFFLongArrays();
+	_IMBTestCR2();
+	_IMBTestNEF();
+	_IMBTestDNG();
+	_IMBTestHEIF();
+	_IMBTestJPEGPreview();
+	_IMBTestRAWPreview();
+	_IMBTestRejects();
+	
+	if (sFailures) fprintf(stderr,"%d failure(s)\n",sFailures);
+	else printf("All IMBImageHeaderReader tests passed\n");
+	
+	return sFailures ? 1 : 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
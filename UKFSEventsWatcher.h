@@ -30,10 +30,15 @@
     id							delegate;           // Delegate must respond to UKFileWatcherDelegate protocol.
 	CFTimeInterval				latency;			// Time that must pass before events are being sent.
 	FSEventStreamCreateFlags	flags;				// See FSEvents.h
-    NSMutableDictionary*		eventStreams;		// List of FSEventStreamRef pointers in NSValues, with the pathnames as their keys.
+	FSEventStreamRef			eventStream;		// A single stream covering all watched paths. Recreated when the paths change.
 	NSCountedSet*				eventStreamPaths;	// To support a client adding the same path multiple times, we 
 													// count the number of times it's been added, and only remove when 
 													// the number goes to zero...
+	BOOL						needsRebuild;		// A rebuild of the stream is pending on the main thread.
+	FSEventStreamEventId		replayEventId;		// Paths in replayPaths get historical events since this ID (0 = none).
+	NSMutableSet*				replayPaths;		// Paths that were watched last time and haven't received their history yet.
+	NSSet*						replayingPaths;		// Paths whose history is being delivered by the current stream.
+	FSEventStreamEventId		replayBarrierId;	// Historical events up to here are only sent for replayingPaths.
 }
 
 + (id) sharedFileWatcher;
@@ -44,6 +49,17 @@
 - (void) setFSEventStreamCreateFlags:(FSEventStreamCreateFlags)flags;
 - (FSEventStreamCreateFlags) fsEventStreamCreateFlags;
 
+// To catch changes that happened while the app wasn't running, persist resumeEventId and resumePaths (together  
+// with eventDatabaseUUID, which changes when the FSEvents history is reset) when quitting. On the next launch pass 
+// them to setReplayEventId:forPaths: before adding any paths. Each of these paths is then sent the changes since 
+// that event once, when it is added again. Paths that were not watched last time never receive any history...
+
+- (void) setReplayEventId:(FSEventStreamEventId)eventId forPaths:(NSArray*)paths;
+- (FSEventStreamEventId) replayEventId;
+- (FSEventStreamEventId) resumeEventId;
+- (NSArray*) resumePaths;
++ (NSString*) eventDatabaseUUID;
+
 // UKFileWatcher defines the methods: addURL:error: removePath: removeAllPaths: and delegate accessors.
 //
 // Our implementation differs from the basic UKFileWatcher protocol in that calls to 
@@ -54,6 +70,13 @@
 // removeAllPaths ensures that every watched path is no longer watched, regardless
 // of the number of times addPath: has been called on a given path.
 //
+// All watched paths share a single FSEventStream. Adding paths recreates it lazily on the next pass 
+// through the main run loop (so that adding many paths in a row only does this once), while removing 
+// paths recreates it immediately (so that volumes can be unmounted)...
+//
+// If the flags include kFSEventStreamCreateFlagFileEvents (10.7), changed files are reported 
+// individually (as write, rename, or delete notifications), while changed folders are still
+// reported as a write to their enclosing folder...
 
 - (BOOL)addURL:(NSURL *)url error:(NSError **)error;
 - (void) removePath: (NSString*)path;
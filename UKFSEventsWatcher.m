@@ -17,6 +17,7 @@
 
 #import "UKFSEventsWatcher.h"
 #import <CoreServices/CoreServices.h>
+#include <sys/stat.h>
 
 // -----------------------------------------------------------------------------
 //  FSEventCallback
@@ -25,6 +26,12 @@
 
 #if MAC_OS_X_VERSION_MAX_ALLOWED > MAC_OS_X_VERSION_10_4
 
+@interface UKFSEventsWatcher (Private)
+- (void) _handleEvents:(NSArray*)inPaths flags:(const FSEventStreamEventFlags*)inFlags ids:(const FSEventStreamEventId*)inIds count:(size_t)inCount;
+- (void) _rebuildEventStream;
+- (void) _setNeedsRebuild;
+@end
+
 static void FSEventCallback(ConstFSEventStreamRef inStreamRef, 
 							void* inClientCallBackInfo, 
 							size_t inNumEvents, 
@@ -34,25 +41,9 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 {
 	UKFSEventsWatcher* watcher = (UKFSEventsWatcher*)inClientCallBackInfo;
 	
-	if (watcher != nil && [watcher delegate] != nil)
+	if (watcher != nil)
 	{
-		id delegate = [watcher delegate];
-		
-		if ([delegate respondsToSelector:@selector(watcher:receivedNotification:forPath:)])
-		{
-			NSEnumerator* paths = [(NSArray*)inEventPaths objectEnumerator];
-			NSString* path;
-			
-			while (path = [paths nextObject])
-			{
-				[delegate watcher:watcher receivedNotification:UKFileWatcherWriteNotification forPath:path];
-				
-				[[[NSWorkspace sharedWorkspace] notificationCenter] 
-					postNotificationName: UKFileWatcherWriteNotification
-					object:watcher
-					userInfo:[NSDictionary dictionaryWithObjectsAndKeys:path,@"path",nil]];
-			}	
-		}
+		[watcher _handleEvents:(NSArray*)inEventPaths flags:inEventFlags ids:inEventIds count:inNumEvents];
 	}
 }
 
@@ -89,8 +80,13 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 	{
 		latency = 1.0;
 		flags = kFSEventStreamCreateFlagUseCFTypes;
-		eventStreams = [[NSMutableDictionary alloc] init];
+		eventStream = NULL;
 		eventStreamPaths = [[NSCountedSet alloc] init];
+		needsRebuild = NO;
+		replayEventId = 0;
+		replayPaths = [[NSMutableSet alloc] init];
+		replayingPaths = nil;
+		replayBarrierId = 0;
     }
 	
     return self;
@@ -103,8 +99,9 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 - (void) dealloc
 {
 	[self removeAllPaths];
-    [eventStreams release];
 	[eventStreamPaths release];
+	[replayPaths release];
+	[replayingPaths release];
     [super dealloc];
 }
 
@@ -121,7 +118,14 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 
 - (void) setLatency:(CFTimeInterval)inLatency
 {
-	latency = inLatency;
+	@synchronized (self)
+	{
+		if (latency != inLatency)
+		{
+			latency = inLatency;
+			if (eventStream) [self _setNeedsRebuild];
+		}
+	}
 }
 
 // -----------------------------------------------------------------------------
@@ -204,53 +208,301 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
     return result;
 }
 
-- (BOOL) _registerFSEventsObserverForPath:(NSString*)path error:(NSError **)error
+// -----------------------------------------------------------------------------
+//  setReplayEventId:forPaths:
+//		The given paths (usually the resumePaths that were saved when the app 
+//		quit last time) are sent all changes since this event once, when they 
+//		are added. Pass 0 to turn replaying off.
+// -----------------------------------------------------------------------------
+
+- (void) setReplayEventId:(FSEventStreamEventId)eventId forPaths:(NSArray*)paths
 {
-	BOOL succeeded = YES;
-	FSEventStreamContext context;
-	context.version = 0;
-	context.info = (void*) self;
-	context.retain = NULL;
-	context.release = NULL;
-	context.copyDescription = NULL;
-
-	NSArray* pathArray = [NSArray arrayWithObject:path];
-	FSEventStreamRef stream = FSEventStreamCreate(NULL,&FSEventCallback,&context,(CFArrayRef)pathArray,kFSEventStreamEventIdSinceNow,latency,flags);
-
-	if (stream)
+	@synchronized (self)
 	{
-        CFRunLoopRef runLoop = CFRunLoopGetMain();
-		FSEventStreamScheduleWithRunLoop(stream, runLoop, kCFRunLoopCommonModes);
-		succeeded = FSEventStreamStart(stream);
-        
-        if (succeeded)
-        {
-            [eventStreams setObject:[NSValue valueWithPointer:stream] forKey:path];
-        }
-        else
-        {
-            FSEventStreamUnscheduleFromRunLoop(stream, runLoop, kCFRunLoopCommonModes);
-            FSEventStreamRelease(stream);
-            
-            if (error)
-            {
-                NSDictionary *userInfo = [NSDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey];
-                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:userInfo];
-            }
-        }
+		replayEventId = eventId;
+		[replayPaths removeAllObjects];
+		if (replayEventId != 0 && paths != nil) [replayPaths addObjectsFromArray:paths];
 	}
-	else
+}
+
+- (FSEventStreamEventId) replayEventId
+{
+	return replayEventId;
+}
+
+// -----------------------------------------------------------------------------
+//  resumeEventId
+//		The event ID to persist for replaying on the next launch. Pending events
+//		of the stream are delivered first, so that everything up to now has been
+//		seen. As long as some watched paths haven't received their history yet, 
+//		this is still the replayEventId, so that nothing gets lost if we quit 
+//		early.
+// -----------------------------------------------------------------------------
+
+- (FSEventStreamEventId) resumeEventId
+{
+	if (eventStream && [NSThread isMainThread]) FSEventStreamFlushSync(eventStream);
+	
+	@synchronized (self)
 	{
-		if (error)
-        {
-            NSDictionary *userInfo = [NSDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey];
-            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:userInfo];
-        }
-        
-		succeeded = NO;
+		for (NSString* path in replayPaths)
+		{
+			if ([eventStreamPaths countForObject:path] > 0) return replayEventId;
+		}
+		
+		return FSEventsGetCurrentEventId();
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  resumePaths
+//		The paths to persist along with resumeEventId.
+// -----------------------------------------------------------------------------
+
+- (NSArray*) resumePaths
+{
+	@synchronized (self)
+	{
+		return [eventStreamPaths allObjects];
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  eventDatabaseUUID
+//		Event IDs are only meaningful as long as the FSEvents database of the
+//		boot volume is not reset. This UUID changes when that happens.
+// -----------------------------------------------------------------------------
+
++ (NSString*) eventDatabaseUUID
+{
+	NSString* string = nil;
+	struct stat info;
+	
+	if (stat("/",&info) == 0)
+	{
+		CFUUIDRef uuid = FSEventsCopyUUIDForDevice(info.st_dev);
+		
+		if (uuid)
+		{
+			string = [(NSString*)CFUUIDCreateString(NULL,uuid) autorelease];
+			CFRelease(uuid);
+		}
+	}
+	
+	return string;
+}
+
+// -----------------------------------------------------------------------------
+//  _isPathInsidePaths
+//		Returns YES if the event path is one of the given paths or inside one.
+// -----------------------------------------------------------------------------
+
+static BOOL _isPathInsidePaths(NSString* path, NSSet* paths)
+{
+	for (NSString* root in paths)
+	{
+		if ([path hasPrefix:root])
+		{
+			NSUInteger length = [root length];
+			
+			if ([path length] == length || [root hasSuffix:@"/"] || [path characterAtIndex:length] == '/')
+			{
+				return YES;
+			}
+		}
 	}
 	
-	return succeeded;
+	return NO;
+}
+
+// -----------------------------------------------------------------------------
+//  _handleEvents:flags:ids:count:
+//		Called by the stream (on the main thread). Sends a write notification
+//		for each changed folder to our delegate. While history is replayed, 
+//		historical events are only sent for the paths that asked for them.
+// -----------------------------------------------------------------------------
+
+- (void) _handleEvents:(NSArray*)inPaths flags:(const FSEventStreamEventFlags*)inFlags ids:(const FSEventStreamEventId*)inIds count:(size_t)inCount
+{
+	NSMutableArray* paths = [NSMutableArray arrayWithCapacity:inCount];
+	NSMutableArray* notifications = [NSMutableArray arrayWithCapacity:inCount];
+	
+	@synchronized (self)
+	{
+		for (size_t i=0; i<inCount; i++)
+		{
+			NSString* path = [inPaths objectAtIndex:i];
+			
+			if (inFlags[i] & kFSEventStreamEventFlagHistoryDone)
+			{
+				if (replayingPaths) [replayPaths minusSet:replayingPaths];
+				[replayingPaths release];
+				replayingPaths = nil;
+				replayBarrierId = 0;
+				continue;
+			}
+			
+			if (inIds[i] <= replayBarrierId && !_isPathInsidePaths(path,replayingPaths))
+			{
+				continue;
+			}
+			
+			NSString* notification = UKFileWatcherWriteNotification;
+			
+			#if defined(MAC_OS_X_VERSION_10_7) && MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_7
+			
+			// With file level events, changes to files are reported as such, so that clients can update 
+			// just the affected items. Changes to folders (created, removed, renamed) are reported as a 
+			// write to the enclosing folder, just like without file level events...
+			
+			if (flags & kFSEventStreamCreateFlagFileEvents)
+			{
+				FSEventStreamEventFlags eventFlags = inFlags[i];
+				
+				if (eventFlags & kFSEventStreamEventFlagItemIsDir)
+				{
+					path = [path stringByDeletingLastPathComponent];
+				}
+				else if (eventFlags & (kFSEventStreamEventFlagItemIsFile | kFSEventStreamEventFlagItemIsSymlink))
+				{
+					if (eventFlags & kFSEventStreamEventFlagItemRemoved) notification = UKFileWatcherDeleteNotification;
+					else if (eventFlags & kFSEventStreamEventFlagItemRenamed) notification = UKFileWatcherRenameNotification;
+				}
+			}
+			
+			#endif
+			
+			[paths addObject:path];
+			[notifications addObject:notification];
+		}
+	}
+	
+	id del = [self delegate];
+	
+	if (del != nil && [del respondsToSelector:@selector(watcher:receivedNotification:forPath:)])
+	{
+		NSUInteger n = [paths count];
+		
+		for (NSUInteger i=0; i<n; i++)
+		{
+			NSString* path = [paths objectAtIndex:i];
+			NSString* notification = [notifications objectAtIndex:i];
+			
+			[del watcher:self receivedNotification:notification forPath:path];
+			
+			[[[NSWorkspace sharedWorkspace] notificationCenter] 
+				postNotificationName: notification
+				object:self
+				userInfo:[NSDictionary dictionaryWithObjectsAndKeys:path,@"path",nil]];
+		}	
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  _rebuildEventStream
+//		Replaces the current stream with a new one for all watched paths. Must
+//		be called on the main thread, where the stream is scheduled. Pending 
+//		events of the old stream are delivered before it is stopped. The new
+//		stream starts at the event ID that was current before that, so that 
+//		nothing in between gets lost. Paths that are waiting for their history
+//		make it start at replayEventId instead, and the historical events are
+//		then filtered (see _handleEvents:...), so that other paths don't get 
+//		any history.
+// -----------------------------------------------------------------------------
+
+- (void) _rebuildEventStream
+{
+	NSAssert([NSThread isMainThread],@"%s must be called on the main thread",__FUNCTION__);
+	
+	FSEventStreamEventId barrierId = FSEventsGetCurrentEventId();
+	
+	// Flush outside of the lock, as our delegate is called in the process...
+	
+	if (eventStream) FSEventStreamFlushSync(eventStream);
+	
+	@synchronized (self)
+	{
+		needsRebuild = NO;
+		
+		if (eventStream)
+		{
+			FSEventStreamStop(eventStream);
+			FSEventStreamInvalidate(eventStream);
+			FSEventStreamRelease(eventStream);
+			eventStream = NULL;
+		}
+		
+		[replayingPaths release];
+		replayingPaths = nil;
+		replayBarrierId = 0;
+		
+		NSArray* pathArray = [eventStreamPaths allObjects];
+		if ([pathArray count] == 0) return;
+		
+		FSEventStreamEventId sinceWhen = barrierId;
+		NSMutableSet* historyPaths = [NSMutableSet setWithArray:pathArray];
+		[historyPaths intersectSet:replayPaths];
+		
+		if (replayEventId != 0 && replayEventId < barrierId && [historyPaths count] > 0)
+		{
+			sinceWhen = replayEventId;
+			replayingPaths = [historyPaths copy];
+			replayBarrierId = barrierId;
+		}
+		else if (replayEventId >= barrierId)
+		{
+			[replayPaths removeAllObjects];		// Nothing happened since then
+		}
+		
+		FSEventStreamContext context;
+		context.version = 0;
+		context.info = (void*) self;
+		context.retain = NULL;
+		context.release = NULL;
+		context.copyDescription = NULL;
+
+		eventStream = FSEventStreamCreate(NULL,&FSEventCallback,&context,(CFArrayRef)pathArray,sinceWhen,latency,flags);
+		
+		if (eventStream)
+		{
+			FSEventStreamScheduleWithRunLoop(eventStream, CFRunLoopGetMain(), kCFRunLoopCommonModes);
+			
+			if (!FSEventStreamStart(eventStream))
+			{
+				NSLog(@"%s Could not start FSEventStream for %@",__FUNCTION__,pathArray);
+				FSEventStreamInvalidate(eventStream);
+				FSEventStreamRelease(eventStream);
+				eventStream = NULL;
+			}
+		}
+		else
+		{
+			NSLog(@"%s Could not create FSEventStream for %@",__FUNCTION__,pathArray);
+		}
+		
+		if (replayingPaths && eventStream == NULL)
+		{
+			[replayingPaths release];
+			replayingPaths = nil;
+			replayBarrierId = 0;
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  _setNeedsRebuild
+//		Coalesces multiple changes to the watched paths into a single rebuild.
+// -----------------------------------------------------------------------------
+
+- (void) _setNeedsRebuild
+{
+	@synchronized (self)
+	{
+		if (needsRebuild) return;
+		needsRebuild = YES;
+	}
+	
+	[self performSelectorOnMainThread:@selector(_rebuildEventStream) withObject:nil waitUntilDone:NO modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
 }
 
 // -----------------------------------------------------------------------------
@@ -264,25 +516,19 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 	NSString *path = [self pathToParentFolderOfFile:url error:error];
     if (!path) return NO;
 
-	// Do we already have a stream scheduled for this path?
 	// NOTE: Synchronize the whole thing so we don't run the risk of the current count changing while 
 	// we're busy updating it with our new addition.
 	@synchronized (self)
 	{
-		BOOL succeeded = YES;
-		
 		NSUInteger currentRegistrationCount = [eventStreamPaths countForObject:path];
-		if (currentRegistrationCount == 0)
-		{
-			succeeded = [self _registerFSEventsObserverForPath:path error:error];
-		}		
+		[eventStreamPaths addObject:path];
 		
-		if (succeeded)
+		if (currentRegistrationCount == 0)
 		{
-			[eventStreamPaths addObject:path];
+			[self _setNeedsRebuild];
 		}
         
-        return succeeded;
+        return YES;
 	}
 }
 
@@ -291,13 +537,6 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
     [self addURL:[NSURL fileURLWithPath:path] error:NULL];
 }
 
-- (void) _unregisterFSEventStream:(FSEventStreamRef)stream
-{
-	FSEventStreamStop(stream);
-	FSEventStreamInvalidate(stream);
-	FSEventStreamRelease(stream);
-}
-
 // -----------------------------------------------------------------------------
 //  removePath:
 //		Decrease the watch count for the given path, and if the count has gone 
@@ -312,8 +551,8 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 	path = [self pathToParentFolderOfFile:[NSURL fileURLWithPath:path] error:NULL];
     if (!path) return;
 
-    NSValue* valueToRemove = nil;
-		
+	BOOL shouldRebuild = NO;
+	
     @synchronized (self)
     {
 		// We are sometimes asked to removePath on a path that we were never asked to add. That's 
@@ -324,24 +563,27 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 		{
 			[eventStreamPaths removeObject:path];
 			
-			NSUInteger newRegistrationCount = [eventStreamPaths countForObject:path];
-			
-			// Clear everything out if we've gone to zero
-			if (newRegistrationCount == 0)
+			// Stop watching if we've gone to zero
+			if ([eventStreamPaths countForObject:path] == 0)
 			{
-				valueToRemove = [[[eventStreams objectForKey:path] retain] autorelease];
-				[eventStreams removeObjectForKey:path];				
+				[replayPaths removeObject:path];
+				shouldRebuild = YES;
 			}
 		}
     }
     
-	if (valueToRemove)
+	// The stream must let go of the path right away (e.g. when its volume is about to be unmounted). 
+	// As the stream lives on the main thread, a removal on another thread is handed over to it...
+	
+	if (shouldRebuild)
 	{
-		FSEventStreamRef stream = [valueToRemove pointerValue];
-		
-		if (stream)
+		if ([NSThread isMainThread])
 		{
-			[self _unregisterFSEventStream:stream];
+			[self _rebuildEventStream];
+		}
+		else
+		{
+			[self _setNeedsRebuild];
 		}
 	}
 }
@@ -355,24 +597,17 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 {
 	@synchronized (self)
 	{
-		// We don't really need the paths, we just need the open FSEventStreamRefs.
-		// Unregister them all indiscriminately, then remove all objects from 
-		// our tracking collections.
-		
-		NSEnumerator* eventStreamEnum = [[eventStreams allValues] objectEnumerator];
-		NSValue* thisEventStreamPointer = nil;
-		
-		while (thisEventStreamPointer = [eventStreamEnum nextObject])
+		if (eventStream)
 		{
-			FSEventStreamRef stream = [thisEventStreamPointer pointerValue];
-
-			if (stream)
-			{
-				[self _unregisterFSEventStream:stream];				
-			}
+			FSEventStreamStop(eventStream);
+			FSEventStreamInvalidate(eventStream);
+			FSEventStreamRelease(eventStream);
+			eventStream = NULL;
 		}
 		
-		[eventStreams removeAllObjects];
+		[replayingPaths release];
+		replayingPaths = nil;
+		replayBarrierId = 0;
 		[eventStreamPaths removeAllObjects];
 	}
 }
@@ -380,4 +615,3 @@ static void FSEventCallback(ConstFSEventStreamRef inStreamRef,
 @end
 
 #endif
-
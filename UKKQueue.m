@@ -22,8 +22,8 @@
 // -----------------------------------------------------------------------------
 
 #import "UKKQueue.h"
-#import "UKMainThreadProxy.h"
 #import <unistd.h>
+#import <errno.h>
 #import <fcntl.h>
 #include <sys/stat.h>
 
@@ -31,8 +31,10 @@
 //  Macros:
 // -----------------------------------------------------------------------------
 
-#define DEBUG_LOG_THREAD_LIFETIME		1
-#define DEBUG_DETAILED_MESSAGES			1
+#define DEBUG_LOG_THREAD_LIFETIME		0
+#define DEBUG_DETAILED_MESSAGES			0
+
+#define UKKQueueEventBatchSize			64		// Max. number of kevents fetched per syscall.
 
 #if MAC_OS_X_VERSION_MAX_ALLOWED <= MAC_OS_X_VERSION_10_4
 #define NSUInteger		unsigned
@@ -144,7 +146,9 @@
 @interface UKKQueueCentral : NSObject
 {
 	int						queueFD;				// The actual queue ID (Unix file descriptor).
+	int						wakeupFDs[2];			// Self-pipe, used to wake up the watcher thread for shutdown.
 	NSMutableDictionary*	watchedFiles;			// List of UKKQueuePathEntries.
+	NSMutableDictionary*	watchedEntriesByFD;		// Same entries, keyed by their file descriptor (NSNumber).
 	BOOL					keepThreadRunning;
 }
 
@@ -161,6 +165,7 @@
 
 // Actual work is done here:
 -(void)		watcherThread: (id)sender;
+-(void)		postNotifications: (NSArray*)notifications;		// Main thread, array of name/path pairs.
 -(void)		postNotification: (NSString*)nm forFile: (NSString*)fp; // Message-posting bottleneck.
 
 @end
@@ -170,7 +175,6 @@
 // -----------------------------------------------------------------------------
 
 static UKKQueueCentral	*	gUKKQueueSharedQueueSingleton = nil;
-static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which we send notifications so they get put in the main thread.
 
 @implementation UKKQueueCentral
 
@@ -192,20 +196,31 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 	self = [super init];
 	if( self )
 	{
-		if( !gUKKQueueSharedNotificationCenterProxy )
+		queueFD = kqueue();
+		if( queueFD == -1 )
 		{
-			gUKKQueueSharedNotificationCenterProxy = [[[NSWorkspace sharedWorkspace] notificationCenter] copyMainThreadProxy];	// Singleton, 'intentional leak'.
-			[gUKKQueueSharedNotificationCenterProxy setWaitForCompletion: NO];	// Better performance and avoid deadlocks.
+			[self release];
+			return nil;
 		}
 		
-		queueFD = kqueue();
-		if( queueFD == -1 )
+		// The watcher thread blocks in kevent() until something happens. To get it to
+		//	quit, we write a byte into this pipe, whose read end is part of the queue:
+		if( pipe( wakeupFDs ) == -1 )
 		{
+			close( queueFD );
+			queueFD = -1;
 			[self release];
 			return nil;
 		}
+		fcntl( wakeupFDs[0], F_SETFL, O_NONBLOCK );
+		fcntl( wakeupFDs[1], F_SETFL, O_NONBLOCK );
+		
+		struct kevent	ev;
+		EV_SET( &ev, wakeupFDs[0], EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL );
+		kevent( queueFD, &ev, 1, NULL, 0, NULL );
 		
 		watchedFiles = [[NSMutableDictionary alloc] init];
+		watchedEntriesByFD = [[NSMutableDictionary alloc] init];
 	}
 	
 	return self;
@@ -222,13 +237,26 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 
 -(void) dealloc
 {
-	keepThreadRunning = NO;
+	// Wake up the watcher thread so it notices it should quit. It closes the queue:
+	if( keepThreadRunning )
+	{
+		keepThreadRunning = NO;
+		write( wakeupFDs[1], "x", 1 );
+	}
+	else if( queueFD != -1 )	// Thread never ran, so nobody closed these yet.
+	{
+		close( queueFD );
+		close( wakeupFDs[0] );
+		close( wakeupFDs[1] );
+	}
 	
 	// Close all our file descriptors so the files can be deleted:
 	[self removeAllPaths];
 	
 	[watchedFiles release];
 	watchedFiles = nil;
+	[watchedEntriesByFD release];
+	watchedEntriesByFD = nil;
 	
 	[super dealloc];
 }
@@ -248,6 +276,7 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 	@synchronized( self )
     {
 		[watchedFiles removeAllObjects];
+		[watchedEntriesByFD removeAllObjects];
 	}
 }
 
@@ -298,12 +327,15 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 		
 		if( pe )
 		{
+			// Events are looked up via their file descriptor (see watcherThread:), so
+			//	that we never touch an entry that was removed in the meantime:
 			EV_SET( &ev, [pe watchedFD], EVFILT_VNODE, 
 					EV_ADD | EV_ENABLE | EV_CLEAR,
-					fflags, 0, pe );
+					fflags, 0, NULL );
 			
 			[pe setSubscriptionFlags: fflags];
             [watchedFiles setObject: pe forKey: path];
+			[watchedEntriesByFD setObject: pe forKey: [NSNumber numberWithInt: [pe watchedFD]]];
             kevent( queueFD, &ev, 1, NULL, 0, &nullts );
 		
 			// Start new thread that fetches and processes our events:
@@ -334,7 +366,10 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 	{
 		UKKQueuePathEntry*	pe = [watchedFiles objectForKey: path];	// Already watching this path?
 		if( pe && [pe releasePath] )	// Give up one subscription. Is this the last subscription?
-			[watchedFiles removeObjectForKey: path];	// Unsubscribe from this file.
+		{
+			[watchedEntriesByFD removeObjectForKey: [NSNumber numberWithInt: [pe watchedFD]]];
+			[watchedFiles removeObjectForKey: path];	// Unsubscribe from this file. Closing its FD also removes it from the queue.
+		}
 	}
 }
 
@@ -372,14 +407,17 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 
 // -----------------------------------------------------------------------------
 //	watcherThread:
-//		This method is called by our NSThread to loop and poll for any file
-//		changes that our kqueue wants to tell us about. This sends separate
-//		notifications for the different kinds of changes that can happen.
-//		All messages are sent via the postNotification:forFile: main bottleneck.
+//		This method is called by our NSThread to wait for any file changes that
+//		our kqueue wants to tell us about. It blocks in kevent() until there
+//		are events (no polling), and fetches up to UKKQueueEventBatchSize events
+//		per call. The resulting notifications are handed to the main thread in
+//		one go, and sent there via the postNotification:forFile: main bottleneck.
 //
-//		This also calls sharedWorkspace's noteFileSystemChanged.
+//		Paths can be added and removed while we're blocked: kevent() registrations
+//		take effect immediately, and closing a file descriptor removes its events.
 //
-//      To terminate this method (and its thread), set keepThreadRunning to NO.
+//      To terminate this method (and its thread), set keepThreadRunning to NO
+//		and write a byte to wakeupFDs[1].
 //
 //	REVISIONS:
 //		2008-11-07	UK	Adapted to new threading model.
@@ -393,10 +431,11 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 
 -(void)		watcherThread: (id)sender
 {
-	int					n;
-    struct kevent		ev;
-    struct timespec     timeout = { 1, 0 }; // 1 second timeout. Should be longer, but we need this thread to exit when a kqueue is dealloced, so 1 second timeout is quite a while to wait.
+	int					n, x;
+    struct kevent		events[UKKQueueEventBatchSize];
 	int					theFD = queueFD;	// So we don't have to risk accessing iVars when the thread is terminated.
+	int					wakeupReadFD = wakeupFDs[0];
+	int					wakeupWriteFD = wakeupFDs[1];
     
 	#if DEBUG_LOG_THREAD_LIFETIME
 	NSLog(@"watcherThread started.");
@@ -407,36 +446,60 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 		NSAutoreleasePool*  pool = [[NSAutoreleasePool alloc] init];
 		
 		NS_DURING
-			n = kevent( queueFD, NULL, 0, &ev, 1, &timeout );
+			n = kevent( theFD, NULL, 0, events, UKKQueueEventBatchSize, NULL );	// Blocks until something happens.
+			
 			if( n > 0 )
 			{
-				NSLog( @"KEVENT returned %d", n );
-				if( ev.filter == EVFILT_VNODE )
+				NSMutableArray*	notifications = [NSMutableArray arrayWithCapacity: n];
+				
+				for( x = 0; x < n; x++ )
 				{
-					NSLog( @"KEVENT filter is EVFILT_VNODE" );
-					if( ev.fflags )
+					struct kevent*	ev = &events[x];
+					
+					if( ev->filter == EVFILT_READ && (int)ev->ident == wakeupReadFD )
 					{
-						NSLog( @"KEVENT flags are set" );
-						UKKQueuePathEntry*	pe = [[(UKKQueuePathEntry*)ev.udata retain] autorelease];    // In case one of the notified folks removes the path.
-						NSString*	fpath = [pe path];
-						[[NSWorkspace sharedWorkspace] noteFileSystemChanged: fpath];
-						
-						if( (ev.fflags & NOTE_RENAME) == NOTE_RENAME )
-							[self postNotification: UKFileWatcherRenameNotification forFile: fpath];
-						if( (ev.fflags & NOTE_WRITE) == NOTE_WRITE )
-							[self postNotification: UKFileWatcherWriteNotification forFile: fpath];
-						if( (ev.fflags & NOTE_DELETE) == NOTE_DELETE )
-							[self postNotification: UKFileWatcherDeleteNotification forFile: fpath];
-						if( (ev.fflags & NOTE_ATTRIB) == NOTE_ATTRIB )
-							[self postNotification: UKFileWatcherAttributeChangeNotification forFile: fpath];
-						if( (ev.fflags & NOTE_EXTEND) == NOTE_EXTEND )
-							[self postNotification: UKFileWatcherSizeIncreaseNotification forFile: fpath];
-						if( (ev.fflags & NOTE_LINK) == NOTE_LINK )
-							[self postNotification: UKFileWatcherLinkCountChangeNotification forFile: fpath];
-						if( (ev.fflags & NOTE_REVOKE) == NOTE_REVOKE )
-							[self postNotification: UKFileWatcherAccessRevocationNotification forFile: fpath];
+						char	buffer[16];
+						while( read( wakeupReadFD, buffer, sizeof(buffer) ) > 0 )
+							;
+						continue;
 					}
+					
+					if( ev->filter != EVFILT_VNODE || ev->fflags == 0 )
+						continue;
+					
+					UKKQueuePathEntry*	pe = nil;
+					@synchronized( self )
+					{
+						pe = [[[watchedEntriesByFD objectForKey: [NSNumber numberWithInt: (int)ev->ident]] retain] autorelease];
+					}
+					if( pe == nil )		// Path was removed in the meantime.
+						continue;
+					
+					NSString*	fpath = [pe path];
+					
+					if( (ev->fflags & NOTE_RENAME) == NOTE_RENAME )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherRenameNotification, fpath, nil]];
+					if( (ev->fflags & NOTE_WRITE) == NOTE_WRITE )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherWriteNotification, fpath, nil]];
+					if( (ev->fflags & NOTE_DELETE) == NOTE_DELETE )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherDeleteNotification, fpath, nil]];
+					if( (ev->fflags & NOTE_ATTRIB) == NOTE_ATTRIB )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherAttributeChangeNotification, fpath, nil]];
+					if( (ev->fflags & NOTE_EXTEND) == NOTE_EXTEND )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherSizeIncreaseNotification, fpath, nil]];
+					if( (ev->fflags & NOTE_LINK) == NOTE_LINK )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherLinkCountChangeNotification, fpath, nil]];
+					if( (ev->fflags & NOTE_REVOKE) == NOTE_REVOKE )
+						[notifications addObject: [NSArray arrayWithObjects: UKFileWatcherAccessRevocationNotification, fpath, nil]];
 				}
+				
+				if( [notifications count] > 0 )
+					[self performSelectorOnMainThread: @selector(postNotifications:) withObject: notifications waitUntilDone: NO];
+			}
+			else if( n == -1 && errno != EINTR )
+			{
+				NSLog(@"watcherThread: kevent failed (%d)", errno);
+				keepThreadRunning = NO;
 			}
 		NS_HANDLER
 			NSLog(@"Error in UKKQueue watcherThread: %@",localException);
@@ -445,20 +508,45 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 		[pool drain];
     }
     
-	// Close our kqueue's file descriptor:
+	// Close our kqueue's file descriptor and the wakeup pipe:
 	if( close( theFD ) == -1 )
 		NSLog(@"watcherThread: Couldn't close main kqueue (%d)", errno);
+	close( wakeupReadFD );
+	close( wakeupWriteFD );
+	queueFD = -1;
    
 	#if DEBUG_LOG_THREAD_LIFETIME
 	NSLog(@"watcherThread finished.");
 	#endif
 }
 
+// -----------------------------------------------------------------------------
+//	postNotifications:
+//		Called on the main thread with a batch of notifications collected by
+//		watcherThread:. Each entry is an array of notification name and path.
+// -----------------------------------------------------------------------------
+
+-(void) postNotifications: (NSArray*)notifications
+{
+	NSString*	lastPath = nil;
+	
+	for( NSArray* notification in notifications )
+	{
+		NSString*	fpath = [notification objectAtIndex: 1];
+		
+		if( ![fpath isEqualToString: lastPath] )
+			[[NSWorkspace sharedWorkspace] noteFileSystemChanged: fpath];
+		lastPath = fpath;
+		
+		[self postNotification: [notification objectAtIndex: 0] forFile: fpath];
+	}
+}
+
 // -----------------------------------------------------------------------------
 //	postNotification:forFile:
 //		This is the main bottleneck for posting notifications. If you don't want
 //		the notifications to go through NSWorkspace, override this method and
-//		send them elsewhere.
+//		send them elsewhere. This is always called on the main thread.
 //
 //	REVISIONS:
 //		2008-11-07	UK	Got rid of old notifications.
@@ -477,8 +565,8 @@ static id					gUKKQueueSharedNotificationCenterProxy = nil;	// Object to which w
 	NSLog( @"%@: %@", nm, fp );
 	#endif
 	
-	[gUKKQueueSharedNotificationCenterProxy postNotificationName: nm object: self
-												userInfo: [NSDictionary dictionaryWithObjectsAndKeys: fp, @"path", nil]];	// The proxy sends the notification on the main thread.
+	[[[NSWorkspace sharedWorkspace] notificationCenter] postNotificationName: nm object: self
+												userInfo: [NSDictionary dictionaryWithObjectsAndKeys: fp, @"path", nil]];
 }
 
 @end